@@ -8,6 +8,8 @@
 
 #define FIO_ARCH	(arch_ppc)
 
+#define FIO_CACHELINE_SIZE	128
+
 #define nop	do { } while (0)
 
 #ifdef __powerpc64__
@@ -76,4 +76,14 @@ static inline int arch_init(char *envp[])
 }
 #endif
 
+/*
+ * For laying out data that different threads write. It doesn't have to
+ * match the cache line size found at runtime, only keep the data apart.
+ */
+#ifndef FIO_CACHELINE_SIZE
+#define FIO_CACHELINE_SIZE	64
+#endif
+
+#define fio_cacheline_aligned	__attribute__((aligned(FIO_CACHELINE_SIZE)))
+
 #endif
@@ -0,0 +1,471 @@
+/*
+ * Arrival processes for rate limited jobs. Given the rate of a data
+ * direction, these decide when its next I/O is due. They extend the
+ * linear and Poisson processes of usec_for_io() with bursty load shapes:
+ *
+ * onoff	Evenly spaced I/O during the ON part of a cycle, none during
+ *		the OFF part.
+ * mmpp		Markov modulated Poisson process with a normal and a burst
+ *		state, and exponentially distributed time in each.
+ * pareto	Pareto distributed inter-arrival times, a heavy tailed
+ *		renewal process.
+ * curve	Poisson process whose rate follows a piecewise linear curve
+ *		over time, which repeats.
+ *
+ * All of them keep the mean rate at the rate that was set, except for
+ * curve, where the rate is scaled by the curve. Each arrival takes a
+ * random number and a few floating point operations at most.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <ctype.h>
+#include <math.h>
+
+#include "fio.h"
+#include "arrival.h"
+
+/*
+ * Exponentially distributed with the given mean
+ */
+static double arrival_exp(struct thread_data *td, enum fio_ddir ddir,
+			  double mean)
+{
+	return -log(__rand_0_1(&td->poisson_state[ddir])) * mean;
+}
+
+static double arrival_onoff(struct thread_data *td, double t, double iops)
+{
+	double on = td->o.rate_time[0], off = td->o.rate_time[1];
+	double pos = fmod(t, on + off);
+
+	/*
+	 * Skip the OFF part, and pace the ON part so the mean rate is kept
+	 */
+	if (pos >= on)
+		t += on + off - pos;
+
+	return t + 1000000.0 * on / ((on + off) * iops);
+}
+
+static double arrival_mmpp(struct thread_data *td, enum fio_ddir ddir,
+			   double t, double iops)
+{
+	struct arrival_state *as = &td->arrival[ddir];
+	double factor = td->o.rate_shape.u.f;
+	double normal = td->o.rate_time[0], burst = td->o.rate_time[1];
+	double low, gap;
+
+	/*
+	 * The rate in the normal state that gives the mean rate overall
+	 */
+	low = iops * (normal + burst) / (normal + factor * burst);
+
+	if (!as->state_end)
+		as->state_end = t + arrival_exp(td, ddir, normal);
+
+	/*
+	 * The process is memoryless, so at a state change we can just draw
+	 * a new gap at the rate of the new state
+	 */
+	do {
+		double rate = as->burst ? low * factor : low;
+
+		gap = arrival_exp(td, ddir, 1000000.0 / rate);
+		if (t + gap < as->state_end)
+			break;
+
+		t = as->state_end;
+		as->burst = !as->burst;
+		as->state_end += arrival_exp(td, ddir,
+						as->burst ? burst : normal);
+	} while (1);
+
+	return t + gap;
+}
+
+static double arrival_pareto(struct thread_data *td, enum fio_ddir ddir,
+			     double t, double iops)
+{
+	double alpha = td->o.rate_shape.u.f;
+	double xm = (1000000.0 / iops) * (alpha - 1.0) / alpha;
+
+	return t + xm / pow(__rand_0_1(&td->poisson_state[ddir]), 1.0 / alpha);
+}
+
+static double curve_scale(struct arrival_point *a, struct arrival_point *b,
+			  double pos)
+{
+	if (b->usec == a->usec)
+		return b->scale;
+
+	return a->scale + (b->scale - a->scale) * (pos - a->usec) /
+				(double) (b->usec - a->usec);
+}
+
+static double arrival_curve(struct thread_data *td, enum fio_ddir ddir,
+			    double t, double iops)
+{
+	struct arrival_state *as = &td->arrival[ddir];
+	struct arrival_point *pts = td->rate_curve;
+	unsigned int nr = td->rate_curve_nr;
+	double period = pts[nr - 1].usec;
+	double start, pos, work;
+
+	if (nr == 1)
+		return t + arrival_exp(td, ddir, 1000000.0 / (iops * pts[0].scale));
+
+	start = t - fmod(t, period);
+	pos = t - start;
+	if (pos < pts[as->seg].usec || pos >= pts[as->seg + 1].usec)
+		as->seg = 0;
+	while (pos >= pts[as->seg + 1].usec)
+		as->seg++;
+
+	/*
+	 * Draw the amount of work to the next arrival, and use it up
+	 * segment by segment at the mean rate of each
+	 */
+	work = arrival_exp(td, ddir, 1.0);
+	do {
+		struct arrival_point *a = &pts[as->seg], *b = &pts[as->seg + 1];
+		double s1 = curve_scale(a, b, pos);
+		double rate = iops * s1 / 1000000.0;
+		double left = b->usec - pos;
+		double seg_work;
+
+		if (rate > 0.0 && work / rate <= left) {
+			/*
+			 * Correct for the slope within the step
+			 */
+			double s2 = curve_scale(a, b, pos + work / rate);
+
+			if (s1 + s2 > 0.0)
+				return start + pos + 2.0 * work /
+						(iops * (s1 + s2) / 1000000.0);
+			return start + pos + work / rate;
+		}
+
+		seg_work = iops * (s1 + b->scale) / 2000000.0 * left;
+		work -= min(work, seg_work);
+		pos = b->usec;
+		if (++as->seg == nr - 1) {
+			as->seg = 0;
+			start += period;
+			pos = 0.0;
+		}
+	} while (1);
+}
+
+uint64_t arrival_next(struct thread_data *td, enum fio_ddir ddir,
+		      uint64_t bps)
+{
+	struct arrival_state *as = &td->arrival[ddir];
+	double iops = (double) bps / td->o.bs[ddir];
+	double t;
+
+	/*
+	 * last_usec is moved by thinktime and reset between loops, follow it
+	 */
+	if ((int64_t) as->usec != td->last_usec[ddir]) {
+		if (td->last_usec[ddir] < as->usec)
+			memset(as, 0, sizeof(*as));
+		as->usec = td->last_usec[ddir];
+	}
+
+	t = as->usec;
+	switch (td->o.rate_process) {
+	case RATE_PROCESS_ONOFF:
+		t = arrival_onoff(td, t, iops);
+		break;
+	case RATE_PROCESS_MMPP:
+		t = arrival_mmpp(td, ddir, t, iops);
+		break;
+	case RATE_PROCESS_PARETO:
+		t = arrival_pareto(td, ddir, t, iops);
+		break;
+	case RATE_PROCESS_CURVE:
+		t = arrival_curve(td, ddir, t, iops);
+		break;
+	default:
+		assert(0);
+		break;
+	}
+
+	as->usec = t;
+	td->last_usec[ddir] = t;
+	return td->last_usec[ddir];
+}
+
+static int add_point(struct arrival_point **pts, unsigned int *nr,
+		     const char *time, const char *scale)
+{
+	struct arrival_point *p;
+	long long usec;
+	double val;
+
+	if (check_str_time(time, &usec, 1) || usec < 0) {
+		log_err("fio: bad time in rate curve: %s\n", time);
+		return 1;
+	}
+	if (!str_to_float(scale, &val, 0) || val < 0.0) {
+		log_err("fio: bad scale in rate curve: %s\n", scale);
+		return 1;
+	}
+	if (*nr && usec < (*pts)[*nr - 1].usec) {
+		log_err("fio: rate curve times must be increasing\n");
+		return 1;
+	}
+
+	p = realloc(*pts, (*nr + 1) * sizeof(*p));
+	if (!p)
+		return 1;
+
+	p[*nr].usec = usec;
+	p[*nr].scale = val;
+	(*nr)++;
+	*pts = p;
+	return 0;
+}
+
+/*
+ * The curve is 'time/scale:time/scale:...' inline, or a file with a
+ * 'time,scale' line per point. Inline curves start with a digit.
+ */
+static bool curve_is_inline(const char *str)
+{
+	return isdigit((int) str[0]) || str[0] == '(';
+}
+
+static int parse_curve(const char *str, struct arrival_point **pts,
+		       unsigned int *nr)
+{
+	char *dup, *p, *tok, *scale;
+	double max_scale = 0.0;
+	int ret = 0;
+	unsigned int i;
+
+	*pts = NULL;
+	*nr = 0;
+
+	if (curve_is_inline(str)) {
+		dup = p = strdup(str);
+		while ((tok = strsep(&p, ":")) != NULL) {
+			scale = strchr(tok, '/');
+			if (!scale) {
+				log_err("fio: bad rate curve point: %s\n", tok);
+				ret = 1;
+				break;
+			}
+			*scale++ = '\0';
+			ret = add_point(pts, nr, tok, scale);
+			if (ret)
+				break;
+		}
+		free(dup);
+	} else {
+		char line[256];
+		FILE *f;
+
+		f = fopen(str, "r");
+		if (!f) {
+			log_err("fio: failed to open rate curve %s: %s\n", str,
+					strerror(errno));
+			return 1;
+		}
+		while (fgets(line, sizeof(line), f)) {
+			p = line;
+			strip_blank_front(&p);
+			strip_blank_end(p);
+			if (!*p || *p == '#')
+				continue;
+			scale = strchr(p, ',');
+			if (!scale) {
+				log_err("fio: bad rate curve line: %s\n", p);
+				ret = 1;
+				break;
+			}
+			*scale++ = '\0';
+			strip_blank_front(&scale);
+			strip_blank_end(p);
+			ret = add_point(pts, nr, p, scale);
+			if (ret)
+				break;
+		}
+		fclose(f);
+	}
+
+	for (i = 0; i < *nr; i++)
+		max_scale = max(max_scale, (*pts)[i].scale);
+
+	if (!ret && (!*nr || max_scale == 0.0)) {
+		log_err("fio: rate curve needs a point with a scale above 0\n");
+		ret = 1;
+	}
+	if (!ret && *nr > 1 && !(*pts)[*nr - 1].usec) {
+		log_err("fio: rate curve must span some time\n");
+		ret = 1;
+	}
+	if (!ret && *nr == 1 && (*pts)[0].scale == 0.0)
+		ret = 1;
+
+	/*
+	 * The curve starts at time 0 with the scale of its first point
+	 */
+	if (!ret && (*pts)[0].usec) {
+		struct arrival_point *n;
+
+		n = realloc(*pts, (*nr + 1) * sizeof(*n));
+		if (n) {
+			memmove(&n[1], &n[0], *nr * sizeof(*n));
+			n[0].usec = 0;
+			(*nr)++;
+			*pts = n;
+		} else
+			ret = 1;
+	}
+
+	if (ret) {
+		free(*pts);
+		*pts = NULL;
+		*nr = 0;
+	}
+	return ret;
+}
+
+/*
+ * Parse the parameters of rate_process=<process>:<params>
+ */
+int arrival_parse(struct thread_options *o, const char *str)
+{
+	char *params, *p, *tok[3];
+	long long times[2] = { -1, -1 };
+	double shape;
+	int i, nr = 0, ret = 1;
+
+	switch (o->rate_process) {
+	case RATE_PROCESS_MMPP:
+		shape = 10.0;
+		times[0] = 1000000;
+		times[1] = 100000;
+		break;
+	case RATE_PROCESS_PARETO:
+		shape = 1.5;
+		break;
+	case RATE_PROCESS_ONOFF:
+	case RATE_PROCESS_CURVE:
+		shape = 0.0;
+		break;
+	default:
+		return 0;
+	}
+
+	params = strchr(str, ':');
+	if (!params) {
+		if (o->rate_process == RATE_PROCESS_ONOFF ||
+		    o->rate_process == RATE_PROCESS_CURVE) {
+			log_err("fio: rate_process=%s needs parameters\n", str);
+			return 1;
+		}
+		goto done;
+	}
+
+	params = p = strdup(params + 1);
+
+	if (o->rate_process == RATE_PROCESS_CURVE) {
+		struct arrival_point *pts;
+		unsigned int pts_nr;
+
+		/*
+		 * A file may only exist where the job runs, check it there
+		 */
+		if (curve_is_inline(params)) {
+			if (parse_curve(params, &pts, &pts_nr))
+				goto out;
+			free(pts);
+		}
+		if (!parse_dryrun()) {
+			free(o->rate_curve);
+			o->rate_curve = strdup(params);
+		}
+		ret = 0;
+		goto out;
+	}
+
+	while (nr < 3 && (tok[nr] = strsep(&p, ":")) != NULL)
+		nr++;
+
+	i = 0;
+	if (o->rate_process == RATE_PROCESS_MMPP ||
+	    o->rate_process == RATE_PROCESS_PARETO) {
+		if (nr > 0 && !str_to_float(tok[i++], &shape, 0)) {
+			log_err("fio: bad rate_process parameter: %s\n", str);
+			goto out;
+		}
+	}
+	for (; i < nr; i++) {
+		int t = o->rate_process == RATE_PROCESS_MMPP ? i - 1 : i;
+
+		if (t > 1 || o->rate_process == RATE_PROCESS_PARETO ||
+		    check_str_time(tok[i], &times[t], 0) ||
+		    times[t] <= 0) {
+			log_err("fio: bad rate_process parameter: %s\n", str);
+			goto out;
+		}
+	}
+
+	ret = 0;
+out:
+	free(params);
+	if (ret)
+		return ret;
+done:
+	if (o->rate_process == RATE_PROCESS_CURVE)
+		return 0;
+	if (o->rate_process == RATE_PROCESS_ONOFF &&
+	    (times[0] <= 0 || times[1] < 0)) {
+		log_err("fio: rate_process=onoff needs ON and OFF times\n");
+		return 1;
+	}
+	if (o->rate_process == RATE_PROCESS_MMPP && shape < 1.0) {
+		log_err("fio: mmpp burst factor must be at least 1.0\n");
+		return 1;
+	}
+	if (o->rate_process == RATE_PROCESS_PARETO && shape <= 1.0) {
+		log_err("fio: pareto alpha must be above 1.0\n");
+		return 1;
+	}
+
+	if (parse_dryrun())
+		return 0;
+
+	o->rate_shape.u.f = shape;
+	o->rate_time[0] = max(times[0], 0LL);
+	o->rate_time[1] = max(times[1], 0LL);
+	return 0;
+}
+
+int arrival_init(struct thread_data *td)
+{
+	memset(td->arrival, 0, sizeof(td->arrival));
+
+	if (td->o.rate_process != RATE_PROCESS_CURVE)
+		return 0;
+
+	if (!td->o.rate_curve ||
+	    parse_curve(td->o.rate_curve, &td->rate_curve,
+			&td->rate_curve_nr)) {
+		td_verror(td, EINVAL, "rate curve");
+		return 1;
+	}
+
+	return 0;
+}
+
+void arrival_exit(struct thread_data *td)
+{
+	free(td->rate_curve);
+	td->rate_curve = NULL;
+	td->rate_curve_nr = 0;
+}
@@ -0,0 +1,37 @@
+#ifndef FIO_ARRIVAL_H
+#define FIO_ARRIVAL_H
+
+#include <inttypes.h>
+
+#include "io_ddir.h"
+
+struct thread_data;
+struct thread_options;
+
+/*
+ * A point of a rate_process=curve, scale is applied to the rate at usec
+ */
+struct arrival_point {
+	uint64_t usec;
+	double scale;
+};
+
+/*
+ * Per data direction state of the arrival process. usec is the time of
+ * the last arrival, kept as a double so high rates don't get truncated
+ * away.
+ */
+struct arrival_state {
+	double usec;
+	double state_end;
+	unsigned int burst;
+	unsigned int seg;
+};
+
+int arrival_parse(struct thread_options *o, const char *str);
+int arrival_init(struct thread_data *td);
+void arrival_exit(struct thread_data *td);
+uint64_t arrival_next(struct thread_data *td, enum fio_ddir ddir,
+		      uint64_t bps);
+
+#endif
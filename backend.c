@@ -49,8 +49,18 @@
 #include "helper_thread.h"
 #include "pshared.h"
 #include "zone-dist.h"
+#include "runner.h"
 
 static struct fio_sem *startup_sem;
+static struct fio_sem *job_exit_sem;
+
+/*
+ * Initialized jobs wait here until the backend starts them all at once
+ */
+static struct start_barrier {
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+} *start_barrier;
 static struct flist_head *cgroup_list;
 static struct cgroup_mnt *cgroup_mnt;
 static int exit_value;
@@ -342,6 +352,8 @@ static inline bool runtime_exceeded(struct thread_data *td, struct timespec *t)
 {
 	if (in_ramp_time(td))
 		return false;
+	if (td->ss.measuring)
+		return utime_since(&td->ss.phase_start, t) >= td->o.ss_measure;
 	if (!td->o.timeout)
 		return false;
 	if (utime_since(&td->epoch, t) >= td->o.timeout)
@@ -833,7 +845,9 @@ static long long usec_for_io(struct thread_data *td, enum fio_ddir ddir)
 
 	assert(!(td->flags & TD_F_CHILD));
 
-	if (td->o.rate_process == RATE_PROCESS_POISSON) {
+	if (td->o.rate_process > RATE_PROCESS_POISSON && bps)
+		return arrival_next(td, ddir, bps);
+	else if (td->o.rate_process == RATE_PROCESS_POISSON && bps) {
 		uint64_t val, iops;
 
 		iops = bps / td->o.bs[ddir];
@@ -899,6 +913,60 @@ static void handle_thinktime(struct thread_data *td, enum fio_ddir ddir)
 	}
 }
 
+/*
+ * io_us set up by get_io_u_batch(), and the next one to hand out
+ */
+struct io_u_batch {
+	struct io_u **io_us;
+	int nr;
+	int next;
+};
+
+/*
+ * Batches are only set up when nothing needs to look at or act on each
+ * io_u between setting it up and issuing it, and setting up an io_u
+ * doesn't hold anything until it is queued. zonemode=zbd holds the zone
+ * lock and only advances the write pointer at queue time, and file locks
+ * are taken at prep time.
+ */
+static bool io_u_batch_ok(struct thread_data *td)
+{
+	struct thread_options *o = &td->o;
+
+	return o->verify == VERIFY_NONE &&
+		!(td->flags & (TD_F_READ_IOLOG | TD_F_TRIM_BACKLOG)) &&
+		o->io_submit_mode == IO_MODE_INLINE &&
+		!should_check_rate(td) && !o->latency_target &&
+		!td->flow && !o->thinktime && !o->serialize_overlap &&
+		o->zone_mode != ZONE_MODE_ZBD &&
+		o->file_lock_mode == FILE_LOCK_NONE;
+}
+
+static struct io_u *get_batched_io_u(struct thread_data *td,
+				     struct io_u_batch *b)
+{
+	int ret;
+
+	if (!b->io_us)
+		return get_io_u(td);
+
+	if (b->next == b->nr) {
+		ret = get_io_u_batch(td, b->io_us, td->o.iodepth_batch_prep);
+		b->next = 0;
+		b->nr = max(ret, 0);
+		if (ret <= 0)
+			return ERR_PTR(ret);
+	}
+
+	return b->io_us[b->next++];
+}
+
+static void put_batched_io_us(struct thread_data *td, struct io_u_batch *b)
+{
+	while (b->next < b->nr)
+		put_io_u(td, b->io_us[b->next++]);
+}
+
 /*
  * Main IO worker function. It retrieves io_u's to process and queues
  * and reaps them, checking for rate and errors along the way.
@@ -907,6 +975,7 @@ static void handle_thinktime(struct thread_data *td, enum fio_ddir ddir)
  */
 static void do_io(struct thread_data *td, uint64_t *bytes_done)
 {
+	struct io_u_batch batch = { NULL, };
 	unsigned int i;
 	int ret = 0;
 	uint64_t total_bytes, bytes_issued = 0;
@@ -942,6 +1011,14 @@ static void do_io(struct thread_data *td, uint64_t *bytes_done)
 	if (td_trimwrite(td))
 		total_bytes += td->total_io_size;
 
+	if (td->o.iodepth_batch_prep > 1) {
+		if (io_u_batch_ok(td))
+			batch.io_us = calloc(td->o.iodepth_batch_prep,
+						sizeof(struct io_u *));
+		else
+			dprint(FD_IO, "iodepth_batch_prep not used for job\n");
+	}
+
 	while ((td->o.read_iolog_file && !flist_empty(&td->io_log_list)) ||
 		(!flist_empty(&td->trim_list)) || !io_issue_bytes_exceeded(td) ||
 		td->o.time_based) {
@@ -965,6 +1042,10 @@ static void do_io(struct thread_data *td, uint64_t *bytes_done)
 			}
 		}
 
+		if ((td->ss.state & FIO_SS_MEASURE) && !td->ss.measuring &&
+		    (td->ss.state & FIO_SS_ATTAINED))
+			steadystate_measure_start(td);
+
 		if (flow_threshold_exceeded(td))
 			continue;
 
@@ -980,7 +1061,7 @@ static void do_io(struct thread_data *td, uint64_t *bytes_done)
 		     (td->o.time_based && td->o.verify != VERIFY_NONE)))
 			break;
 
-		io_u = get_io_u(td);
+		io_u = get_batched_io_u(td, &batch);
 		if (IS_ERR_OR_NULL(io_u)) {
 			int err = PTR_ERR(io_u);
 
@@ -1068,13 +1149,20 @@ static void do_io(struct thread_data *td, uint64_t *bytes_done)
 			if (io_queue_event(td, io_u, &ret, ddir, &bytes_issued, 0, &comp_time))
 				break;
 
+			/*
+			 * Hand the rest of a batch to the engine in one go
+			 */
+			if (batch.io_us && batch.next == batch.nr)
+				td_io_commit(td);
+
 			/*
 			 * See if we need to complete some commands. Note that
 			 * we can get BUSY even without IO queued, if the
-			 * system is resource starved.
+			 * system is resource starved. The queue is full while
+			 * we hold a batch, so don't wait until it's issued.
 			 */
 reap:
-			full = queue_full(td) ||
+			full = (queue_full(td) && batch.next == batch.nr) ||
 				(ret == FIO_Q_BUSY && td->cur_depth);
 			if (full || io_in_polling(td))
 				ret = wait_for_completions(td, &comp_time);
@@ -1100,6 +1188,9 @@ reap:
 			handle_thinktime(td, ddir);
 	}
 
+	put_batched_io_us(td, &batch);
+	free(batch.io_us);
+
 	check_update_rusage(td);
 
 	if (td->trim_entries)
@@ -1529,6 +1620,27 @@ struct fork_data {
 	struct sk_out *sk_out;
 };
 
+/*
+ * Wait for the backend to move us from TD_INITIALIZED to running
+ */
+static void wait_for_start(struct thread_data *td)
+{
+	dprint(FD_MUTEX, "wait on start barrier\n");
+
+	if (in_runner()) {
+		while (td->runstate == TD_INITIALIZED)
+			runner_sleep(1000);
+	} else {
+		pthread_mutex_lock(&start_barrier->lock);
+		while (td->runstate == TD_INITIALIZED)
+			pthread_cond_wait(&start_barrier->cond,
+						&start_barrier->lock);
+		pthread_mutex_unlock(&start_barrier->lock);
+	}
+
+	dprint(FD_MUTEX, "done waiting on start barrier\n");
+}
+
 /*
  * Entry point for the thread based jobs. The process based jobs end up
  * here as well, after a little setup.
@@ -1541,6 +1653,7 @@ static void *thread_main(void *data)
 	struct thread_options *o = &td->o;
 	struct sk_out *sk_out = fd->sk_out;
 	uint64_t bytes_done[DDIR_RWDIR_CNT];
+	struct timespec setup_start;
 	int deadlock_loop_cnt;
 	bool clear_state;
 	int ret;
@@ -1555,6 +1668,7 @@ static void *thread_main(void *data)
 		td->pid = gettid();
 
 	fio_local_clock_init();
+	fio_gettime(&setup_start, NULL);
 
 	dprint(FD_PROCESS, "jobs pid=%d started\n", (int) td->pid);
 
@@ -1578,12 +1692,11 @@ static void *thread_main(void *data)
 		goto err;
 	}
 
-	td_set_runstate(td, TD_INITIALIZED);
-	dprint(FD_MUTEX, "up startup_sem\n");
-	fio_sem_up(startup_sem);
-	dprint(FD_MUTEX, "wait on td->sem\n");
-	fio_sem_down(td->sem);
-	dprint(FD_MUTEX, "done waiting on td->sem\n");
+	/*
+	 * Set up everything before we report in as initialized, so that all
+	 * jobs do their setup in parallel, and start their I/O together.
+	 */
+	td_set_runstate(td, TD_SETTING_UP);
 
 	/*
 	 * A new gid requires privilege, so we need to do this before setting
@@ -1607,6 +1720,8 @@ static void *thread_main(void *data)
 	 */
 	if (iolog_compress_init(td, sk_out))
 		goto err;
+	if (iolog_stream_init(td, sk_out))
+		goto err;
 
 	/*
 	 * If we have a gettimeofday() thread, make sure we exclude that
@@ -1710,6 +1825,9 @@ static void *thread_main(void *data)
 	if (o->verify_async && verify_async_init(td))
 		goto err;
 
+	if (arrival_init(td))
+		goto err;
+
 	if (fio_option_is_set(o, ioprio) ||
 	    fio_option_is_set(o, ioprio_class)) {
 		ret = ioprio_set(IOPRIO_WHO_PROCESS, 0, o->ioprio_class, o->ioprio);
@@ -1743,16 +1861,27 @@ static void *thread_main(void *data)
 	if (o->pre_read && !pre_read_files(td))
 		goto err;
 
+	if (o->precondition_fill && !precondition_fill_files(td))
+		goto err;
+
 	fio_verify_init(td);
 
 	if (rate_submit_init(td, sk_out))
 		goto err;
 
+	td->ts.setup_time = utime_since_now(&setup_start);
+
+	td_set_runstate(td, TD_INITIALIZED);
+	dprint(FD_MUTEX, "up startup_sem\n");
+	fio_sem_up(startup_sem);
+	wait_for_start(td);
+
 	set_epoch_time(td, o->log_unix_epoch);
 	fio_getrusage(&td->ru_start);
 	memcpy(&td->bw_sample_time, &td->epoch, sizeof(td->epoch));
 	memcpy(&td->iops_sample_time, &td->epoch, sizeof(td->epoch));
 	memcpy(&td->ss.prev_time, &td->epoch, sizeof(td->epoch));
+	memcpy(&td->ss.phase_start, &td->epoch, sizeof(td->epoch));
 
 	if (o->ratemin[DDIR_READ] || o->ratemin[DDIR_WRITE] ||
 			o->ratemin[DDIR_TRIM]) {
@@ -1818,7 +1947,7 @@ static void *thread_main(void *data)
 			check_update_rusage(td);
 			if (!fio_sem_down_trylock(stat_sem))
 				break;
-			usleep(1000);
+			runner_sleep(1000);
 			if (deadlock_loop_cnt++ > 5000) {
 				log_err("fio seems to be stuck grabbing stat_sem, forcibly exiting\n");
 				td->error = EDEADLK;
@@ -1875,6 +2004,7 @@ static void *thread_main(void *data)
 		pthread_mutex_unlock(&overlap_check);
 
 	update_rusage_stat(td);
+	steadystate_phase_end(td);
 	td->ts.total_run_time = mtime_since_now(&td->epoch);
 	td->ts.io_bytes[DDIR_READ] = td->io_bytes[DDIR_READ];
 	td->ts.io_bytes[DDIR_WRITE] = td->io_bytes[DDIR_WRITE];
@@ -1886,6 +2016,7 @@ static void *thread_main(void *data)
 
 	fio_unpin_memory(td);
 
+	iolog_stream_exit(td);
 	td_writeout_logs(td, true);
 
 	iolog_compress_exit(td);
@@ -1925,8 +2056,11 @@ err:
 		write_iolog_close(td);
 	if (td->io_log_rfile)
 		fclose(td->io_log_rfile);
+	lat_target_exit(td);
+	arrival_exit(td);
 
 	td_set_runstate(td, TD_EXITED);
+	fio_sem_up(job_exit_sem);
 
 	/*
 	 * Do this last after setting our runstate to exited, so we
@@ -2123,11 +2257,14 @@ static int fio_verify_load_state(struct thread_data *td)
 	return ret;
 }
 
-static void do_usleep(unsigned int usecs)
+/*
+ * Wait for msecs, or until a job exits
+ */
+static void wait_for_job_exit(unsigned int msecs)
 {
 	check_for_running_stats();
 	check_trigger_file();
-	usleep(usecs);
+	fio_sem_down_timeout(job_exit_sem, msecs);
 }
 
 static bool check_mount_writes(struct thread_data *td)
@@ -2191,7 +2328,7 @@ static bool waitee_running(struct thread_data *me)
 static void run_threads(struct sk_out *sk_out)
 {
 	struct thread_data *td;
-	unsigned int i, todo, nr_running, nr_started;
+	unsigned int i, todo, nr_running, nr_started, nr_runners;
 	uint64_t m_rate, t_rate;
 	uint64_t spent;
 
@@ -2202,7 +2339,7 @@ static void run_threads(struct sk_out *sk_out)
 
 	set_sig_handlers();
 
-	nr_thread = nr_process = 0;
+	nr_thread = nr_process = nr_runners = 0;
 	for_each_td(td, i) {
 		if (check_mount_writes(td))
 			return;
@@ -2210,8 +2347,12 @@ static void run_threads(struct sk_out *sk_out)
 			nr_thread++;
 		else
 			nr_process++;
+		nr_runners = max(nr_runners, td->o.job_runners);
 	}
 
+	if (nr_runners && runner_init(nr_runners))
+		return;
+
 	if (output_format & FIO_OUTPUT_NORMAL) {
 		struct buf_output out;
 
@@ -2226,6 +2367,9 @@ static void run_threads(struct sk_out *sk_out)
 			__log_buf(&out, "%d process%s", nr_process,
 						nr_process > 1 ? "es" : "");
 		}
+		if (nr_runners)
+			__log_buf(&out, " on %u job runner%s", nr_runners,
+						nr_runners > 1 ? "s" : "");
 		__log_buf(&out, "\n");
 		log_info_buf(out.buf, out.buflen);
 		buf_output_free(&out);
@@ -2337,7 +2481,15 @@ reap:
 			fd->td = td;
 			fd->sk_out = sk_out;
 
-			if (td->o.use_thread) {
+			if (td->o.job_runners) {
+				dprint(FD_PROCESS, "will start on runner\n");
+				if (runner_start_job(thread_main, fd)) {
+					free(fd);
+					nr_started--;
+					break;
+				}
+				fd = NULL;
+			} else if (td->o.use_thread) {
 				int ret;
 
 				dprint(FD_PROCESS, "will pthread_create\n");
@@ -2363,33 +2515,34 @@ reap:
 					int ret;
 
 					ret = (int)(uintptr_t)thread_main(fd);
+					sflush();
 					_exit(ret);
 				} else if (i == fio_debug_jobno)
 					*fio_debug_jobp = pid;
 			}
-			dprint(FD_MUTEX, "wait on startup_sem\n");
-			if (fio_sem_down_timeout(startup_sem, 10000)) {
-				log_err("fio: job startup hung? exiting.\n");
-				fio_terminate_threads(TERMINATE_ALL);
-				fio_abort = true;
-				nr_started--;
-				free(fd);
-				break;
-			}
-			dprint(FD_MUTEX, "done waiting on startup_sem\n");
 		}
 
 		/*
-		 * Wait for the started threads to transition to
-		 * TD_INITIALIZED.
+		 * Wait for the started threads to set up and transition to
+		 * TD_INITIALIZED. Each one ups startup_sem when it gets
+		 * there. Setup may take as long as it needs, but a job must
+		 * have gotten going within JOB_START_TIMEOUT.
 		 */
 		fio_gettime(&this_start, NULL);
 		left = this_jobs;
 		while (left && !fio_abort) {
-			if (mtime_since_now(&this_start) > JOB_START_TIMEOUT)
-				break;
+			bool timed_out;
+			int not_started = 0;
 
-			do_usleep(100000);
+			timed_out = mtime_since_now(&this_start) > JOB_START_TIMEOUT;
+
+			check_for_running_stats();
+			check_trigger_file();
+			dprint(FD_MUTEX, "wait on startup_sem\n");
+			if (!fio_sem_down_timeout(startup_sem, 100)) {
+				while (!fio_sem_down_trylock(startup_sem))
+					;
+			}
 
 			for (i = 0; i < this_jobs; i++) {
 				td = map[i];
@@ -2403,8 +2556,12 @@ reap:
 					left--;
 					todo--;
 					nr_running++; /* work-around... */
-				}
+				} else if (td->runstate == TD_CREATED)
+					not_started++;
 			}
+
+			if (timed_out && not_started == left)
+				break;
 		}
 
 		if (left) {
@@ -2420,8 +2577,10 @@ reap:
 		}
 
 		/*
-		 * start created threads (TD_INITIALIZED -> TD_RUNNING).
+		 * start created threads (TD_INITIALIZED -> TD_RUNNING), and
+		 * release them from the start barrier all at once.
 		 */
+		pthread_mutex_lock(&start_barrier->lock);
 		for_each_td(td, i) {
 			if (td->runstate != TD_INITIALIZED)
 				continue;
@@ -2435,20 +2594,23 @@ reap:
 			m_rate += ddir_rw_sum(td->o.ratemin);
 			t_rate += ddir_rw_sum(td->o.rate);
 			todo--;
-			fio_sem_up(td->sem);
 		}
+		pthread_cond_broadcast(&start_barrier->cond);
+		pthread_mutex_unlock(&start_barrier->lock);
 
 		reap_threads(&nr_running, &t_rate, &m_rate);
 
 		if (todo)
-			do_usleep(100000);
+			wait_for_job_exit(100);
 	}
 
 	while (nr_running) {
 		reap_threads(&nr_running, &t_rate, &m_rate);
-		do_usleep(10000);
+		wait_for_job_exit(100);
 	}
 
+	runner_exit();
+
 	fio_idle_prof_stop();
 
 	update_io_ticks();
@@ -2489,6 +2651,14 @@ int fio_backend(struct sk_out *sk_out)
 		is_local_backend = true;
 	if (startup_sem == NULL)
 		return 1;
+	job_exit_sem = fio_sem_init(FIO_SEM_LOCKED);
+	if (job_exit_sem == NULL)
+		return 1;
+	start_barrier = scalloc(1, sizeof(*start_barrier));
+	if (!start_barrier ||
+	    mutex_cond_init_pshared(&start_barrier->lock,
+				    &start_barrier->cond))
+		return 1;
 
 	set_genesis_time();
 	stat_init();
@@ -2521,8 +2691,6 @@ int fio_backend(struct sk_out *sk_out)
 			fio_sem_remove(td->rusage_sem);
 			td->rusage_sem = NULL;
 		}
-		fio_sem_remove(td->sem);
-		td->sem = NULL;
 	}
 
 	free_disk_util();
@@ -2531,6 +2699,10 @@ int fio_backend(struct sk_out *sk_out)
 		sfree(cgroup_list);
 	}
 
+	pthread_cond_destroy(&start_barrier->cond);
+	pthread_mutex_destroy(&start_barrier->lock);
+	sfree(start_barrier);
+	fio_sem_remove(job_exit_sem);
 	fio_sem_remove(startup_sem);
 	stat_exit();
 	return exit_value;
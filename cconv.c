@@ -37,6 +37,8 @@ static void free_thread_options_to_cpu(struct thread_options *o)
 	free(o->mmapfile);
 	free(o->read_iolog_file);
 	free(o->write_iolog_file);
+	free(o->latency_log_file);
+	free(o->rate_curve);
 	free(o->merge_blktrace_file);
 	free(o->bw_log_file);
 	free(o->lat_log_file);
@@ -74,6 +76,8 @@ void convert_thread_options_to_cpu(struct thread_options *o,
 	string_to_cpu(&o->mmapfile, top->mmapfile);
 	string_to_cpu(&o->read_iolog_file, top->read_iolog_file);
 	string_to_cpu(&o->write_iolog_file, top->write_iolog_file);
+	string_to_cpu(&o->latency_log_file, top->latency_log_file);
+	string_to_cpu(&o->rate_curve, top->rate_curve);
 	string_to_cpu(&o->merge_blktrace_file, top->merge_blktrace_file);
 	string_to_cpu(&o->bw_log_file, top->bw_log_file);
 	string_to_cpu(&o->lat_log_file, top->lat_log_file);
@@ -99,6 +103,7 @@ void convert_thread_options_to_cpu(struct thread_options *o,
 	o->iodepth_batch = le32_to_cpu(top->iodepth_batch);
 	o->iodepth_batch_complete_min = le32_to_cpu(top->iodepth_batch_complete_min);
 	o->iodepth_batch_complete_max = le32_to_cpu(top->iodepth_batch_complete_max);
+	o->iodepth_batch_prep = le32_to_cpu(top->iodepth_batch_prep);
 	o->serialize_overlap = le32_to_cpu(top->serialize_overlap);
 	o->size = le64_to_cpu(top->size);
 	o->io_size = le64_to_cpu(top->io_size);
@@ -178,6 +183,7 @@ void convert_thread_options_to_cpu(struct thread_options *o,
 	o->verify_async = le32_to_cpu(top->verify_async);
 	o->verify_batch = le32_to_cpu(top->verify_batch);
 	o->use_thread = le32_to_cpu(top->use_thread);
+	o->job_runners = le32_to_cpu(top->job_runners);
 	o->unlink = le32_to_cpu(top->unlink);
 	o->unlink_each_loop = le32_to_cpu(top->unlink_each_loop);
 	o->do_disk_util = le32_to_cpu(top->do_disk_util);
@@ -222,6 +228,11 @@ void convert_thread_options_to_cpu(struct thread_options *o,
 	o->ss_ramp_time = le64_to_cpu(top->ss_ramp_time);
 	o->ss_state = le32_to_cpu(top->ss_state);
 	o->ss_limit.u.f = fio_uint64_to_double(le64_to_cpu(top->ss_limit.u.i));
+	o->ss_percentile.u.f = fio_uint64_to_double(le64_to_cpu(top->ss_percentile.u.i));
+	o->ss_lat_window = le64_to_cpu(top->ss_lat_window);
+	o->ss_per_job = le32_to_cpu(top->ss_per_job);
+	o->ss_measure = le64_to_cpu(top->ss_measure);
+	o->precondition_fill = le32_to_cpu(top->precondition_fill);
 	o->zone_range = le64_to_cpu(top->zone_range);
 	o->zone_size = le64_to_cpu(top->zone_size);
 	o->zone_skip = le64_to_cpu(top->zone_skip);
@@ -281,11 +292,15 @@ void convert_thread_options_to_cpu(struct thread_options *o,
 	o->flow = __le32_to_cpu(top->flow);
 	o->flow_watermark = __le32_to_cpu(top->flow_watermark);
 	o->flow_sleep = le32_to_cpu(top->flow_sleep);
+	o->flow_rate = le64_to_cpu(top->flow_rate);
+	o->flow_rate_iops = le32_to_cpu(top->flow_rate_iops);
+	o->flow_weight = le32_to_cpu(top->flow_weight);
 	o->sync_file_range = le32_to_cpu(top->sync_file_range);
 	o->latency_target = le64_to_cpu(top->latency_target);
 	o->latency_window = le64_to_cpu(top->latency_window);
 	o->max_latency = le64_to_cpu(top->max_latency);
 	o->latency_percentile.u.f = fio_uint64_to_double(le64_to_cpu(top->latency_percentile.u.i));
+	o->latency_controller = le32_to_cpu(top->latency_controller);
 	o->compress_percentage = le32_to_cpu(top->compress_percentage);
 	o->compress_chunk = le32_to_cpu(top->compress_chunk);
 	o->dedupe_percentage = le32_to_cpu(top->dedupe_percentage);
@@ -302,6 +317,9 @@ void convert_thread_options_to_cpu(struct thread_options *o,
 
 	o->trim_backlog = le64_to_cpu(top->trim_backlog);
 	o->rate_process = le32_to_cpu(top->rate_process);
+	o->rate_time[0] = le64_to_cpu(top->rate_time[0]);
+	o->rate_time[1] = le64_to_cpu(top->rate_time[1]);
+	o->rate_shape.u.f = fio_uint64_to_double(le64_to_cpu(top->rate_shape.u.i));
 	o->rate_ign_think = le32_to_cpu(top->rate_ign_think);
 
 	for (i = 0; i < FIO_IO_U_LIST_MAX_LEN; i++)
@@ -338,6 +356,8 @@ void convert_thread_options_to_net(struct thread_options_pack *top,
 	string_to_net(top->mmapfile, o->mmapfile);
 	string_to_net(top->read_iolog_file, o->read_iolog_file);
 	string_to_net(top->write_iolog_file, o->write_iolog_file);
+	string_to_net(top->latency_log_file, o->latency_log_file);
+	string_to_net(top->rate_curve, o->rate_curve);
 	string_to_net(top->merge_blktrace_file, o->merge_blktrace_file);
 	string_to_net(top->bw_log_file, o->bw_log_file);
 	string_to_net(top->lat_log_file, o->lat_log_file);
@@ -362,6 +382,7 @@ void convert_thread_options_to_net(struct thread_options_pack *top,
 	top->iodepth_batch = cpu_to_le32(o->iodepth_batch);
 	top->iodepth_batch_complete_min = cpu_to_le32(o->iodepth_batch_complete_min);
 	top->iodepth_batch_complete_max = cpu_to_le32(o->iodepth_batch_complete_max);
+	top->iodepth_batch_prep = cpu_to_le32(o->iodepth_batch_prep);
 	top->serialize_overlap = cpu_to_le32(o->serialize_overlap);
 	top->size_percent = cpu_to_le32(o->size_percent);
 	top->fill_device = cpu_to_le32(o->fill_device);
@@ -395,6 +416,7 @@ void convert_thread_options_to_net(struct thread_options_pack *top,
 	top->verify_async = cpu_to_le32(o->verify_async);
 	top->verify_batch = cpu_to_le32(o->verify_batch);
 	top->use_thread = cpu_to_le32(o->use_thread);
+	top->job_runners = cpu_to_le32(o->job_runners);
 	top->unlink = cpu_to_le32(o->unlink);
 	top->unlink_each_loop = cpu_to_le32(o->unlink_each_loop);
 	top->do_disk_util = cpu_to_le32(o->do_disk_util);
@@ -478,11 +500,15 @@ void convert_thread_options_to_net(struct thread_options_pack *top,
 	top->flow = __cpu_to_le32(o->flow);
 	top->flow_watermark = __cpu_to_le32(o->flow_watermark);
 	top->flow_sleep = cpu_to_le32(o->flow_sleep);
+	top->flow_rate = __cpu_to_le64(o->flow_rate);
+	top->flow_rate_iops = cpu_to_le32(o->flow_rate_iops);
+	top->flow_weight = cpu_to_le32(o->flow_weight);
 	top->sync_file_range = cpu_to_le32(o->sync_file_range);
 	top->latency_target = __cpu_to_le64(o->latency_target);
 	top->latency_window = __cpu_to_le64(o->latency_window);
 	top->max_latency = __cpu_to_le64(o->max_latency);
 	top->latency_percentile.u.i = __cpu_to_le64(fio_double_to_uint64(o->latency_percentile.u.f));
+	top->latency_controller = cpu_to_le32(o->latency_controller);
 	top->compress_percentage = cpu_to_le32(o->compress_percentage);
 	top->compress_chunk = cpu_to_le32(o->compress_chunk);
 	top->dedupe_percentage = cpu_to_le32(o->dedupe_percentage);
@@ -555,6 +581,11 @@ void convert_thread_options_to_net(struct thread_options_pack *top,
 	top->ss_ramp_time = __cpu_to_le64(top->ss_ramp_time);
 	top->ss_state = cpu_to_le32(top->ss_state);
 	top->ss_limit.u.i = __cpu_to_le64(fio_double_to_uint64(o->ss_limit.u.f));
+	top->ss_percentile.u.i = __cpu_to_le64(fio_double_to_uint64(o->ss_percentile.u.f));
+	top->ss_lat_window = __cpu_to_le64(o->ss_lat_window);
+	top->ss_per_job = cpu_to_le32(o->ss_per_job);
+	top->ss_measure = __cpu_to_le64(o->ss_measure);
+	top->precondition_fill = cpu_to_le32(o->precondition_fill);
 	top->zone_range = __cpu_to_le64(o->zone_range);
 	top->zone_size = __cpu_to_le64(o->zone_size);
 	top->zone_skip = __cpu_to_le64(o->zone_skip);
@@ -570,6 +601,9 @@ void convert_thread_options_to_net(struct thread_options_pack *top,
 	top->offset_increment = __cpu_to_le64(o->offset_increment);
 	top->number_ios = __cpu_to_le64(o->number_ios);
 	top->rate_process = cpu_to_le32(o->rate_process);
+	top->rate_time[0] = __cpu_to_le64(o->rate_time[0]);
+	top->rate_time[1] = __cpu_to_le64(o->rate_time[1]);
+	top->rate_shape.u.i = __cpu_to_le64(fio_double_to_uint64(o->rate_shape.u.f));
 	top->rate_ign_think = cpu_to_le32(o->rate_ign_think);
 
 	for (i = 0; i < FIO_IO_U_LIST_MAX_LEN; i++)
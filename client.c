@@ -12,6 +12,15 @@
 #include <arpa/inet.h>
 #include <netdb.h>
 #include <signal.h>
+#ifdef CONFIG_LINUX_EPOLL
+#include <sys/epoll.h>
+#endif
+#ifdef CONFIG_LZ4
+#include <lz4.h>
+#endif
+#ifdef CONFIG_ZSTD
+#include <zstd.h>
+#endif
 #ifdef CONFIG_ZLIB
 #include <zlib.h>
 #endif
@@ -45,6 +54,7 @@ struct client_ops fio_client_ops = {
 	.probe		= handle_probe,
 	.eta_msec	= FIO_CLIENT_DEF_ETA_MSEC,
 	.client_type	= FIO_CLIENT_TYPE_CLI,
+	.stat_workers	= FIO_CLIENT_DEF_STAT_WORKERS,
 };
 
 static struct timespec eta_ts;
@@ -66,6 +76,46 @@ static struct json_array *du_array = NULL;
 
 static int error_clients;
 
+/*
+ * TS summed by one stat worker. The sums of all workers are merged into
+ * client_ts/client_gs once the clients are done.
+ */
+struct client_stat_sum {
+	struct thread_stat ts;
+	struct group_run_stats gs;
+	unsigned int nr;
+	char *hostname;
+	int port;
+};
+
+struct client_stat_cmd {
+	struct flist_head list;
+	struct fio_net_cmd *cmd;
+};
+
+/*
+ * A log file that the server is sending chunks of
+ */
+struct client_log_stream {
+	struct flist_head list;
+	char *name;
+	FILE *f;
+};
+
+static struct workqueue stat_wq;
+static bool stat_wq_running;
+static struct client_stat_sum inline_stat_sum;
+static char *sum_hostname;
+static int sum_port;
+
+/*
+ * stat_lock protects the per-client stat_list and stat_queued, json_lock
+ * the json objects shared by all clients.
+ */
+static pthread_mutex_t stat_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t stat_cond = PTHREAD_COND_INITIALIZER;
+static pthread_mutex_t json_lock = PTHREAD_MUTEX_INITIALIZER;
+
 #define FIO_CLIENT_HASH_BITS	7
 #define FIO_CLIENT_HASH_SZ	(1 << FIO_CLIENT_HASH_BITS)
 #define FIO_CLIENT_HASH_MASK	(FIO_CLIENT_HASH_SZ - 1)
@@ -81,6 +131,14 @@ static void fio_client_add_hash(struct fio_client *client)
 	flist_add(&client->hash_list, &client_hash[bucket]);
 }
 
+static void client_log_stream_close(struct client_log_stream *stream)
+{
+	flist_del(&stream->list);
+	fclose(stream->f);
+	free(stream->name);
+	free(stream);
+}
+
 static void fio_client_remove_hash(struct fio_client *client)
 {
 	if (!flist_empty(&client->hash_list))
@@ -259,6 +317,20 @@ void fio_put_client(struct fio_client *client)
 		free(client->files);
 	if (client->opt_lists)
 		free(client->opt_lists);
+	while (client->nr_ts_base)
+		free(client->ts_base[--client->nr_ts_base]);
+	if (client->ts_base)
+		free(client->ts_base);
+	while (!flist_empty(&client->log_streams)) {
+		struct client_log_stream *stream;
+
+		stream = flist_first_entry(&client->log_streams,
+						struct client_log_stream, list);
+		log_err("fio: log %s is incomplete\n", stream->name);
+		client_log_stream_close(stream);
+	}
+	if (client->log_buf)
+		free(client->log_buf);
 
 	if (!client->did_stat)
 		sum_stat_clients--;
@@ -298,12 +370,25 @@ static void fio_drain_client_text(struct fio_client *client)
 	} while (1);
 }
 
+/*
+ * Wait for the stat workers to finish the stats queued for this client
+ */
+static void client_wait_stat(struct fio_client *client)
+{
+	pthread_mutex_lock(&stat_lock);
+	while (client->stat_queued)
+		pthread_cond_wait(&stat_cond, &stat_lock);
+	pthread_mutex_unlock(&stat_lock);
+}
+
 static void remove_client(struct fio_client *client)
 {
 	assert(client->refs);
 
 	dprint(FD_NET, "client: removed <%s>\n", client->hostname);
 
+	client_wait_stat(client);
+
 	fio_drain_client_text(client);
 
 	if (!flist_empty(&client->list))
@@ -375,6 +460,8 @@ static struct fio_client *get_new_client(void)
 	INIT_FLIST_HEAD(&client->arg_list);
 	INIT_FLIST_HEAD(&client->eta_list);
 	INIT_FLIST_HEAD(&client->cmd_list);
+	INIT_FLIST_HEAD(&client->stat_list);
+	INIT_FLIST_HEAD(&client->log_streams);
 
 	buf_output_init(&client->buf);
 
@@ -511,10 +598,15 @@ static void probe_client(struct fio_client *client)
 
 	dprint(FD_NET, "client: send probe\n");
 
-#ifdef CONFIG_ZLIB
-	pdu.flags = __le64_to_cpu(FIO_PROBE_FLAG_ZLIB);
-#else
 	pdu.flags = 0;
+#ifdef CONFIG_ZLIB
+	pdu.flags |= __le64_to_cpu(FIO_PROBE_FLAG_ZLIB);
+#endif
+#ifdef CONFIG_LZ4
+	pdu.flags |= __le64_to_cpu(FIO_PROBE_FLAG_LZ4);
+#endif
+#ifdef CONFIG_ZSTD
+	pdu.flags |= __le64_to_cpu(FIO_PROBE_FLAG_ZSTD);
 #endif
 
 	sname = server_name(client, buf, sizeof(buf));
@@ -955,6 +1047,8 @@ static void convert_ts(struct thread_stat *dst, struct thread_stat *src)
 		convert_io_stat(&dst->clat_stat[i], &src->clat_stat[i]);
 		convert_io_stat(&dst->slat_stat[i], &src->slat_stat[i]);
 		convert_io_stat(&dst->lat_stat[i], &src->lat_stat[i]);
+		convert_io_stat(&dst->rsp_stat[i], &src->rsp_stat[i]);
+		convert_io_stat(&dst->backlog_stat[i], &src->backlog_stat[i]);
 		convert_io_stat(&dst->bw_stat[i], &src->bw_stat[i]);
 		convert_io_stat(&dst->iops_stat[i], &src->iops_stat[i]);
 	}
@@ -988,9 +1082,12 @@ static void convert_ts(struct thread_stat *dst, struct thread_stat *src)
 	for (i = 0; i < FIO_IO_U_LAT_M_NR; i++)
 		dst->io_u_lat_m[i]	= le64_to_cpu(src->io_u_lat_m[i]);
 
-	for (i = 0; i < DDIR_RWDIR_CNT; i++)
-		for (j = 0; j < FIO_IO_U_PLAT_NR; j++)
+	for (i = 0; i < DDIR_RWDIR_CNT; i++) {
+		for (j = 0; j < FIO_IO_U_PLAT_NR; j++) {
 			dst->io_u_plat[i][j] = le64_to_cpu(src->io_u_plat[i][j]);
+			dst->io_u_rsp_plat[i][j] = le64_to_cpu(src->io_u_rsp_plat[i][j]);
+		}
+	}
 
 	for (i = 0; i < DDIR_RWDIR_CNT; i++) {
 		dst->total_io_u[i]	= le64_to_cpu(src->total_io_u[i]);
@@ -1001,6 +1098,13 @@ static void convert_ts(struct thread_stat *dst, struct thread_stat *src)
 	dst->total_submit	= le64_to_cpu(src->total_submit);
 	dst->total_complete	= le64_to_cpu(src->total_complete);
 	dst->nr_zone_resets	= le64_to_cpu(src->nr_zone_resets);
+	dst->nr_zone_finishes	= le64_to_cpu(src->nr_zone_finishes);
+
+	for (i = 0; i < FIO_ZONE_OP_NR; i++) {
+		convert_io_stat(&dst->zone_op_stat[i], &src->zone_op_stat[i]);
+		for (j = 0; j < FIO_IO_U_PLAT_NR; j++)
+			dst->io_u_zone_op_plat[i][j] = le64_to_cpu(src->io_u_zone_op_plat[i][j]);
+	}
 
 	for (i = 0; i < DDIR_RWDIR_CNT; i++) {
 		dst->io_bytes[i]	= le64_to_cpu(src->io_bytes[i]);
@@ -1019,6 +1123,8 @@ static void convert_ts(struct thread_stat *dst, struct thread_stat *src)
 	dst->latency_depth	= le32_to_cpu(src->latency_depth);
 	dst->latency_target	= le64_to_cpu(src->latency_target);
 	dst->latency_window	= le64_to_cpu(src->latency_window);
+	dst->latency_sustained_iops = le64_to_cpu(src->latency_sustained_iops);
+	dst->setup_time		= le64_to_cpu(src->setup_time);
 	dst->latency_percentile.u.f = fio_uint64_to_double(le64_to_cpu(src->latency_percentile.u.i));
 
 	dst->nr_block_infos	= le64_to_cpu(src->nr_block_infos);
@@ -1029,6 +1135,12 @@ static void convert_ts(struct thread_stat *dst, struct thread_stat *src)
 	dst->ss_state		= le32_to_cpu(src->ss_state);
 	dst->ss_head		= le32_to_cpu(src->ss_head);
 	dst->ss_limit.u.f 	= fio_uint64_to_double(le64_to_cpu(src->ss_limit.u.i));
+	dst->ss_percentile.u.f 	= fio_uint64_to_double(le64_to_cpu(src->ss_percentile.u.i));
+
+	dst->precond_fill_msec	= le64_to_cpu(src->precond_fill_msec);
+	dst->precond_ss_msec	= le64_to_cpu(src->precond_ss_msec);
+	dst->precond_measure_msec = le64_to_cpu(src->precond_measure_msec);
+	dst->precond_fill_passes = le32_to_cpu(src->precond_fill_passes);
 	dst->ss_slope.u.f 	= fio_uint64_to_double(le64_to_cpu(src->ss_slope.u.i));
 	dst->ss_deviation.u.f 	= fio_uint64_to_double(le64_to_cpu(src->ss_deviation.u.i));
 	dst->ss_criterion.u.f 	= fio_uint64_to_double(le64_to_cpu(src->ss_criterion.u.i));
@@ -1037,6 +1149,7 @@ static void convert_ts(struct thread_stat *dst, struct thread_stat *src)
 		for (i = 0; i < dst->ss_dur; i++ ) {
 			dst->ss_iops_data[i] = le64_to_cpu(src->ss_iops_data[i]);
 			dst->ss_bw_data[i] = le64_to_cpu(src->ss_bw_data[i]);
+			dst->ss_lat_data[i] = le64_to_cpu(src->ss_lat_data[i]);
 		}
 	}
 
@@ -1073,9 +1186,15 @@ static void json_object_add_client_info(struct json_object *obj,
 	json_object_add_value_int(obj, "port", client->port);
 }
 
+/*
+ * Called from a stat worker, or from the main thread if there are none.
+ * The TS is summed into the stat_sum of the worker, client_stat_merge()
+ * adds those up at the end.
+ */
 static void handle_ts(struct fio_client *client, struct fio_net_cmd *cmd)
 {
 	struct cmd_ts_pdu *p = (struct cmd_ts_pdu *) cmd->payload;
+	struct client_stat_sum *sum = client->stat_sum;
 	struct flist_head *opt_list = NULL;
 	struct json_object *tsobj;
 
@@ -1086,29 +1205,92 @@ static void handle_ts(struct fio_client *client, struct fio_net_cmd *cmd)
 	client->did_stat = true;
 	if (tsobj) {
 		json_object_add_client_info(tsobj, client);
+		pthread_mutex_lock(&json_lock);
 		json_array_add_value_object(clients_array, tsobj);
+		pthread_mutex_unlock(&json_lock);
 	}
 
 	if (sum_stat_clients <= 1)
 		return;
 
-	sum_thread_stats(&client_ts, &p->ts, sum_stat_nr == 1);
-	sum_group_stats(&client_gs, &p->rs);
-
-	client_ts.members++;
-	client_ts.thread_number = p->ts.thread_number;
-	client_ts.groupid = p->ts.groupid;
-	client_ts.unified_rw_rep = p->ts.unified_rw_rep;
-	client_ts.sig_figs = p->ts.sig_figs;
-
-	if (++sum_stat_nr == sum_stat_clients) {
-		strcpy(client_ts.name, "All clients");
-		tsobj = show_thread_status(&client_ts, &client_gs, NULL, &client->buf);
-		if (tsobj) {
-			json_object_add_client_info(tsobj, client);
-			json_array_add_value_object(clients_array, tsobj);
-		}
+	if (!sum)
+		sum = &inline_stat_sum;
+
+	sum_thread_stats(&sum->ts, &p->ts, !sum->nr);
+	sum_group_stats(&sum->gs, &p->rs);
+
+	sum->ts.members++;
+	sum->ts.thread_number = p->ts.thread_number;
+	sum->ts.groupid = p->ts.groupid;
+	sum->ts.unified_rw_rep = p->ts.unified_rw_rep;
+	sum->ts.sig_figs = p->ts.sig_figs;
+	sum->nr++;
+
+	if (!sum->hostname || strcmp(sum->hostname, client->hostname)) {
+		free(sum->hostname);
+		sum->hostname = strdup(client->hostname);
 	}
+	sum->port = client->port;
+}
+
+static void client_stat_sum_init(struct client_stat_sum *sum)
+{
+	init_thread_stat(&sum->ts);
+	init_group_run_stat(&sum->gs);
+	sum->nr = 0;
+	sum->hostname = NULL;
+	sum->port = 0;
+}
+
+/*
+ * Add the TS summed by one worker to client_ts/client_gs
+ */
+static void client_stat_merge(struct client_stat_sum *sum)
+{
+	if (!sum->nr)
+		return;
+
+	sum_thread_stats(&client_ts, &sum->ts, !sum_stat_nr);
+	sum_group_stats(&client_gs, &sum->gs);
+
+	client_ts.members += sum->ts.members;
+	client_ts.thread_number = sum->ts.thread_number;
+	client_ts.groupid = sum->ts.groupid;
+	client_ts.unified_rw_rep = sum->ts.unified_rw_rep;
+	client_ts.sig_figs = sum->ts.sig_figs;
+	sum_stat_nr += sum->nr;
+
+	free(sum_hostname);
+	sum_hostname = sum->hostname;
+	sum_port = sum->port;
+
+	client_stat_sum_init(sum);
+}
+
+static void client_show_stat_sum(void)
+{
+	struct json_object *tsobj;
+	struct buf_output out;
+
+	if (sum_stat_clients <= 1 || sum_stat_nr < sum_stat_clients)
+		goto out;
+
+	buf_output_init(&out);
+
+	strcpy(client_ts.name, "All clients");
+	tsobj = show_thread_status(&client_ts, &client_gs, NULL, &out);
+	if (tsobj) {
+		json_object_add_value_string(tsobj, "hostname",
+					sum_hostname ? sum_hostname : "");
+		json_object_add_value_int(tsobj, "port", sum_port);
+		json_array_add_value_object(clients_array, tsobj);
+	}
+
+	log_info_buf(out.buf, out.buflen);
+	buf_output_free(&out);
+out:
+	free(sum_hostname);
+	sum_hostname = NULL;
 }
 
 static void handle_gs(struct fio_client *client, struct fio_net_cmd *cmd)
@@ -1144,7 +1326,9 @@ static void handle_job_opt(struct fio_client *client, struct fio_net_cmd *cmd)
 		if (p->value)
 			pos = p->value;
 
+		pthread_mutex_lock(&json_lock);
 		json_object_add_value_string(job_opt_object, p->name, pos);
+		pthread_mutex_unlock(&json_lock);
 	} else if (client->opt_lists) {
 		struct flist_head *opt_list = &client->opt_lists[pdu->groupid];
 
@@ -1215,9 +1399,11 @@ static void handle_du(struct fio_client *client, struct fio_net_cmd *cmd)
 	if (output_format & FIO_OUTPUT_JSON) {
 		struct json_object *duobj;
 
+		pthread_mutex_lock(&json_lock);
 		json_array_add_disk_util(&du->dus, &du->agg, du_array);
 		duobj = json_array_last_value_object(du_array);
 		json_object_add_client_info(duobj, client);
+		pthread_mutex_unlock(&json_lock);
 	} else if (output_format & FIO_OUTPUT_TERSE)
 		print_disk_util(&du->dus, &du->agg, 1, &client->buf);
 	else if (output_format & FIO_OUTPUT_NORMAL) {
@@ -1393,9 +1579,164 @@ static void client_flush_hist_samples(FILE *f, int hist_coarseness, void *sample
 	}
 }
 
+static struct client_log_stream *client_log_stream_find(struct fio_client *client,
+							 const char *name)
+{
+	struct flist_head *entry;
+
+	flist_for_each(entry, &client->log_streams) {
+		struct client_log_stream *stream;
+
+		stream = flist_entry(entry, struct client_log_stream, list);
+		if (!strcmp(stream->name, name))
+			return stream;
+	}
+
+	return NULL;
+}
+
+/*
+ * Decompress the samples of an IOLOG_CHUNK into the client log buffer.
+ * Returns the samples, or NULL on error.
+ */
+static void *client_inflate_chunk(struct fio_client *client,
+				  struct cmd_iolog_chunk_pdu *pdu, size_t in_len)
+{
+	size_t len = pdu->len;
+	int ret = -1;
+
+	if (pdu->comp == FIO_NET_COMP_NONE)
+		return in_len == len ? pdu->samples : NULL;
+
+	if (client->log_buf_len < len) {
+		void *buf = realloc(client->log_buf, len);
+
+		if (!buf)
+			return NULL;
+		client->log_buf = buf;
+		client->log_buf_len = len;
+	}
+
+	switch (pdu->comp) {
+#ifdef CONFIG_ZLIB
+	case FIO_NET_COMP_ZLIB: {
+		uLongf dlen = len;
+
+		if (uncompress(client->log_buf, &dlen, pdu->samples, in_len) == Z_OK &&
+		    dlen == len)
+			ret = 0;
+		break;
+		}
+#endif
+#ifdef CONFIG_LZ4
+	case FIO_NET_COMP_LZ4:
+		if (LZ4_decompress_safe((const char *) pdu->samples,
+					client->log_buf, in_len, len) == len)
+			ret = 0;
+		break;
+#endif
+#ifdef CONFIG_ZSTD
+	case FIO_NET_COMP_ZSTD:
+		if (ZSTD_decompress(client->log_buf, len, pdu->samples,
+				    in_len) == len)
+			ret = 0;
+		break;
+#endif
+	default:
+		log_err("fio: log chunk compressed with unknown method %u\n",
+				pdu->comp);
+		return NULL;
+	}
+
+	return ret ? NULL : client->log_buf;
+}
+
+/*
+ * Samples of a log sent while the job runs. They are appended to the log
+ * file as they arrive.
+ */
+static int fio_client_handle_iolog_chunk(struct fio_client *client,
+					 struct fio_net_cmd *cmd)
+{
+	struct cmd_iolog_chunk_pdu *pdu = (struct cmd_iolog_chunk_pdu *) cmd->payload;
+	struct client_log_stream *stream;
+	char *log_pathname;
+	void *samples;
+	uint64_t i;
+
+	if (cmd->pdu_len < sizeof(*pdu))
+		return 1;
+
+	pdu->nr_samples		= le64_to_cpu(pdu->nr_samples);
+	pdu->thread_number	= le32_to_cpu(pdu->thread_number);
+	pdu->log_type		= le32_to_cpu(pdu->log_type);
+	pdu->log_offset		= le32_to_cpu(pdu->log_offset);
+	pdu->comp		= le32_to_cpu(pdu->comp);
+	pdu->len		= le32_to_cpu(pdu->len);
+	pdu->name[FIO_NET_NAME_MAX - 1] = '\0';
+
+	if (pdu->len != pdu->nr_samples * __log_entry_sz(pdu->log_offset)) {
+		log_err("fio: bad log chunk\n");
+		return 1;
+	}
+
+	samples = client_inflate_chunk(client, pdu, cmd->pdu_len - sizeof(*pdu));
+	if (!samples) {
+		log_err("fio: failed decompressing log chunk\n");
+		return 1;
+	}
+
+	log_pathname = malloc(10 + strlen((char *) pdu->name) +
+				strlen(client->hostname));
+	if (!log_pathname)
+		return 1;
+	sprintf(log_pathname, "%s.%s", pdu->name, client->hostname);
+
+	stream = client_log_stream_find(client, log_pathname);
+	if (!stream) {
+		stream = malloc(sizeof(*stream));
+		if (!stream) {
+			free(log_pathname);
+			return 1;
+		}
+
+		stream->f = fopen(log_pathname, "w");
+		if (!stream->f) {
+			log_err("fio: fopen log %s : %s\n", log_pathname,
+					strerror(errno));
+			free(stream);
+			free(log_pathname);
+			return 1;
+		}
+
+		stream->name = log_pathname;
+		flist_add_tail(&stream->list, &client->log_streams);
+	} else
+		free(log_pathname);
+
+	for (i = 0; i < pdu->nr_samples; i++) {
+		struct io_sample *s = __get_sample(samples, pdu->log_offset, i);
+
+		s->time		= le64_to_cpu(s->time);
+		s->data.val	= le64_to_cpu(s->data.val);
+		s->__ddir	= le32_to_cpu(s->__ddir);
+		s->bs		= le64_to_cpu(s->bs);
+
+		if (pdu->log_offset) {
+			struct io_sample_offset *so = (void *) s;
+
+			so->offset = le64_to_cpu(so->offset);
+		}
+	}
+
+	flush_samples(stream->f, samples, pdu->len);
+	return 0;
+}
+
 static int fio_client_handle_iolog(struct fio_client *client,
 				   struct fio_net_cmd *cmd)
 {
+	struct client_log_stream *stream;
 	struct cmd_iolog_pdu *pdu = NULL;
 	bool store_direct;
 	char *log_pathname = NULL;
@@ -1419,6 +1760,15 @@ static int fio_client_handle_iolog(struct fio_client *client,
 	/* generate a unique pathname for the log file using hostname */
 	sprintf(log_pathname, "%s.%s", pdu->name, client->hostname);
 
+	stream = client_log_stream_find(client, log_pathname);
+	if (stream) {
+		flush_samples(stream->f, pdu->samples,
+				pdu->nr_samples * sizeof(struct io_sample));
+		client_log_stream_close(stream);
+		ret = 0;
+		goto out;
+	}
+
 	if (store_direct) {
 		ssize_t wrote;
 		size_t sz;
@@ -1738,33 +2088,136 @@ fail:
 	return 0;
 }
 
-int fio_handle_client(struct fio_client *client)
+/*
+ * Keep a wire format copy of a full TS, later deltas apply to it
+ */
+static void client_save_ts_base(struct fio_client *client,
+				struct cmd_ts_pdu *p)
 {
-	struct client_ops *ops = client->ops;
-	struct fio_net_cmd *cmd;
-	int size;
+	uint32_t thread_number = le32_to_cpu(p->ts.thread_number);
 
-	dprint(FD_NET, "client: handle %s\n", client->hostname);
+	if (!thread_number)
+		return;
 
-	cmd = fio_net_recv_cmd(client->fd, true);
-	if (!cmd)
-		return 0;
+	if (thread_number > client->nr_ts_base) {
+		struct cmd_ts_pdu **base;
 
-	dprint(FD_NET, "client: got cmd op %s from %s (pdu=%u)\n",
-		fio_server_op(cmd->opcode), client->hostname, cmd->pdu_len);
+		base = realloc(client->ts_base, thread_number * sizeof(*base));
+		if (!base)
+			return;
 
-	client->last_cmd = cmd->opcode;
+		memset(base + client->nr_ts_base, 0, (thread_number -
+			client->nr_ts_base) * sizeof(*base));
+		client->ts_base = base;
+		client->nr_ts_base = thread_number;
+	}
+
+	if (!client->ts_base[thread_number - 1]) {
+		client->ts_base[thread_number - 1] = malloc(sizeof(*p));
+		if (!client->ts_base[thread_number - 1])
+			return;
+	}
+
+	memcpy(client->ts_base[thread_number - 1], p, sizeof(*p));
+}
+
+/*
+ * Apply a TS_DELTA to the saved TS it is based on, and return a TS
+ * command holding the result.
+ */
+static struct fio_net_cmd *client_apply_ts_delta(struct fio_client *client,
+						 struct fio_net_cmd *cmd)
+{
+	struct cmd_ts_delta_pdu *pdu = (struct cmd_ts_delta_pdu *) cmd->payload;
+	uint32_t thread_number, nr_runs, len, i;
+	struct fio_net_cmd *ret = NULL;
+	struct cmd_ts_pdu *base;
+	uint8_t *runs, *p, *end;
+
+	if (cmd->pdu_len < sizeof(*pdu))
+		return NULL;
+
+	thread_number = le32_to_cpu(pdu->thread_number);
+	nr_runs = le32_to_cpu(pdu->nr_runs);
+	len = le32_to_cpu(pdu->len);
+
+	if (!thread_number || thread_number > client->nr_ts_base ||
+	    !client->ts_base[thread_number - 1]) {
+		log_err("fio: client: TS delta for unknown thread %u\n",
+			thread_number);
+		return NULL;
+	}
+	base = client->ts_base[thread_number - 1];
+
+	if (le32_to_cpu(pdu->compressed)) {
+#ifdef CONFIG_ZLIB
+		uLongf dlen = len;
+
+		runs = malloc(len);
+		if (!runs)
+			return NULL;
+		if (uncompress(runs, &dlen, pdu->data,
+			       cmd->pdu_len - sizeof(*pdu)) != Z_OK ||
+		    dlen != len) {
+			log_err("fio: client: failed inflating TS delta\n");
+			goto out;
+		}
+#else
+		log_err("fio: client: compressed TS delta, but no zlib\n");
+		return NULL;
+#endif
+	} else {
+		if (len > cmd->pdu_len - sizeof(*pdu))
+			return NULL;
+		runs = pdu->data;
+	}
+
+	p = runs;
+	end = runs + len;
+	for (i = 0; i < nr_runs; i++) {
+		struct cmd_ts_delta_run *run = (struct cmd_ts_delta_run *) p;
+		uint32_t off, rlen;
+
+		if (p + sizeof(*run) > end)
+			break;
+
+		off = le32_to_cpu(run->offset);
+		rlen = le32_to_cpu(run->len);
+		if (off + rlen > sizeof(*base) || rlen > end - p - sizeof(*run))
+			break;
+
+		memcpy((uint8_t *) base + off, run->data, rlen);
+		p += sizeof(*run) + rlen;
+	}
+
+	if (i != nr_runs) {
+		log_err("fio: client: bad TS delta\n");
+		goto out;
+	}
+
+	ret = malloc(sizeof(*ret) + sizeof(*base));
+	if (ret) {
+		memcpy(ret, cmd, sizeof(*ret));
+		ret->opcode = FIO_NET_CMD_TS;
+		ret->pdu_len = sizeof(*base);
+		memcpy(ret->payload, base, sizeof(*base));
+	}
+out:
+	if (runs != pdu->data)
+		free(runs);
+	return ret;
+}
+
+/*
+ * Handle the commands that carry stats and logs, these may run in a stat
+ * worker
+ */
+static void handle_stat_cmd(struct fio_client *client, struct fio_net_cmd *cmd)
+{
+	struct client_ops *ops = client->ops;
+	int size;
 
 	switch (cmd->opcode) {
-	case FIO_NET_CMD_QUIT:
-		if (ops->quit)
-			ops->quit(client, cmd);
-		remove_client(client);
-		break;
-	case FIO_NET_CMD_TEXT:
-		convert_text(cmd);
-		ops->text(client, cmd);
-		break;
 	case FIO_NET_CMD_DU: {
 		struct cmd_du_pdu *du = (struct cmd_du_pdu *) cmd->payload;
 
@@ -1784,14 +2237,33 @@ int fio_handle_client(struct fio_client *client)
 			size = le64_to_cpu(p->ts.ss_dur);
 			p->ts.ss_iops_data = (uint64_t *) ((struct cmd_ts_pdu *)cmd->payload + 1);
 			p->ts.ss_bw_data = p->ts.ss_iops_data + size;
+			p->ts.ss_lat_data = p->ts.ss_bw_data + size;
 		}
 
+		client_save_ts_base(client, p);
+
 		convert_ts(&p->ts, &p->ts);
 		convert_gs(&p->rs, &p->rs);
 
 		ops->thread_status(client, cmd);
 		break;
 		}
+	case FIO_NET_CMD_TS_DELTA: {
+		struct fio_net_cmd *ts_cmd;
+		struct cmd_ts_pdu *p;
+
+		ts_cmd = client_apply_ts_delta(client, cmd);
+		if (!ts_cmd)
+			break;
+
+		p = (struct cmd_ts_pdu *) ts_cmd->payload;
+		convert_ts(&p->ts, &p->ts);
+		convert_gs(&p->rs, &p->rs);
+
+		ops->thread_status(client, ts_cmd);
+		free(ts_cmd);
+		break;
+		}
 	case FIO_NET_CMD_GS: {
 		struct group_run_stats *gs = (struct group_run_stats *) cmd->payload;
 
@@ -1800,6 +2272,184 @@ int fio_handle_client(struct fio_client *client)
 		ops->group_stats(client, cmd);
 		break;
 		}
+	case FIO_NET_CMD_JOB_OPT:
+		handle_job_opt(client, cmd);
+		break;
+	case FIO_NET_CMD_IOLOG:
+		fio_client_handle_iolog(client, cmd);
+		break;
+	case FIO_NET_CMD_IOLOG_CHUNK:
+		fio_client_handle_iolog_chunk(client, cmd);
+		break;
+	}
+}
+
+static int client_stat_work(struct submit_worker *sw,
+			    struct workqueue_work *work)
+{
+	struct fio_client *client;
+	struct client_stat_cmd *sc;
+
+	client = container_of(work, struct fio_client, stat_work);
+	client->stat_sum = sw->priv;
+
+	do {
+		pthread_mutex_lock(&stat_lock);
+		if (flist_empty(&client->stat_list)) {
+			client->stat_sum = NULL;
+			client->stat_queued = false;
+			pthread_cond_broadcast(&stat_cond);
+			pthread_mutex_unlock(&stat_lock);
+			break;
+		}
+
+		sc = flist_first_entry(&client->stat_list,
+					struct client_stat_cmd, list);
+		flist_del(&sc->list);
+		pthread_mutex_unlock(&stat_lock);
+
+		handle_stat_cmd(client, sc->cmd);
+		free(sc->cmd);
+		free(sc);
+	} while (1);
+
+	return 0;
+}
+
+static int client_stat_alloc_worker(struct submit_worker *sw)
+{
+	struct client_stat_sum *sum;
+
+	sum = malloc(sizeof(*sum));
+	if (!sum)
+		return 1;
+
+	client_stat_sum_init(sum);
+	sw->priv = sum;
+	return 0;
+}
+
+static void client_stat_free_worker(struct submit_worker *sw)
+{
+	struct client_stat_sum *sum = sw->priv;
+
+	free(sum->hostname);
+	free(sum);
+}
+
+static void client_stat_exit_worker(struct submit_worker *sw,
+				    unsigned int *sum_cnt)
+{
+	client_stat_merge(sw->priv);
+}
+
+static struct workqueue_ops client_stat_wq_ops = {
+	.fn			= client_stat_work,
+	.alloc_worker_fn	= client_stat_alloc_worker,
+	.free_worker_fn		= client_stat_free_worker,
+	.exit_worker_fn		= client_stat_exit_worker,
+};
+
+/*
+ * Start the stat workers. Decoding and summing the stats of different
+ * clients then runs in parallel, while those of one client are still
+ * handled in the order they were received.
+ */
+static void client_stat_init(struct client_ops *ops)
+{
+	unsigned int workers;
+
+	client_stat_sum_init(&inline_stat_sum);
+
+	if (nr_clients < 2 || !ops->stat_workers)
+		return;
+
+	workers = min(ops->stat_workers, (unsigned int) nr_clients);
+	workers = min(workers, cpus_online());
+
+	if (!workqueue_init(NULL, &stat_wq, &client_stat_wq_ops, workers, NULL))
+		stat_wq_running = true;
+}
+
+static void client_stat_exit(void)
+{
+	if (stat_wq_running) {
+		workqueue_exit(&stat_wq);
+		stat_wq_running = false;
+	}
+
+	client_stat_merge(&inline_stat_sum);
+	client_show_stat_sum();
+}
+
+/*
+ * Hand a stats command to a stat worker. Returns false if it must be
+ * handled inline.
+ */
+static bool client_queue_stat_cmd(struct fio_client *client,
+				  struct fio_net_cmd *cmd)
+{
+	struct client_stat_cmd *sc;
+	bool queue;
+
+	if (!stat_wq_running || !client->ops->stat_workers)
+		return false;
+
+	sc = malloc(sizeof(*sc));
+	if (!sc)
+		return false;
+
+	sc->cmd = cmd;
+
+	pthread_mutex_lock(&stat_lock);
+	flist_add_tail(&sc->list, &client->stat_list);
+	queue = !client->stat_queued;
+	client->stat_queued = true;
+	pthread_mutex_unlock(&stat_lock);
+
+	if (queue)
+		workqueue_enqueue(&stat_wq, &client->stat_work);
+
+	return true;
+}
+
+int fio_handle_client(struct fio_client *client)
+{
+	struct client_ops *ops = client->ops;
+	struct fio_net_cmd *cmd;
+
+	dprint(FD_NET, "client: handle %s\n", client->hostname);
+
+	cmd = fio_net_recv_cmd(client->fd, true);
+	if (!cmd)
+		return 0;
+
+	dprint(FD_NET, "client: got cmd op %s from %s (pdu=%u)\n",
+		fio_server_op(cmd->opcode), client->hostname, cmd->pdu_len);
+
+	client->last_cmd = cmd->opcode;
+
+	switch (cmd->opcode) {
+	case FIO_NET_CMD_QUIT:
+		if (ops->quit)
+			ops->quit(client, cmd);
+		remove_client(client);
+		break;
+	case FIO_NET_CMD_TEXT:
+		convert_text(cmd);
+		ops->text(client, cmd);
+		break;
+	case FIO_NET_CMD_DU:
+	case FIO_NET_CMD_TS:
+	case FIO_NET_CMD_TS_DELTA:
+	case FIO_NET_CMD_GS:
+	case FIO_NET_CMD_JOB_OPT:
+	case FIO_NET_CMD_IOLOG:
+	case FIO_NET_CMD_IOLOG_CHUNK:
+		if (client_queue_stat_cmd(client, cmd))
+			return 1;
+		handle_stat_cmd(client, cmd);
+		break;
 	case FIO_NET_CMD_ETA: {
 		struct jobs_eta *je = (struct jobs_eta *) cmd->payload;
 
@@ -1845,9 +2495,6 @@ int fio_handle_client(struct fio_client *client)
 			ops->add_job(client, cmd);
 		break;
 		}
-	case FIO_NET_CMD_IOLOG:
-		fio_client_handle_iolog(client, cmd);
-		break;
 	case FIO_NET_CMD_UPDATE_JOB:
 		ops->update_job(client, cmd);
 		remove_reply_cmd(client, cmd);
@@ -1871,10 +2518,6 @@ int fio_handle_client(struct fio_client *client)
 		fio_send_file(client, pdu, cmd->tag);
 		break;
 		}
-	case FIO_NET_CMD_JOB_OPT: {
-		handle_job_opt(client, cmd);
-		break;
-	}
 	default:
 		log_err("fio: unknown client op: %s\n", fio_server_op(cmd->opcode));
 		break;
@@ -2048,15 +2691,30 @@ static int fio_check_clients_timed_out(void)
 
 int fio_handle_clients(struct client_ops *ops)
 {
+#ifdef CONFIG_LINUX_EPOLL
+	struct epoll_event *events;
+	int epfd;
+#else
 	struct pollfd *pfds;
-	int i, ret = 0, retval = 0;
+#endif
+	int i, nr_fds, ret = 0, retval = 0;
 
 	fio_gettime(&eta_ts, NULL);
 
+#ifdef CONFIG_LINUX_EPOLL
+	epfd = epoll_create(nr_clients ? nr_clients : 1);
+	if (epfd < 0) {
+		log_err("fio: epoll_create: %s\n", strerror(errno));
+		return 1;
+	}
+	events = malloc(nr_clients * sizeof(struct epoll_event));
+#else
 	pfds = malloc(nr_clients * sizeof(struct pollfd));
+#endif
 
 	init_thread_stat(&client_ts);
 	init_group_run_stat(&client_gs);
+	client_stat_init(ops);
 
 	while (!exit_backend && nr_clients) {
 		struct flist_head *entry, *tmp;
@@ -2072,8 +2730,21 @@ int fio_handle_clients(struct client_ops *ops)
 				continue;
 			}
 
+#ifdef CONFIG_LINUX_EPOLL
+			if (!client->polled) {
+				struct epoll_event ev = {
+					.events = EPOLLIN,
+					.data.fd = client->fd,
+				};
+
+				if (epoll_ctl(epfd, EPOLL_CTL_ADD, client->fd, &ev) < 0)
+					log_err("fio: epoll_ctl: %s\n", strerror(errno));
+				client->polled = true;
+			}
+#else
 			pfds[i].fd = client->fd;
 			pfds[i].events = POLLIN;
+#endif
 			i++;
 		}
 
@@ -2099,7 +2770,11 @@ int fio_handle_clients(struct client_ops *ops)
 
 			timeout = min(100u, ops->eta_msec);
 
+#ifdef CONFIG_LINUX_EPOLL
+			ret = epoll_wait(epfd, events, nr_clients, timeout);
+#else
 			ret = poll(pfds, nr_clients, timeout);
+#endif
 			if (ret < 0) {
 				if (errno == EINTR)
 					continue;
@@ -2109,13 +2784,30 @@ int fio_handle_clients(struct client_ops *ops)
 				continue;
 		} while (ret <= 0);
 
-		for (i = 0; i < nr_clients; i++) {
+		/*
+		 * epoll only returns the ready fds, poll needs all of them
+		 * checked. Clients may be removed below, so don't loop on
+		 * nr_clients.
+		 */
+#ifdef CONFIG_LINUX_EPOLL
+		nr_fds = ret > 0 ? ret : 0;
+#else
+		nr_fds = nr_clients;
+#endif
+		for (i = 0; i < nr_fds; i++) {
+			int fd;
+
+#ifdef CONFIG_LINUX_EPOLL
+			fd = events[i].data.fd;
+#else
 			if (!(pfds[i].revents & POLLIN))
 				continue;
+			fd = pfds[i].fd;
+#endif
 
-			client = find_client_by_fd(pfds[i].fd);
+			client = find_client_by_fd(fd);
 			if (!client) {
-				log_err("fio: unknown client fd %ld\n", (long) pfds[i].fd);
+				log_err("fio: unknown client fd %ld\n", (long) fd);
 				continue;
 			}
 			if (!fio_handle_client(client)) {
@@ -2129,9 +2821,15 @@ int fio_handle_clients(struct client_ops *ops)
 		}
 	}
 
+	client_stat_exit();
 	fio_client_json_fini();
 
+#ifdef CONFIG_LINUX_EPOLL
+	close(epfd);
+	free(events);
+#else
 	free(pfds);
+#endif
 	return retval || error_clients;
 }
 
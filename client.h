@@ -7,8 +7,10 @@
 
 #include "lib/types.h"
 #include "stat.h"
+#include "workqueue.h"
 
 struct fio_net_cmd;
+struct cmd_ts_pdu;
 
 enum {
 	Client_created		= 0,
@@ -75,6 +77,31 @@ struct fio_client {
 	struct client_file *files;
 	unsigned int nr_files;
 
+	/*
+	 * Last TS received for each thread_number, in wire format. TS
+	 * deltas are applied to these.
+	 */
+	struct cmd_ts_pdu **ts_base;
+	unsigned int nr_ts_base;
+
+	/*
+	 * Stats commands waiting for a stat worker. Only one worker handles
+	 * a client at a time, so they are processed in order.
+	 */
+	struct workqueue_work stat_work;
+	struct flist_head stat_list;
+	bool stat_queued;
+	struct client_stat_sum *stat_sum;
+	bool polled;
+
+	/*
+	 * Logs being streamed by the server, and the buffer their chunks
+	 * are decompressed into
+	 */
+	struct flist_head log_streams;
+	void *log_buf;
+	size_t log_buf_len;
+
 	struct buf_output buf;
 };
 
@@ -106,6 +133,12 @@ struct client_ops {
 	unsigned int eta_msec;
 	int stay_connected;
 	uint32_t client_type;
+
+	/*
+	 * Max number of threads decoding and summing stats, if more than
+	 * one client is connected. 0 handles them inline.
+	 */
+	unsigned int stat_workers;
 };
 
 struct client_eta {
@@ -141,6 +174,7 @@ extern int fio_client_wait_for_reply(struct fio_client *, uint64_t);
 extern int fio_clients_send_trigger(const char *);
 
 #define FIO_CLIENT_DEF_ETA_MSEC		900
+#define FIO_CLIENT_DEF_STAT_WORKERS	8
 
 enum {
 	FIO_CLIENT_TYPE_CLI		= 1,
@@ -21,6 +21,7 @@
 #define fio_exit	__attribute__((destructor))
 
 #define fio_unlikely(x)	__builtin_expect(!!(x), 0)
+#define fio_prefetch(x)	__builtin_prefetch(x)
 
 /*
  * Check at compile time that something is of a particular type.
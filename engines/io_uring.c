@@ -55,6 +55,10 @@ struct ioring_data {
 	struct iovec *iovecs;
 	unsigned sq_ring_mask;
 
+	/* fixedbufs, whole buffer area registered as one buffer */
+	struct iovec buf_area;
+	bool single_buf;
+
 	struct io_cq_ring cq_ring;
 	unsigned cq_ring_mask;
 
@@ -156,7 +160,8 @@ static int fio_ioring_prep(struct thread_data *td, struct io_u *io_u)
 				sqe->opcode = IORING_OP_WRITE_FIXED;
 			sqe->addr = (unsigned long) io_u->xfer_buf;
 			sqe->len = io_u->xfer_buflen;
-			sqe->buf_index = io_u->index;
+			if (!ld->single_buf)
+				sqe->buf_index = io_u->index;
 		} else {
 			if (io_u->ddir == DDIR_READ)
 				sqe->opcode = IORING_OP_READV;
@@ -478,8 +483,12 @@ static int fio_ioring_queue_init(struct thread_data *td)
 		if (setrlimit(RLIMIT_MEMLOCK, &rlim) < 0)
 			return -1;
 
-		ret = syscall(__NR_sys_io_uring_register, ld->ring_fd,
-				IORING_REGISTER_BUFFERS, ld->iovecs, depth);
+		if (ld->single_buf)
+			ret = syscall(__NR_sys_io_uring_register, ld->ring_fd,
+					IORING_REGISTER_BUFFERS, &ld->buf_area, 1);
+		else
+			ret = syscall(__NR_sys_io_uring_register, ld->ring_fd,
+					IORING_REGISTER_BUFFERS, ld->iovecs, depth);
 		if (ret < 0)
 			return ret;
 	}
@@ -487,9 +496,28 @@ static int fio_ioring_queue_init(struct thread_data *td)
 	return fio_ioring_mmap(ld, &p);
 }
 
+/*
+ * The kernel takes fixed buffers of up to 1GiB. If the buffer area of the
+ * job fits, it is registered as one buffer instead of one per io_u.
+ */
+static int fio_ioring_buf_area(struct thread_data *td, void *buf, size_t len,
+			       void *data)
+{
+	struct ioring_data *ld = data;
+
+	if (len > (1UL << 30))
+		return 1;
+
+	ld->buf_area.iov_base = buf;
+	ld->buf_area.iov_len = len;
+	ld->single_buf = true;
+	return 0;
+}
+
 static int fio_ioring_post_init(struct thread_data *td)
 {
 	struct ioring_data *ld = td->io_ops_data;
+	struct ioring_options *o = td->eo;
 	struct io_u *io_u;
 	int err, i;
 
@@ -501,6 +529,9 @@ static int fio_ioring_post_init(struct thread_data *td)
 		iov->iov_len = td_max_bs(td);
 	}
 
+	if (o->fixedbufs)
+		fio_register_io_mem(td, fio_ioring_buf_area, ld);
+
 	err = fio_ioring_queue_init(td);
 	if (err) {
 		td_verror(td, errno, "io_queue_init");
@@ -12,36 +12,147 @@
 
 #include "../fio.h"
 #include "../verify.h"
+#include "../optgroup.h"
+#include "../lib/memcpy.h"
+#include "../lib/getrusage.h"
 
 /*
  * Limits us to 1GiB of mapped files in total
  */
 #define MMAP_TOTAL_SZ	(1 * 1024 * 1024 * 1024UL)
 
-static unsigned long mmap_map_size;
+enum {
+	FIO_MMAP_HUGE_NONE	= 0,
+	FIO_MMAP_HUGE_THP,
+	FIO_MMAP_HUGE_HUGETLB,
+};
 
-struct fio_mmap_data {
+struct mmap_options {
+	void *pad;
+	unsigned int populate;
+	unsigned int huge;
+	unsigned int windows;
+	unsigned int fault_stats;
+};
+
+static struct fio_option options[] = {
+	{
+		.name	= "mmap_populate",
+		.lname	= "mmap populate",
+		.type	= FIO_OPT_BOOL,
+		.off1	= offsetof(struct mmap_options, populate),
+		.help	= "Prefault mappings with MAP_POPULATE",
+		.def	= "0",
+		.category = FIO_OPT_C_ENGINE,
+		.group	= FIO_OPT_G_MMAP,
+	},
+	{
+		.name	= "mmap_huge",
+		.lname	= "mmap huge pages",
+		.type	= FIO_OPT_STR,
+		.off1	= offsetof(struct mmap_options, huge),
+		.help	= "Back mappings with huge pages",
+		.def	= "none",
+		.posval = {
+			  { .ival = "none",
+			    .oval = FIO_MMAP_HUGE_NONE,
+			    .help = "Use regular pages",
+			  },
+			  { .ival = "thp",
+			    .oval = FIO_MMAP_HUGE_THP,
+			    .help = "Ask for transparent huge pages with MADV_HUGEPAGE",
+			  },
+			  { .ival = "hugetlb",
+			    .oval = FIO_MMAP_HUGE_HUGETLB,
+			    .help = "Map with MAP_HUGETLB, file must be on hugetlbfs",
+			  },
+		},
+		.category = FIO_OPT_C_ENGINE,
+		.group	= FIO_OPT_G_MMAP,
+	},
+	{
+		.name	= "mmap_windows",
+		.lname	= "mmap window cache size",
+		.type	= FIO_OPT_INT,
+		.off1	= offsetof(struct mmap_options, windows),
+		.help	= "Number of partial file mappings kept per file",
+		.def	= "1",
+		.minval	= 1,
+		.maxval	= 1024,
+		.category = FIO_OPT_C_ENGINE,
+		.group	= FIO_OPT_G_MMAP,
+	},
+	{
+		.name	= "mmap_fault_stats",
+		.lname	= "mmap page fault statistics",
+		.type	= FIO_OPT_BOOL,
+		.off1	= offsetof(struct mmap_options, fault_stats),
+		.help	= "Count page faults taken by each I/O",
+		.def	= "0",
+		.category = FIO_OPT_C_ENGINE,
+		.group	= FIO_OPT_G_MMAP,
+	},
+	{
+		.name	= NULL,
+	},
+};
+
+struct mmapio_data {
+	unsigned long map_size;
+	unsigned long align;
+
+	uint64_t maps;
+	uint64_t hits;
+
+	/*
+	 * Page fault accounting, see mmap_fault_stats
+	 */
+	uint64_t ios;
+	uint64_t fault_ios;
+	uint64_t minflt;
+	uint64_t majflt;
+	uint64_t fault_nsec;
+	uint64_t nofault_nsec;
+};
+
+/*
+ * A mapped region of a file
+ */
+struct fio_mmap_window {
 	void *mmap_ptr;
 	size_t mmap_sz;
 	off_t mmap_off;
+	uint64_t last_use;
 };
 
-static bool fio_madvise_file(struct thread_data *td, struct fio_file *f,
-			     size_t length)
+struct fio_mmap_data {
+	struct fio_mmap_window *win;
+	unsigned int nr_win;
+	uint64_t clock;
+};
 
+static bool fio_madvise_file(struct thread_data *td, void *ptr, size_t length)
 {
-	struct fio_mmap_data *fmd = FILE_ENG_DATA(f);
+	struct mmap_options *o = td->eo;
+
+#ifdef MADV_HUGEPAGE
+	if (o->huge == FIO_MMAP_HUGE_THP &&
+	    madvise(ptr, length, MADV_HUGEPAGE) < 0) {
+		td_verror(td, errno, "madvise");
+		return false;
+	}
+#endif
 
 	if (!td->o.fadvise_hint)
 		return true;
 
 	if (!td_random(td)) {
-		if (posix_madvise(fmd->mmap_ptr, length, POSIX_MADV_SEQUENTIAL) < 0) {
+		if (posix_madvise(ptr, length, POSIX_MADV_SEQUENTIAL) < 0) {
 			td_verror(td, errno, "madvise");
 			return false;
 		}
 	} else {
-		if (posix_madvise(fmd->mmap_ptr, length, POSIX_MADV_RANDOM) < 0) {
+		if (posix_madvise(ptr, length, POSIX_MADV_RANDOM) < 0) {
 			td_verror(td, errno, "madvise");
 			return false;
 		}
@@ -51,10 +162,11 @@ static bool fio_madvise_file(struct thread_data *td, struct fio_file *f,
 }
 
 static int fio_mmap_file(struct thread_data *td, struct fio_file *f,
-			 size_t length, off_t off)
+			 struct fio_mmap_window *w, size_t length, off_t off)
 {
-	struct fio_mmap_data *fmd = FILE_ENG_DATA(f);
-	int flags = 0;
+	struct mmapio_data *md = td->io_ops_data;
+	struct mmap_options *o = td->eo;
+	int flags = 0, mflags = MAP_SHARED;
 
 	if (td_rw(td) && !td->o.verify_only)
 		flags = PROT_READ | PROT_WRITE;
@@ -66,29 +178,43 @@ static int fio_mmap_file(struct thread_data *td, struct fio_file *f,
 	} else
 		flags = PROT_READ;
 
-	fmd->mmap_ptr = mmap(NULL, length, flags, MAP_SHARED, f->fd, off);
-	if (fmd->mmap_ptr == MAP_FAILED) {
-		fmd->mmap_ptr = NULL;
+#ifdef MAP_POPULATE
+	if (o->populate)
+		mflags |= MAP_POPULATE;
+#endif
+	if (o->huge == FIO_MMAP_HUGE_HUGETLB)
+		mflags |= MAP_HUGETLB;
+
+	md->maps++;
+	w->mmap_ptr = mmap(NULL, length, flags, mflags, f->fd, off);
+	if (w->mmap_ptr == MAP_FAILED) {
+		w->mmap_ptr = NULL;
 		td_verror(td, errno, "mmap");
 		goto err;
 	}
 
-	if (!fio_madvise_file(td, f, length))
+	if (!fio_madvise_file(td, w->mmap_ptr, length))
 		goto err;
 
-	if (posix_madvise(fmd->mmap_ptr, length, POSIX_MADV_DONTNEED) < 0) {
+	/*
+	 * Dropping the pages would undo MAP_POPULATE
+	 */
+	if (!o->populate &&
+	    posix_madvise(w->mmap_ptr, length, POSIX_MADV_DONTNEED) < 0) {
 		td_verror(td, errno, "madvise");
 		goto err;
 	}
 
 #ifdef FIO_MADV_FREE
-	if (f->filetype == FIO_TYPE_BLOCK)
-		(void) posix_madvise(fmd->mmap_ptr, fmd->mmap_sz, FIO_MADV_FREE);
+	if (f->filetype == FIO_TYPE_BLOCK && !o->populate)
+		(void) posix_madvise(w->mmap_ptr, length, FIO_MADV_FREE);
 #endif
 
 err:
-	if (td->error && fmd->mmap_ptr)
-		munmap(fmd->mmap_ptr, length);
+	if (td->error && w->mmap_ptr) {
+		munmap(w->mmap_ptr, length);
+		w->mmap_ptr = NULL;
+	}
 
 	return td->error;
 }
@@ -96,104 +222,210 @@ err:
 /*
  * Just mmap an appropriate portion, we cannot mmap the full extent
  */
-static int fio_mmapio_prep_limited(struct thread_data *td, struct io_u *io_u)
+static int fio_mmapio_prep_limited(struct thread_data *td, struct io_u *io_u,
+				   struct fio_mmap_window *w)
 {
+	struct mmapio_data *md = td->io_ops_data;
 	struct fio_file *f = io_u->file;
-	struct fio_mmap_data *fmd = FILE_ENG_DATA(f);
 
-	if (io_u->buflen > mmap_map_size) {
+	w->mmap_off = io_u->offset & ~((unsigned long long) md->align - 1);
+
+	if (io_u->offset - w->mmap_off + io_u->buflen > md->map_size) {
 		log_err("fio: bs too big for mmap engine\n");
 		return EIO;
 	}
 
-	fmd->mmap_sz = mmap_map_size;
-	if (fmd->mmap_sz  > f->io_size)
-		fmd->mmap_sz = f->io_size;
+	w->mmap_sz = md->map_size;
+	if (w->mmap_sz  > f->io_size)
+		w->mmap_sz = f->io_size;
+	if (w->mmap_sz < io_u->offset - w->mmap_off + io_u->buflen)
+		w->mmap_sz = io_u->offset - w->mmap_off + io_u->buflen;
 
-	fmd->mmap_off = io_u->offset;
-
-	return fio_mmap_file(td, f, fmd->mmap_sz, fmd->mmap_off);
+	return fio_mmap_file(td, f, w, w->mmap_sz, w->mmap_off);
 }
 
 /*
  * Attempt to mmap the entire file
  */
-static int fio_mmapio_prep_full(struct thread_data *td, struct io_u *io_u)
+static int fio_mmapio_prep_full(struct thread_data *td, struct io_u *io_u,
+				struct fio_mmap_window *w)
 {
 	struct fio_file *f = io_u->file;
-	struct fio_mmap_data *fmd = FILE_ENG_DATA(f);
+	uint64_t end = f->file_offset + f->io_size;
 	int ret;
 
 	if (fio_file_partial_mmap(f))
 		return EINVAL;
-	if (io_u->offset != (size_t) io_u->offset ||
-	    f->io_size != (size_t) f->io_size) {
+	if (io_u->offset != (size_t) io_u->offset || end != (size_t) end) {
 		fio_file_set_partial_mmap(f);
 		return EINVAL;
 	}
 
-	fmd->mmap_sz = f->io_size;
-	fmd->mmap_off = 0;
+	w->mmap_sz = end;
+	w->mmap_off = 0;
 
-	ret = fio_mmap_file(td, f, fmd->mmap_sz, fmd->mmap_off);
+	ret = fio_mmap_file(td, f, w, w->mmap_sz, w->mmap_off);
 	if (ret)
 		fio_file_set_partial_mmap(f);
 
 	return ret;
 }
 
+/*
+ * Find a mapping covering the io_u, or the least recently used one to
+ * replace.
+ */
+static struct fio_mmap_window *fio_mmapio_find(struct fio_mmap_data *fmd,
+					       struct io_u *io_u, bool *hit)
+{
+	struct fio_mmap_window *w, *lru = NULL;
+	unsigned int i;
+
+	for (i = 0; i < fmd->nr_win; i++) {
+		w = &fmd->win[i];
+
+		if (!w->mmap_ptr) {
+			if (!lru || lru->mmap_ptr)
+				lru = w;
+			continue;
+		}
+
+		if (io_u->offset >= w->mmap_off &&
+		    io_u->offset + io_u->buflen <= w->mmap_off + w->mmap_sz) {
+			*hit = true;
+			return w;
+		}
+
+		if (!lru || (lru->mmap_ptr && w->last_use < lru->last_use))
+			lru = w;
+	}
+
+	*hit = false;
+	return lru;
+}
+
 static int fio_mmapio_prep(struct thread_data *td, struct io_u *io_u)
 {
+	struct mmapio_data *md = td->io_ops_data;
 	struct fio_file *f = io_u->file;
 	struct fio_mmap_data *fmd = FILE_ENG_DATA(f);
+	struct fio_mmap_window *w;
+	bool hit;
 	int ret;
 
 	/*
-	 * It fits within existing mapping, use it
+	 * It fits within an existing mapping, use it
 	 */
-	if (io_u->offset >= fmd->mmap_off &&
-	    io_u->offset + io_u->buflen <= fmd->mmap_off + fmd->mmap_sz)
+	w = fio_mmapio_find(fmd, io_u, &hit);
+	if (hit) {
+		md->hits++;
 		goto done;
+	}
 
 	/*
-	 * unmap any existing mapping
+	 * unmap the mapping we are replacing
 	 */
-	if (fmd->mmap_ptr) {
-		if (munmap(fmd->mmap_ptr, fmd->mmap_sz) < 0)
+	if (w->mmap_ptr) {
+		if (munmap(w->mmap_ptr, w->mmap_sz) < 0)
 			return errno;
-		fmd->mmap_ptr = NULL;
+		w->mmap_ptr = NULL;
 	}
 
-	if (fio_mmapio_prep_full(td, io_u)) {
+	/*
+	 * With a window cache, always map windows rather than the full file
+	 */
+	if (fmd->nr_win > 1 || fio_mmapio_prep_full(td, io_u, w)) {
 		td_clear_error(td);
-		ret = fio_mmapio_prep_limited(td, io_u);
+		ret = fio_mmapio_prep_limited(td, io_u, w);
 		if (ret)
 			return ret;
 	}
 
 done:
-	io_u->mmap_data = fmd->mmap_ptr + io_u->offset - fmd->mmap_off -
-				f->file_offset;
+	w->last_use = ++fmd->clock;
+	io_u->mmap_data = w->mmap_ptr + io_u->offset - w->mmap_off;
+	return 0;
+}
+
+static int fio_mmapio_sync(struct thread_data *td, struct fio_file *f)
+{
+	struct fio_mmap_data *fmd = FILE_ENG_DATA(f);
+	unsigned int i;
+
+	for (i = 0; i < fmd->nr_win; i++) {
+		struct fio_mmap_window *w = &fmd->win[i];
+
+		if (w->mmap_ptr && msync(w->mmap_ptr, w->mmap_sz, MS_SYNC))
+			return errno;
+	}
+
 	return 0;
 }
 
+/*
+ * Copy with the page faults taken by the thread counted. The copy time of
+ * I/Os that faulted and of those that didn't is kept apart, so the cost
+ * of a fault can be told from the cost of the copy.
+ */
+static void fio_mmapio_copy_faults(struct thread_data *td, struct io_u *io_u,
+				   void *dst, void *src)
+{
+	struct mmapio_data *md = td->io_ops_data;
+	struct rusage ru_start, ru_end;
+	unsigned long minflt, majflt;
+	struct timespec start;
+	uint64_t nsec;
+
+	fio_getrusage(&ru_start);
+	fio_gettime(&start, NULL);
+
+	fio_memcpy(dst, src, io_u->xfer_buflen);
+
+	nsec = ntime_since_now(&start);
+	fio_getrusage(&ru_end);
+
+	minflt = ru_end.ru_minflt - ru_start.ru_minflt;
+	majflt = ru_end.ru_majflt - ru_start.ru_majflt;
+
+	dprint(FD_IO, "mmap: io_u %p: minflt=%lu majflt=%lu nsec=%llu\n",
+		io_u, minflt, majflt, (unsigned long long) nsec);
+
+	md->ios++;
+	md->minflt += minflt;
+	md->majflt += majflt;
+	if (minflt || majflt) {
+		md->fault_ios++;
+		md->fault_nsec += nsec;
+	} else
+		md->nofault_nsec += nsec;
+}
+
 static enum fio_q_status fio_mmapio_queue(struct thread_data *td,
 					  struct io_u *io_u)
 {
+	struct mmap_options *o = td->eo;
 	struct fio_file *f = io_u->file;
-	struct fio_mmap_data *fmd = FILE_ENG_DATA(f);
 
 	fio_ro_check(td, io_u);
 
-	if (io_u->ddir == DDIR_READ)
-		memcpy(io_u->xfer_buf, io_u->mmap_data, io_u->xfer_buflen);
-	else if (io_u->ddir == DDIR_WRITE)
-		memcpy(io_u->mmap_data, io_u->xfer_buf, io_u->xfer_buflen);
-	else if (ddir_sync(io_u->ddir)) {
-		if (msync(fmd->mmap_ptr, fmd->mmap_sz, MS_SYNC)) {
-			io_u->error = errno;
+	if (io_u->ddir == DDIR_READ) {
+		if (o->fault_stats)
+			fio_mmapio_copy_faults(td, io_u, io_u->xfer_buf,
+						io_u->mmap_data);
+		else
+			fio_memcpy(io_u->xfer_buf, io_u->mmap_data,
+					io_u->xfer_buflen);
+	} else if (io_u->ddir == DDIR_WRITE) {
+		if (o->fault_stats)
+			fio_mmapio_copy_faults(td, io_u, io_u->mmap_data,
+						io_u->xfer_buf);
+		else
+			fio_memcpy(io_u->mmap_data, io_u->xfer_buf,
+					io_u->xfer_buflen);
+	} else if (ddir_sync(io_u->ddir)) {
+		io_u->error = fio_mmapio_sync(td, f);
+		if (io_u->error)
 			td_verror(td, io_u->error, "msync");
-		}
 	} else if (io_u->ddir == DDIR_TRIM) {
 		int ret = do_io_u_trim(td, io_u);
 
@@ -222,6 +454,8 @@ static enum fio_q_status fio_mmapio_queue(struct thread_data *td,
 static int fio_mmapio_init(struct thread_data *td)
 {
 	struct thread_options *o = &td->o;
+	struct mmap_options *eo = td->eo;
+	struct mmapio_data *md;
 
 	if ((o->rw_min_bs & page_mask) &&
 	    (o->odirect || o->fsync_blocks || o->fdatasync_blocks)) {
@@ -230,12 +464,93 @@ static int fio_mmapio_init(struct thread_data *td)
 		return 1;
 	}
 
-	mmap_map_size = MMAP_TOTAL_SZ / o->nr_files;
+#ifndef MAP_POPULATE
+	if (eo->populate) {
+		log_err("fio: mmap_populate isn't supported on this platform\n");
+		return 1;
+	}
+#endif
+#ifndef MADV_HUGEPAGE
+	if (eo->huge == FIO_MMAP_HUGE_THP) {
+		log_err("fio: mmap_huge=thp isn't supported on this platform\n");
+		return 1;
+	}
+#endif
+#ifndef FIO_HAVE_MMAP_HUGE
+	if (eo->huge == FIO_MMAP_HUGE_HUGETLB) {
+		log_err("fio: mmap_huge=hugetlb isn't supported on this platform\n");
+		return 1;
+	}
+#endif
+
+	md = calloc(1, sizeof(*md));
+	if (!md)
+		return 1;
+
+	/*
+	 * Partial mappings of huge page backed files must start on a huge
+	 * page boundary, and THP can only map aligned ranges with huge pages
+	 */
+	md->align = page_size;
+	if (eo->huge != FIO_MMAP_HUGE_NONE)
+		md->align = o->hugepage_size;
+
+	md->map_size = MMAP_TOTAL_SZ / o->nr_files / eo->windows;
+	md->map_size &= ~(md->align - 1);
+	if (!md->map_size)
+		md->map_size = md->align;
+
+	td->io_ops_data = md;
+	fio_memcpy_init();
 	return 0;
 }
 
+static void fio_mmapio_report(struct thread_data *td)
+{
+	struct mmapio_data *md = td->io_ops_data;
+	struct mmap_options *o = td->eo;
+	uint64_t nofault_ios;
+
+	if (!(output_format & FIO_OUTPUT_NORMAL))
+		return;
+
+	if (o->windows > 1)
+		log_info("%s: mmap maps=%llu, window hits=%llu\n", td->o.name,
+			 (unsigned long long) md->maps,
+			 (unsigned long long) md->hits);
+
+	if (!o->fault_stats || !md->ios)
+		return;
+
+	nofault_ios = md->ios - md->fault_ios;
+	log_info("%s: mmap faults minor=%llu (%.2f/io), major=%llu (%.2f/io), "
+		 "copy nsec/io with faults=%llu (%llu ios), without=%llu "
+		 "(%llu ios)\n", td->o.name,
+		 (unsigned long long) md->minflt,
+		 (double) md->minflt / md->ios,
+		 (unsigned long long) md->majflt,
+		 (double) md->majflt / md->ios,
+		 (unsigned long long) (md->fault_ios ?
+				md->fault_nsec / md->fault_ios : 0),
+		 (unsigned long long) md->fault_ios,
+		 (unsigned long long) (nofault_ios ?
+				md->nofault_nsec / nofault_ios : 0),
+		 (unsigned long long) nofault_ios);
+}
+
+static void fio_mmapio_cleanup(struct thread_data *td)
+{
+	struct mmapio_data *md = td->io_ops_data;
+
+	if (md) {
+		fio_mmapio_report(td);
+		free(md);
+	}
+}
+
 static int fio_mmapio_open_file(struct thread_data *td, struct fio_file *f)
 {
+	struct mmap_options *o = td->eo;
 	struct fio_mmap_data *fmd;
 	int ret;
 
@@ -244,8 +559,13 @@ static int fio_mmapio_open_file(struct thread_data *td, struct fio_file *f)
 		return ret;
 
 	fmd = calloc(1, sizeof(*fmd));
-	if (!fmd) {
+	if (fmd) {
+		fmd->nr_win = o->windows;
+		fmd->win = calloc(fmd->nr_win, sizeof(struct fio_mmap_window));
+	}
+	if (!fmd || !fmd->win) {
 		int fio_unused __ret;
+		free(fmd);
 		__ret = generic_close_file(td, f);
 		return 1;
 	}
@@ -257,8 +577,17 @@ static int fio_mmapio_open_file(struct thread_data *td, struct fio_file *f)
 static int fio_mmapio_close_file(struct thread_data *td, struct fio_file *f)
 {
 	struct fio_mmap_data *fmd = FILE_ENG_DATA(f);
+	unsigned int i;
+
+	for (i = 0; i < fmd->nr_win; i++) {
+		struct fio_mmap_window *w = &fmd->win[i];
+
+		if (w->mmap_ptr)
+			munmap(w->mmap_ptr, w->mmap_sz);
+	}
 
 	FILE_SET_ENG_DATA(f, NULL);
+	free(fmd->win);
 	free(fmd);
 	fio_file_clear_partial_mmap(f);
 
@@ -271,10 +600,13 @@ static struct ioengine_ops ioengine = {
 	.init		= fio_mmapio_init,
 	.prep		= fio_mmapio_prep,
 	.queue		= fio_mmapio_queue,
+	.cleanup	= fio_mmapio_cleanup,
 	.open_file	= fio_mmapio_open_file,
 	.close_file	= fio_mmapio_close_file,
 	.get_file_size	= generic_get_file_size,
 	.flags		= FIO_SYNCIO | FIO_NOEXTEND,
+	.options	= options,
+	.option_struct_size	= sizeof(struct mmap_options),
 };
 
 static void fio_init fio_mmapio_register(void)
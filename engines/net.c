@@ -9,6 +9,8 @@
 #include <unistd.h>
 #include <signal.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <math.h>
 #include <netinet/in.h>
 #include <netinet/tcp.h>
 #include <arpa/inet.h>
@@ -17,10 +19,57 @@
 #include <sys/stat.h>
 #include <sys/socket.h>
 #include <sys/un.h>
+#include <sys/mman.h>
+#ifdef CONFIG_NET_ZEROCOPY
+#include <linux/errqueue.h>
+#endif
+#ifdef CONFIG_LINUX_EPOLL
+#include <sys/epoll.h>
+#endif
 
 #include "../fio.h"
 #include "../verify.h"
 #include "../optgroup.h"
+#include "../lib/getrusage.h"
+
+struct netasync_req {
+	struct io_u *io_u;
+	struct timespec start;
+};
+
+/*
+ * FIFO of requests, sized to the job iodepth so it can never overflow
+ */
+struct netasync_ring {
+	struct netasync_req *reqs;
+	unsigned int entries;
+	unsigned int head;
+	unsigned int tail;
+	unsigned int nr;
+};
+
+/*
+ * Per connection (file) state for the netasync engine. A request moves
+ * from the send to the receive queue for a ping-pong client, and the other
+ * way around for a ping-pong server. A TCP stream is ordered, so the head
+ * of each queue is the one being transferred.
+ */
+struct netasync_conn {
+	struct netasync_ring sendq;
+	struct netasync_ring recvq;
+	unsigned long long send_off;
+	unsigned long long recv_off;
+	bool readable;
+	bool writable;
+	bool eof;
+
+	uint64_t ios;
+	uint64_t lat_min;
+	uint64_t lat_max;
+	double lat_sum;
+	double lat_sum_sq;
+	uint64_t *lat_plat;
+};
 
 struct netio_data {
 	int listenfd;
@@ -32,6 +81,48 @@ struct netio_data {
 	struct sockaddr_un addr_un;
 	uint64_t udp_send_seq;
 	uint64_t udp_recv_seq;
+
+	/*
+	 * MSG_ZEROCOPY send state. The kernel numbers zerocopy sends on a
+	 * socket from zero, and reports released ranges on the error queue.
+	 */
+	uint32_t zc_send_id;
+	uint32_t zc_done_id;
+	uint64_t zc_sends;
+	uint64_t zc_copied;
+
+	/*
+	 * Sent io_us waiting for their pages to be released, in send order,
+	 * with the zerocopy ID of each, and the reaped ones handed back
+	 * through ->event()
+	 */
+	struct io_u **zc_queued;
+	uint32_t *zc_ids;
+	struct io_u **zc_events;
+	unsigned int zc_entries;
+	unsigned int zc_head;
+	unsigned int zc_tail;
+	unsigned int zc_nr_queued;
+	bool zc_last_queued;
+
+	/*
+	 * TCP_ZEROCOPY_RECEIVE mapping of the socket
+	 */
+	void *zc_map;
+	size_t zc_map_len;
+	uint64_t zc_recv_mapped;
+	uint64_t zc_recv_copied;
+
+	struct rusage ru_start;
+
+	/*
+	 * netasync state
+	 */
+	int epfd;
+	unsigned int nr_eof;
+	struct netasync_ring completed;
+	struct io_u **async_events;
+	struct epoll_event *ep_events;
 };
 
 struct netio_options {
@@ -44,6 +135,8 @@ struct netio_options {
 	unsigned int ttl;
 	unsigned int window_size;
 	unsigned int mss;
+	unsigned int zerocopy;
+	unsigned int connections;
 	char *intfc;
 };
 
@@ -202,6 +295,31 @@ static struct fio_option options[] = {
 		.category = FIO_OPT_C_ENGINE,
 		.group	= FIO_OPT_G_NETIO,
 	},
+#endif
+#ifdef CONFIG_LINUX_EPOLL
+	{
+		.name	= "connections",
+		.lname	= "Connections",
+		.type	= FIO_OPT_INT,
+		.off1	= offsetof(struct netio_options, connections),
+		.minval	= 1,
+		.help	= "Number of connections to drive from one job (netasync)",
+		.def	= "1",
+		.category = FIO_OPT_C_ENGINE,
+		.group	= FIO_OPT_G_NETIO,
+	},
+#endif
+#if defined(CONFIG_NET_ZEROCOPY) || defined(CONFIG_TCP_ZEROCOPY_RECEIVE)
+	{
+		.name	= "zerocopy",
+		.lname	= "Zero copy",
+		.type	= FIO_OPT_BOOL,
+		.off1	= offsetof(struct netio_options, zerocopy),
+		.help	= "Use MSG_ZEROCOPY sends and TCP_ZEROCOPY_RECEIVE",
+		.def	= "0",
+		.category = FIO_OPT_C_ENGINE,
+		.group	= FIO_OPT_G_NETIO,
+	},
 #endif
 	{
 		.name	= NULL,
@@ -281,6 +399,41 @@ static int set_mss(struct thread_data *td, int fd)
 #endif
 }
 
+static int set_zerocopy(struct thread_data *td, int fd)
+{
+	struct netio_options *o = td->eo;
+	struct netio_data *nd = td->io_ops_data;
+
+	if (!o->zerocopy)
+		return 0;
+
+#ifdef CONFIG_NET_ZEROCOPY
+	if (!o->listen || o->pingpong) {
+		int one = 1;
+
+		if (setsockopt(fd, SOL_SOCKET, SO_ZEROCOPY, (void *) &one,
+				sizeof(one)) < 0) {
+			td_verror(td, errno, "setsockopt SO_ZEROCOPY");
+			return 1;
+		}
+		nd->zc_send_id = nd->zc_done_id = 0;
+	}
+#endif
+#ifdef CONFIG_TCP_ZEROCOPY_RECEIVE
+	if (o->listen || o->pingpong) {
+		nd->zc_map_len = (td->o.max_bs[DDIR_READ] + page_size - 1) &
+					~(page_size - 1);
+		nd->zc_map = mmap(NULL, nd->zc_map_len, PROT_READ, MAP_SHARED,
+					fd, 0);
+		if (nd->zc_map == MAP_FAILED) {
+			nd->zc_map = NULL;
+			td_verror(td, errno, "mmap zerocopy receive");
+			return 1;
+		}
+	}
+#endif
+	return 0;
+}
 
 /*
  * Return -1 for error and 'nr events' for a positive number
@@ -522,6 +675,207 @@ static void verify_udp_seq(struct thread_data *td, struct netio_data *nd,
 	nd->udp_recv_seq = seq + 1;
 }
 
+#ifdef CONFIG_NET_ZEROCOPY
+/*
+ * Reap MSG_ZEROCOPY notifications from the socket error queue. Returns
+ * the number of notifications seen, 0 if none were pending, or -1 on error.
+ */
+static int fio_netio_zc_reap(struct thread_data *td, int fd)
+{
+	struct netio_data *nd = td->io_ops_data;
+	char control[CMSG_SPACE(sizeof(struct sock_extended_err)) + 64];
+	struct sock_extended_err *serr;
+	struct msghdr msg;
+	struct cmsghdr *cm;
+	int reaped = 0;
+
+	do {
+		memset(&msg, 0, sizeof(msg));
+		msg.msg_control = control;
+		msg.msg_controllen = sizeof(control);
+
+		if (recvmsg(fd, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0) {
+			if (errno == EAGAIN || errno == EWOULDBLOCK)
+				break;
+			if (errno == EINTR)
+				continue;
+			td_verror(td, errno, "recvmsg MSG_ERRQUEUE");
+			return -1;
+		}
+
+		for (cm = CMSG_FIRSTHDR(&msg); cm; cm = CMSG_NXTHDR(&msg, cm)) {
+			uint32_t lo, hi;
+
+			serr = (struct sock_extended_err *) CMSG_DATA(cm);
+			if (serr->ee_origin != SO_EE_ORIGIN_ZEROCOPY)
+				continue;
+			if (serr->ee_errno) {
+				td_verror(td, serr->ee_errno, "zerocopy send");
+				return -1;
+			}
+
+			lo = serr->ee_info;
+			hi = serr->ee_data;
+			if (serr->ee_code & SO_EE_CODE_ZEROCOPY_COPIED)
+				nd->zc_copied += hi - lo + 1;
+			if ((int32_t) (hi + 1 - nd->zc_done_id) > 0)
+				nd->zc_done_id = hi + 1;
+			reaped++;
+		}
+	} while (1);
+
+	return reaped;
+}
+
+/*
+ * Wait for zerocopy notifications for up to 'msec' (-1 for no limit).
+ * A pending error queue is signalled as POLLERR, which poll always reports.
+ */
+static int fio_netio_zc_poll(struct thread_data *td, int fd, int msec)
+{
+	struct pollfd pfd;
+	int ret;
+
+	ret = fio_netio_zc_reap(td, fd);
+	if (ret)
+		return ret;
+
+	pfd.fd = fd;
+	pfd.events = 0;
+	ret = poll(&pfd, 1, msec);
+	if (ret < 0 && errno != EINTR) {
+		td_verror(td, errno, "poll");
+		return -1;
+	}
+
+	return fio_netio_zc_reap(td, fd);
+}
+
+/*
+ * Wait until the kernel has released the pages of zerocopy send 'id',
+ * the io_u buffer can't be reused before that.
+ */
+static int fio_netio_zc_wait(struct thread_data *td, int fd, uint32_t id)
+{
+	struct netio_data *nd = td->io_ops_data;
+
+	while ((int32_t) (nd->zc_done_id - id) <= 0) {
+		if (td->terminate)
+			return -1;
+		if (fio_netio_zc_poll(td, fd, -1) < 0)
+			return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * Send with MSG_ZEROCOPY. A full send of a non ping-pong io_u is left
+ * queued, and completes through ->getevents() once the kernel releases
+ * its pages. Partial sends are waited for here, since they complete with
+ * a residual and fio will reuse the buffer for the rest right away.
+ */
+static int fio_netio_send_zc(struct thread_data *td, struct io_u *io_u,
+			     int flags)
+{
+	struct netio_data *nd = td->io_ops_data;
+	struct netio_options *o = td->eo;
+	int ret, fd = io_u->file->fd;
+	uint32_t id;
+
+	do {
+		ret = send(fd, io_u->xfer_buf, io_u->xfer_buflen,
+				flags | MSG_ZEROCOPY);
+		if (ret >= 0 || errno != ENOBUFS)
+			break;
+
+		/*
+		 * Out of option memory for pinned pages, wait for some of
+		 * the outstanding sends to be released
+		 */
+		if (nd->zc_send_id == nd->zc_done_id)
+			break;
+		if (fio_netio_zc_poll(td, fd, -1) < 0)
+			return -1;
+	} while (1);
+
+	if (ret <= 0)
+		return ret;
+
+	nd->zc_sends++;
+	id = nd->zc_send_id++;
+
+	if (ret == (int) io_u->xfer_buflen && !o->pingpong) {
+		nd->zc_queued[nd->zc_tail] = io_u;
+		nd->zc_ids[nd->zc_tail] = id;
+		nd->zc_tail = (nd->zc_tail + 1) % nd->zc_entries;
+		nd->zc_nr_queued++;
+		nd->zc_last_queued = true;
+		return ret;
+	}
+
+	if (fio_netio_zc_wait(td, fd, id))
+		return -1;
+
+	return ret;
+}
+
+static int fio_netio_getevents(struct thread_data *td, unsigned int min,
+			       unsigned int max, const struct timespec *t)
+{
+	struct netio_data *nd = td->io_ops_data;
+	int msec = t ? t->tv_sec * 1000 + t->tv_nsec / 1000000 : -1;
+	unsigned int events = 0;
+	struct io_u *io_u;
+
+	do {
+		while (nd->zc_nr_queued && events < max) {
+			if ((int32_t) (nd->zc_done_id -
+				       nd->zc_ids[nd->zc_head]) <= 0)
+				break;
+
+			nd->zc_events[events++] = nd->zc_queued[nd->zc_head];
+			nd->zc_head = (nd->zc_head + 1) % nd->zc_entries;
+			nd->zc_nr_queued--;
+		}
+
+		if (events >= min || !nd->zc_nr_queued || td->terminate)
+			break;
+
+		io_u = nd->zc_queued[nd->zc_head];
+		if (fio_netio_zc_poll(td, io_u->file->fd, msec) < 0)
+			return -1;
+	} while (t == NULL);
+
+	return events;
+}
+
+static struct io_u *fio_netio_event(struct thread_data *td, int event)
+{
+	struct netio_data *nd = td->io_ops_data;
+
+	return nd->zc_events[event];
+}
+#else
+static int fio_netio_send_zc(struct thread_data *td, struct io_u *io_u,
+			     int flags)
+{
+	errno = EOPNOTSUPP;
+	return -1;
+}
+
+static int fio_netio_getevents(struct thread_data *td, unsigned int min,
+			       unsigned int max, const struct timespec *t)
+{
+	return 0;
+}
+
+static struct io_u *fio_netio_event(struct thread_data *td, int event)
+{
+	return NULL;
+}
+#endif
+
 static int fio_netio_send(struct thread_data *td, struct io_u *io_u)
 {
 	struct netio_data *nd = td->io_ops_data;
@@ -555,8 +909,11 @@ static int fio_netio_send(struct thread_data *td, struct io_u *io_u)
 			    td->o.size) && !o->pingpong)
 				flags |= MSG_MORE;
 #endif
-			ret = send(io_u->file->fd, io_u->xfer_buf,
-					io_u->xfer_buflen, flags);
+			if (o->zerocopy)
+				ret = fio_netio_send_zc(td, io_u, flags);
+			else
+				ret = send(io_u->file->fd, io_u->xfer_buf,
+						io_u->xfer_buflen, flags);
 		}
 		if (ret > 0)
 			break;
@@ -585,12 +942,91 @@ static int is_close_msg(struct io_u *io_u, int len)
 	return 1;
 }
 
+#ifdef CONFIG_TCP_ZEROCOPY_RECEIVE
+/*
+ * Map received pages into the socket mapping instead of copying them into
+ * the io_u. Data that isn't page aligned in the receive queue has to be
+ * read the normal way, the kernel tells us how much of it through
+ * recv_skip_hint.
+ */
+static int fio_netio_recv_zc(struct thread_data *td, struct io_u *io_u)
+{
+	struct netio_data *nd = td->io_ops_data;
+	unsigned int len = io_u->xfer_buflen;
+	struct tcp_zerocopy_receive zc;
+	socklen_t zc_len;
+	int ret, before, done = 0;
+
+	do {
+		before = done;
+
+		memset(&zc, 0, sizeof(zc));
+		zc.address = (uintptr_t) nd->zc_map;
+		zc.length = (len - done) & ~(page_size - 1);
+		zc_len = sizeof(zc);
+
+		if (zc.length) {
+			ret = getsockopt(io_u->file->fd, IPPROTO_TCP,
+					TCP_ZEROCOPY_RECEIVE, &zc, &zc_len);
+			if (ret < 0)
+				return done ? done : -1;
+
+			done += zc.length;
+			nd->zc_recv_mapped += zc.length;
+		}
+
+		/*
+		 * Nothing mapped and no hint means either nothing is queued,
+		 * or we're at EOF. A plain non-blocking recv tells us which.
+		 */
+		if (done < len && (zc.recv_skip_hint || done == before)) {
+			unsigned int skip = zc.recv_skip_hint;
+
+			if (!skip || skip > len - done)
+				skip = len - done;
+
+			ret = recv(io_u->file->fd, io_u->xfer_buf + done, skip,
+					MSG_DONTWAIT);
+			if (ret > 0) {
+				done += ret;
+				nd->zc_recv_copied += ret;
+			} else if (!ret)
+				return done;
+			else if (errno != EAGAIN && errno != EWOULDBLOCK)
+				return done ? done : -1;
+		}
+
+		if (done == len)
+			break;
+		if (done != before)
+			continue;
+		if (done)
+			break;
+
+		ret = poll_wait(td, io_u->file->fd, POLLIN);
+		if (ret <= 0)
+			return ret;
+	} while (1);
+
+	return done;
+}
+#else
+static int fio_netio_recv_zc(struct thread_data *td, struct io_u *io_u)
+{
+	errno = EOPNOTSUPP;
+	return -1;
+}
+#endif
+
 static int fio_netio_recv(struct thread_data *td, struct io_u *io_u)
 {
 	struct netio_data *nd = td->io_ops_data;
 	struct netio_options *o = td->eo;
 	int ret, flags = 0;
 
+	if (o->zerocopy && nd->zc_map)
+		return fio_netio_recv_zc(td, io_u);
+
 	do {
 		if (is_udp(o)) {
 			struct sockaddr *from;
@@ -650,6 +1086,8 @@ static enum fio_q_status __fio_netio_queue(struct thread_data *td,
 	struct netio_options *o = td->eo;
 	int ret;
 
+	nd->zc_last_queued = false;
+
 	if (ddir == DDIR_WRITE) {
 		if (!nd->use_splice || is_udp(o) ||
 		    o->proto == FIO_TYPE_UNIX)
@@ -684,6 +1122,8 @@ static enum fio_q_status __fio_netio_queue(struct thread_data *td,
 
 	if (io_u->error)
 		td_verror(td, io_u->error, "xfer");
+	else if (nd->zc_last_queued)
+		return FIO_Q_QUEUED;
 
 	return FIO_Q_COMPLETED;
 }
@@ -905,6 +1345,13 @@ static void fio_netio_send_close(struct thread_data *td, struct fio_file *f)
 
 static int fio_netio_close_file(struct thread_data *td, struct fio_file *f)
 {
+	struct netio_data *nd = td->io_ops_data;
+
+	if (nd->zc_map) {
+		munmap(nd->zc_map, nd->zc_map_len);
+		nd->zc_map = NULL;
+	}
+
 	/*
 	 * Notify the receiver that we are closing down the link
 	 */
@@ -991,6 +1438,12 @@ static int fio_netio_open_file(struct thread_data *td, struct fio_file *f)
 		return ret;
 	}
 
+	if (set_zerocopy(td, f->fd)) {
+		close(f->fd);
+		f->fd = -1;
+		return 1;
+	}
+
 	if (is_udp(o)) {
 		if (td_write(td))
 			ret = fio_netio_send_open(td, f);
@@ -1285,7 +1738,7 @@ static int fio_netio_setup_listen(struct thread_data *td)
 	if (is_udp(o))
 		return 0;
 
-	if (listen(nd->listenfd, 10) < 0) {
+	if (listen(nd->listenfd, max(10U, o->connections)) < 0) {
 		td_verror(td, errno, "listen");
 		nd->listenfd = -1;
 		return 1;
@@ -1319,6 +1772,35 @@ static int fio_netio_init(struct thread_data *td)
 
 	o->port += td->subjob_number;
 
+	if (o->zerocopy) {
+		struct netio_data *nd = td->io_ops_data;
+
+		if (!is_tcp(o) || nd->use_splice) {
+			log_err("fio: zerocopy is only supported for TCP on the net engine\n");
+			return 1;
+		}
+		if ((o->listen || o->pingpong) && td->o.verify != VERIFY_NONE) {
+			log_err("fio: zerocopy receive doesn't fill the io_u buffer, can't verify\n");
+			return 1;
+		}
+		fio_getrusage(&nd->ru_start);
+
+		nd->zc_entries = td->o.iodepth;
+		nd->zc_queued = calloc(nd->zc_entries, sizeof(struct io_u *));
+		nd->zc_ids = calloc(nd->zc_entries, sizeof(uint32_t));
+		nd->zc_events = calloc(nd->zc_entries, sizeof(struct io_u *));
+		if (!nd->zc_queued || !nd->zc_ids || !nd->zc_events) {
+			log_err("fio: failed allocating zerocopy queue\n");
+			return 1;
+		}
+
+		/*
+		 * Zerocopy sends complete through ->getevents(), so the job
+		 * can't be run as a sync one
+		 */
+		td_clear_ioengine_flags(td, FIO_SYNCIO);
+	}
+
 	if (!is_tcp(o)) {
 		if (o->listen) {
 			log_err("fio: listen only valid for TCP proto IO\n");
@@ -1344,11 +1826,46 @@ static int fio_netio_init(struct thread_data *td)
 	return ret;
 }
 
+static uint64_t tv_usec_diff(const struct timeval *s, const struct timeval *e)
+{
+	return (e->tv_sec - s->tv_sec) * 1000000ULL + e->tv_usec - s->tv_usec;
+}
+
+/*
+ * Zero copy is about CPU cost, so report what the transfer cost in CPU
+ * time per byte along with how much of it actually avoided the copy.
+ */
+static void fio_netio_zc_report(struct thread_data *td)
+{
+	struct netio_data *nd = td->io_ops_data;
+	struct netio_options *o = td->eo;
+	uint64_t bytes, cpu_usec;
+	struct rusage ru;
+
+	if (!o->zerocopy || !(output_format & FIO_OUTPUT_NORMAL))
+		return;
+
+	fio_getrusage(&ru);
+	cpu_usec = tv_usec_diff(&nd->ru_start.ru_utime, &ru.ru_utime) +
+			tv_usec_diff(&nd->ru_start.ru_stime, &ru.ru_stime);
+	bytes = td->io_bytes[DDIR_READ] + td->io_bytes[DDIR_WRITE];
+
+	log_info("%s: zerocopy sends=%llu (copied=%llu), recv mapped=%llu, "
+		 "recv copied=%llu, cpu=%.3f nsec/KiB\n", td->o.name,
+		 (unsigned long long) nd->zc_sends,
+		 (unsigned long long) nd->zc_copied,
+		 (unsigned long long) nd->zc_recv_mapped,
+		 (unsigned long long) nd->zc_recv_copied,
+		 bytes ? (double) cpu_usec * 1000.0 * 1024.0 / bytes : 0.0);
+}
+
 static void fio_netio_cleanup(struct thread_data *td)
 {
 	struct netio_data *nd = td->io_ops_data;
 
 	if (nd) {
+		fio_netio_zc_report(td);
+
 		if (nd->listenfd != -1)
 			close(nd->listenfd);
 		if (nd->pipes[0] != -1)
@@ -1356,6 +1873,15 @@ static void fio_netio_cleanup(struct thread_data *td)
 		if (nd->pipes[1] != -1)
 			close(nd->pipes[1]);
 
+		if (nd->epfd != -1)
+			close(nd->epfd);
+
+		free(nd->zc_queued);
+		free(nd->zc_ids);
+		free(nd->zc_events);
+		free(nd->completed.reqs);
+		free(nd->async_events);
+		free(nd->ep_events);
 		free(nd);
 	}
 }
@@ -1375,6 +1901,7 @@ static int fio_netio_setup(struct thread_data *td)
 
 		memset(nd, 0, sizeof(*nd));
 		nd->listenfd = -1;
+		nd->epfd = -1;
 		nd->pipes[0] = nd->pipes[1] = -1;
 		td->io_ops_data = nd;
 	}
@@ -1424,11 +1951,487 @@ static struct ioengine_ops ioengine_splice = {
 };
 #endif
 
+#ifdef CONFIG_LINUX_EPOLL
+static int netasync_ring_init(struct netasync_ring *r, unsigned int entries)
+{
+	r->reqs = calloc(entries, sizeof(struct netasync_req));
+	r->entries = entries;
+	r->head = r->tail = r->nr = 0;
+	return r->reqs == NULL;
+}
+
+static void netasync_ring_push(struct netasync_ring *r, struct io_u *io_u,
+			       struct timespec *start)
+{
+	struct netasync_req *req = &r->reqs[r->tail];
+
+	req->io_u = io_u;
+	req->start = *start;
+	r->tail = (r->tail + 1) % r->entries;
+	r->nr++;
+}
+
+static struct netasync_req *netasync_ring_pop(struct netasync_ring *r)
+{
+	struct netasync_req *req = &r->reqs[r->head];
+
+	r->head = (r->head + 1) % r->entries;
+	r->nr--;
+	return req;
+}
+
+/*
+ * Drop 'io_u' from the ring, keeping the others in order. Returns its
+ * position from the head, or -1 if it isn't queued.
+ */
+static int netasync_ring_remove(struct netasync_ring *r, struct io_u *io_u)
+{
+	unsigned int pos, i, cur, next;
+
+	for (pos = 0; pos < r->nr; pos++) {
+		cur = (r->head + pos) % r->entries;
+		if (r->reqs[cur].io_u != io_u)
+			continue;
+
+		for (i = pos; i + 1 < r->nr; i++) {
+			next = (cur + 1) % r->entries;
+			r->reqs[cur] = r->reqs[next];
+			cur = next;
+		}
+		r->tail = cur;
+		r->nr--;
+		return pos;
+	}
+
+	return -1;
+}
+
+/*
+ * The first transfer of a read is a receive, and a write is a send. In
+ * ping-pong mode the opposite transfer follows before the io_u completes.
+ */
+static enum fio_q_status fio_netasync_queue(struct thread_data *td,
+					    struct io_u *io_u)
+{
+	struct netasync_conn *conn = FILE_ENG_DATA(io_u->file);
+	struct timespec now;
+
+	fio_ro_check(td, io_u);
+
+	if (!ddir_rw(io_u->ddir))
+		return FIO_Q_COMPLETED;
+
+	fio_gettime(&now, NULL);
+	if (io_u->ddir == DDIR_WRITE)
+		netasync_ring_push(&conn->sendq, io_u, &now);
+	else
+		netasync_ring_push(&conn->recvq, io_u, &now);
+
+	return FIO_Q_QUEUED;
+}
+
+static void fio_netasync_complete(struct thread_data *td,
+				  struct netasync_conn *conn,
+				  struct netasync_req *req, struct timespec *now)
+{
+	struct netio_data *nd = td->io_ops_data;
+	uint64_t nsec = ntime_since(&req->start, now);
+
+	if (!conn->ios || nsec < conn->lat_min)
+		conn->lat_min = nsec;
+	if (nsec > conn->lat_max)
+		conn->lat_max = nsec;
+	conn->lat_sum += nsec;
+	conn->lat_sum_sq += (double) nsec * nsec;
+	conn->lat_plat[plat_val_to_idx(nsec)]++;
+	conn->ios++;
+
+	netasync_ring_push(&nd->completed, req->io_u, &req->start);
+}
+
+/*
+ * Move the head of the send queue along. Returns true if any progress
+ * was made.
+ */
+static bool fio_netasync_send(struct thread_data *td, struct fio_file *f,
+			      struct netasync_conn *conn, struct timespec *now)
+{
+	struct netio_options *o = td->eo;
+	struct netasync_req *req;
+	struct io_u *io_u;
+	bool progress = false;
+	ssize_t ret;
+
+	while (conn->sendq.nr && conn->writable) {
+		req = &conn->sendq.reqs[conn->sendq.head];
+		io_u = req->io_u;
+
+		ret = send(f->fd, io_u->xfer_buf + conn->send_off,
+				io_u->xfer_buflen - conn->send_off,
+				MSG_DONTWAIT | MSG_NOSIGNAL);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			if (errno == EAGAIN || errno == EWOULDBLOCK) {
+				conn->writable = false;
+				break;
+			}
+			io_u->error = errno;
+			conn->send_off = 0;
+			fio_netasync_complete(td, conn,
+					netasync_ring_pop(&conn->sendq), now);
+			progress = true;
+			continue;
+		}
+
+		progress = true;
+		conn->send_off += ret;
+		if (conn->send_off < io_u->xfer_buflen)
+			continue;
+
+		conn->send_off = 0;
+		req = netasync_ring_pop(&conn->sendq);
+		if (o->pingpong && io_u->ddir == DDIR_WRITE)
+			netasync_ring_push(&conn->recvq, io_u, &req->start);
+		else
+			fio_netasync_complete(td, conn, req, now);
+	}
+
+	return progress;
+}
+
+static bool fio_netasync_recv(struct thread_data *td, struct fio_file *f,
+			      struct netasync_conn *conn, struct timespec *now)
+{
+	struct netio_data *nd = td->io_ops_data;
+	struct netio_options *o = td->eo;
+	struct netasync_req *req;
+	struct io_u *io_u;
+	bool progress = false;
+	ssize_t ret;
+
+	while (conn->recvq.nr && conn->readable && !conn->eof) {
+		req = &conn->recvq.reqs[conn->recvq.head];
+		io_u = req->io_u;
+
+		ret = recv(f->fd, io_u->xfer_buf + conn->recv_off,
+				io_u->xfer_buflen - conn->recv_off,
+				MSG_DONTWAIT);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			if (errno == EAGAIN || errno == EWOULDBLOCK) {
+				conn->readable = false;
+				break;
+			}
+			io_u->error = errno;
+			conn->recv_off = 0;
+			fio_netasync_complete(td, conn,
+					netasync_ring_pop(&conn->recvq), now);
+			progress = true;
+			continue;
+		} else if (!ret) {
+			/*
+			 * Peer closed the connection. Once all of them are
+			 * gone, we're done.
+			 */
+			conn->eof = true;
+			if (++nd->nr_eof == td->o.nr_files)
+				td->done = 1;
+			break;
+		}
+
+		progress = true;
+		conn->recv_off += ret;
+		if (conn->recv_off < io_u->xfer_buflen)
+			continue;
+
+		conn->recv_off = 0;
+		req = netasync_ring_pop(&conn->recvq);
+		if (o->pingpong && io_u->ddir == DDIR_READ)
+			netasync_ring_push(&conn->sendq, io_u, &req->start);
+		else
+			fio_netasync_complete(td, conn, req, now);
+	}
+
+	return progress;
+}
+
+static void fio_netasync_progress(struct thread_data *td)
+{
+	struct timespec now;
+	struct fio_file *f;
+	unsigned int i;
+	bool progress;
+
+	fio_gettime(&now, NULL);
+
+	for_each_file(td, f, i) {
+		struct netasync_conn *conn = FILE_ENG_DATA(f);
+
+		if (!conn)
+			continue;
+
+		do {
+			progress = fio_netasync_send(td, f, conn, &now);
+			progress |= fio_netasync_recv(td, f, conn, &now);
+		} while (progress);
+	}
+}
+
+static int fio_netasync_getevents(struct thread_data *td, unsigned int min,
+				  unsigned int max, const struct timespec *t)
+{
+	struct netio_data *nd = td->io_ops_data;
+	int msec = t ? t->tv_sec * 1000 + t->tv_nsec / 1000000 : -1;
+	unsigned int events = 0;
+	int i, ret;
+
+	do {
+		fio_netasync_progress(td);
+
+		while (nd->completed.nr && events < max) {
+			struct netasync_req *req;
+
+			req = netasync_ring_pop(&nd->completed);
+			nd->async_events[events++] = req->io_u;
+		}
+
+		if (events >= min || td->done || td->terminate)
+			break;
+
+		ret = epoll_wait(nd->epfd, nd->ep_events, td->o.nr_files, msec);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			td_verror(td, errno, "epoll_wait");
+			return -errno;
+		} else if (!ret && t)
+			break;
+
+		for (i = 0; i < ret; i++) {
+			struct fio_file *f = nd->ep_events[i].data.ptr;
+			struct netasync_conn *conn = FILE_ENG_DATA(f);
+
+			if (nd->ep_events[i].events & (EPOLLIN | EPOLLHUP |
+							EPOLLERR))
+				conn->readable = true;
+			if (nd->ep_events[i].events & (EPOLLOUT | EPOLLERR))
+				conn->writable = true;
+		}
+	} while (1);
+
+	return events;
+}
+
+static struct io_u *fio_netasync_event(struct thread_data *td, int event)
+{
+	struct netio_data *nd = td->io_ops_data;
+
+	return nd->async_events[event];
+}
+
+/*
+ * Once all peers have gone away, whatever is left queued is dropped. If
+ * the cancelled request was partially transferred, it was at the head of
+ * its queue, and the next one starts from scratch.
+ */
+static int fio_netasync_cancel(struct thread_data *td, struct io_u *io_u)
+{
+	struct netasync_conn *conn = FILE_ENG_DATA(io_u->file);
+	struct netio_data *nd = td->io_ops_data;
+
+	if (conn) {
+		if (!netasync_ring_remove(&conn->sendq, io_u))
+			conn->send_off = 0;
+		if (!netasync_ring_remove(&conn->recvq, io_u))
+			conn->recv_off = 0;
+	}
+	netasync_ring_remove(&nd->completed, io_u);
+	return 0;
+}
+
+static int fio_netasync_open_file(struct thread_data *td, struct fio_file *f)
+{
+	struct netio_data *nd = td->io_ops_data;
+	struct netasync_conn *conn;
+	struct epoll_event ev;
+	int ret, flags;
+
+	ret = fio_netio_open_file(td, f);
+	if (ret)
+		return ret;
+
+	conn = calloc(1, sizeof(*conn));
+	if (!conn ||
+	    netasync_ring_init(&conn->sendq, td->o.iodepth) ||
+	    netasync_ring_init(&conn->recvq, td->o.iodepth) ||
+	    !(conn->lat_plat = calloc(FIO_IO_U_PLAT_NR, sizeof(uint64_t)))) {
+		log_err("fio: failed allocating connection\n");
+		goto err;
+	}
+
+	flags = fcntl(f->fd, F_GETFL);
+	if (flags < 0 || fcntl(f->fd, F_SETFL, flags | O_NONBLOCK) < 0) {
+		td_verror(td, errno, "fcntl O_NONBLOCK");
+		goto err;
+	}
+
+	memset(&ev, 0, sizeof(ev));
+	ev.events = EPOLLIN | EPOLLOUT | EPOLLET;
+	ev.data.ptr = f;
+	if (epoll_ctl(nd->epfd, EPOLL_CTL_ADD, f->fd, &ev) < 0) {
+		td_verror(td, errno, "epoll_ctl");
+		goto err;
+	}
+
+	conn->readable = conn->writable = true;
+	FILE_SET_ENG_DATA(f, conn);
+	return 0;
+err:
+	if (conn) {
+		free(conn->sendq.reqs);
+		free(conn->recvq.reqs);
+		free(conn->lat_plat);
+		free(conn);
+	}
+	if (generic_close_file(td, f))
+		log_err("fio: failed closing connection\n");
+	return 1;
+}
+
+static void fio_netasync_show_conn(struct thread_data *td, struct fio_file *f,
+				   struct netasync_conn *conn)
+{
+	fio_fp64_t plist[] = {
+		{ .u.f = 50.0 }, { .u.f = 90.0 }, { .u.f = 99.0 },
+		{ .u.f = 99.9 }, { .u.f = 0.0 },
+	};
+	unsigned long long *ovals = NULL, minv, maxv;
+	unsigned int i, len;
+	double mean, dev = 0.0;
+
+	if (!conn->ios || !(output_format & FIO_OUTPUT_NORMAL))
+		return;
+
+	mean = conn->lat_sum / conn->ios;
+	if (conn->ios > 1)
+		dev = sqrt((conn->lat_sum_sq - conn->lat_sum * mean) /
+				(conn->ios - 1));
+
+	log_info("%s: connection %d: ios=%llu, lat (usec): min=%.2f, "
+		 "max=%.2f, avg=%.2f, stdev=%.2f\n", td->o.name, f->fileno,
+		 (unsigned long long) conn->ios, conn->lat_min / 1000.0,
+		 conn->lat_max / 1000.0, mean / 1000.0, dev / 1000.0);
+
+	len = calc_clat_percentiles(conn->lat_plat, conn->ios, plist, &ovals,
+					&maxv, &minv);
+	if (!len)
+		return;
+
+	log_info("%s: connection %d: lat percentiles (usec):", td->o.name,
+		 f->fileno);
+	for (i = 0; i < len; i++)
+		log_info(" %.2fth=%llu%s", plist[i].u.f, ovals[i] / 1000,
+			 i + 1 < len ? "," : "\n");
+	free(ovals);
+}
+
+static int fio_netasync_close_file(struct thread_data *td, struct fio_file *f)
+{
+	struct netasync_conn *conn = FILE_ENG_DATA(f);
+
+	if (conn) {
+		fio_netasync_show_conn(td, f, conn);
+		FILE_SET_ENG_DATA(f, NULL);
+		free(conn->sendq.reqs);
+		free(conn->recvq.reqs);
+		free(conn->lat_plat);
+		free(conn);
+	}
+
+	/*
+	 * The peer learns about the end of the stream from the socket
+	 * being shut down, not from an in-band close message
+	 */
+	return generic_close_file(td, f);
+}
+
+static int fio_netasync_setup(struct thread_data *td)
+{
+	struct netio_options *o = td->eo;
+	char name[64];
+
+	fio_netio_setup(td);
+
+	while (td->files_index < o->connections) {
+		snprintf(name, sizeof(name), "%s.%u",
+				td->o.filename ?: "net", td->files_index);
+		add_file(td, name, 0, 1);
+	}
+	td->o.open_files = td->o.nr_files;
+	return 0;
+}
+
+static int fio_netasync_init(struct thread_data *td)
+{
+	struct netio_data *nd = td->io_ops_data;
+	struct netio_options *o = td->eo;
+
+	if (is_udp(o)) {
+		log_err("fio: netasync only supports stream sockets\n");
+		return 1;
+	}
+	if (o->zerocopy) {
+		log_err("fio: netasync doesn't support zerocopy\n");
+		return 1;
+	}
+
+	nd->epfd = epoll_create1(0);
+	if (nd->epfd < 0) {
+		td_verror(td, errno, "epoll_create1");
+		return 1;
+	}
+
+	nd->async_events = calloc(td->o.iodepth, sizeof(struct io_u *));
+	nd->ep_events = calloc(td->o.nr_files, sizeof(struct epoll_event));
+	if (!nd->async_events || !nd->ep_events ||
+	    netasync_ring_init(&nd->completed, td->o.iodepth)) {
+		log_err("fio: failed allocating netasync state\n");
+		return 1;
+	}
+
+	return fio_netio_init(td);
+}
+
+static struct ioengine_ops ioengine_async = {
+	.name			= "netasync",
+	.version		= FIO_IOOPS_VERSION,
+	.prep			= fio_netio_prep,
+	.queue			= fio_netasync_queue,
+	.getevents		= fio_netasync_getevents,
+	.event			= fio_netasync_event,
+	.cancel			= fio_netasync_cancel,
+	.setup			= fio_netasync_setup,
+	.init			= fio_netasync_init,
+	.cleanup		= fio_netio_cleanup,
+	.open_file		= fio_netasync_open_file,
+	.close_file		= fio_netasync_close_file,
+	.terminate		= fio_netio_terminate,
+	.options		= options,
+	.option_struct_size	= sizeof(struct netio_options),
+	.flags			= FIO_DISKLESSIO | FIO_UNIDIR | FIO_PIPEIO |
+				  FIO_BIT_BASED,
+};
+#endif
+
 static struct ioengine_ops ioengine_rw = {
 	.name			= "net",
 	.version		= FIO_IOOPS_VERSION,
 	.prep			= fio_netio_prep,
 	.queue			= fio_netio_queue,
+	.getevents		= fio_netio_getevents,
+	.event			= fio_netio_event,
 	.setup			= fio_netio_setup,
 	.init			= fio_netio_init,
 	.cleanup		= fio_netio_cleanup,
@@ -1457,6 +2460,9 @@ static void fio_init fio_netio_register(void)
 #ifdef CONFIG_LINUX_SPLICE
 	register_ioengine(&ioengine_splice);
 #endif
+#ifdef CONFIG_LINUX_EPOLL
+	register_ioengine(&ioengine_async);
+#endif
 }
 
 static void fio_exit fio_netio_unregister(void)
@@ -1465,4 +2471,7 @@ static void fio_exit fio_netio_unregister(void)
 #ifdef CONFIG_LINUX_SPLICE
 	unregister_ioengine(&ioengine_splice);
 #endif
+#ifdef CONFIG_LINUX_EPOLL
+	unregister_ioengine(&ioengine_async);
+#endif
 }
@@ -29,17 +29,19 @@ static struct io_u *null_event(struct null_data *nd, int event)
 	return nd->io_us[event];
 }
 
-static int null_getevents(struct null_data *nd, unsigned int min_events,
+static int null_getevents(struct null_data *nd,
+			  unsigned int fio_unused min_events,
 			  unsigned int fio_unused max,
 			  const struct timespec fio_unused *t)
 {
-	int ret = 0;
-
-	if (min_events) {
-		ret = nd->events;
-		nd->events = 0;
-	}
-
+	int ret;
+
+	/*
+	 * Everything committed has completed, so hand it back even when
+	 * polled with min_events == 0, as job runners do.
+	 */
+	ret = nd->events;
+	nd->events = 0;
 	return ret;
 }
 
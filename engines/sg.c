@@ -39,15 +39,19 @@
  *  
  * In async mode:
  *  /dev/sgY with direct=0 and sync=0
- *   RW: read and write operations are submitted in queue()
+ *   RW: read and write operations are queued in queue() and submitted
+ *       as one batch in commit()
  *    io_u_mark_depth()			called in td_io_commit()
- *    io_u_mark_submit()		called in queue()
- *    issue_time			set in td_io_queue()
+ *    io_u_mark_submit()		called in commit()
+ *    issue_time			set in commit()
  *   T: trim operations are queued in queue() and submitted in commit()
  *    io_u_mark_depth()			called in td_io_commit()
  *    io_u_mark_submit()		called in commit()
  *    issue_time			set in commit()
  *
+ * The nvme ioengine at the end of this file is a synchronous variant that
+ * sends NVMe commands straight to the namespace with NVME_IOCTL_IO_CMD.
+ *
  */
 #include <stdio.h>
 #include <stdlib.h>
@@ -60,6 +64,10 @@
 
 #ifdef FIO_HAVE_SGIO
 
+#ifdef CONFIG_LINUX_NVME_IOCTL
+#include <linux/nvme_ioctl.h>
+#endif
+
 enum {
 	FIO_SG_WRITE		= 1,
 	FIO_SG_WRITE_VERIFY	= 2,
@@ -152,6 +160,10 @@ struct sgio_data {
 	int type_checked;
 	struct sgio_trim **trim_queues;
 	int current_queue;
+	struct io_u **pending;
+	unsigned int nr_pending;
+	struct io_u **failed;
+	unsigned int nr_failed;
 #ifdef FIO_SGIO_DEBUG
 	unsigned int *trim_queue_map;
 #endif
@@ -267,6 +279,19 @@ static int fio_sgio_getevents(struct thread_data *td, unsigned int min,
 	struct fio_file *f;
 	struct io_u *io_u;
 
+	/*
+	 * io_us that a commit failed to submit complete first, with their
+	 * error
+	 */
+	if (sd->nr_failed) {
+		events = min(max, sd->nr_failed);
+		memcpy(sd->events, sd->failed, events * sizeof(struct io_u *));
+		sd->nr_failed -= events;
+		memmove(sd->failed, sd->failed + events,
+			sd->nr_failed * sizeof(struct io_u *));
+		return events;
+	}
+
 	/*
 	 * Fill in the file descriptors
 	 */
@@ -653,6 +678,13 @@ static enum fio_q_status fio_sgio_queue(struct thread_data *td,
 			return FIO_Q_QUEUED;
 	}
 
+	if (!do_sync && io_u->file->filetype == FIO_TYPE_CHAR &&
+	    ddir_rw(io_u->ddir)) {
+		/* queue up reads and writes and submit in commit() */
+		sd->pending[sd->nr_pending++] = io_u;
+		return FIO_Q_QUEUED;
+	}
+
 	ret = fio_sgio_doio(td, io_u, do_sync);
 
 	if (ret < 0)
@@ -664,9 +696,6 @@ static enum fio_q_status fio_sgio_queue(struct thread_data *td,
 		if (do_sync && !ddir_sync(io_u->ddir)) {
 			io_u_mark_submit(td, 1);
 			io_u_mark_complete(td, 1);
-		} else if (io_u->ddir == DDIR_READ || io_u->ddir == DDIR_WRITE) {
-			io_u_mark_submit(td, 1);
-			io_u_queued(td, io_u);
 		}
 	}
 
@@ -678,6 +707,61 @@ static enum fio_q_status fio_sgio_queue(struct thread_data *td,
 	return ret;
 }
 
+/*
+ * Submit the reads and writes held back by queue(). The sg v3 driver
+ * consumes a single sg_io_hdr per write(2), whatever the count passed in,
+ * so the batch is written back to back rather than in one call.
+ */
+static int fio_sgio_commit_rw(struct thread_data *td)
+{
+	struct sgio_data *sd = td->io_ops_data;
+	struct io_u *io_u;
+	struct timespec now;
+	unsigned int i, j;
+	int ret = 0;
+
+	if (!sd->nr_pending)
+		return 0;
+
+	if (fio_fill_issue_time(td))
+		fio_gettime(&now, NULL);
+
+	for (i = 0; i < sd->nr_pending; i++) {
+		io_u = sd->pending[i];
+
+		if (fio_fill_issue_time(td))
+			memcpy(&io_u->issue_time, &now, sizeof(now));
+
+		ret = write(io_u->file->fd, &io_u->hdr, sizeof(io_u->hdr));
+		if (ret < 0)
+			break;
+
+		io_u_queued(td, io_u);
+	}
+
+	io_u_mark_submit(td, i);
+
+	if (ret < 0) {
+		int error = errno;
+
+		/*
+		 * The io_us that weren't written are in flight as far as the
+		 * core is concerned. Hand them back through getevents() with
+		 * the error, rather than freeing them here.
+		 */
+		for (j = i; j < sd->nr_pending; j++) {
+			sd->pending[j]->error = error;
+			sd->failed[sd->nr_failed++] = sd->pending[j];
+		}
+
+		sd->nr_pending = 0;
+		return -error;
+	}
+
+	sd->nr_pending = 0;
+	return 0;
+}
+
 static int fio_sgio_commit(struct thread_data *td)
 {
 	struct sgio_data *sd = td->io_ops_data;
@@ -688,6 +772,10 @@ static int fio_sgio_commit(struct thread_data *td)
 	unsigned int i;
 	int ret;
 
+	ret = fio_sgio_commit_rw(td);
+	if (ret)
+		return ret;
+
 	if (sd->current_queue == -1)
 		return 0;
 
@@ -846,6 +934,8 @@ static void fio_sgio_cleanup(struct thread_data *td)
 		free(sd->fd_flags);
 		free(sd->pfds);
 		free(sd->sgbuf);
+		free(sd->pending);
+		free(sd->failed);
 #ifdef FIO_SGIO_DEBUG
 		free(sd->trim_queue_map);
 #endif
@@ -873,6 +963,8 @@ static int fio_sgio_init(struct thread_data *td)
 	sd->events = calloc(td->o.iodepth, sizeof(struct io_u *));
 	sd->pfds = calloc(td->o.nr_files, sizeof(struct pollfd));
 	sd->fd_flags = calloc(td->o.nr_files, sizeof(int));
+	sd->pending = calloc(td->o.iodepth, sizeof(struct io_u *));
+	sd->failed = calloc(td->o.iodepth, sizeof(struct io_u *));
 	sd->type_checked = 0;
 
 	sd->trim_queues = calloc(td->o.iodepth, sizeof(struct sgio_trim *));
@@ -1249,6 +1341,309 @@ static struct ioengine_ops ioengine = {
 	.option_struct_size	= sizeof(struct sg_options)
 };
 
+#ifdef CONFIG_LINUX_NVME_IOCTL
+
+#define NVME_IDENTIFY_SIZE	4096
+
+enum {
+	NVME_CMD_FLUSH		= 0x00,
+	NVME_CMD_WRITE		= 0x01,
+	NVME_CMD_READ		= 0x02,
+	NVME_CMD_DSM		= 0x09,
+	NVME_ADMIN_IDENTIFY	= 0x06,
+};
+
+#define NVME_RW_FUA		(1U << 30)
+#define NVME_DSM_AD		(1U << 2)
+
+/*
+ * Per namespace (file) information
+ */
+struct nvme_file {
+	__u32 nsid;
+	unsigned int lba_shift;
+};
+
+/*
+ * Per io_u command, hung off io_u->engine_data
+ */
+struct nvme_cmd {
+	struct nvme_passthru_cmd cmd;
+	uint8_t dsm_range[16];
+	int status;
+};
+
+/*
+ * Find the namespace id of 'fd', and its LBA size and count from the
+ * IDENTIFY NAMESPACE data (NSZE, FLBAS and the LBA format list).
+ */
+static int fio_nvme_get_info(int fd, __u32 *nsid, unsigned int *lba_shift,
+			     unsigned long long *nlba)
+{
+	struct nvme_admin_cmd cmd;
+	uint8_t *buf;
+	int ns, ret, format;
+
+	ns = ioctl(fd, NVME_IOCTL_ID);
+	if (ns <= 0)
+		return ns < 0 ? errno : EINVAL;
+
+	if (posix_memalign((void **) &buf, page_size, NVME_IDENTIFY_SIZE))
+		return ENOMEM;
+
+	memset(buf, 0, NVME_IDENTIFY_SIZE);
+	memset(&cmd, 0, sizeof(cmd));
+	cmd.opcode = NVME_ADMIN_IDENTIFY;
+	cmd.nsid = ns;
+	cmd.addr = (__u64) (uintptr_t) buf;
+	cmd.data_len = NVME_IDENTIFY_SIZE;
+	cmd.cdw10 = 0;	/* CNS 0: identify namespace */
+
+	ret = ioctl(fd, NVME_IOCTL_ADMIN_CMD, &cmd);
+	if (ret) {
+		ret = ret < 0 ? errno : EIO;
+		goto out;
+	}
+
+	format = buf[26] & 0xf;
+	*nsid = ns;
+	*lba_shift = buf[128 + 4 * format + 2];
+	*nlba = le64_to_cpu(*((uint64_t *) buf));
+
+	if (*lba_shift < 9 || !*nlba)
+		ret = EINVAL;
+out:
+	free(buf);
+	return ret;
+}
+
+static int fio_nvme_get_file_size(struct thread_data *td, struct fio_file *f)
+{
+	unsigned long long nlba;
+	unsigned int lba_shift;
+	__u32 nsid;
+	int fd, ret;
+
+	if (fio_file_size_known(f))
+		return 0;
+
+	if (f->filetype != FIO_TYPE_BLOCK && f->filetype != FIO_TYPE_CHAR) {
+		td_verror(td, EINVAL, "wrong file type");
+		log_err("ioengine nvme only works on block or character devices\n");
+		return 1;
+	}
+
+	fd = open(f->file_name, O_RDONLY);
+	if (fd < 0) {
+		td_verror(td, errno, "open");
+		return 1;
+	}
+
+	ret = fio_nvme_get_info(fd, &nsid, &lba_shift, &nlba);
+	close(fd);
+	if (ret) {
+		td_verror(td, ret, "fio_nvme_get_info");
+		log_err("ioengine nvme unable to identify namespace of %s\n",
+			f->file_name);
+		return 1;
+	}
+
+	f->real_file_size = nlba << lba_shift;
+	fio_file_set_size_known(f);
+	return 0;
+}
+
+static int fio_nvme_open(struct thread_data *td, struct fio_file *f)
+{
+	struct nvme_file *nf;
+	unsigned long long nlba;
+	int ret;
+
+	ret = generic_open_file(td, f);
+	if (ret)
+		return ret;
+
+	nf = calloc(1, sizeof(*nf));
+	if (!nf) {
+		log_err("fio: nvme failed to allocate file data\n");
+		if (generic_close_file(td, f))
+			log_err("fio: nvme failed to close %s\n", f->file_name);
+		return -ENOMEM;
+	}
+
+	ret = fio_nvme_get_info(f->fd, &nf->nsid, &nf->lba_shift, &nlba);
+	if (ret) {
+		td_verror(td, ret, "fio_nvme_get_info");
+		log_err("ioengine nvme unable to identify namespace of %s\n",
+			f->file_name);
+		free(nf);
+		if (generic_close_file(td, f))
+			log_err("fio: nvme failed to close %s\n", f->file_name);
+		return 1;
+	}
+
+	dprint(FD_FILE, "nvme: %s nsid=%u lba size=%u\n", f->file_name,
+		nf->nsid, 1U << nf->lba_shift);
+
+	FILE_SET_ENG_DATA(f, nf);
+	return 0;
+}
+
+static int fio_nvme_close(struct thread_data *td, struct fio_file *f)
+{
+	struct nvme_file *nf = FILE_ENG_DATA(f);
+
+	FILE_SET_ENG_DATA(f, NULL);
+	free(nf);
+
+	return generic_close_file(td, f);
+}
+
+static int fio_nvme_prep(struct thread_data *td, struct io_u *io_u)
+{
+	struct nvme_file *nf = FILE_ENG_DATA(io_u->file);
+	struct nvme_cmd *nc = io_u->engine_data;
+	struct nvme_passthru_cmd *cmd = &nc->cmd;
+	struct sg_options *o = td->eo;
+	unsigned long long slba, nlb;
+
+	memset(cmd, 0, sizeof(*cmd));
+	cmd->nsid = nf->nsid;
+	nc->status = 0;
+
+	if (ddir_sync(io_u->ddir)) {
+		cmd->opcode = NVME_CMD_FLUSH;
+		return 0;
+	}
+
+	if ((io_u->offset | io_u->xfer_buflen) &
+	    ((1ULL << nf->lba_shift) - 1)) {
+		log_err("nvme: I/O not aligned to the namespace LBA size\n");
+		return EINVAL;
+	}
+
+	slba = io_u->offset >> nf->lba_shift;
+	nlb = io_u->xfer_buflen >> nf->lba_shift;
+
+	if (io_u->ddir == DDIR_TRIM) {
+		/* single range: context attributes, length, starting LBA */
+		memset(nc->dsm_range, 0, sizeof(nc->dsm_range));
+		*((uint32_t *) &nc->dsm_range[4]) = cpu_to_le32((uint32_t) nlb);
+		*((uint64_t *) &nc->dsm_range[8]) = cpu_to_le64((uint64_t) slba);
+
+		cmd->opcode = NVME_CMD_DSM;
+		cmd->addr = (__u64) (uintptr_t) nc->dsm_range;
+		cmd->data_len = sizeof(nc->dsm_range);
+		cmd->cdw10 = 0;		/* number of ranges, 0's based */
+		cmd->cdw11 = NVME_DSM_AD;
+		return 0;
+	}
+
+	if (!nlb || nlb > 0x10000) {
+		log_err("nvme: I/O size must be 1 to 65536 LBAs\n");
+		return EINVAL;
+	}
+
+	if (io_u->ddir == DDIR_READ) {
+		cmd->opcode = NVME_CMD_READ;
+		if (o->readfua)
+			cmd->cdw12 |= NVME_RW_FUA;
+	} else {
+		cmd->opcode = NVME_CMD_WRITE;
+		if (o->writefua)
+			cmd->cdw12 |= NVME_RW_FUA;
+	}
+
+	cmd->addr = (__u64) (uintptr_t) io_u->xfer_buf;
+	cmd->data_len = io_u->xfer_buflen;
+	cmd->cdw10 = slba & 0xffffffff;
+	cmd->cdw11 = slba >> 32;
+	cmd->cdw12 |= nlb - 1;
+	return 0;
+}
+
+static enum fio_q_status fio_nvme_queue(struct thread_data *td,
+					struct io_u *io_u)
+{
+	struct nvme_cmd *nc = io_u->engine_data;
+	int ret;
+
+	fio_ro_check(td, io_u);
+
+	ret = ioctl(io_u->file->fd, NVME_IOCTL_IO_CMD, &nc->cmd);
+	if (ret < 0)
+		io_u->error = errno;
+	else if (ret) {
+		/* positive returns are the NVMe completion status */
+		nc->status = ret;
+		io_u->error = EIO;
+	}
+
+	if (io_u->error)
+		td_verror(td, io_u->error, "xfer");
+
+	return FIO_Q_COMPLETED;
+}
+
+static char *fio_nvme_errdetails(struct io_u *io_u)
+{
+	struct nvme_cmd *nc = io_u->engine_data;
+	struct nvme_passthru_cmd *cmd = &nc->cmd;
+	char *msg;
+
+	msg = calloc(1, MAXERRDETAIL);
+	snprintf(msg, MAXERRDETAIL, "NVMe Status: 0x%04x (SCT 0x%x, SC 0x%02x%s). "
+		 "opcode: 0x%02x, nsid: %u, cdw10: 0x%08x, cdw11: 0x%08x, "
+		 "cdw12: 0x%08x. ", nc->status, (nc->status >> 8) & 0x7,
+		 nc->status & 0xff, (nc->status & 0x4000) ? ", DNR" : "",
+		 cmd->opcode, cmd->nsid, cmd->cdw10, cmd->cdw11, cmd->cdw12);
+
+	return msg;
+}
+
+static int fio_nvme_io_u_init(struct thread_data *td, struct io_u *io_u)
+{
+	io_u->engine_data = calloc(1, sizeof(struct nvme_cmd));
+	if (!io_u->engine_data)
+		return 1;
+
+	return 0;
+}
+
+static void fio_nvme_io_u_free(struct thread_data *td, struct io_u *io_u)
+{
+	free(io_u->engine_data);
+	io_u->engine_data = NULL;
+}
+
+static int fio_nvme_init(struct thread_data *td)
+{
+	/*
+	 * commands go straight to the device, like with sg
+	 */
+	td->o.override_sync = 1;
+	return 0;
+}
+
+static struct ioengine_ops ioengine_nvme = {
+	.name		= "nvme",
+	.version	= FIO_IOOPS_VERSION,
+	.init		= fio_nvme_init,
+	.prep		= fio_nvme_prep,
+	.queue		= fio_nvme_queue,
+	.errdetails	= fio_nvme_errdetails,
+	.io_u_init	= fio_nvme_io_u_init,
+	.io_u_free	= fio_nvme_io_u_free,
+	.open_file	= fio_nvme_open,
+	.close_file	= fio_nvme_close,
+	.get_file_size	= fio_nvme_get_file_size,
+	.flags		= FIO_SYNCIO | FIO_RAWIO,
+	.options	= options,
+	.option_struct_size	= sizeof(struct sg_options)
+};
+
+#endif /* CONFIG_LINUX_NVME_IOCTL */
+
 #else /* FIO_HAVE_SGIO */
 
 /*
@@ -1273,9 +1668,15 @@ static struct ioengine_ops ioengine = {
 static void fio_init fio_sgio_register(void)
 {
 	register_ioengine(&ioengine);
+#if defined(FIO_HAVE_SGIO) && defined(CONFIG_LINUX_NVME_IOCTL)
+	register_ioengine(&ioengine_nvme);
+#endif
 }
 
 static void fio_exit fio_sgio_unregister(void)
 {
 	unregister_ioengine(&ioengine);
+#if defined(FIO_HAVE_SGIO) && defined(CONFIG_LINUX_NVME_IOCTL)
+	unregister_ioengine(&ioengine_nvme);
+#endif
 }
@@ -92,6 +92,9 @@ static void check_str_update(struct thread_data *td)
 	case TD_PRE_READING:
 		c = 'p';
 		break;
+	case TD_PRECONDITIONING:
+		c = 'c';
+		break;
 	case TD_VERIFYING:
 		c = 'V';
 		break;
@@ -257,7 +260,8 @@ static unsigned long thread_eta(struct thread_data *td)
 			|| td->runstate == TD_INITIALIZED
 			|| td->runstate == TD_SETTING_UP
 			|| td->runstate == TD_RAMP
-			|| td->runstate == TD_PRE_READING) {
+			|| td->runstate == TD_PRE_READING
+			|| td->runstate == TD_PRECONDITIONING) {
 		int64_t t_eta = 0, r_eta = 0;
 		unsigned long long rate_bytes;
 
@@ -427,6 +431,7 @@ bool calc_thread_status(struct jobs_eta *je, int force)
 		if (td->runstate == TD_RUNNING || td->runstate == TD_VERIFYING
 		    || td->runstate == TD_FSYNCING
 		    || td->runstate == TD_PRE_READING
+		    || td->runstate == TD_PRECONDITIONING
 		    || td->runstate == TD_FINISHING) {
 			je->nr_running++;
 			if (td_read(td)) {
@@ -103,6 +103,11 @@ struct fio_file {
 	 * Zoned block device information. See also zonemode=zbd.
 	 */
 	struct zoned_block_device_info *zbd_info;
+	/*
+	 * Which of the files sharing zbd_info this is. Used to give each job
+	 * its own part of the open zones.
+	 */
+	uint32_t zbd_slot;
 
 	/*
 	 * Track last end and last start of IO for a given data direction
@@ -206,6 +211,7 @@ extern int __must_check generic_get_file_size(struct thread_data *, struct fio_f
 #endif
 extern int __must_check file_lookup_open(struct fio_file *f, int flags);
 extern bool __must_check pre_read_files(struct thread_data *);
+extern bool __must_check precondition_fill_files(struct thread_data *);
 extern unsigned long long get_rand_file_size(struct thread_data *td);
 extern int add_file(struct thread_data *, const char *, int, int);
 extern int add_file_exclusive(struct thread_data *, const char *);
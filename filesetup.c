@@ -15,11 +15,17 @@
 #include "lib/axmap.h"
 #include "rwlock.h"
 #include "zbd.h"
+#include "lib/memalign.h"
 
 #ifdef CONFIG_LINUX_FALLOCATE
 #include <linux/falloc.h>
 #endif
 
+/*
+ * Block size of the sequential preconditioning fill
+ */
+#define PRECOND_FILL_BS		(1024 * 1024)
+
 static FLIST_HEAD(filename_list);
 
 /*
@@ -327,6 +333,101 @@ error:
 	return ret;
 }
 
+/*
+ * Write the job region of the file sequentially from start to end, so the
+ * workload starts out on a device that has been written in full. This
+ * uses a file descriptor of its own, as the workload may be read only.
+ */
+static bool precondition_fill_file(struct thread_data *td, struct fio_file *f)
+{
+	unsigned long long left, bs, off;
+	int fd, flags = O_WRONLY, old_runstate;
+	bool ret = true;
+	char *b;
+	ssize_t r;
+
+	if (td->o.odirect)
+		flags |= OS_O_DIRECT;
+
+	fd = open(f->file_name, flags);
+	if (fd < 0) {
+		td_verror(td, errno, "open");
+		log_err("fio: cannot precondition %s\n", f->file_name);
+		return false;
+	}
+
+	old_runstate = td_bump_runstate(td, TD_PRECONDITIONING);
+
+	bs = PRECOND_FILL_BS;
+	b = fio_memalign(page_size, bs, false);
+	if (!b) {
+		td_verror(td, errno, "malloc");
+		ret = false;
+		goto error;
+	}
+	__fill_random_buf(b, bs, td->o.rand_seed);
+
+	left = f->io_size;
+	off = f->file_offset;
+	while (left && !td->terminate) {
+		if (bs > left)
+			bs = left;
+
+		r = pwrite(fd, b, bs, off);
+		if (r != (ssize_t) bs) {
+			td_verror(td, r < 0 ? errno : EIO, "precondition_fill");
+			ret = false;
+			break;
+		}
+		left -= bs;
+		off += bs;
+	}
+
+	if (ret && fsync(fd) < 0 && errno != EINVAL) {
+		td_verror(td, errno, "fsync");
+		ret = false;
+	}
+
+	fio_memfree(b, PRECOND_FILL_BS, false);
+error:
+	td_restore_runstate(td, old_runstate);
+	close(fd);
+	return ret;
+}
+
+bool precondition_fill_files(struct thread_data *td)
+{
+	struct timespec start;
+	struct fio_file *f;
+	unsigned int i, pass;
+
+	if (td_ioengine_flagged(td, FIO_PIPEIO) ||
+	    td_ioengine_flagged(td, FIO_NOIO) ||
+	    td_ioengine_flagged(td, FIO_DISKLESSIO))
+		return true;
+
+	fio_gettime(&start, NULL);
+
+	for (pass = 0; pass < td->o.precondition_fill; pass++) {
+		dprint(FD_FILE, "precondition fill pass %u\n", pass);
+
+		for_each_file(td, f, i) {
+			if (f->filetype == FIO_TYPE_CHAR)
+				continue;
+			if (!precondition_fill_file(td, f))
+				return false;
+		}
+
+		if (td->terminate)
+			break;
+
+		td->ts.precond_fill_passes++;
+	}
+
+	td->ts.precond_fill_msec = mtime_since_now(&start);
+	return true;
+}
+
 unsigned long long get_rand_file_size(struct thread_data *td)
 {
 	unsigned long long ret, sized;
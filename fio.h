@@ -40,6 +40,7 @@
 #include "server.h"
 #include "stat.h"
 #include "flow.h"
+#include "arrival.h"
 #include "io_u.h"
 #include "io_u_queue.h"
 #include "workqueue.h"
@@ -146,6 +147,10 @@ enum {
 
 	RATE_PROCESS_LINEAR = 0,
 	RATE_PROCESS_POISSON = 1,
+	RATE_PROCESS_ONOFF = 2,
+	RATE_PROCESS_MMPP = 3,
+	RATE_PROCESS_PARETO = 4,
+	RATE_PROCESS_CURVE = 5,
 };
 
 enum {
@@ -191,20 +196,30 @@ struct thread_data {
 	struct io_log *clat_log;
 	struct io_log *clat_hist_log;
 	struct io_log *lat_log;
+	struct io_log *rsp_log;
 	struct io_log *bw_log;
 	struct io_log *iops_log;
 
 	struct workqueue log_compress_wq;
+	struct workqueue log_stream_wq;
 
 	struct thread_data *parent;
 
-	uint64_t stat_io_bytes[DDIR_RWDIR_CNT];
-	struct timespec bw_sample_time;
+	/*
+	 * Written by the helper thread when it takes bw and iops samples or
+	 * asks for a rusage update. Kept off the cache lines the job uses
+	 * for each I/O.
+	 */
+	struct {
+		uint64_t stat_io_bytes[DDIR_RWDIR_CNT];
+		struct timespec bw_sample_time;
+
+		uint64_t stat_io_blocks[DDIR_RWDIR_CNT];
+		struct timespec iops_sample_time;
 
-	uint64_t stat_io_blocks[DDIR_RWDIR_CNT];
-	struct timespec iops_sample_time;
+		volatile int update_rusage;
+	} fio_cacheline_aligned;
 
-	volatile int update_rusage;
 	struct fio_sem *rusage_sem;
 	struct rusage ru_start;
 	struct rusage ru_end;
@@ -323,6 +338,9 @@ struct thread_data {
 	struct timespec lastrate[DDIR_RWDIR_CNT];
 	int64_t last_usec[DDIR_RWDIR_CNT];
 	struct frand_state poisson_state[DDIR_RWDIR_CNT];
+	struct arrival_state arrival[DDIR_RWDIR_CNT];
+	struct arrival_point *rate_curve;
+	unsigned int rate_curve_nr;
 
 	/*
 	 * Enforced rate submission/completion workqueue
@@ -340,15 +358,18 @@ struct thread_data {
 	uint64_t loops;
 
 	/*
-	 * Completions
+	 * Completions. Written for each I/O, and read by the helper thread
+	 * and the ETA code, so they get cache lines of their own.
 	 */
-	uint64_t io_blocks[DDIR_RWDIR_CNT];
-	uint64_t this_io_blocks[DDIR_RWDIR_CNT];
-	uint64_t io_bytes[DDIR_RWDIR_CNT];
-	uint64_t this_io_bytes[DDIR_RWDIR_CNT];
+	struct {
+		uint64_t io_blocks[DDIR_RWDIR_CNT];
+		uint64_t this_io_blocks[DDIR_RWDIR_CNT];
+		uint64_t io_bytes[DDIR_RWDIR_CNT];
+		uint64_t this_io_bytes[DDIR_RWDIR_CNT];
+	} fio_cacheline_aligned;
+
 	uint64_t io_skip_bytes;
 	uint64_t zone_bytes;
-	struct fio_sem *sem;
 	uint64_t bytes_done[DDIR_RWDIR_CNT];
 
 	/*
@@ -378,6 +399,18 @@ struct thread_data {
 	uint64_t latency_ios;
 	int latency_end_run;
 
+	/*
+	 * latency_controller=depth|iops state. The load is the queue depth
+	 * or IOPS rate, as a double so that small steps add up.
+	 */
+	uint64_t *latency_plat;
+	double latency_load;
+	double latency_err[2];
+	unsigned int latency_met;
+	uint64_t latency_met_iops[LAT_CTL_SUSTAIN];
+	uint64_t latency_sustained_iops;
+	FILE *latency_log;
+
 	/*
 	 * read/write mixed workload state
 	 */
@@ -436,6 +469,7 @@ struct thread_data {
 	int first_error;
 
 	struct fio_flow *flow;
+	uint64_t flow_tat[FLOW_RATE_NR];
 
 	/*
 	 * Can be overloaded by profiles
@@ -445,7 +479,10 @@ struct thread_data {
 
 	void *pinned_mem;
 
-	struct steadystate_data ss;
+	/*
+	 * Updated by the helper thread
+	 */
+	struct steadystate_data ss fio_cacheline_aligned;
 
 	char verror[FIO_VERROR_SIZE];
 
@@ -625,6 +662,7 @@ enum {
 	TD_SETTING_UP,
 	TD_RUNNING,
 	TD_PRE_READING,
+	TD_PRECONDITIONING,
 	TD_VERIFYING,
 	TD_FSYNCING,
 	TD_FINISHING,
@@ -643,6 +681,12 @@ static inline void td_set_ioengine_flags(struct thread_data *td)
 		    (td->io_ops->flags << TD_ENG_FLAG_SHIFT);
 }
 
+static inline void td_clear_ioengine_flags(struct thread_data *td,
+					   enum fio_ioengine_flags flags)
+{
+	td->flags &= ~(flags << TD_ENG_FLAG_SHIFT);
+}
+
 static inline bool td_ioengine_flagged(struct thread_data *td,
 				       enum fio_ioengine_flags flags)
 {
@@ -671,6 +715,9 @@ extern int __must_check fio_pin_memory(struct thread_data *);
 extern void fio_unpin_memory(struct thread_data *);
 extern int __must_check allocate_io_mem(struct thread_data *);
 extern void free_io_mem(struct thread_data *);
+typedef int (fio_io_mem_reg_fn)(struct thread_data *, void *, size_t, void *);
+extern int fio_register_io_mem(struct thread_data *, fio_io_mem_reg_fn *,
+				void *);
 extern void free_threads_shm(void);
 
 #ifdef FIO_INTERNAL
@@ -693,6 +740,7 @@ extern int io_queue_event(struct thread_data *td, struct io_u *io_u, int *ret,
 extern void lat_target_check(struct thread_data *);
 extern void lat_target_init(struct thread_data *);
 extern void lat_target_reset(struct thread_data *);
+extern void lat_target_exit(struct thread_data *);
 
 /*
  * Iterates all threads/processes within all the defined jobs
@@ -1,13 +1,33 @@
+#include <time.h>
+
 #include "fio.h"
 #include "fio_sem.h"
 #include "smalloc.h"
 #include "flist.h"
+#include "ioengines.h"
+#include "runner.h"
+
+/*
+ * How far ahead of its rate a flow or a job may get, i.e. the burst size
+ */
+#define FLOW_BURST_NSEC		((uint64_t) 1000000)
 
 struct fio_flow {
 	unsigned int refs;
 	struct flist_head list;
 	unsigned int id;
 	long long int flow_counter;
+
+	/*
+	 * Rate limit shared by all jobs in the flow. Each job is assured a
+	 * share of it by weight, and may use what other jobs leave idle.
+	 * The buckets hold the time at which the flow is allowed to do its
+	 * next I/O, and are updated with atomics since the jobs may be
+	 * processes.
+	 */
+	unsigned int total_weight;
+	uint64_t rate[FLOW_RATE_NR];
+	uint64_t tat[FLOW_RATE_NR];
 };
 
 static struct flist_head *flow_list;
@@ -29,8 +49,9 @@ int flow_threshold_exceeded(struct thread_data *td)
 	if (flow_counter > td->o.flow_watermark) {
 		if (td->o.flow_sleep) {
 			io_u_quiesce(td);
-			usleep(td->o.flow_sleep);
-		}
+			runner_sleep(td->o.flow_sleep);
+		} else
+			runner_yield();
 
 		return 1;
 	}
@@ -41,6 +62,137 @@ int flow_threshold_exceeded(struct thread_data *td)
 	return 0;
 }
 
+/*
+ * Jobs may be processes, so use a clock that is the same for all of them
+ */
+static uint64_t flow_now_ns(void)
+{
+	struct timeval tv;
+#ifdef CONFIG_CLOCK_MONOTONIC
+	struct timespec ts;
+
+	if (!clock_gettime(CLOCK_MONOTONIC, &ts))
+		return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#endif
+
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec * 1000000000ULL + tv.tv_usec * 1000ULL;
+}
+
+/*
+ * Charge 'cost' to a shared bucket if it isn't more than the burst ahead of
+ * now, or always if 'force' is set. Returns 0 if charged, or how long to
+ * wait before it can be.
+ */
+static uint64_t flow_bucket_take(uint64_t *tat, uint64_t now, uint64_t cost,
+				 bool force)
+{
+	uint64_t old, start;
+
+	do {
+		old = *(volatile uint64_t *) tat;
+		start = max(old, now);
+		if (!force && start - now > FLOW_BURST_NSEC)
+			return start - now - FLOW_BURST_NSEC;
+	} while (!__sync_bool_compare_and_swap(tat, old, start + cost));
+
+	return 0;
+}
+
+static bool flow_rate_limited(struct fio_flow *flow)
+{
+	return flow->rate[FLOW_RATE_BPS] || flow->rate[FLOW_RATE_IOPS];
+}
+
+/*
+ * Wait until the flow of this job lets it issue an I/O of 'bytes'. Within
+ * its assured share the job only waits for its own bucket. Beyond that it
+ * borrows from the flow, if the other jobs leave any of it idle.
+ */
+void flow_rate_wait(struct thread_data *td, unsigned long long bytes)
+{
+	struct fio_flow *flow = td->flow;
+	uint64_t cost[FLOW_RATE_NR], now, wait, job_wait;
+	const uint64_t units[FLOW_RATE_NR] = { bytes, 1 };
+	bool assured;
+	int i;
+
+	if (!flow || !flow_rate_limited(flow))
+		return;
+
+	for (i = 0; i < FLOW_RATE_NR; i++) {
+		if (flow->rate[i])
+			cost[i] = units[i] * 1000000000ULL / flow->rate[i];
+	}
+
+	while (!td->terminate) {
+		now = flow_now_ns();
+
+		job_wait = 0;
+		for (i = 0; i < FLOW_RATE_NR; i++) {
+			if (flow->rate[i] &&
+			    td->flow_tat[i] > now + FLOW_BURST_NSEC)
+				job_wait = max(job_wait, td->flow_tat[i] - now -
+							FLOW_BURST_NSEC);
+		}
+
+		assured = !job_wait;
+		wait = 0;
+		for (i = 0; i < FLOW_RATE_NR; i++) {
+			if (!flow->rate[i])
+				continue;
+
+			wait = flow_bucket_take(&flow->tat[i], now, cost[i],
+						assured);
+			if (wait)
+				break;
+		}
+
+		/*
+		 * If a later limit refused the I/O, give back what the
+		 * earlier ones were charged, we'll try again after waiting
+		 */
+		if (wait) {
+			while (--i >= 0) {
+				if (flow->rate[i])
+					__sync_fetch_and_sub(&flow->tat[i],
+								cost[i]);
+			}
+		}
+
+		if (!wait) {
+			for (i = 0; i < FLOW_RATE_NR; i++) {
+				uint64_t job_cost, tat;
+
+				if (!flow->rate[i])
+					continue;
+
+				job_cost = cost[i] * flow->total_weight /
+						td->o.flow_weight;
+				tat = max(td->flow_tat[i], now) + job_cost;
+				/*
+				 * Don't let a job use up its assured share
+				 * by borrowing
+				 */
+				if (!assured)
+					tat = min(tat, now + FLOW_BURST_NSEC +
+								job_cost);
+				td->flow_tat[i] = tat;
+			}
+			return;
+		}
+
+		wait = min(wait, job_wait ? job_wait : wait);
+		dprint(FD_RATE, "flow %u: wait %llu nsec\n", flow->id,
+						(unsigned long long) wait);
+
+		if (td->io_u_queued)
+			td_io_commit(td);
+
+		usec_sleep(td, (wait + 999) / 1000);
+	}
+}
+
 static struct fio_flow *flow_get(unsigned int id)
 {
 	struct fio_flow *flow = NULL;
@@ -65,10 +217,9 @@ static struct fio_flow *flow_get(unsigned int id)
 			fio_sem_up(flow_lock);
 			return NULL;
 		}
-		flow->refs = 0;
+		memset(flow, 0, sizeof(*flow));
 		INIT_FLIST_HEAD(&flow->list);
 		flow->id = id;
-		flow->flow_counter = 0;
 
 		flist_add_tail(&flow->list, flow_list);
 	}
@@ -93,15 +244,68 @@ static void flow_put(struct fio_flow *flow)
 	fio_sem_up(flow_lock);
 }
 
-void flow_init_job(struct thread_data *td)
+/*
+ * All jobs of a rate limited flow should agree on the limits, whichever
+ * job sets them
+ */
+static int flow_set_rate(struct fio_flow *flow, struct thread_data *td)
 {
-	if (td->o.flow)
-		td->flow = flow_get(td->o.flow_id);
+	const uint64_t rate[FLOW_RATE_NR] = {
+		td->o.flow_rate, td->o.flow_rate_iops
+	};
+	int i, ret = 0;
+
+	fio_sem_down(flow_lock);
+
+	for (i = 0; i < FLOW_RATE_NR; i++) {
+		if (!rate[i])
+			continue;
+		if (flow->rate[i] && flow->rate[i] != rate[i]) {
+			log_err("fio: %s: flow %u has conflicting rate limits\n",
+					td->o.name, flow->id);
+			ret = 1;
+			break;
+		}
+		flow->rate[i] = rate[i];
+	}
+
+	if (!ret)
+		flow->total_weight += td->o.flow_weight;
+
+	fio_sem_up(flow_lock);
+	return ret;
+}
+
+int flow_init_job(struct thread_data *td)
+{
+	if (!td->o.flow && !td->o.flow_rate && !td->o.flow_rate_iops)
+		return 0;
+
+	td->flow = flow_get(td->o.flow_id);
+	if (!td->flow) {
+		if (!td->o.flow_rate && !td->o.flow_rate_iops)
+			return 0;
+
+		log_err("fio: failed to set up flow %u\n", td->o.flow_id);
+		return 1;
+	}
+
+	if (flow_set_rate(td->flow, td)) {
+		flow_put(td->flow);
+		td->flow = NULL;
+		return 1;
+	}
+
+	return 0;
 }
 
 void flow_exit_job(struct thread_data *td)
 {
 	if (td->flow) {
+		fio_sem_down(flow_lock);
+		td->flow->total_weight -= td->o.flow_weight;
+		fio_sem_up(flow_lock);
+
 		flow_put(td->flow);
 		td->flow = NULL;
 	}
@@ -1,8 +1,18 @@
 #ifndef FIO_FLOW_H
 #define FIO_FLOW_H
 
+/*
+ * Limits that can be set on a flow, see flow_rate and flow_rate_iops
+ */
+enum {
+	FLOW_RATE_BPS = 0,
+	FLOW_RATE_IOPS,
+	FLOW_RATE_NR,
+};
+
 int flow_threshold_exceeded(struct thread_data *td);
-void flow_init_job(struct thread_data *td);
+void flow_rate_wait(struct thread_data *td, unsigned long long bytes);
+int flow_init_job(struct thread_data *td);
 void flow_exit_job(struct thread_data *td);
 
 void flow_exit(void);
@@ -5,13 +5,29 @@
 
 static volatile struct idle_prof_common ipc;
 
+/*
+ * A unit of work. It pauses rather than touches memory, so the idle loop
+ * doesn't pollute the caches or compete for memory bandwidth with the jobs
+ * on its CPU or its siblings.
+ */
+static inline void idle_unit(void)
+{
+	int i;
+
+	for (i = 0; i < IDLE_UNIT_PAUSES; i++) {
+		nop;
+		/* don't let an empty nop turn this into an empty loop */
+		__asm__ __volatile__("" : : : "memory");
+	}
+}
+
 /*
  * Get time to complete an unit work on a particular cpu.
  * The minimum number in CALIBRATE_RUNS runs is returned.
  */
-static double calibrate_unit(unsigned char *data)
+static double calibrate_unit(void)
 {
-	unsigned long t, i, j, k;
+	unsigned long t, i, j;
 	struct timespec tps;
 	double tunit = 0.0;
 
@@ -20,16 +36,13 @@ static double calibrate_unit(unsigned char *data)
 		fio_gettime(&tps, NULL);
 		/* scale for less variance */
 		for (j = 0; j < CALIBRATE_SCALE; j++) {
-			/* unit of work */
-			for (k=0; k < page_size; k++) {
-				data[(k + j) % page_size] = k % 256;
-				/*
-				 * we won't see STOP here. this is to match
-				 * the same statement in the profiling loop.
-				 */
-				if (ipc.status == IDLE_PROF_STATUS_PROF_STOP)
-					return 0.0;
-			}
+			idle_unit();
+			/*
+			 * we won't see STOP here. this is to match
+			 * the same statement in the profiling loop.
+			 */
+			if (ipc.status == IDLE_PROF_STATUS_PROF_STOP)
+				return 0.0;
 		}
 
 		t = utime_since_now(&tps);
@@ -77,7 +90,7 @@ static int set_cpu_affinity(struct idle_prof_thread *ipt)
 static void *idle_prof_thread_fn(void *data)
 {
 	int retval;
-	unsigned long j, k;
+	unsigned long j;
 	struct idle_prof_thread *ipt = data;
 
 	/* wait for all threads are spawned */
@@ -96,7 +109,8 @@ static void *idle_prof_thread_fn(void *data)
 		return NULL;
         }
 
-	ipt->cali_time = calibrate_unit(ipt->data);
+	if (!ipc.cached)
+		ipt->cali_time = calibrate_unit();
 
 	/* delay to set IDLE class till now for better calibration accuracy */
 #if defined(CONFIG_SCHED_IDLE)
@@ -137,20 +151,13 @@ static void *idle_prof_thread_fn(void *data)
 	ipt->state = TD_RUNNING;
 
 	j = 0;
-	while (1) {
-		for (k = 0; k < page_size; k++) {
-			ipt->data[(k + j) % page_size] = k % 256;
-			if (ipc.status == IDLE_PROF_STATUS_PROF_STOP) {
-				fio_gettime(&ipt->tpe, NULL);
-				goto idle_prof_done;
-			}
-		}
+	while (ipc.status != IDLE_PROF_STATUS_PROF_STOP) {
+		idle_unit();
 		j++;
 	}
+	fio_gettime(&ipt->tpe, NULL);
 
-idle_prof_done:
-
-	ipt->loops = j + (double) k / page_size;
+	ipt->loops = j;
 	ipt->state = TD_EXITED;
 	pthread_mutex_unlock(&ipt->start_lock);
 
@@ -181,6 +188,108 @@ static void calibration_stats(void)
 	ipc.cali_stddev = sqrt(var/(ipc.nr_cpus-1));
 }
 
+/*
+ * Cached calibration results are only valid for the same machine, CPU
+ * model and unit of work
+ */
+static void idle_prof_cache_key(char *buf, size_t len)
+{
+	char host[64], model[128] = "unknown", line[256];
+	FILE *f;
+
+	if (gethostname(host, sizeof(host)))
+		strcpy(host, "unknown");
+	host[sizeof(host) - 1] = '\0';
+
+	f = fopen("/proc/cpuinfo", "r");
+	if (f) {
+		while (fgets(line, sizeof(line), f)) {
+			char *p;
+
+			if (strncmp(line, "model name", 10))
+				continue;
+			p = strchr(line, ':');
+			if (!p)
+				break;
+			p++;
+			while (*p == ' ')
+				p++;
+			p[strcspn(p, "\n")] = '\0';
+			snprintf(model, sizeof(model), "%s", p);
+			break;
+		}
+		fclose(f);
+	}
+
+	snprintf(buf, len, "fio-idle-prof v%d host=%s cpus=%d unit=%d model=%s\n",
+			IDLE_PROF_CACHE_VER, host, ipc.nr_cpus,
+			IDLE_UNIT_PAUSES, model);
+}
+
+static int idle_prof_cache_load(void)
+{
+	char key[512], line[512];
+	double t, sum = 0.0, mean;
+	int i, cpu;
+	FILE *f;
+
+	f = fopen(ipc.cache_file, "r");
+	if (!f)
+		return 0;
+
+	idle_prof_cache_key(key, sizeof(key));
+	if (!fgets(line, sizeof(line), f) || strcmp(line, key))
+		goto invalid;
+
+	for (i = 0; i < ipc.nr_cpus; i++) {
+		if (fscanf(f, "%d %lf\n", &cpu, &t) != 2 || cpu != i ||
+		    t <= 0.0)
+			goto invalid;
+		ipc.ipts[i].cali_time = t;
+		sum += t;
+	}
+	fclose(f);
+
+	/*
+	 * Make sure the unit of work still takes as long, e.g. the frequency
+	 * governor settings may have changed since
+	 */
+	mean = sum / ipc.nr_cpus;
+	t = calibrate_unit();
+	if (fabs(t - mean) > mean * IDLE_PROF_CACHE_TOL / 100.0) {
+		log_info("fio: idle-prof calibration cache is stale "
+			 "(%3.2fus vs %3.2fus), recalibrating\n", t, mean);
+		return 0;
+	}
+
+	dprint(FD_PROCESS, "idle-prof: using calibration from %s\n",
+			ipc.cache_file);
+	return 1;
+invalid:
+	fclose(f);
+	return 0;
+}
+
+static void idle_prof_cache_save(void)
+{
+	char key[512];
+	FILE *f;
+	int i;
+
+	f = fopen(ipc.cache_file, "w");
+	if (!f) {
+		log_err("fio: failed to write idle-prof cache %s: %s\n",
+				ipc.cache_file, strerror(errno));
+		return;
+	}
+
+	idle_prof_cache_key(key, sizeof(key));
+	fputs(key, f);
+	for (i = 0; i < ipc.nr_cpus; i++)
+		fprintf(f, "%d %f\n", i, ipc.ipts[i].cali_time);
+	fclose(f);
+}
+
 void fio_idle_prof_init(void)
 {
 	int i, ret;
@@ -209,12 +318,7 @@ void fio_idle_prof_init(void)
 		return;
 	}
 
-	ipc.buf = malloc(ipc.nr_cpus * page_size);
-	if (!ipc.buf) {
-		log_err("fio: malloc failed\n");
-		free(ipc.ipts);
-		return;
-	}
+	ipc.cached = ipc.cache_file && idle_prof_cache_load();
 
 	/*
 	 * profiling aborts on any single thread failure since the
@@ -225,7 +329,6 @@ void fio_idle_prof_init(void)
 
 		ipt->cpu = i;	
 		ipt->state = TD_NOT_CREATED;
-		ipt->data = (unsigned char *)(ipc.buf + page_size * i);
 
 		if ((ret = pthread_mutex_init(&ipt->init_lock, NULL))) {
 			ipc.status = IDLE_PROF_STATUS_ABORT;
@@ -296,9 +399,11 @@ void fio_idle_prof_init(void)
 			ipc.status = IDLE_PROF_STATUS_ABORT;
 	}
 
-	if (ipc.status != IDLE_PROF_STATUS_ABORT)
+	if (ipc.status != IDLE_PROF_STATUS_ABORT) {
 		calibration_stats();
-	else
+		if (ipc.cache_file && !ipc.cached)
+			idle_prof_cache_save();
+	} else
 		ipc.cali_mean = ipc.cali_stddev = 0.0;
 
 	if (ipc.opt == IDLE_PROF_OPT_CALI)
@@ -397,6 +502,44 @@ static double fio_idle_prof_cpu_stat(int cpu)
 	return p * 100.0;
 }
 
+static int idle_prof_nr_nodes(void)
+{
+#ifdef CONFIG_LIBNUMA
+	if (numa_available() < 0)
+		return 0;
+
+	return numa_max_node() + 1;
+#else
+	return 0;
+#endif
+}
+
+/*
+ * return idle percentage of the cpus of a NUMA node, or -1 if the node
+ * has no cpus.
+ */
+static double fio_idle_prof_node_stat(int node)
+{
+#ifdef CONFIG_LIBNUMA
+	int i, nr = 0;
+	double p = 0.0;
+
+	if (ipc.opt == IDLE_PROF_OPT_NONE)
+		return -1.0;
+
+	for (i = 0; i < ipc.nr_cpus; i++) {
+		if (numa_node_of_cpu(i) != node)
+			continue;
+		p += ipc.ipts[i].idleness;
+		nr++;
+	}
+
+	if (nr)
+		return p * 100.0 / nr;
+#endif
+	return -1.0;
+}
+
 void fio_idle_prof_cleanup(void)
 {
 	if (ipc.ipts) {
@@ -404,14 +547,17 @@ void fio_idle_prof_cleanup(void)
 		ipc.ipts = NULL;
 	}
 
-	if (ipc.buf) {
-		free(ipc.buf);
-		ipc.buf = NULL;
+	if (ipc.cache_file) {
+		free(ipc.cache_file);
+		ipc.cache_file = NULL;
 	}
 }
 
 int fio_idle_prof_parse_opt(const char *args)
 {
+	char *str, *cache;
+	int ret;
+
 	ipc.opt = IDLE_PROF_OPT_NONE; /* default */
 
 	if (!args) {
@@ -420,23 +566,38 @@ int fio_idle_prof_parse_opt(const char *args)
 	}	
 
 #if defined(FIO_HAVE_CPU_AFFINITY) && defined(CONFIG_SCHED_IDLE)
-	if (strcmp("calibrate", args) == 0) {
+	str = strdup(args);
+	cache = strchr(str, ',');
+	if (cache) {
+		*cache++ = '\0';
+		if (strncmp(cache, "cache=", 6) || !cache[6]) {
+			log_err("fio: incorrect idle-prof option: %s\n", args);
+			free(str);
+			return -1;
+		}
+		ipc.cache_file = strdup(cache + 6);
+	}
+
+	if (strcmp("calibrate", str) == 0) {
 		ipc.opt = IDLE_PROF_OPT_CALI;
 		fio_idle_prof_init();
 		fio_idle_prof_start();
 		fio_idle_prof_stop();
 		show_idle_prof_stats(FIO_OUTPUT_NORMAL, NULL, NULL);
-		return 1;
-	} else if (strcmp("system", args) == 0) {
+		ret = 1;
+	} else if (strcmp("system", str) == 0) {
 		ipc.opt = IDLE_PROF_OPT_SYSTEM;
-		return 0;
-	} else if (strcmp("percpu", args) == 0) {
+		ret = 0;
+	} else if (strcmp("percpu", str) == 0) {
 		ipc.opt = IDLE_PROF_OPT_PERCPU;
-		return 0;
+		ret = 0;
 	} else {
 		log_err("fio: incorrect idle-prof option: %s\n", args);
-		return -1;
+		ret = -1;
 	}	
+
+	free(str);
+	return ret;
 #else
 	log_err("fio: idle-prof not supported on this platform\n");
 	return -1;
@@ -446,9 +607,10 @@ int fio_idle_prof_parse_opt(const char *args)
 void show_idle_prof_stats(int output, struct json_object *parent,
 			  struct buf_output *out)
 {
-	int i, nr_cpus = ipc.nr_cpus;
+	int i, nr_cpus = ipc.nr_cpus, nr_nodes = idle_prof_nr_nodes();
 	struct json_object *tmp;
 	char s[MAX_CPU_STR_LEN];
+	double p;
 
 	if (output == FIO_OUTPUT_NORMAL) {
 		if (ipc.opt > IDLE_PROF_OPT_CALI)
@@ -466,9 +628,23 @@ void show_idle_prof_stats(int output, struct json_object *parent,
 			log_buf(out, "\n");
 		}
 
+		if (ipc.opt >= IDLE_PROF_OPT_SYSTEM && nr_nodes > 1) {
+			const char *sep = "  pernode:";
+
+			for (i = 0; i < nr_nodes; i++) {
+				p = fio_idle_prof_node_stat(i);
+				if (p < 0.0)
+					continue;
+				log_buf(out, "%s node%d=%3.2f%%", sep, i, p);
+				sep = ",";
+			}
+			log_buf(out, "\n");
+		}
+
 		if (ipc.opt >= IDLE_PROF_OPT_CALI) {
 			log_buf(out, "  unit work: mean=%3.2fus,", ipc.cali_mean);
-			log_buf(out, " stddev=%3.2f\n", ipc.cali_stddev);
+			log_buf(out, " stddev=%3.2f%s\n", ipc.cali_stddev,
+					ipc.cached ? " (cached)" : "");
 		}
 
 		return;
@@ -492,7 +668,16 @@ void show_idle_prof_stats(int output, struct json_object *parent,
 			}
 		}
 
+		for (i = 0; nr_nodes > 1 && i < nr_nodes; i++) {
+			p = fio_idle_prof_node_stat(i);
+			if (p < 0.0)
+				continue;
+			snprintf(s, MAX_CPU_STR_LEN, "node-%d", i);
+			json_object_add_value_float(tmp, s, p);
+		}
+
 		json_object_add_value_float(tmp, "unit_mean", ipc.cali_mean);
 		json_object_add_value_float(tmp, "unit_stddev", ipc.cali_stddev);
+		json_object_add_value_int(tmp, "unit_cached", ipc.cached);
 	}
 }
@@ -9,6 +9,16 @@
 #define CALIBRATE_SCALE 1000
 #define MAX_CPU_STR_LEN 32
 
+/* pause instructions in a unit of work */
+#define IDLE_UNIT_PAUSES	256
+
+/*
+ * Cached calibration results are used if the unit work time measured at
+ * start is within this many percent of the cached mean
+ */
+#define IDLE_PROF_CACHE_VER	1
+#define IDLE_PROF_CACHE_TOL	10
+
 enum {
 	IDLE_PROF_OPT_NONE,
 	IDLE_PROF_OPT_CALI,                /* calibration only */
@@ -32,7 +42,6 @@ struct idle_prof_thread {
 	double cali_time; /* microseconds to finish a unit work */
 	double loops;
 	double idleness;
-	unsigned char *data;             /* bytes to be touched */
 	pthread_cond_t  cond;
 	pthread_mutex_t init_lock;
 	pthread_mutex_t start_lock;
@@ -47,7 +56,8 @@ struct idle_prof_common {
 	int opt;
 	double cali_mean;
 	double cali_stddev;
-	void *buf;    /* single data allocation for all threads */
+	char *cache_file;	/* calibration cache, if any */
+	int cached;		/* calibration came from the cache */
 };
 
 extern int fio_idle_prof_parse_opt(const char *);
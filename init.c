@@ -331,6 +331,8 @@ static void free_shm(void)
 	trigger_file = trigger_cmd = trigger_remote_cmd = NULL;
 
 	options_free(fio_options, &def_thread.o);
+	free(def_thread.o.rate_curve);
+	def_thread.o.rate_curve = NULL;
 	fio_filelock_exit();
 	file_hash_exit();
 	scleanup();
@@ -367,7 +369,7 @@ static int setup_thread_area(void)
 			break;
 		}
 #else
-		threads = malloc(size);
+		threads = calloc(1, size);
 		if (threads)
 			break;
 #endif
@@ -388,7 +390,11 @@ static int setup_thread_area(void)
 		shmctl(shm_id, IPC_RMID, NULL);
 #endif
 
-	memset(threads, 0, max_jobs * sizeof(struct thread_data));
+	/*
+	 * A new shm segment is zero filled, as is the calloc'ed one. Don't
+	 * clear it again, as that would fault in all of it up front, for
+	 * max_jobs jobs rather than the ones actually used.
+	 */
 	for (i = 0; i < max_jobs; i++)
 		DRD_IGNORE_VAR(threads[i]);
 	fio_debug_jobp = (unsigned int *)(threads + max_jobs);
@@ -484,7 +490,15 @@ static struct thread_data *get_new_job(bool global, struct thread_data *parent,
 	}
 
 	td = &threads[thread_number++];
-	*td = *parent;
+
+	/*
+	 * Copy everything but the stats, which are big and are set up by
+	 * add_job(). Free slots are zeroed, so they start out cleared.
+	 */
+	memcpy(td, parent, offsetof(struct thread_data, ts));
+	memcpy((char *) &td->ts + sizeof(td->ts),
+		(char *) &parent->ts + sizeof(parent->ts),
+		sizeof(*td) - offsetof(struct thread_data, ts) - sizeof(td->ts));
 
 	INIT_FLIST_HEAD(&td->opt_list);
 	if (parent != &def_thread)
@@ -607,6 +621,67 @@ static int fixup_options(struct thread_data *td)
 			 " with the --readonly parameter.\n");
 		ret |= 1;
 	}
+	if (read_only && o->precondition_fill) {
+		log_err("fio: precondition_fill is not allowed with the"
+			 " --readonly parameter.\n");
+		ret |= 1;
+	}
+
+	if (o->ss_measure && !o->ss_dur) {
+		log_err("fio: steadystate_measure requires steadystate_duration\n");
+		ret |= 1;
+	}
+
+	if (o->latency_controller != LAT_CTL_BISECT && !o->latency_target) {
+		log_err("fio: latency_controller requires latency_target\n");
+		ret |= 1;
+	}
+	if (o->latency_controller == LAT_CTL_IOPS &&
+	    (ddir_rw_sum(o->rate) || ddir_rw_sum(o->rate_iops))) {
+		log_err("fio: latency_controller=iops can't be combined with"
+			 " rate or rate_iops\n");
+		ret |= 1;
+	}
+	if (o->latency_controller != LAT_CTL_BISECT && o->disable_lat) {
+		log_err("fio: latency_controller needs disable_lat=0\n");
+		ret |= 1;
+	}
+
+	if (o->job_runners) {
+		/*
+		 * Jobs on a runner must never block the runner thread, nor
+		 * change settings that are per thread
+		 */
+		if (o->verify_async || o->io_submit_mode == IO_MODE_OFFLOAD) {
+			log_err("fio: job_runners can't be combined with"
+				 " verify_async or io_submit_mode=offload\n");
+			ret |= 1;
+		}
+		if (fio_option_is_set(o, cpumask) ||
+		    fio_option_is_set(o, numa_cpunodes) ||
+		    fio_option_is_set(o, numa_memnodes)) {
+			log_err("fio: job_runners can't be combined with"
+				 " cpus_allowed, cpumask or numa options\n");
+			ret |= 1;
+		}
+		if (fio_option_is_set(o, nice) ||
+		    fio_option_is_set(o, ioprio) ||
+		    fio_option_is_set(o, ioprio_class) || o->cgroup) {
+			log_err("fio: job_runners can't be combined with"
+				 " nice, prio, prioclass or cgroup\n");
+			ret |= 1;
+		}
+		/*
+		 * Zone locks are recursive pthread mutexes, jobs sharing a
+		 * runner thread would all own them at once
+		 */
+		if (o->zone_mode == ZONE_MODE_ZBD) {
+			log_err("fio: job_runners can't be combined with"
+				 " zonemode=zbd\n");
+			ret |= 1;
+		}
+		o->use_thread = 1;
+	}
 
 #ifndef CONFIG_PSHARED
 	if (!o->use_thread) {
@@ -734,6 +809,14 @@ static int fixup_options(struct thread_data *td)
 	if (o->iodepth_batch > o->iodepth || !o->iodepth_batch)
 		o->iodepth_batch = o->iodepth;
 
+	/*
+	 * Prepared batches are submitted in one go, unless asked otherwise
+	 */
+	if (o->iodepth_batch_prep > o->iodepth)
+		o->iodepth_batch_prep = o->iodepth;
+	if (o->iodepth_batch_prep > 1 && !fio_option_is_set(o, iodepth_batch))
+		o->iodepth_batch = o->iodepth_batch_prep;
+
 	/*
 	 * If max batch complete number isn't set or set incorrectly,
 	 * default to the same as iodepth_batch_complete_min
@@ -1493,7 +1576,8 @@ static int add_job(struct thread_data *td, const char *jobname, int job_add_num,
 	if (!wait_for_ok(jobname, o))
 		goto err;
 
-	flow_init_job(td);
+	if (flow_init_job(td))
+		goto err;
 
 	/*
 	 * IO engines only need this for option callbacks, and the address may
@@ -1509,8 +1593,6 @@ static int add_job(struct thread_data *td, const char *jobname, int job_add_num,
 			f->real_file_size = -1ULL;
 	}
 
-	td->sem = fio_sem_init(FIO_SEM_LOCKED);
-
 	td->ts.clat_percentiles = o->clat_percentiles;
 	td->ts.lat_percentiles = o->lat_percentiles;
 	td->ts.percentile_precision = o->percentile_precision;
@@ -1521,10 +1603,14 @@ static int add_job(struct thread_data *td, const char *jobname, int job_add_num,
 		td->ts.clat_stat[i].min_val = ULONG_MAX;
 		td->ts.slat_stat[i].min_val = ULONG_MAX;
 		td->ts.lat_stat[i].min_val = ULONG_MAX;
+		td->ts.rsp_stat[i].min_val = ULONG_MAX;
+		td->ts.backlog_stat[i].min_val = ULONG_MAX;
 		td->ts.bw_stat[i].min_val = ULONG_MAX;
 		td->ts.iops_stat[i].min_val = ULONG_MAX;
 	}
 	td->ts.sync_stat.min_val = ULONG_MAX;
+	for (i = 0; i < FIO_ZONE_OP_NR; i++)
+		td->ts.zone_op_stat[i].min_val = ULONG_MAX;
 	td->ddir_seq_nr = o->ddir_seq_nr;
 
 	if ((o->stonewall || o->new_group) && prev_group_jobs) {
@@ -1573,6 +1659,12 @@ static int add_job(struct thread_data *td, const char *jobname, int job_add_num,
 				td->thread_number, suf, o->per_job_logs);
 		setup_log(&td->clat_log, &p, logname);
 
+		if (ddir_rw_sum(td->rate_bps)) {
+			p.log_type = IO_LOG_TYPE_RSP;
+			gen_log_name(logname, sizeof(logname), "rsp", pre,
+					td->thread_number, suf, o->per_job_logs);
+			setup_log(&td->rsp_log, &p, logname);
+		}
 	}
 
 	if (o->write_hist_log) {
@@ -2192,6 +2284,7 @@ static void usage(const char *name)
 	printf("  --help\t\tPrint this page\n");
 	printf("  --cpuclock-test\tPerform test/validation of CPU clock\n");
 	printf("  --crctest=[type]\tTest speed of checksum functions\n");
+	printf("  --memcpytest=[type]\tTest speed of memory copy kernels\n");
 	printf("  --cmdhelp=cmd\t\tPrint command help, \"all\" for all of"
 		" them\n");
 	printf("  --enghelp=engine\tPrint ioengine help, or list"
@@ -2219,7 +2312,8 @@ static void usage(const char *name)
 	printf("  --remote-config=file\tTell fio server to load this local job file\n");
 	printf("  --idle-prof=option\tReport cpu idleness on a system or percpu basis\n"
 		"\t\t\t(option=system,percpu) or run unit work\n"
-		"\t\t\tcalibration only (option=calibrate)\n");
+		"\t\t\tcalibration only (option=calibrate), optionally\n"
+		"\t\t\tcached in a file (option=...,cache=file)\n");
 #ifdef CONFIG_ZLIB
 	printf("  --inflate-log=log\tInflate and output compressed log\n");
 #endif
@@ -2851,7 +2945,8 @@ int parse_cmd_line(int argc, char *argv[], int client_type)
 		case 'M':
 			did_arg = true;
 			do_exit++;
-			exit_val = fio_memcpy_test(optarg);
+			exit_val = fio_memcpy_test(optarg,
+					output_format & FIO_OUTPUT_JSON);
 			break;
 		case 'L': {
 			long long val;
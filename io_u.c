@@ -1,6 +1,7 @@
 #include <unistd.h>
 #include <string.h>
 #include <assert.h>
+#include <math.h>
 
 #include "fio.h"
 #include "verify.h"
@@ -11,9 +12,11 @@
 #include "lib/pow2.h"
 #include "minmax.h"
 #include "zbd.h"
+#include "runner.h"
 
 struct io_completion_data {
 	int nr;				/* input */
+	struct lat_batch *lat_batch;	/* input, if latencies are batched */
 
 	int error;			/* output */
 	uint64_t bytes_done[DDIR_RWDIR_CNT];	/* output */
@@ -742,6 +745,37 @@ static enum fio_ddir get_rw_ddir(struct thread_data *td)
 	return td->rwmix_ddir;
 }
 
+/*
+ * Note when the rate process wanted this io_u to be issued. The response
+ * time is measured from then, so stalls that make us issue late still show
+ * up in the latency, rather than being hidden by the late issue. The number
+ * of I/Os that should have been issued by now is the backlog.
+ */
+static void set_rate_sched(struct thread_data *td, struct io_u *io_u,
+			   enum fio_ddir ddir)
+{
+	uint64_t sched = td->rate_next_io_time[ddir];
+	uint64_t now, nsec;
+
+	io_u->sched_time = td->start;
+	nsec = io_u->sched_time.tv_nsec + sched * 1000;
+	io_u->sched_time.tv_sec += nsec / 1000000000;
+	io_u->sched_time.tv_nsec = nsec % 1000000000;
+	io_u_set(td, io_u, IO_U_F_RATE_SCHED);
+
+	if (!td->o.stats || !ramp_time_over(td))
+		return;
+
+	now = utime_since_now(&td->start);
+	if (now > sched)
+		now = (now - sched) * td->rate_bps[ddir] /
+			(1000000ULL * td->o.min_bs[ddir]);
+	else
+		now = 0;
+
+	add_backlog_sample(td, ddir, now);
+}
+
 static void set_rw_ddir(struct thread_data *td, struct io_u *io_u)
 {
 	enum fio_ddir ddir = get_rw_ddir(td);
@@ -756,6 +790,9 @@ static void set_rw_ddir(struct thread_data *td, struct io_u *io_u)
 
 	io_u->ddir = io_u->acct_ddir = ddir;
 
+	if (ddir_rw(ddir) && __should_check_rate(td) && td->rate_bps[ddir])
+		set_rate_sched(td, io_u, ddir);
+
 	if (io_u->ddir == DDIR_WRITE && td_ioengine_flagged(td, FIO_BARRIER) &&
 	    td->o.barrier_blocks &&
 	   !(td->io_issues[DDIR_WRITE] % td->o.barrier_blocks) &&
@@ -1371,6 +1408,185 @@ static void lat_new_cycle(struct thread_data *td)
 	td->latency_failed = 0;
 }
 
+/*
+ * latency_controller=depth|iops. Every window, the load (queue depth or
+ * IOPS) is adjusted by an incremental PID controller on the log ratio of
+ * latency_target to the latency_percentile of the window. Working on the
+ * ratio makes the steps independent of the scale of the latencies.
+ */
+#define LAT_CTL_KP		0.3
+#define LAT_CTL_KI		0.4
+#define LAT_CTL_KD		0.1
+#define LAT_CTL_MAX_STEP	0.5
+#define LAT_CTL_WINDOW		500000000ULL	/* nsec */
+#define LAT_CTL_MIN_SAMPLES	64
+
+/*
+ * Pace the job to 'iops' through the rate code, split by rwmix. Restart
+ * the rate accounting as if we had been going at the new rate all along, so
+ * the job doesn't burst to catch up or stall to slow down.
+ */
+static void lat_ctl_set_iops(struct thread_data *td, double iops)
+{
+	struct thread_options *o = &td->o;
+	uint64_t now = utime_since_now(&td->start);
+	enum fio_ddir ddir;
+
+	for (ddir = DDIR_READ; ddir <= DDIR_WRITE; ddir++) {
+		double share = 1.0;
+		uint64_t bps;
+
+		if ((ddir == DDIR_READ && !td_read(td)) ||
+		    (ddir == DDIR_WRITE && !td_write(td)))
+			continue;
+		if (td_rw(td))
+			share = o->rwmix[ddir] / 100.0;
+
+		bps = iops * share * o->min_bs[ddir];
+		td->rate_bps[ddir] = bps;
+		td->rate_io_issue_bytes[ddir] = (double) now * bps / 1000000.0;
+		td->last_usec[ddir] = now;
+		td->rate_next_io_time[ddir] = now;
+	}
+}
+
+static void lat_ctl_check(struct thread_data *td)
+{
+	struct thread_options *o = &td->o;
+	const double p = o->latency_percentile.u.f;
+	unsigned long long *ovals = NULL, minv, maxv;
+	uint64_t nsec_window, ios, iops, lat = 0, nr = 0, min_nr;
+	fio_fp64_t plist[2];
+	double err, step;
+	int i;
+
+	/*
+	 * Both are in nsec, latency_window is converted by fixup_options()
+	 */
+	nsec_window = ntime_since_now(&td->latency_ts);
+	if (nsec_window < (o->latency_window ?: LAT_CTL_WINDOW))
+		return;
+
+	/*
+	 * Extend the window until the percentile means something
+	 */
+	for (i = 0; i < FIO_IO_U_PLAT_NR; i++)
+		nr += td->latency_plat[i];
+	min_nr = LAT_CTL_MIN_SAMPLES;
+	if (p < 100.0)
+		min_nr = max(min_nr, (uint64_t) (100.0 / (100.0 - p)));
+	if (nr < min_nr)
+		return;
+
+	ios = ddir_rw_sum(td->io_blocks) - td->latency_ios;
+	iops = ios * 1000000000ULL / nsec_window;
+
+	plist[0].u.f = p;
+	plist[1].u.f = 0.0;
+	if (calc_clat_percentiles(td->latency_plat, nr, plist, &ovals, &maxv,
+				  &minv)) {
+		lat = ovals[0];
+		free(ovals);
+	}
+	memset(td->latency_plat, 0, FIO_IO_U_PLAT_NR * sizeof(uint64_t));
+
+	/*
+	 * Track the highest IOPS that met the target for LAT_CTL_SUSTAIN
+	 * windows in a row
+	 */
+	if (lat <= o->latency_target) {
+		uint64_t sustained = -1ULL;
+
+		td->latency_met_iops[td->latency_met++ % LAT_CTL_SUSTAIN] = iops;
+		if (td->latency_met >= LAT_CTL_SUSTAIN) {
+			for (i = 0; i < LAT_CTL_SUSTAIN; i++)
+				sustained = min(sustained, td->latency_met_iops[i]);
+			td->latency_sustained_iops = max(td->latency_sustained_iops,
+								sustained);
+		}
+	} else
+		td->latency_met = 0;
+
+	err = log((double) o->latency_target / (double) max(lat, (uint64_t) 1));
+	step = LAT_CTL_KP * (err - td->latency_err[0]) + LAT_CTL_KI * err +
+		LAT_CTL_KD * (err - 2 * td->latency_err[0] + td->latency_err[1]);
+	step = min(step, LAT_CTL_MAX_STEP);
+	step = max(step, -LAT_CTL_MAX_STEP);
+	td->latency_err[1] = td->latency_err[0];
+	td->latency_err[0] = err;
+
+	if (o->latency_controller == LAT_CTL_DEPTH) {
+		td->latency_load *= exp(step);
+		td->latency_load = min(td->latency_load, (double) o->iodepth);
+		td->latency_load = max(td->latency_load, 1.0);
+		td->latency_qd = td->latency_load + 0.5;
+	} else {
+		/*
+		 * The first window ran unpaced, start from what it did
+		 */
+		if (!td->latency_load)
+			td->latency_load = iops;
+		td->latency_load = max(td->latency_load * exp(step), 1.0);
+
+		/*
+		 * Don't let the rate run off if the device can't keep up
+		 * with it, we'd never get back down in time
+		 */
+		td->latency_load = min(td->latency_load,
+					(iops + 1) * exp(LAT_CTL_MAX_STEP));
+		lat_ctl_set_iops(td, td->latency_load);
+	}
+
+	dprint(FD_RATE, "lat ctl: p%.2f=%llu nsec, iops=%llu, load=%.2f\n", p,
+			(unsigned long long) lat, (unsigned long long) iops,
+			td->latency_load);
+
+	if (td->latency_log)
+		fprintf(td->latency_log, "%llu, %llu, %llu, %u, %llu\n",
+			(unsigned long long) mtime_since_now(&td->epoch),
+			(unsigned long long) lat, (unsigned long long) iops,
+			td->latency_qd,
+			o->latency_controller == LAT_CTL_IOPS ?
+				(unsigned long long) td->latency_load : 0ULL);
+
+	lat_new_cycle(td);
+}
+
+static void lat_ctl_init(struct thread_data *td)
+{
+	struct thread_options *o = &td->o;
+
+	if (!td->latency_plat)
+		td->latency_plat = calloc(FIO_IO_U_PLAT_NR, sizeof(uint64_t));
+	else
+		memset(td->latency_plat, 0, FIO_IO_U_PLAT_NR * sizeof(uint64_t));
+
+	td->latency_err[0] = td->latency_err[1] = 0.0;
+	td->latency_met = 0;
+	td->latency_sustained_iops = 0;
+
+	if (o->latency_controller == LAT_CTL_DEPTH) {
+		td->latency_load = 1.0;
+		td->latency_qd = 1;
+	} else {
+		td->latency_load = 0.0;
+		td->latency_qd = o->iodepth;
+		td->flags |= TD_F_CHECK_RATE;
+		lat_ctl_set_iops(td, 0.0);
+	}
+
+	if (o->latency_log_file && !td->latency_log) {
+		char name[PATH_MAX];
+
+		snprintf(name, sizeof(name), "%s_latctl.%d.log",
+				o->latency_log_file, td->thread_number);
+		td->latency_log = fopen(name, "w");
+		if (!td->latency_log)
+			log_err("fio: failed to open latency log %s: %s\n",
+					name, strerror(errno));
+	}
+}
+
 /*
  * We had an IO outside the latency target. Reduce the queue depth. If we
  * are at QD=1, then it's time to give up.
@@ -1418,10 +1634,23 @@ void lat_target_init(struct thread_data *td)
 		td->latency_qd_high = td->o.iodepth;
 		td->latency_qd_low = 1;
 		td->latency_ios = ddir_rw_sum(td->io_blocks);
+		if (td->o.latency_controller != LAT_CTL_BISECT)
+			lat_ctl_init(td);
 	} else
 		td->latency_qd = td->o.iodepth;
 }
 
+void lat_target_exit(struct thread_data *td)
+{
+	if (td->latency_log) {
+		fclose(td->latency_log);
+		td->latency_log = NULL;
+	}
+
+	free(td->latency_plat);
+	td->latency_plat = NULL;
+}
+
 void lat_target_reset(struct thread_data *td)
 {
 	if (!td->latency_end_run)
@@ -1475,12 +1704,20 @@ static void lat_target_success(struct thread_data *td)
  */
 void lat_target_check(struct thread_data *td)
 {
-	uint64_t usec_window;
+	uint64_t nsec_window;
 	uint64_t ios;
 	double success_ios;
 
-	usec_window = utime_since_now(&td->latency_ts);
-	if (usec_window < td->o.latency_window)
+	if (td->latency_plat) {
+		lat_ctl_check(td);
+		return;
+	}
+
+	/*
+	 * latency_window is in nsec, see fixup_options()
+	 */
+	nsec_window = ntime_since_now(&td->latency_ts);
+	if (nsec_window < td->o.latency_window)
 		return;
 
 	ios = ddir_rw_sum(td->io_blocks) - td->latency_ios;
@@ -1539,7 +1776,7 @@ again:
 		assert(io_u->flags & IO_U_F_FREE);
 		io_u_clear(td, io_u, IO_U_F_FREE | IO_U_F_NO_FILE_PUT |
 				 IO_U_F_TRIMMED | IO_U_F_BARRIER |
-				 IO_U_F_VER_LIST);
+				 IO_U_F_VER_LIST | IO_U_F_RATE_SCHED);
 
 		io_u->error = 0;
 		io_u->acct_ddir = -1;
@@ -1663,22 +1900,16 @@ static void small_content_scramble(struct io_u *io_u)
 }
 
 /*
- * Return an io_u to be processed. Gets a buflen and offset, sets direction,
- * etc. The returned io_u is fully ready to be prepped, populated and submitted.
+ * Set up a free io_u for issue. If 'now' is given, it's used as the start
+ * time instead of reading the clock.
  */
-struct io_u *get_io_u(struct thread_data *td)
+static struct io_u *prep_io_u(struct thread_data *td, struct io_u *io_u,
+			      const struct timespec *now)
 {
 	struct fio_file *f;
-	struct io_u *io_u;
 	int do_scramble = 0;
 	long ret = 0;
 
-	io_u = __get_io_u(td);
-	if (!io_u) {
-		dprint(FD_IO, "__get_io_u failed\n");
-		return NULL;
-	}
-
 	if (check_get_verify(td, io_u))
 		goto out;
 	if (check_get_trim(td, io_u))
@@ -1735,6 +1966,9 @@ struct io_u *get_io_u(struct thread_data *td)
 			 */
 			io_u->buf_filled_len = 0;
 		}
+
+		if (td->flow)
+			flow_rate_wait(td, io_u->buflen);
 	}
 
 	/*
@@ -1746,8 +1980,12 @@ struct io_u *get_io_u(struct thread_data *td)
 out:
 	assert(io_u->file);
 	if (!td_io_prep(td, io_u)) {
-		if (!td->o.disable_lat)
-			fio_gettime(&io_u->start_time, NULL);
+		if (!td->o.disable_lat) {
+			if (now)
+				io_u->start_time = *now;
+			else
+				fio_gettime(&io_u->start_time, NULL);
+		}
 
 		if (do_scramble)
 			small_content_scramble(io_u);
@@ -1760,6 +1998,67 @@ err_put:
 	return ERR_PTR(ret);
 }
 
+/*
+ * Return an io_u to be processed. Gets a buflen and offset, sets direction,
+ * etc. The returned io_u is fully ready to be prepped, populated and submitted.
+ */
+struct io_u *get_io_u(struct thread_data *td)
+{
+	struct io_u *io_u;
+
+	io_u = __get_io_u(td);
+	if (!io_u) {
+		dprint(FD_IO, "__get_io_u failed\n");
+		return NULL;
+	}
+
+	return prep_io_u(td, io_u, NULL);
+}
+
+/*
+ * Set up to 'nr' io_us in one pass, for iodepth_batch_prep. All the free
+ * io_us are taken first, then filled in back to back, prefetching the next
+ * one while the current one is set up. They share one start time. Returns
+ * the number of io_us set up, or like get_io_u() if there were none.
+ */
+int get_io_u_batch(struct thread_data *td, struct io_u **io_us, int nr)
+{
+	struct timespec now = { 0, };
+	struct io_u *io_u;
+	int i, got = 0;
+
+	for (i = 0; i < nr; i++) {
+		io_us[i] = __get_io_u(td);
+		if (!io_us[i])
+			break;
+	}
+	nr = i;
+	if (!nr) {
+		dprint(FD_IO, "__get_io_u failed\n");
+		return 0;
+	}
+
+	if (!td->o.disable_lat)
+		fio_gettime(&now, NULL);
+
+	for (i = 0; i < nr; i++) {
+		if (i + 1 < nr)
+			fio_prefetch(io_us[i + 1]);
+
+		io_u = prep_io_u(td, io_us[i], &now);
+		if (IS_ERR_OR_NULL(io_u)) {
+			while (++i < nr)
+				put_io_u(td, io_us[i]);
+			if (!got)
+				return PTR_ERR(io_u);
+			break;
+		}
+		io_us[got++] = io_u;
+	}
+
+	return got;
+}
+
 static void __io_u_log_error(struct thread_data *td, struct io_u *io_u)
 {
 	enum error_type_bit eb = td_error_type(io_u->ddir, io_u->error);
@@ -1808,11 +2107,29 @@ static void trim_block_info(struct thread_data *td, struct io_u *io_u)
 	*info = BLOCK_INFO(BLOCK_STATE_TRIMMED, BLOCK_INFO_TRIMS(*info) + 1);
 }
 
+static void flush_lat_batch(struct thread_data *td, struct lat_batch *b)
+{
+	unsigned int i;
+
+	if (!b->nr)
+		return;
+
+	add_lat_batch(td, b);
+
+	if (!td->o.disable_clat) {
+		for (i = 0; i < b->nr; i++)
+			io_u_mark_latency(td, b->clat[i]);
+	}
+
+	b->nr = 0;
+}
+
 static void account_io_completion(struct thread_data *td, struct io_u *io_u,
 				  struct io_completion_data *icd,
 				  const enum fio_ddir idx, unsigned int bytes)
 {
 	const int no_reduce = !gtod_reduce(td);
+	struct lat_batch *b = ddir_rw(idx) ? icd->lat_batch : NULL;
 	unsigned long long llnsec = 0;
 
 	if (td->parent)
@@ -1828,7 +2145,10 @@ static void account_io_completion(struct thread_data *td, struct io_u *io_u,
 		unsigned long long tnsec;
 
 		tnsec = ntime_since(&io_u->start_time, &icd->time);
-		add_lat_sample(td, idx, tnsec, bytes, io_u->offset);
+		if (b)
+			b->lat[b->nr] = tnsec;
+		else
+			add_lat_sample(td, idx, tnsec, bytes, io_u->offset);
 
 		if (td->flags & TD_F_PROFILE_OPS) {
 			struct prof_io_ops *ops = &td->prof_io_ops;
@@ -1839,16 +2159,37 @@ static void account_io_completion(struct thread_data *td, struct io_u *io_u,
 
 		if (td->o.max_latency && tnsec > td->o.max_latency)
 			lat_fatal(td, icd, tnsec, td->o.max_latency);
-		if (td->o.latency_target && tnsec > td->o.latency_target) {
+		if (td->latency_plat)
+			td->latency_plat[plat_val_to_idx(tnsec)]++;
+		else if (td->o.latency_target && tnsec > td->o.latency_target) {
 			if (lat_target_failed(td))
 				lat_fatal(td, icd, tnsec, td->o.latency_target);
 		}
 	}
 
+	if (no_reduce && ddir_rw(idx) && (io_u->flags & IO_U_F_RATE_SCHED)) {
+		const struct timespec *base = &io_u->sched_time;
+
+		/*
+		 * Issued ahead of schedule (e.g. rate_ignore_thinktime),
+		 * count from the actual start then.
+		 */
+		if (ntime_since(&io_u->start_time, base))
+			base = &io_u->start_time;
+
+		add_rsp_sample(td, idx, ntime_since(base, &icd->time), bytes,
+				io_u->offset);
+	}
+
 	if (ddir_rw(idx)) {
 		if (!td->o.disable_clat) {
-			add_clat_sample(td, idx, llnsec, bytes, io_u->offset);
-			io_u_mark_latency(td, llnsec);
+			if (b)
+				b->clat[b->nr] = llnsec;
+			else {
+				add_clat_sample(td, idx, llnsec, bytes,
+						io_u->offset);
+				io_u_mark_latency(td, llnsec);
+			}
 		}
 
 		if (!td->o.disable_bw && per_unit_log(td->bw_log))
@@ -1861,6 +2202,12 @@ static void account_io_completion(struct thread_data *td, struct io_u *io_u,
 
 	if (td->ts.nr_block_infos && io_u->ddir == DDIR_TRIM)
 		trim_block_info(td, io_u);
+
+	if (b) {
+		b->ddir[b->nr] = idx;
+		if (++b->nr == FIO_LAT_BATCH)
+			flush_lat_batch(td, b);
+	}
 }
 
 static void file_log_write_comp(const struct thread_data *td, struct fio_file *f,
@@ -1989,6 +2336,7 @@ static void init_icd(struct thread_data *td, struct io_completion_data *icd,
 		fio_gettime(&icd->time, NULL);
 
 	icd->nr = nr;
+	icd->lat_batch = NULL;
 
 	icd->error = 0;
 	for (ddir = 0; ddir < DDIR_RWDIR_CNT; ddir++)
@@ -2036,14 +2384,84 @@ int io_u_sync_complete(struct thread_data *td, struct io_u *io_u)
 	return 0;
 }
 
+/*
+ * Complete the nr events just returned by td_io_getevents().
+ */
+static int complete_reaped(struct thread_data *td, int nr)
+{
+	struct io_completion_data icd;
+	struct lat_batch lat_batch;
+	int ddir;
+
+	init_icd(td, &icd, nr);
+	if (nr > 1 && lat_batch_ok(td)) {
+		lat_batch.nr = 0;
+		icd.lat_batch = &lat_batch;
+	}
+	ios_completed(td, &icd);
+	if (icd.lat_batch)
+		flush_lat_batch(td, icd.lat_batch);
+	if (icd.error) {
+		td_verror(td, icd.error, "io_u_queued_complete");
+		return -1;
+	}
+
+	for (ddir = 0; ddir < DDIR_RWDIR_CNT; ddir++)
+		td->bytes_done[ddir] += icd.bytes_done[ddir];
+
+	return nr;
+}
+
+/*
+ * Don't block a runner that has other jobs to run waiting for completions.
+ * Poll for them instead, letting the other jobs run in between, until
+ * min_evts have been reaped. The events of each poll are completed before
+ * the next one, as the engine only keeps them until its next ->getevents().
+ * Stop early if the job is done or has nothing left in flight, as
+ * td_io_getevents() won't return anything more then.
+ */
+static int runner_queued_complete(struct thread_data *td, int min_evts)
+{
+	struct timespec ts = { .tv_sec = 0, .tv_nsec = 0, };
+	int ret, done = 0;
+
+	if (td->io_ops->commit) {
+		ret = td->io_ops->commit(td);
+		if (ret < 0) {
+			td_verror(td, -ret, "td_io_commit");
+			return ret;
+		}
+	}
+
+	while (done < min_evts) {
+		ret = td_io_getevents(td, 0, td->o.iodepth_batch_complete_max,
+					&ts);
+		if (ret < 0) {
+			td_verror(td, -ret, "td_io_getevents");
+			return ret;
+		} else if (!ret) {
+			if (td->done || td->terminate || !td->cur_depth)
+				break;
+			runner_yield();
+			continue;
+		}
+
+		ret = complete_reaped(td, ret);
+		if (ret < 0)
+			return ret;
+		done += ret;
+	}
+
+	return done;
+}
+
 /*
  * Called to complete min_events number of io for the async engines.
  */
 int io_u_queued_complete(struct thread_data *td, int min_evts)
 {
-	struct io_completion_data icd;
 	struct timespec *tvp = NULL;
-	int ret, ddir;
+	int ret;
 	struct timespec ts = { .tv_sec = 0, .tv_nsec = 0, };
 
 	dprint(FD_IO, "io_u_queued_complete: min=%d\n", min_evts);
@@ -2053,26 +2471,20 @@ int io_u_queued_complete(struct thread_data *td, int min_evts)
 	else if (min_evts > td->cur_depth)
 		min_evts = td->cur_depth;
 
+	if (min_evts && runner_busy())
+		return runner_queued_complete(td, min_evts);
+
 	/* No worries, td_io_getevents fixes min and max if they are
 	 * set incorrectly */
-	ret = td_io_getevents(td, min_evts, td->o.iodepth_batch_complete_max, tvp);
+	ret = td_io_getevents(td, min_evts, td->o.iodepth_batch_complete_max,
+				tvp);
 	if (ret < 0) {
 		td_verror(td, -ret, "td_io_getevents");
 		return ret;
 	} else if (!ret)
 		return ret;
 
-	init_icd(td, &icd, ret);
-	ios_completed(td, &icd);
-	if (icd.error) {
-		td_verror(td, icd.error, "io_u_queued_complete");
-		return -1;
-	}
-
-	for (ddir = 0; ddir < DDIR_RWDIR_CNT; ddir++)
-		td->bytes_done[ddir] += icd.bytes_done[ddir];
-
-	return ret;
+	return complete_reaped(td, ret);
 }
 
 /*
@@ -24,16 +24,15 @@ enum {
 	IO_U_F_TRIMMED		= 1 << 5,
 	IO_U_F_BARRIER		= 1 << 6,
 	IO_U_F_VER_LIST		= 1 << 7,
+	IO_U_F_RATE_SCHED	= 1 << 8,
 };
 
 /*
- * The io unit
+ * The io unit. io_us are cache line aligned, and the fields used for every
+ * I/O come first so that setting up, issuing and completing one touches as
+ * few cache lines as possible. Verify, rate, replay and zoned state follow.
  */
 struct io_u {
-	struct timespec start_time;
-	struct timespec issue_time;
-
-	struct fio_file *file;
 	unsigned int flags;
 	enum fio_ddir ddir;
 
@@ -42,23 +41,15 @@ struct io_u {
 	 * IO type than what is being submitted.
 	 */
 	enum fio_ddir acct_ddir;
+	unsigned int error;
 
-	/*
-	 * Write generation
-	 */
-	unsigned short numberio;
+	struct fio_file *file;
 
 	/*
 	 * Allocated/set buffer and length
 	 */
-	unsigned long long buflen;
 	unsigned long long offset;
-	void *buf;
-
-	/*
-	 * Initial seed for generating the buffer contents
-	 */
-	uint64_t rand_seed;
+	unsigned long long buflen;
 
 	/*
 	 * IO engine state, may be different from above when we get
@@ -67,25 +58,49 @@ struct io_u {
 	void *xfer_buf;
 	unsigned long long xfer_buflen;
 
+	/*
+	 * io engine private data
+	 */
+	union {
+		unsigned int index;
+		unsigned int seen;
+		void *engine_data;
+	};
+
+	struct timespec start_time;
+	struct timespec issue_time;
+
+	void *buf;
+	unsigned long long resid;
+
+	/*
+	 * Callback for io completion
+	 */
+	int (*end_io)(struct thread_data *, struct io_u **);
+
 	/*
 	 * Parameter related to pre-filled buffers and
 	 * their size to handle variable block sizes.
 	 */
 	unsigned long long buf_filled_len;
 
-	struct io_piece *ipo;
+	/*
+	 * When the rate process wanted this io_u to be issued, for the
+	 * response time. Valid if IO_U_F_RATE_SCHED is set.
+	 */
+	struct timespec sched_time;
 
-	unsigned long long resid;
-	unsigned int error;
+	/*
+	 * Write generation
+	 */
+	unsigned short numberio;
 
 	/*
-	 * io engine private data
+	 * Initial seed for generating the buffer contents
 	 */
-	union {
-		unsigned int index;
-		unsigned int seen;
-		void *engine_data;
-	};
+	uint64_t rand_seed;
+
+	struct io_piece *ipo;
 
 	union {
 		struct flist_head verify_list;
@@ -104,15 +119,17 @@ struct io_u {
 
 	/*
 	 * ZBD mode zbd_put_io callback: called in after completion of an I/O
-	 * or commit of an async I/O to unlock the I/O target zone.
+	 * or commit of an async I/O to unlock the I/O target zone, or with
+	 * zone_append=1 to account for the completion of a write.
 	 */
 	void (*zbd_put_io)(const struct io_u *);
-#endif
 
 	/*
-	 * Callback for io completion
+	 * ZBD mode zbd_commit_io callback: called once a queued zone_append=1
+	 * write has been submitted to unlock the I/O target zone.
 	 */
-	int (*end_io)(struct thread_data *, struct io_u **);
+	void (*zbd_commit_io)(const struct io_u *);
+#endif
 
 	union {
 #ifdef CONFIG_LIBAIO
@@ -142,6 +159,7 @@ struct io_u {
  */
 extern struct io_u *__get_io_u(struct thread_data *);
 extern struct io_u *get_io_u(struct thread_data *);
+extern int get_io_u_batch(struct thread_data *, struct io_u **, int);
 extern void put_io_u(struct thread_data *, struct io_u *);
 extern void clear_io_u(struct thread_data *, struct io_u *);
 extern void requeue_io_u(struct thread_data *, struct io_u **);
@@ -371,7 +371,7 @@ enum fio_q_status td_io_queue(struct thread_data *td, struct io_u *io_u)
 	if (!td->io_ops->commit) {
 		io_u_mark_submit(td, 1);
 		io_u_mark_complete(td, 1);
-		zbd_put_io_u(io_u);
+		zbd_submitted_io_u(io_u);
 	}
 
 	if (ret == FIO_Q_COMPLETED) {
@@ -441,6 +441,9 @@ void td_io_commit(struct thread_data *td)
 			td_verror(td, -ret, "io commit");
 	}
 
+	if (td->o.zone_mode == ZONE_MODE_ZBD && td->o.zone_append)
+		zbd_io_committed(td);
+
 	/*
 	 * Reflect that events were submitted as async IO requests.
 	 */
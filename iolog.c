@@ -1542,6 +1542,106 @@ void iolog_compress_exit(struct thread_data *td)
 
 #endif
 
+struct iolog_stream_data {
+	struct workqueue_work work;
+	struct io_log *log;
+	void *samples;
+	uint64_t nr_samples;
+};
+
+/*
+ * Only logs that are regrown from the job thread are streamed, histogram
+ * logs need the previous entry and are sent at the end.
+ */
+static bool iolog_can_stream(struct io_log *log)
+{
+	if (!log || log->log_gz || log->log_gz_store)
+		return false;
+	if (log->log_type == IO_LOG_TYPE_HIST)
+		return false;
+
+	return inline_log(log) || !log->avg_msec;
+}
+
+static int stream_work(struct submit_worker *sw, struct workqueue_work *work)
+{
+	struct iolog_stream_data *data;
+
+	data = container_of(work, struct iolog_stream_data, work);
+	fio_send_iolog_chunk(data->log, data->samples, data->nr_samples);
+	free(data->samples);
+	free(data);
+	return 0;
+}
+
+static struct workqueue_ops log_stream_wq_ops = {
+	.fn		= stream_work,
+	.nice		= 1,
+};
+
+/*
+ * When running as a server, send the logs to the client as the job fills
+ * them, instead of all of it once the job is done. The sending is done
+ * by a helper thread.
+ */
+int iolog_stream_init(struct thread_data *td, struct sk_out *sk_out)
+{
+	struct io_log *logs[] = { td->slat_log, td->clat_log, td->lat_log,
+				  td->rsp_log, td->bw_log, td->iops_log };
+	bool stream = false;
+	int i;
+
+	if (!is_backend || td->o.io_submit_mode == IO_MODE_OFFLOAD)
+		return 0;
+
+	for (i = 0; i < sizeof(logs) / sizeof(logs[0]); i++)
+		if (iolog_can_stream(logs[i]))
+			stream = true;
+
+	if (!stream)
+		return 0;
+
+	if (workqueue_init(td, &td->log_stream_wq, &log_stream_wq_ops, 1, sk_out))
+		return 1;
+
+	for (i = 0; i < sizeof(logs) / sizeof(logs[0]); i++)
+		if (iolog_can_stream(logs[i]))
+			logs[i]->stream = true;
+
+	return 0;
+}
+
+/*
+ * Must be called before the logs are written out, so that all chunks have
+ * been sent before the end of the log.
+ */
+void iolog_stream_exit(struct thread_data *td)
+{
+	workqueue_exit(&td->log_stream_wq);
+}
+
+/*
+ * Hand the full log array to the stream thread, which sends and frees it
+ */
+int iolog_cur_stream(struct io_log *log, struct io_logs *cur_log)
+{
+	struct iolog_stream_data *data;
+
+	data = malloc(sizeof(*data));
+	if (!data)
+		return 1;
+
+	data->log = log;
+	data->samples = cur_log->log;
+	data->nr_samples = cur_log->nr_samples;
+
+	cur_log->nr_samples = cur_log->max_samples = 0;
+	cur_log->log = NULL;
+
+	workqueue_enqueue(&log->td->log_stream_wq, &data->work);
+	return 0;
+}
+
 struct io_logs *iolog_cur_log(struct io_log *log)
 {
 	if (flist_empty(&log->io_logs))
@@ -1643,6 +1743,20 @@ static int write_lat_log(struct thread_data *td, int try, bool unit_log)
 	return ret;
 }
 
+static int write_rsp_log(struct thread_data *td, int try, bool unit_log)
+{
+	int ret;
+
+	if (!unit_log)
+		return 0;
+
+	ret = __write_log(td, td->rsp_log, try);
+	if (!ret)
+		td->rsp_log = NULL;
+
+	return ret;
+}
+
 static int write_bandw_log(struct thread_data *td, int try, bool unit_log)
 {
 	int ret;
@@ -1664,8 +1778,9 @@ enum {
 	CLAT_LOG_MASK	= 8,
 	IOPS_LOG_MASK	= 16,
 	CLAT_HIST_LOG_MASK = 32,
+	RSP_LOG_MASK	= 64,
 
-	ALL_LOG_NR	= 6,
+	ALL_LOG_NR	= 7,
 };
 
 struct log_type {
@@ -1697,6 +1812,10 @@ static struct log_type log_types[] = {
 	{
 		.mask	= CLAT_HIST_LOG_MASK,
 		.fn	= write_clat_hist_log,
+	},
+	{
+		.mask	= RSP_LOG_MASK,
+		.fn	= write_rsp_log,
 	}
 };
 
@@ -57,6 +57,7 @@ enum {
 	IO_LOG_TYPE_BW,
 	IO_LOG_TYPE_IOPS,
 	IO_LOG_TYPE_HIST,
+	IO_LOG_TYPE_RSP,
 };
 
 #define DEF_LOG_ENTRIES		1024
@@ -113,6 +114,12 @@ struct io_log {
 	 */
 	unsigned int log_gz_store;
 
+	/*
+	 * Running as a server, full log arrays are sent to the client while
+	 * the job runs
+	 */
+	bool stream;
+
 	/*
 	 * Windowed average, for logging single entries average over some
 	 * period of time.
@@ -243,6 +250,8 @@ extern void prune_io_piece_log(struct thread_data *);
 extern void write_iolog_close(struct thread_data *);
 extern int iolog_compress_init(struct thread_data *, struct sk_out *);
 extern void iolog_compress_exit(struct thread_data *);
+extern int iolog_stream_init(struct thread_data *, struct sk_out *);
+extern void iolog_stream_exit(struct thread_data *);
 extern size_t log_chunk_sizes(struct io_log *);
 extern int init_io_u_buffers(struct thread_data *);
 
@@ -274,7 +283,8 @@ static inline bool inline_log(struct io_log *log)
 {
 	return log->log_type == IO_LOG_TYPE_LAT ||
 		log->log_type == IO_LOG_TYPE_CLAT ||
-		log->log_type == IO_LOG_TYPE_SLAT;
+		log->log_type == IO_LOG_TYPE_SLAT ||
+		log->log_type == IO_LOG_TYPE_RSP;
 }
 
 static inline void ipo_bytes_align(unsigned int replay_align, struct io_piece *ipo)
@@ -294,6 +304,7 @@ extern void free_log(struct io_log *);
 extern void fio_writeout_logs(bool);
 extern void td_writeout_logs(struct thread_data *, bool);
 extern int iolog_cur_flush(struct io_log *, struct io_logs *);
+extern int iolog_cur_stream(struct io_log *, struct io_logs *);
 
 static inline void init_ipo(struct io_piece *ipo)
 {
@@ -2,21 +2,46 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <pthread.h>
 
 #include "memcpy.h"
 #include "rand.h"
 #include "../fio_time.h"
 #include "../gettime.h"
+#include "../json.h"
 #include "../os/os.h"
 
+#if defined(__x86_64__) && defined(__SSE2__)
+#include <emmintrin.h>
+#define FIO_HAVE_NT_MEMCPY
+#endif
+
 #define BUF_SIZE	32 * 1024 * 1024ULL
 
-#define NR_ITERS	64
+/*
+ * Hot cache runs copy back and forth inside a buffer small enough to stay
+ * in L2, cold cache runs stream through BUF_SIZE.
+ */
+#define HOT_BUF_SIZE	256 * 1024ULL
+
+/*
+ * Every run copies NR_ITERS * BUF_SIZE bytes in total, independent of
+ * buffer and copy size.
+ */
+#define NR_ITERS	16
+
+#define MAX_THREADS	64
+
+/*
+ * Parameters for picking the fio_memcpy() kernel at startup. Kept small,
+ * this runs once per process that uses an engine which copies data.
+ */
+#define SELECT_BUF_SIZE		8 * 1024 * 1024ULL
+#define SELECT_COPY_SIZE	64 * 1024ULL
+#define SELECT_ITERS		4
 
 struct memcpy_test {
 	const char *name;
-	void *src;
-	void *dst;
 	size_t size;
 };
 
@@ -65,15 +90,36 @@ static struct memcpy_test tests[] = {
 		.name		= "524288 bytes",
 		.size		= 524288,
 	},
+	{
+		.name		= "1048576 bytes",
+		.size		= 1048576,
+	},
+	{
+		.name		= "4194304 bytes",
+		.size		= 4194304,
+	},
 	{
 		.name		= NULL,
 	},
 };
 
+/*
+ * One copy run: a kernel copying 'size' sized chunks from src to dst,
+ * wrapping at 'buf_size', until NR_ITERS * BUF_SIZE bytes are done.
+ */
+struct memcpy_run {
+	void *src;
+	void *dst;
+	size_t buf_size;
+	size_t size;
+	unsigned long long bytes;
+};
+
 struct memcpy_type {
 	const char *name;
 	unsigned int mask;
-	void (*fn)(struct memcpy_test *);
+	void (*fn)(struct memcpy_run *);
+	memcpy_fn_t *kernel;
 };
 
 enum {
@@ -81,19 +127,37 @@ enum {
 	T_MEMMOVE	= 1U << 1,
 	T_SIMPLE	= 1U << 2,
 	T_HYBRID	= 1U << 3,
+	T_NT		= 1U << 4,
 };
 
-#define do_test(test, fn)	do {					\
+enum {
+	M_HOT		= 1U << 0,
+	M_COLD		= 1U << 1,
+	M_ALIGNED	= 1U << 2,
+	M_UNALIGNED	= 1U << 3,
+};
+
+/*
+ * Unaligned runs offset source and destination differently, so that
+ * neither the kernel nor the hardware can lean on matching alignment.
+ */
+#define UNALIGNED_SRC_OFF	1
+#define UNALIGNED_DST_OFF	3
+
+#define do_test(run, fn)	do {					\
+	unsigned long long total = NR_ITERS * BUF_SIZE;			\
 	size_t left, this;						\
 	void *src, *dst;						\
-	int i;								\
 									\
-	for (i = 0; i < NR_ITERS; i++) {				\
-		left = BUF_SIZE;					\
-		src = test->src;					\
-		dst = test->dst;					\
+	while (total) {							\
+		left = (run)->buf_size;					\
+		if (left > total)					\
+			left = total;					\
+		total -= left;						\
+		src = (run)->src;					\
+		dst = (run)->dst;					\
 		while (left) {						\
-			this = test->size;				\
+			this = (run)->size;				\
 			if (this > left)				\
 				this = left;				\
 			(fn)(dst, src, this);				\
@@ -102,50 +166,106 @@ enum {
 			dst += this;					\
 		}							\
 	}								\
+	(run)->bytes = NR_ITERS * BUF_SIZE;				\
 } while (0)
 
-static void t_memcpy(struct memcpy_test *test)
+static void t_memcpy(struct memcpy_run *run)
 {
-	do_test(test, memcpy);
+	do_test(run, memcpy);
 }
 
-static void t_memmove(struct memcpy_test *test)
+static void t_memmove(struct memcpy_run *run)
 {
-	do_test(test, memmove);
+	do_test(run, memmove);
 }
 
-static void simple_memcpy(void *dst, void const *src, size_t len)
+static void *simple_memcpy(void *dst, void const *src, size_t len)
 {
- 	char *d = dst;
+	char *d = dst;
 	const char *s = src;
 
 	while (len--)
 		*d++ = *s++;
+
+	return dst;
 }
 
-static void t_simple(struct memcpy_test *test)
+static void t_simple(struct memcpy_run *run)
 {
-	do_test(test, simple_memcpy);
+	do_test(run, simple_memcpy);
 }
 
-static void t_hybrid(struct memcpy_test *test)
+static void t_hybrid(struct memcpy_run *run)
 {
-	if (test->size >= 64)
-		do_test(test, simple_memcpy);
+	if (run->size >= 64)
+		do_test(run, simple_memcpy);
 	else
-		do_test(test, memcpy);
+		do_test(run, memcpy);
+}
+
+#ifdef FIO_HAVE_NT_MEMCPY
+/*
+ * Copy with non-temporal stores, bypassing the cache for the destination.
+ * Small copies aren't worth the fence, hand those to memcpy.
+ */
+static void *nt_memcpy(void *dst, const void *src, size_t len)
+{
+	const char *s = src;
+	char *d = dst;
+	size_t head;
+
+	if (len < 256)
+		return memcpy(dst, src, len);
+
+	head = (16 - ((uintptr_t) d & 15)) & 15;
+	if (head) {
+		memcpy(d, s, head);
+		d += head;
+		s += head;
+		len -= head;
+	}
+
+	while (len >= 64) {
+		__m128i a = _mm_loadu_si128((const __m128i *) (s + 0));
+		__m128i b = _mm_loadu_si128((const __m128i *) (s + 16));
+		__m128i c = _mm_loadu_si128((const __m128i *) (s + 32));
+		__m128i e = _mm_loadu_si128((const __m128i *) (s + 48));
+
+		_mm_stream_si128((__m128i *) (d + 0), a);
+		_mm_stream_si128((__m128i *) (d + 16), b);
+		_mm_stream_si128((__m128i *) (d + 32), c);
+		_mm_stream_si128((__m128i *) (d + 48), e);
+		s += 64;
+		d += 64;
+		len -= 64;
+	}
+
+	_mm_sfence();
+
+	if (len)
+		memcpy(d, s, len);
+
+	return dst;
+}
+
+static void t_nt(struct memcpy_run *run)
+{
+	do_test(run, nt_memcpy);
 }
+#endif
 
 static struct memcpy_type t[] = {
 	{
 		.name = "memcpy",
 		.mask = T_MEMCPY,
 		.fn = t_memcpy,
+		.kernel = memcpy,
 	},
 	{
 		.name = "memmove",
 		.mask = T_MEMMOVE,
 		.fn = t_memmove,
+		.kernel = memmove,
 	},
 	{
 		.name = "simple",
@@ -157,31 +277,80 @@ static struct memcpy_type t[] = {
 		.mask = T_HYBRID,
 		.fn = t_hybrid,
 	},
+#ifdef FIO_HAVE_NT_MEMCPY
+	{
+		.name = "nt",
+		.mask = T_NT,
+		.fn = t_nt,
+		.kernel = nt_memcpy,
+	},
+#endif
 	{
 		.name = NULL,
 	},
 };
 
-static unsigned int get_test_mask(const char *type)
+static const struct {
+	const char *name;
+	unsigned int mask;
+} modes[] = {
+	{ .name = "hot",	.mask = M_HOT, },
+	{ .name = "cold",	.mask = M_COLD, },
+	{ .name = "aligned",	.mask = M_ALIGNED, },
+	{ .name = "unaligned",	.mask = M_UNALIGNED, },
+	{ .name = NULL, },
+};
+
+struct memcpy_opts {
+	unsigned int test_mask;
+	unsigned int mode_mask;
+	unsigned int nr_threads;
+	bool json;
+};
+
+memcpy_fn_t *fio_memcpy_fn = memcpy;
+
+static int parse_test_opts(const char *type, struct memcpy_opts *opts)
 {
 	char *ostr, *str = strdup(type);
-	unsigned int mask;
 	char *name;
-	int i;
+	int i, ret = 0;
 
 	ostr = str;
-	mask = 0;
 	while ((name = strsep(&str, ",")) != NULL) {
+		if (!strncmp(name, "threads=", 8)) {
+			opts->nr_threads = atoi(name + 8);
+			if (!opts->nr_threads || opts->nr_threads > MAX_THREADS) {
+				fprintf(stderr, "fio: threads must be 1..%d\n",
+						MAX_THREADS);
+				ret = 1;
+				break;
+			}
+			continue;
+		}
+		for (i = 0; modes[i].name; i++) {
+			if (!strcmp(modes[i].name, name)) {
+				opts->mode_mask |= modes[i].mask;
+				break;
+			}
+		}
+		if (modes[i].name)
+			continue;
 		for (i = 0; t[i].name; i++) {
 			if (!strcmp(t[i].name, name)) {
-				mask |= t[i].mask;
+				opts->test_mask |= t[i].mask;
 				break;
 			}
 		}
+		if (!t[i].name) {
+			fprintf(stderr, "fio: unknown memcpy test `%s`\n", name);
+			ret = 1;
+			break;
+		}
 	}
 
 	free(ostr);
-	return mask;
+	return ret;
 }
 
 static int list_types(void)
@@ -191,70 +360,137 @@ static int list_types(void)
 	for (i = 0; t[i].name; i++)
 		printf("%s\n", t[i].name);
 
+	printf("\nModifiers:\n");
+	for (i = 0; modes[i].name; i++)
+		printf("%s\n", modes[i].name);
+	printf("threads=<nr>\n");
+
 	return 1;
 }
 
-static int setup_tests(void)
+struct memcpy_thread {
+	pthread_t thread;
+	struct memcpy_type *type;
+	struct memcpy_run run;
+	void *src_buf;
+	void *dst_buf;
+	uint64_t usec;
+};
+
+static int setup_thread_bufs(struct memcpy_thread *mt, unsigned int seed)
 {
-	struct memcpy_test *test;
 	struct frand_state state;
-	void *src, *dst;
-	int i;
 
-	src = malloc(BUF_SIZE);
-	dst = malloc(BUF_SIZE);
-	if (!src || !dst) {
-		free(src);
-		free(dst);
+	mt->src_buf = malloc(BUF_SIZE + UNALIGNED_SRC_OFF);
+	mt->dst_buf = malloc(BUF_SIZE + UNALIGNED_DST_OFF);
+	if (!mt->src_buf || !mt->dst_buf) {
+		free(mt->src_buf);
+		free(mt->dst_buf);
 		return 1;
 	}
 
-	init_rand_seed(&state, 0x8989, 0);
-	fill_random_buf(&state, src, BUF_SIZE);
-
-	for (i = 0; tests[i].name; i++) {
-		test = &tests[i];
-		test->src = src;
-		test->dst = dst;
-	}
-
+	init_rand_seed(&state, 0x8989 + seed, 0);
+	fill_random_buf(&state, mt->src_buf, BUF_SIZE + UNALIGNED_SRC_OFF);
+	memset(mt->dst_buf, 0, BUF_SIZE + UNALIGNED_DST_OFF);
 	return 0;
 }
 
-static void free_tests(void)
+static void *memcpy_thread_main(void *data)
 {
-	free(tests[0].src);
-	free(tests[0].dst);
+	struct memcpy_thread *mt = data;
+	struct timespec ts;
+
+	fio_gettime(&ts, NULL);
+	mt->type->fn(&mt->run);
+	mt->usec = utime_since_now(&ts);
+	return NULL;
 }
 
-int fio_memcpy_test(const char *type)
+/*
+ * Run one kernel/size/mode combination on all threads, returning the
+ * aggregate throughput in MiB/sec. Aggregate is total bytes over the
+ * slowest thread's runtime.
+ */
+static double run_one(struct memcpy_thread *threads, unsigned int nr_threads,
+		      struct memcpy_type *type, struct memcpy_test *test,
+		      unsigned int mode)
 {
-	unsigned int test_mask = 0;
-	int j, i;
+	unsigned long long bytes = 0;
+	uint64_t usec = 0;
+	unsigned int i;
+
+	for (i = 0; i < nr_threads; i++) {
+		struct memcpy_thread *mt = &threads[i];
+
+		mt->type = type;
+		mt->run.src = mt->src_buf;
+		mt->run.dst = mt->dst_buf;
+		if (mode & M_UNALIGNED) {
+			mt->run.src += UNALIGNED_SRC_OFF;
+			mt->run.dst += UNALIGNED_DST_OFF;
+		}
+		mt->run.buf_size = (mode & M_HOT) ? HOT_BUF_SIZE : BUF_SIZE;
+		if (test->size > mt->run.buf_size)
+			mt->run.buf_size = test->size;
+		mt->run.size = test->size;
+	}
 
-	if (!type)
-		test_mask = ~0U;
-	else if (!strcmp(type, "help") || !strcmp(type, "list"))
-		return list_types();
-	else
-		test_mask = get_test_mask(type);
+	if (nr_threads == 1)
+		memcpy_thread_main(&threads[0]);
+	else {
+		for (i = 0; i < nr_threads; i++) {
+			if (pthread_create(&threads[i].thread, NULL,
+					   memcpy_thread_main, &threads[i])) {
+				fprintf(stderr, "fio: pthread_create failed\n");
+				nr_threads = i;
+				break;
+			}
+		}
+		for (i = 0; i < nr_threads; i++)
+			pthread_join(threads[i].thread, NULL);
+	}
 
-	if (!test_mask) {
-		fprintf(stderr, "fio: unknown hash `%s`. Available:\n", type);
-		return list_types();
+	for (i = 0; i < nr_threads; i++) {
+		bytes += threads[i].run.bytes;
+		if (threads[i].usec > usec)
+			usec = threads[i].usec;
 	}
 
-	if (setup_tests()) {
-		fprintf(stderr, "setting up mem regions failed\n");
-		return 1;
+	if (!usec)
+		return 0.0;
+
+	return ((double) bytes / (double) usec) / (1.024 * 1.024);
+}
+
+static const char *mode_name(unsigned int mode)
+{
+	if (mode & M_HOT)
+		return (mode & M_UNALIGNED) ? "hot unaligned" : "hot aligned";
+
+	return (mode & M_UNALIGNED) ? "cold unaligned" : "cold aligned";
+}
+
+static void run_tests(struct memcpy_opts *opts, struct memcpy_thread *threads)
+{
+	static const unsigned int all_modes[] = {
+		M_COLD | M_ALIGNED, M_COLD | M_UNALIGNED,
+		M_HOT | M_ALIGNED, M_HOT | M_UNALIGNED,
+	};
+	struct json_object *root = NULL, *jtype, *jmode;
+	struct json_array *jtypes = NULL, *jmodes, *jsizes;
+	int i, j, m;
+
+	if (opts->json) {
+		root = json_create_object();
+		json_object_add_value_int(root, "threads", opts->nr_threads);
+		json_object_add_value_int(root, "bytes_per_run",
+						NR_ITERS * BUF_SIZE);
+		jtypes = json_create_array();
+		json_object_add_value_array(root, "kernels", jtypes);
 	}
 
 	for (i = 0; t[i].name; i++) {
-		struct timespec ts;
-		double mb_sec;
-		uint64_t usec;
-
-		if (!(t[i].mask & test_mask))
+		if (!(t[i].mask & opts->test_mask))
 			continue;
 
 		/*
@@ -262,26 +498,178 @@ int fio_memcpy_test(const char *type)
 		 * we've touched the data.
 		 */
 		usec_spin(100000);
-		t[i].fn(&tests[0]);
+		run_one(threads, opts->nr_threads, &t[i], &tests[0],
+				M_COLD | M_ALIGNED);
+
+		if (opts->json) {
+			jtype = json_create_object();
+			json_array_add_value_object(jtypes, jtype);
+			json_object_add_value_string(jtype, "name", t[i].name);
+			jmodes = json_create_array();
+			json_object_add_value_array(jtype, "modes", jmodes);
+		} else
+			printf("%s\n", t[i].name);
+
+		for (m = 0; m < (int) ARRAY_SIZE(all_modes); m++) {
+			unsigned int mode = all_modes[m];
+
+			if ((mode & opts->mode_mask) != mode)
+				continue;
+
+			if (opts->json) {
+				jmode = json_create_object();
+				json_array_add_value_object(jmodes, jmode);
+				json_object_add_value_string(jmode, "name",
+								mode_name(mode));
+				jsizes = json_create_array();
+				json_object_add_value_array(jmode, "sizes",
+								jsizes);
+			} else
+				printf("  %s\n", mode_name(mode));
+
+			for (j = 0; tests[j].name; j++) {
+				double mb_sec;
+
+				mb_sec = run_one(threads, opts->nr_threads,
+						&t[i], &tests[j], mode);
+
+				if (opts->json) {
+					struct json_object *js;
+
+					js = json_create_object();
+					json_array_add_value_object(jsizes, js);
+					json_object_add_value_int(js, "size",
+								tests[j].size);
+					json_object_add_value_float(js,
+							"mib_sec", mb_sec);
+				} else if (mb_sec != 0.0)
+					printf("\t%s:\t%8.2f MiB/sec\n",
+						tests[j].name, mb_sec);
+				else
+					printf("\t%s:inf MiB/sec\n",
+						tests[j].name);
+			}
+		}
+	}
 
-		printf("%s\n", t[i].name);
+	if (opts->json) {
+		struct buf_output out;
+
+		buf_output_init(&out);
+		json_print_object(root, &out);
+		buf_output_add(&out, "\n", 1);
+		fwrite(out.buf, out.buflen, 1, stdout);
+		buf_output_free(&out);
+		json_free_object(root);
+	}
+}
+
+int fio_memcpy_test(const char *type, bool json)
+{
+	struct memcpy_opts opts = {
+		.nr_threads	= 1,
+		.json		= json,
+	};
+	struct memcpy_thread *threads;
+	unsigned int i;
+
+	if (type && (!strcmp(type, "help") || !strcmp(type, "list")))
+		return list_types();
+	if (type && parse_test_opts(type, &opts)) {
+		fprintf(stderr, "Available:\n");
+		return list_types();
+	}
 
-		for (j = 0; tests[j].name; j++) {
-			fio_gettime(&ts, NULL);
-			t[i].fn(&tests[j]);
-			usec = utime_since_now(&ts);
+	if (!opts.test_mask)
+		opts.test_mask = ~0U;
+	if (!(opts.mode_mask & (M_HOT | M_COLD)))
+		opts.mode_mask |= M_HOT | M_COLD;
+	if (!(opts.mode_mask & (M_ALIGNED | M_UNALIGNED)))
+		opts.mode_mask |= M_ALIGNED | M_UNALIGNED;
 
-			if (usec) {
-				unsigned long long mb = NR_ITERS * BUF_SIZE;
+	threads = calloc(opts.nr_threads, sizeof(*threads));
+	if (!threads)
+		return 1;
 
-				mb_sec = (double) mb / (double) usec;
-				mb_sec /= (1.024 * 1.024);
-				printf("\t%s:\t%8.2f MiB/sec\n", tests[j].name, mb_sec);
-			} else
-				printf("\t%s:inf MiB/sec\n", tests[j].name);
+	for (i = 0; i < opts.nr_threads; i++) {
+		if (setup_thread_bufs(&threads[i], i)) {
+			fprintf(stderr, "setting up mem regions failed\n");
+			opts.nr_threads = i;
+			goto err;
 		}
 	}
 
-	free_tests();
+	run_tests(&opts, threads);
+
+	for (i = 0; i < opts.nr_threads; i++) {
+		free(threads[i].src_buf);
+		free(threads[i].dst_buf);
+	}
+	free(threads);
 	return 0;
+err:
+	for (i = 0; i < opts.nr_threads; i++) {
+		free(threads[i].src_buf);
+		free(threads[i].dst_buf);
+	}
+	free(threads);
+	return 1;
+}
+
+/*
+ * Time each selectable kernel on a buffer copy that is representative of
+ * what the engines do (block sized copies, destination not reused soon)
+ * and make the fastest one back fio_memcpy().
+ */
+static void __fio_memcpy_init(void)
+{
+	uint64_t best_usec = -1ULL;
+	void *src, *dst;
+	int i, j;
+
+	src = malloc(SELECT_BUF_SIZE);
+	dst = malloc(SELECT_BUF_SIZE);
+	if (!src || !dst)
+		goto out;
+
+	memset(src, 0x5a, SELECT_BUF_SIZE);
+	memset(dst, 0, SELECT_BUF_SIZE);
+
+	for (i = 0; t[i].name; i++) {
+		struct timespec ts;
+		uint64_t usec;
+		size_t off;
+
+		if (!t[i].kernel)
+			continue;
+
+		fio_gettime(&ts, NULL);
+		for (j = 0; j < SELECT_ITERS; j++) {
+			for (off = 0; off < SELECT_BUF_SIZE;
+			     off += SELECT_COPY_SIZE)
+				t[i].kernel(dst + off, src + off,
+						SELECT_COPY_SIZE);
+		}
+		usec = utime_since_now(&ts);
+
+		if (usec < best_usec) {
+			best_usec = usec;
+			fio_memcpy_fn = t[i].kernel;
+		}
+	}
+
+out:
+	free(src);
+	free(dst);
+}
+
+/*
+ * Called from every mmap job's init; with thread=1 those run concurrently,
+ * so let pthread_once() make sure the selection runs only once per process.
+ */
+void fio_memcpy_init(void)
+{
+	static pthread_once_t once = PTHREAD_ONCE_INIT;
+
+	pthread_once(&once, __fio_memcpy_init);
 }
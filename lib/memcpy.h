@@ -1,6 +1,23 @@
 #ifndef FIO_MEMCPY_H
 #define FIO_MEMCPY_H
 
-int fio_memcpy_test(const char *type);
+#include <stddef.h>
+#include <stdbool.h>
+
+typedef void *(memcpy_fn_t)(void *, const void *, size_t);
+
+extern memcpy_fn_t *fio_memcpy_fn;
+
+int fio_memcpy_test(const char *type, bool json);
+void fio_memcpy_init(void);
+
+/*
+ * Copy kernel picked by fio_memcpy_init(), for engines that move data
+ * between the io_u buffer and a mapping. Plain memcpy until initialized.
+ */
+static inline void *fio_memcpy(void *dst, const void *src, size_t len)
+{
+	return fio_memcpy_fn(dst, src, len);
+}
 
 #endif
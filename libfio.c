@@ -186,6 +186,7 @@ static const char *td_runstates[] = {
 	"SETTING_UP",
 	"RUNNING",
 	"PRE_READING",
+	"PRECONDITIONING",
 	"VERIFYING",
 	"FSYNCING",
 	"FINISHING",
@@ -195,7 +196,7 @@ static const char *td_runstates[] = {
 
 const char *runstate_to_name(int runstate)
 {
-	compiletime_assert(TD_LAST == 12, "td runstate list");
+	compiletime_assert(TD_LAST == 13, "td runstate list");
 	if (runstate >= 0 && runstate < TD_LAST)
 		return td_runstates[runstate];
 
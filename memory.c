@@ -3,6 +3,7 @@
  */
 #include <fcntl.h>
 #include <unistd.h>
+#include <pthread.h>
 #include <sys/mman.h>
 #include <sys/stat.h>
 
@@ -10,6 +11,26 @@
 #ifndef FIO_NO_HAVE_SHM_H
 #include <sys/shm.h>
 #endif
+#ifdef CONFIG_LIBNUMA
+#include <numaif.h>
+#endif
+
+/*
+ * A mapping in the buffer arena. Slabs are bound to a NUMA node and kept
+ * around when a job is done with them, so later jobs on the same node get
+ * memory that is already faulted in.
+ */
+struct arena_slab {
+	struct flist_head list;
+	void *ptr;
+	size_t size;
+	int node;
+	bool huge;
+	bool in_use;
+};
+
+static FLIST_HEAD(arena_slabs);
+static pthread_mutex_t arena_lock = PTHREAD_MUTEX_INITIALIZER;
 
 void fio_unpin_memory(struct thread_data *td)
 {
@@ -282,6 +303,208 @@ static void free_mem_cudamalloc(struct thread_data *td)
 #endif
 }
 
+/*
+ * The node the buffers of a job should live on. That's the node of the
+ * CPUs the job may run on if they are all on one node, otherwise the node
+ * of the CPU it is running on now.
+ */
+static int arena_node(struct thread_data *td)
+{
+#ifdef CONFIG_LIBNUMA
+	int cpu, node = -1;
+
+	if (numa_available() < 0)
+		return 0;
+
+#ifdef FIO_HAVE_CPU_AFFINITY
+	if (fio_option_is_set(&td->o, cpumask)) {
+		for (cpu = 0; cpu < cpus_online(); cpu++) {
+			int this_node;
+
+			if (!fio_cpu_isset(&td->o.cpumask, cpu))
+				continue;
+
+			this_node = numa_node_of_cpu(cpu);
+			if (node == -1)
+				node = this_node;
+			else if (node != this_node) {
+				node = -1;
+				break;
+			}
+		}
+		if (node >= 0)
+			return node;
+	}
+#endif
+
+	cpu = sched_getcpu();
+	if (cpu >= 0)
+		node = numa_node_of_cpu(cpu);
+
+	return node < 0 ? 0 : node;
+#else
+	return 0;
+#endif
+}
+
+/*
+ * Prefer the node for the pages of the slab. Nothing has touched them
+ * yet, so they get allocated there on first use. A memory policy set with
+ * numa_mem_policy takes precedence.
+ */
+static void arena_bind(struct thread_data *td, struct arena_slab *slab)
+{
+#ifdef CONFIG_LIBNUMA
+	unsigned long mask;
+
+	if (numa_available() < 0 || fio_option_is_set(&td->o, numa_memnodes))
+		return;
+	if (slab->node >= sizeof(mask) * 8)
+		return;
+
+	mask = 1UL << slab->node;
+	if (mbind(slab->ptr, slab->size, MPOL_PREFERRED, &mask,
+		  sizeof(mask) * 8 + 1, 0) < 0)
+		dprint(FD_MEM, "arena mbind node %d: %s\n", slab->node,
+							strerror(errno));
+#endif
+}
+
+static struct arena_slab *arena_new_slab(struct thread_data *td, size_t size,
+					 int node)
+{
+	struct arena_slab *slab;
+	int flags = OS_MAP_ANON | MAP_PRIVATE;
+
+	slab = calloc(1, sizeof(*slab));
+	if (!slab)
+		return NULL;
+
+	slab->size = size;
+	slab->node = node;
+	slab->ptr = MAP_FAILED;
+
+#ifdef MAP_HUGETLB
+	slab->ptr = mmap(NULL, size, PROT_READ | PROT_WRITE,
+				flags | MAP_HUGETLB, -1, 0);
+	slab->huge = slab->ptr != MAP_FAILED;
+#endif
+	if (slab->ptr == MAP_FAILED) {
+		/*
+		 * No huge pages reserved, settle for transparent huge pages
+		 */
+		slab->ptr = mmap(NULL, size, PROT_READ | PROT_WRITE, flags,
+					-1, 0);
+		if (slab->ptr == MAP_FAILED) {
+			td_verror(td, errno, "mmap");
+			free(slab);
+			return NULL;
+		}
+#ifdef MADV_HUGEPAGE
+		madvise(slab->ptr, size, MADV_HUGEPAGE);
+#endif
+	}
+
+	arena_bind(td, slab);
+
+	dprint(FD_MEM, "arena new slab %p, %llu bytes, node %d, huge=%d\n",
+			slab->ptr, (unsigned long long) size, node, slab->huge);
+	return slab;
+}
+
+static int alloc_mem_arena(struct thread_data *td, size_t total_mem)
+{
+	unsigned long long mask = td->o.hugepage_size - 1;
+	struct arena_slab *slab = NULL;
+	struct flist_head *entry;
+	size_t size;
+	int node;
+
+	if (!td->o.hugepage_size)
+		mask = page_mask;
+
+	size = (total_mem + mask) & ~mask;
+	node = arena_node(td);
+
+	/*
+	 * Reuse a slab on the same node, if one is free and not much larger
+	 */
+	pthread_mutex_lock(&arena_lock);
+	flist_for_each(entry, &arena_slabs) {
+		struct arena_slab *s;
+
+		s = flist_entry(entry, struct arena_slab, list);
+		if (s->in_use || s->node != node || s->size < size ||
+		    s->size > 2 * size)
+			continue;
+
+		s->in_use = true;
+		slab = s;
+		break;
+	}
+	pthread_mutex_unlock(&arena_lock);
+
+	if (slab)
+		dprint(FD_MEM, "arena reuse slab %p, node %d\n", slab->ptr, node);
+	else {
+		slab = arena_new_slab(td, size, node);
+		if (!slab)
+			return 1;
+
+		slab->in_use = true;
+		pthread_mutex_lock(&arena_lock);
+		flist_add_tail(&slab->list, &arena_slabs);
+		pthread_mutex_unlock(&arena_lock);
+	}
+
+	td->orig_buffer = slab->ptr;
+	return 0;
+}
+
+static void free_mem_arena(struct thread_data *td)
+{
+	struct flist_head *entry;
+
+	pthread_mutex_lock(&arena_lock);
+	flist_for_each(entry, &arena_slabs) {
+		struct arena_slab *slab;
+
+		slab = flist_entry(entry, struct arena_slab, list);
+		if (slab->ptr == td->orig_buffer) {
+			dprint(FD_MEM, "arena put slab %p\n", slab->ptr);
+			slab->in_use = false;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&arena_lock);
+}
+
+static void fio_exit arena_exit(void)
+{
+	struct arena_slab *slab;
+
+	while (!flist_empty(&arena_slabs)) {
+		slab = flist_first_entry(&arena_slabs, struct arena_slab, list);
+		flist_del(&slab->list);
+		munmap(slab->ptr, slab->size);
+		free(slab);
+	}
+}
+
+/*
+ * Engines that have to register I/O memory with the kernel or a device
+ * (io_uring fixed buffers, RDMA memory regions) can do so for the whole
+ * buffer area of the job in one call, rather than for each io_u.
+ */
+int fio_register_io_mem(struct thread_data *td, fio_io_mem_reg_fn *fn,
+			void *data)
+{
+	if (!td->orig_buffer)
+		return 1;
+
+	return fn(td, td->orig_buffer, td->orig_buffer_size, data);
+}
+
 /*
  * Set up the buffer area we need for io.
  */
@@ -323,6 +546,8 @@ int allocate_io_mem(struct thread_data *td)
 		ret = alloc_mem_mmap(td, total_mem);
 	else if (td->o.mem_type == MEM_CUDA_MALLOC)
 		ret = alloc_mem_cudamalloc(td, total_mem);
+	else if (td->o.mem_type == MEM_ARENA)
+		ret = alloc_mem_arena(td, total_mem);
 	else {
 		log_err("fio: bad mem type: %d\n", td->o.mem_type);
 		ret = 1;
@@ -354,6 +579,8 @@ void free_io_mem(struct thread_data *td)
 		free_mem_mmap(td, total_mem);
 	else if (td->o.mem_type == MEM_CUDA_MALLOC)
 		free_mem_cudamalloc(td);
+	else if (td->o.mem_type == MEM_ARENA)
+		free_mem_arena(td);
 	else
 		log_err("Bad memory type %u\n", td->o.mem_type);
 
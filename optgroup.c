@@ -169,6 +169,10 @@ static const struct opt_group fio_opt_cat_groups[] = {
 		.name	= "libhdfs I/O engine", /* libhdfs */
 		.mask	= FIO_OPT_G_HDFS,
 	},
+	{
+		.name	= "mmap I/O engine", /* mmap */
+		.mask	= FIO_OPT_G_MMAP,
+	},
 	{
 		.name	= NULL,
 	},
@@ -1081,6 +1081,13 @@ static int str_random_distribution_cb(void *data, const char *str)
 	return 0;
 }
 
+static int str_rate_process_cb(void *data, const char *str)
+{
+	struct thread_data *td = cb_data_to_td(data);
+
+	return arrival_parse(&td->o, str);
+}
+
 static int str_steadystate_cb(void *data, const char *str)
 {
 	struct thread_data *td = cb_data_to_td(data);
@@ -1090,7 +1097,8 @@ static int str_steadystate_cb(void *data, const char *str)
 	long long ll;
 
 	if (td->o.ss_state != FIO_SS_IOPS && td->o.ss_state != FIO_SS_IOPS_SLOPE &&
-	    td->o.ss_state != FIO_SS_BW && td->o.ss_state != FIO_SS_BW_SLOPE) {
+	    td->o.ss_state != FIO_SS_BW && td->o.ss_state != FIO_SS_BW_SLOPE &&
+	    td->o.ss_state != FIO_SS_LAT && td->o.ss_state != FIO_SS_LAT_SLOPE) {
 		/* should be impossible to get here */
 		log_err("fio: unknown steady state criterion\n");
 		return 1;
@@ -1134,6 +1142,20 @@ static int str_steadystate_cb(void *data, const char *str)
 			return 0;
 
 		td->o.ss_limit.u.f = val;
+	} else if (td->o.ss_state & FIO_SS_LAT) {
+		if (check_str_time(nr, &ll, 0)) {
+			log_err("fio: steadystate latency threshold postfix parsing failed\n");
+			free(nr);
+			return 1;
+		}
+
+		dprint(FD_PARSE, "set steady state latency threshold to %lldus\n", ll);
+		free(nr);
+		if (parse_dryrun())
+			return 0;
+
+		/* latency samples are in nsec */
+		td->o.ss_limit.u.f = (double) ll * 1000.0;
 	} else {	/* bandwidth criterion */
 		if (str_to_decimal(nr, &ll, 1, td, 0, 0)) {
 			log_err("fio: steadystate BW threshold postfix parsing failed\n");
@@ -1955,6 +1977,20 @@ struct fio_option fio_options[FIO_MAX_OPTS] = {
 		.category = FIO_OPT_C_IO,
 		.group	= FIO_OPT_G_IO_BASIC,
 	},
+	{
+		.name	= "iodepth_batch_prep",
+		.lname	= "IO depth batch prepare",
+		.type	= FIO_OPT_INT,
+		.off1	= offsetof(struct thread_options, iodepth_batch_prep),
+		.help	= "Number of IO buffers to set up in one pass",
+		.parent	= "iodepth",
+		.hide	= 1,
+		.minval	= 1,
+		.interval = 1,
+		.def	= "1",
+		.category = FIO_OPT_C_IO,
+		.group	= FIO_OPT_G_IO_BASIC,
+	},
 	{
 		.name	= "iodepth_low",
 		.lname	= "IO Depth batch low",
@@ -2740,6 +2776,10 @@ struct fio_option fio_options[FIO_MAX_OPTS] = {
 			    .help = "Allocate GPU device memory for GPUDirect RDMA",
 			  },
 #endif
+			  { .ival = "arena",
+			    .oval = MEM_ARENA,
+			    .help = "Huge page backed memory on the NUMA node of the job, reused across jobs",
+			  },
 		  },
 	},
 	{
@@ -3330,6 +3370,16 @@ struct fio_option fio_options[FIO_MAX_OPTS] = {
 		.category = FIO_OPT_C_IO,
 		.group	= FIO_OPT_G_INVALID,
 	},
+	{
+		.name	= "zone_append",
+		.lname	= "Emulate zone append",
+		.type	= FIO_OPT_BOOL,
+		.off1	= offsetof(struct thread_options, zone_append),
+		.help	= "Allow several writes to a zone to be in flight at once",
+		.def	= "0",
+		.category = FIO_OPT_C_IO,
+		.group	= FIO_OPT_G_INVALID,
+	},
 	{
 		.name	= "max_open_zones",
 		.lname	= "Maximum number of open zones",
@@ -3561,6 +3611,7 @@ struct fio_option fio_options[FIO_MAX_OPTS] = {
 		.lname	= "Rate Process",
 		.type	= FIO_OPT_STR,
 		.off1	= offsetof(struct thread_options, rate_process),
+		.cb	= str_rate_process_cb,
 		.help	= "What process controls how rated IO is managed",
 		.def	= "linear",
 		.category = FIO_OPT_C_IO,
@@ -3575,6 +3626,26 @@ struct fio_option fio_options[FIO_MAX_OPTS] = {
 			    .oval = RATE_PROCESS_POISSON,
 			    .help = "Rate follows Poisson process",
 			  },
+			  {
+			    .ival = "onoff",
+			    .oval = RATE_PROCESS_ONOFF,
+			    .help = "Cycles of I/O for ON time and none for OFF time",
+			  },
+			  {
+			    .ival = "mmpp",
+			    .oval = RATE_PROCESS_MMPP,
+			    .help = "Poisson process that switches between a normal and a burst rate",
+			  },
+			  {
+			    .ival = "pareto",
+			    .oval = RATE_PROCESS_PARETO,
+			    .help = "Pareto distributed time between I/Os",
+			  },
+			  {
+			    .ival = "curve",
+			    .oval = RATE_PROCESS_CURVE,
+			    .help = "Poisson process with the rate scaled by a curve over time",
+			  },
 		},
 		.parent = "rate",
 	},
@@ -3644,6 +3715,41 @@ struct fio_option fio_options[FIO_MAX_OPTS] = {
 		.category = FIO_OPT_C_IO,
 		.group	= FIO_OPT_G_LATPROF,
 	},
+	{
+		.name	= "latency_controller",
+		.lname	= "Latency Target Controller",
+		.type	= FIO_OPT_STR,
+		.off1	= offsetof(struct thread_options, latency_controller),
+		.help	= "How to find the load that meets latency_target",
+		.def	= "bisect",
+		.posval	= {
+			  { .ival = "bisect",
+			    .oval = LAT_CTL_BISECT,
+			    .help = "Bisect the queue depth",
+			  },
+			  { .ival = "depth",
+			    .oval = LAT_CTL_DEPTH,
+			    .help = "Control the queue depth from windowed latency percentiles",
+			  },
+			  { .ival = "iops",
+			    .oval = LAT_CTL_IOPS,
+			    .help = "Control the IOPS rate from windowed latency percentiles",
+			  },
+		},
+		.parent	= "latency_target",
+		.category = FIO_OPT_C_IO,
+		.group	= FIO_OPT_G_LATPROF,
+	},
+	{
+		.name	= "latency_log",
+		.lname	= "Latency Controller Log",
+		.type	= FIO_OPT_STR_STORE,
+		.off1	= offsetof(struct thread_options, latency_log_file),
+		.help	= "Log each latency_controller window to this file",
+		.parent	= "latency_target",
+		.category = FIO_OPT_C_IO,
+		.group	= FIO_OPT_G_LATPROF,
+	},
 	{
 		.name	= "invalidate",
 		.lname	= "Cache invalidate",
@@ -3962,6 +4068,25 @@ struct fio_option fio_options[FIO_MAX_OPTS] = {
 		.category = FIO_OPT_C_GENERAL,
 		.group	= FIO_OPT_G_PROCESS,
 	},
+#ifdef CONFIG_UCONTEXT
+	{
+		.name	= "job_runners",
+		.lname	= "Job runners",
+		.type	= FIO_OPT_INT,
+		.off1	= offsetof(struct thread_options, job_runners),
+		.help	= "Run jobs on a pool of this many threads",
+		.def	= "0",
+		.category = FIO_OPT_C_GENERAL,
+		.group	= FIO_OPT_G_PROCESS,
+	},
+#else
+	{
+		.name	= "job_runners",
+		.lname	= "Job runners",
+		.type	= FIO_OPT_UNSUPPORTED,
+		.help	= "Your platform does not support job runners",
+	},
+#endif
 	{
 		.name	= "per_job_logs",
 		.lname	= "Per Job Logs",
@@ -4640,6 +4765,41 @@ struct fio_option fio_options[FIO_MAX_OPTS] = {
 		.category = FIO_OPT_C_IO,
 		.group	= FIO_OPT_G_IO_FLOW,
 	},
+	{
+		.name	= "flow_rate",
+		.lname	= "I/O flow rate",
+		.type	= FIO_OPT_ULL,
+		.off1	= offsetof(struct thread_options, flow_rate),
+		.help	= "Bandwidth limit shared by all jobs in the flow",
+		.parent	= "flow_id",
+		.hide	= 1,
+		.category = FIO_OPT_C_IO,
+		.group	= FIO_OPT_G_IO_FLOW,
+	},
+	{
+		.name	= "flow_rate_iops",
+		.lname	= "I/O flow rate IOPS",
+		.type	= FIO_OPT_INT,
+		.off1	= offsetof(struct thread_options, flow_rate_iops),
+		.help	= "IOPS limit shared by all jobs in the flow",
+		.parent	= "flow_id",
+		.hide	= 1,
+		.category = FIO_OPT_C_IO,
+		.group	= FIO_OPT_G_IO_FLOW,
+	},
+	{
+		.name	= "flow_weight",
+		.lname	= "I/O flow rate weight",
+		.type	= FIO_OPT_INT,
+		.off1	= offsetof(struct thread_options, flow_weight),
+		.help	= "Share of the flow rate limits assured to this job",
+		.minval	= 1,
+		.parent	= "flow_id",
+		.hide	= 1,
+		.def	= "1",
+		.category = FIO_OPT_C_IO,
+		.group	= FIO_OPT_G_IO_FLOW,
+	},
 	{
 		.name   = "steadystate",
 		.lname  = "Steady state threshold",
@@ -4667,6 +4827,14 @@ struct fio_option fio_options[FIO_MAX_OPTS] = {
 			    .oval = FIO_SS_BW_SLOPE,
 			    .help = "slope calculated from bandwidth measurements",
 			  },
+			  { .ival = "lat",
+			    .oval = FIO_SS_LAT,
+			    .help = "maximum mean deviation of latency percentile measurements",
+			  },
+			  { .ival = "lat_slope",
+			    .oval = FIO_SS_LAT_SLOPE,
+			    .help = "slope calculated from latency percentile measurements",
+			  },
 		},
 		.category = FIO_OPT_C_GENERAL,
 		.group  = FIO_OPT_G_RUNTIME,
@@ -4699,6 +4867,71 @@ struct fio_option fio_options[FIO_MAX_OPTS] = {
 		.category = FIO_OPT_C_GENERAL,
 		.group  = FIO_OPT_G_RUNTIME,
 	},
+	{
+		.name	= "steadystate_percentile",
+		.lname	= "Steady state latency percentile",
+		.alias	= "ss_percentile",
+		.parent	= "steadystate",
+		.type	= FIO_OPT_FLOAT_LIST,
+		.off1	= offsetof(struct thread_options, ss_percentile),
+		.help	= "Latency percentile judged by the lat and lat_slope criteria",
+		.def	= "99",
+		.maxlen	= 1,
+		.minfp	= 0.0,
+		.maxfp	= 100.0,
+		.category = FIO_OPT_C_GENERAL,
+		.group	= FIO_OPT_G_RUNTIME,
+	},
+	{
+		.name	= "steadystate_lat_window",
+		.lname	= "Steady state latency window",
+		.alias	= "ss_lat_window",
+		.parent	= "steadystate",
+		.type	= FIO_OPT_STR_VAL_TIME,
+		.off1	= offsetof(struct thread_options, ss_lat_window),
+		.help	= "Window of completions each latency percentile measurement is taken over",
+		.def	= "5",
+		.is_seconds = 1,
+		.is_time = 1,
+		.category = FIO_OPT_C_GENERAL,
+		.group	= FIO_OPT_G_RUNTIME,
+	},
+	{
+		.name	= "steadystate_per_job",
+		.lname	= "Steady state per job",
+		.alias	= "ss_per_job",
+		.parent	= "steadystate",
+		.type	= FIO_OPT_BOOL,
+		.off1	= offsetof(struct thread_options, ss_per_job),
+		.help	= "Judge steady state and stop each job on its own, even with group_reporting",
+		.def	= "0",
+		.category = FIO_OPT_C_GENERAL,
+		.group	= FIO_OPT_G_RUNTIME,
+	},
+	{
+		.name	= "steadystate_measure",
+		.lname	= "Steady state measurement",
+		.alias	= "ss_measure",
+		.parent	= "steadystate",
+		.type	= FIO_OPT_STR_VAL_TIME,
+		.off1	= offsetof(struct thread_options, ss_measure),
+		.help	= "Once in steady state, reset the statistics and measure for this long",
+		.def	= "0",
+		.is_seconds = 1,
+		.is_time = 1,
+		.category = FIO_OPT_C_GENERAL,
+		.group	= FIO_OPT_G_RUNTIME,
+	},
+	{
+		.name	= "precondition_fill",
+		.lname	= "Precondition fill passes",
+		.type	= FIO_OPT_INT,
+		.off1	= offsetof(struct thread_options, precondition_fill),
+		.help	= "Sequentially write the files this many times before the workload",
+		.def	= "0",
+		.category = FIO_OPT_C_GENERAL,
+		.group	= FIO_OPT_G_RUNTIME,
+	},
 	{
 		.name = NULL,
 	},
@@ -4761,6 +4994,7 @@ void fio_options_dup_and_init(struct option *long_options)
 {
 	unsigned int i;
 
+	options_index(fio_options);
 	options_init(fio_options);
 
 	i = 0;
@@ -5132,6 +5366,13 @@ void fio_options_mem_dupe(struct thread_data *td)
 {
 	options_mem_dupe(fio_options, &td->o);
 
+	/*
+	 * Set by the rate_process callback rather than a string option of
+	 * its own, so the option code doesn't know to dup it
+	 */
+	if (td->o.rate_curve)
+		td->o.rate_curve = strdup(td->o.rate_curve);
+
 	if (td->eo && td->io_ops) {
 		void *oldeo = td->eo;
 
@@ -5182,6 +5423,7 @@ int add_option(const struct fio_option *o)
 
 	memcpy(&fio_options[opt_index], o, sizeof(*o));
 	fio_options[opt_index + 1].name = NULL;
+	options_index(fio_options);
 	return 0;
 }
 
@@ -5241,6 +5483,8 @@ void del_opt_posval(const char *optname, const char *ival)
 void fio_options_free(struct thread_data *td)
 {
 	options_free(fio_options, &td->o);
+	free(td->o.rate_curve);
+	td->o.rate_curve = NULL;
 	if (td->eo && td->io_ops && td->io_ops->options) {
 		options_free(td->io_ops->options, td->eo);
 		free(td->eo);
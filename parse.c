@@ -18,6 +18,7 @@
 #include "minmax.h"
 #include "lib/ieee754.h"
 #include "lib/pow2.h"
+#include "hash.h"
 
 #ifdef CONFIG_ARITHMETIC
 #include "y.tab.h"
@@ -1025,10 +1026,100 @@ static int handle_option(const struct fio_option *o, const char *__ptr,
 	return ret;
 }
 
+/*
+ * Hash of option names and aliases, so that looking up an option in the
+ * main option table doesn't have to strcmp() its way through hundreds of
+ * entries for every line of every job. Keys are inserted in table order,
+ * so a lookup finds matches in the same order as a linear scan would.
+ */
+struct option_slot {
+	const char *key;
+	struct fio_option *o;
+};
+
+static struct {
+	const struct fio_option *options;
+	struct option_slot *slots;
+	unsigned int mask;
+} opt_index;
+
+static unsigned int option_hash(const char *key)
+{
+	return jhash(key, strlen(key), 0) & opt_index.mask;
+}
+
+static void option_index_add(const char *key, struct fio_option *o)
+{
+	unsigned int i = option_hash(key);
+
+	while (opt_index.slots[i].key)
+		i = (i + 1) & opt_index.mask;
+
+	opt_index.slots[i].key = key;
+	opt_index.slots[i].o = o;
+}
+
+/*
+ * (Re)build the lookup hash for 'options'. Must be called again if entries
+ * are added to or renamed in the table.
+ */
+void options_index(struct fio_option *options)
+{
+	struct fio_option *o;
+	unsigned int nr = 0, size;
+
+	free(opt_index.slots);
+	opt_index.options = NULL;
+	opt_index.slots = NULL;
+
+	for (o = &options[0]; o->name; o++)
+		nr += 1 + (o->alias != NULL);
+
+	/* keep the table at most a quarter full */
+	size = 64;
+	while (size < nr * 4)
+		size <<= 1;
+	opt_index.slots = calloc(size, sizeof(struct option_slot));
+	if (!opt_index.slots)
+		return;
+	opt_index.mask = size - 1;
+
+	for (o = &options[0]; o->name; o++) {
+		option_index_add(o->name, o);
+		if (o->alias)
+			option_index_add(o->alias, o);
+	}
+
+	opt_index.options = options;
+}
+
+static struct fio_option *find_option_hashed(const char *opt)
+{
+	unsigned int i = option_hash(opt);
+	struct option_slot *s;
+
+	for (s = &opt_index.slots[i]; s->key;
+	     s = &opt_index.slots[i = (i + 1) & opt_index.mask]) {
+		if (strcmp(s->key, opt))
+			continue;
+		if (s->o->type == FIO_OPT_UNSUPPORTED) {
+			log_err("Option <%s>: %s\n", s->o->name, s->o->help);
+			continue;
+		}
+
+		return s->o;
+	}
+
+	return NULL;
+}
+
 struct fio_option *find_option(struct fio_option *options, const char *opt)
 {
 	struct fio_option *o;
 
+	if (options == opt_index.options)
+		return find_option_hashed(opt);
+
 	for (o = &options[0]; o->name; o++) {
 		if (!o_match(o, opt))
 			continue;
@@ -94,6 +94,7 @@ extern int parse_cmd_option(const char *t, const char *l,
 extern int show_cmd_help(const struct fio_option *, const char *);
 extern void fill_default_options(void *, const struct fio_option *);
 extern void options_init(struct fio_option *);
+extern void options_index(struct fio_option *);
 extern void options_mem_dupe(const struct fio_option *, void *);
 extern void options_free(const struct fio_option *, void *);
 
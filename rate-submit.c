@@ -7,6 +7,7 @@
 #include "fio.h"
 #include "ioengines.h"
 #include "lib/getrusage.h"
+#include "lib/memalign.h"
 #include "rate-submit.h"
 
 static void check_overlap(struct io_u *io_u)
@@ -127,14 +128,18 @@ static int io_workqueue_alloc_fn(struct submit_worker *sw)
 {
 	struct thread_data *td;
 
-	td = calloc(1, sizeof(*td));
+	td = fio_memalign(FIO_CACHELINE_SIZE, sizeof(*td), false);
+	if (!td)
+		return 1;
+
+	memset(td, 0, sizeof(*td));
 	sw->priv = td;
 	return 0;
 }
 
 static void io_workqueue_free_fn(struct submit_worker *sw)
 {
-	free(sw->priv);
+	fio_memfree(sw->priv, sizeof(struct thread_data), false);
 	sw->priv = NULL;
 }
 
@@ -0,0 +1,308 @@
+/*
+ * Job runners, running many jobs on a small pool of threads
+ *
+ * Each job started on a runner gets a context and stack of its own, and is
+ * switched to by the runner thread it was assigned to. A job keeps the
+ * thread until it has to wait for something, at which point it switches
+ * back to the runner. The runner then resumes the next job that is ready
+ * to run, or sleeps until one is.
+ */
+#include <ucontext.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "fio.h"
+#include "flist.h"
+#include "pshared.h"
+#include "runner.h"
+
+#define RUNNER_STACK_SIZE	(2 * 1024 * 1024)
+
+/*
+ * Longest time (usec) an idle runner sleeps before checking for newly
+ * started jobs
+ */
+#define RUNNER_MAX_SLEEP	10000
+
+struct runner_job {
+	struct flist_head list;
+	ucontext_t ctx;
+	void *stack;
+	void *(*fn)(void *);
+	void *data;
+	uint64_t wake;		/* usec since genesis, 0 if ready to run */
+	bool done;
+};
+
+struct job_runner {
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	struct flist_head new_jobs;	/* protected by lock */
+	unsigned int nr_new_jobs;	/* protected by lock */
+	bool exit;			/* protected by lock */
+
+	struct flist_head jobs;
+	unsigned int nr_jobs;
+	ucontext_t ctx;
+};
+
+static struct job_runner *runners;
+static unsigned int nr_runners, next_runner;
+
+static __thread struct job_runner *cur_runner;
+static __thread struct runner_job *cur_job;
+
+bool in_runner(void)
+{
+	return cur_job != NULL;
+}
+
+/*
+ * True if other jobs share the runner of the calling job
+ */
+bool runner_busy(void)
+{
+	return cur_job && cur_runner->nr_jobs > 1;
+}
+
+static void switch_to_runner(void)
+{
+	swapcontext(&cur_job->ctx, &cur_runner->ctx);
+}
+
+void runner_yield(void)
+{
+	if (!cur_job)
+		return;
+
+	cur_job->wake = 0;
+	switch_to_runner();
+}
+
+void runner_sleep(unsigned long long usec)
+{
+	if (!cur_job) {
+		usleep(usec);
+		return;
+	}
+
+	cur_job->wake = utime_since_genesis() + usec;
+	if (!cur_job->wake)
+		cur_job->wake = 1;
+	switch_to_runner();
+}
+
+static void runner_job_main(void)
+{
+	struct runner_job *job = cur_job;
+
+	job->fn(job->data);
+	job->done = true;
+}
+
+static void free_runner_job(struct runner_job *job)
+{
+	munmap(job->stack, RUNNER_STACK_SIZE);
+	free(job);
+}
+
+/*
+ * Run the jobs that are ready once. Returns the number of jobs that ran,
+ * and the earliest time a sleeping job wants to run again in next_wake.
+ */
+static unsigned int run_jobs(struct job_runner *r, uint64_t *next_wake)
+{
+	struct flist_head *n, *tmp;
+	unsigned int ran = 0;
+
+	*next_wake = -1ULL;
+
+	flist_for_each_safe(n, tmp, &r->jobs) {
+		struct runner_job *job;
+
+		job = flist_entry(n, struct runner_job, list);
+		if (job->wake) {
+			if (job->wake > utime_since_genesis()) {
+				*next_wake = min(*next_wake, job->wake);
+				continue;
+			}
+			job->wake = 0;
+		}
+
+		cur_job = job;
+		swapcontext(&r->ctx, &job->ctx);
+		cur_job = NULL;
+		ran++;
+
+		if (job->done) {
+			flist_del(&job->list);
+			free_runner_job(job);
+			r->nr_jobs--;
+		} else if (job->wake)
+			*next_wake = min(*next_wake, job->wake);
+	}
+
+	return ran;
+}
+
+static void *runner_main(void *data)
+{
+	struct job_runner *r = data;
+
+	cur_runner = r;
+
+	while (1) {
+		uint64_t next_wake, now;
+
+		pthread_mutex_lock(&r->lock);
+		while (flist_empty(&r->jobs) && !r->nr_new_jobs && !r->exit)
+			pthread_cond_wait(&r->cond, &r->lock);
+		flist_splice_tail_init(&r->new_jobs, &r->jobs);
+		r->nr_jobs += r->nr_new_jobs;
+		r->nr_new_jobs = 0;
+		pthread_mutex_unlock(&r->lock);
+
+		/* no jobs left, and no new ones coming */
+		if (flist_empty(&r->jobs))
+			break;
+
+		if (run_jobs(r, &next_wake) || next_wake == -1ULL)
+			continue;
+
+		now = utime_since_genesis();
+		if (next_wake > now) {
+			struct timespec req;
+			uint64_t usec;
+
+			usec = min(next_wake - now, (uint64_t) RUNNER_MAX_SLEEP);
+			req.tv_sec = usec / 1000000;
+			req.tv_nsec = (usec % 1000000) * 1000;
+			nanosleep(&req, NULL);
+		}
+	}
+
+	return NULL;
+}
+
+/*
+ * Start fn(data) as a job on the next runner, round robin
+ */
+int runner_start_job(void *(*fn)(void *), void *data)
+{
+	struct job_runner *r;
+	struct runner_job *job;
+
+	if (!nr_runners) {
+		log_err("fio: no job runners\n");
+		return 1;
+	}
+
+	r = &runners[next_runner++ % nr_runners];
+
+	job = calloc(1, sizeof(*job));
+	if (!job) {
+		log_err("fio: failed allocating runner job\n");
+		return 1;
+	}
+	job->fn = fn;
+	job->data = data;
+	job->stack = mmap(NULL, RUNNER_STACK_SIZE, PROT_READ | PROT_WRITE,
+				MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (job->stack == MAP_FAILED) {
+		log_err("fio: runner stack: %s\n", strerror(errno));
+		free(job);
+		return 1;
+	}
+
+	/* guard page, to catch stack overruns */
+	mprotect(job->stack, page_size, PROT_NONE);
+
+	if (getcontext(&job->ctx)) {
+		log_err("fio: getcontext: %s\n", strerror(errno));
+		free_runner_job(job);
+		return 1;
+	}
+	job->ctx.uc_stack.ss_sp = job->stack;
+	job->ctx.uc_stack.ss_size = RUNNER_STACK_SIZE;
+	job->ctx.uc_link = &r->ctx;
+	makecontext(&job->ctx, runner_job_main, 0);
+
+	pthread_mutex_lock(&r->lock);
+	flist_add_tail(&job->list, &r->new_jobs);
+	r->nr_new_jobs++;
+	pthread_cond_signal(&r->cond);
+	pthread_mutex_unlock(&r->lock);
+	return 0;
+}
+
+int runner_init(unsigned int nr)
+{
+	unsigned int i;
+	int ret;
+
+	runners = calloc(nr, sizeof(*runners));
+	if (!runners) {
+		log_err("fio: failed allocating job runners\n");
+		return 1;
+	}
+
+	for (i = 0; i < nr; i++) {
+		struct job_runner *r = &runners[i];
+
+		INIT_FLIST_HEAD(&r->new_jobs);
+		INIT_FLIST_HEAD(&r->jobs);
+
+		ret = mutex_cond_init_pshared(&r->lock, &r->cond);
+		if (ret) {
+			log_err("fio: runner lock: %s\n", strerror(ret));
+			break;
+		}
+
+		ret = pthread_create(&r->thread, NULL, runner_main, r);
+		if (ret) {
+			log_err("fio: runner thread: %s\n", strerror(ret));
+			pthread_cond_destroy(&r->cond);
+			pthread_mutex_destroy(&r->lock);
+			break;
+		}
+
+		nr_runners++;
+	}
+
+	if (nr_runners == nr)
+		return 0;
+
+	runner_exit();
+	return 1;
+}
+
+/*
+ * Wait for the runners to finish their jobs, and stop them
+ */
+void runner_exit(void)
+{
+	unsigned int i;
+
+	for (i = 0; i < nr_runners; i++) {
+		struct job_runner *r = &runners[i];
+
+		pthread_mutex_lock(&r->lock);
+		r->exit = true;
+		pthread_cond_signal(&r->cond);
+		pthread_mutex_unlock(&r->lock);
+	}
+
+	for (i = 0; i < nr_runners; i++) {
+		struct job_runner *r = &runners[i];
+
+		pthread_join(r->thread, NULL);
+		pthread_cond_destroy(&r->cond);
+		pthread_mutex_destroy(&r->lock);
+	}
+
+	free(runners);
+	runners = NULL;
+	nr_runners = next_runner = 0;
+}
@@ -0,0 +1,52 @@
+#ifndef FIO_RUNNER_H
+#define FIO_RUNNER_H
+
+#include <stdbool.h>
+#include <unistd.h>
+
+/*
+ * Job runners run jobs as coroutines on a small pool of threads, see the
+ * job_runners option. A job running on a runner must not block the thread
+ * when it waits, but hand the runner to its other jobs with one of the
+ * runner_*() calls below. Outside of a runner they fall back to the
+ * regular blocking behaviour.
+ */
+#ifdef CONFIG_UCONTEXT
+extern bool in_runner(void);
+extern bool runner_busy(void);
+extern void runner_yield(void);
+extern void runner_sleep(unsigned long long usec);
+
+extern int runner_init(unsigned int nr_runners);
+extern int runner_start_job(void *(*fn)(void *), void *data);
+extern void runner_exit(void);
+#else
+static inline bool in_runner(void)
+{
+	return false;
+}
+static inline bool runner_busy(void)
+{
+	return false;
+}
+static inline void runner_yield(void)
+{
+}
+static inline void runner_sleep(unsigned long long usec)
+{
+	usleep(usec);
+}
+static inline int runner_init(unsigned int nr_runners)
+{
+	return 1;
+}
+static inline int runner_start_job(void *(*fn)(void *), void *data)
+{
+	return 1;
+}
+static inline void runner_exit(void)
+{
+}
+#endif
+
+#endif
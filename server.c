@@ -17,6 +17,12 @@
 #ifdef CONFIG_ZLIB
 #include <zlib.h>
 #endif
+#ifdef CONFIG_LZ4
+#include <lz4.h>
+#endif
+#ifdef CONFIG_ZSTD
+#include <zstd.h>
+#endif
 
 #include "fio.h"
 #include "options.h"
@@ -59,8 +65,21 @@ static unsigned int has_zlib = 1;
 static unsigned int has_zlib = 0;
 #endif
 static unsigned int use_zlib;
+static unsigned int log_comp;
 static char me[128];
 
+/*
+ * Last TS sent for each thread_number, deltas are sent against it
+ */
+struct ts_delta_base {
+	struct flist_head list;
+	uint32_t thread_number;
+	struct cmd_ts_pdu pdu;
+};
+
+static FLIST_HEAD(ts_delta_list);
+static pthread_mutex_t ts_delta_lock = PTHREAD_MUTEX_INITIALIZER;
+
 static pthread_key_t sk_out_key;
 
 struct fio_fork_item {
@@ -102,6 +121,8 @@ static const char *fio_server_ops[FIO_NET_CMD_NR] = {
 	"VTRIGGER",
 	"SENDFILE",
 	"JOB_OPT",
+	"TS_DELTA",
+	"IOLOG_CHUNK",
 };
 
 static void sk_lock(struct sk_out *sk_out)
@@ -781,6 +802,7 @@ static int handle_run_cmd(struct sk_out *sk_out, struct flist_head *job_list,
 	ret = fio_backend(sk_out);
 	free_threads_shm();
 	sk_out_drop();
+	sflush();
 	_exit(ret);
 }
 
@@ -873,11 +895,31 @@ static int handle_probe_cmd(struct fio_net_cmd *cmd)
 	if (has_zlib && le64_to_cpu(pdu->flags) & FIO_PROBE_FLAG_ZLIB) {
 		probe.flags = __cpu_to_le64(FIO_PROBE_FLAG_ZLIB);
 		use_zlib = 1;
+		log_comp = FIO_NET_COMP_ZLIB;
 	} else {
 		probe.flags = 0;
 		use_zlib = 0;
+		log_comp = FIO_NET_COMP_NONE;
 	}
 
+	/*
+	 * Logs streamed while jobs run use the fastest compressor we share
+	 * with the client, lz4 before zstd before zlib.
+	 */
+#ifdef CONFIG_ZSTD
+	if (le64_to_cpu(pdu->flags) & FIO_PROBE_FLAG_ZSTD) {
+		probe.flags |= __cpu_to_le64(FIO_PROBE_FLAG_ZSTD);
+		log_comp = FIO_NET_COMP_ZSTD;
+	}
+#endif
+#ifdef CONFIG_LZ4
+	if (le64_to_cpu(pdu->flags) & FIO_PROBE_FLAG_LZ4) {
+		probe.flags &= ~__cpu_to_le64(FIO_PROBE_FLAG_ZSTD);
+		probe.flags |= __cpu_to_le64(FIO_PROBE_FLAG_LZ4);
+		log_comp = FIO_NET_COMP_LZ4;
+	}
+#endif
+
 	return fio_net_queue_cmd(FIO_NET_CMD_PROBE, &probe, sizeof(probe), &tag, SK_F_COPY);
 }
 
@@ -1258,6 +1300,7 @@ static int handle_connection(struct sk_out *sk_out)
 	close(sk_out->sk);
 	sk_out->sk = -1;
 	__sk_out_drop(sk_out);
+	sflush();
 	_exit(ret);
 }
 
@@ -1455,16 +1498,179 @@ static void convert_gs(struct group_run_stats *dst, struct group_run_stats *src)
 	dst->sig_figs	= cpu_to_le32(src->sig_figs);
 }
 
+static struct ts_delta_base *ts_delta_find(uint32_t thread_number,
+					    bool *created)
+{
+	struct ts_delta_base *base;
+	struct flist_head *entry;
+
+	*created = false;
+	flist_for_each(entry, &ts_delta_list) {
+		base = flist_entry(entry, struct ts_delta_base, list);
+		if (base->thread_number == thread_number)
+			return base;
+	}
+
+	base = malloc(sizeof(*base));
+	if (!base)
+		return NULL;
+
+	base->thread_number = thread_number;
+	flist_add_tail(&base->list, &ts_delta_list);
+	*created = true;
+	return base;
+}
+
+/*
+ * Remember 'p' as the last TS the client got in full
+ */
+static void fio_server_ts_delta_base(struct cmd_ts_pdu *p)
+{
+	struct ts_delta_base *base;
+	bool created;
+
+	pthread_mutex_lock(&ts_delta_lock);
+	base = ts_delta_find(p->ts.thread_number, &created);
+	if (base)
+		memcpy(&base->pdu, p, sizeof(*p));
+	pthread_mutex_unlock(&ts_delta_lock);
+}
+
+static inline bool ts_delta_changed(const uint8_t *old, const uint8_t *new,
+				    size_t off, size_t size)
+{
+	size_t len = min(sizeof(uint64_t), size - off);
+
+	return memcmp(old + off, new + off, len) != 0;
+}
+
+/*
+ * Encode the 8 byte words of 'new' that differ from 'old' as runs. A single
+ * unchanged word costs as much as a new run header, so runs are merged
+ * across it.
+ */
+static size_t ts_delta_encode(const uint8_t *old, const uint8_t *new,
+			      size_t size, uint8_t *out, uint32_t *nr_runs)
+{
+	const size_t word = sizeof(uint64_t);
+	struct cmd_ts_delta_run *run;
+	uint8_t *p = out;
+	size_t off = 0, end;
+
+	*nr_runs = 0;
+	while (off < size) {
+		if (!ts_delta_changed(old, new, off, size)) {
+			off += word;
+			continue;
+		}
+
+		end = off + word;
+		while (end < size) {
+			if (ts_delta_changed(old, new, end, size))
+				end += word;
+			else if (end + word < size &&
+				 ts_delta_changed(old, new, end + word, size))
+				end += 2 * word;
+			else
+				break;
+		}
+		if (end > size)
+			end = size;
+
+		run = (struct cmd_ts_delta_run *) p;
+		run->offset = cpu_to_le32((uint32_t) off);
+		run->len = cpu_to_le32((uint32_t) (end - off));
+		memcpy(run->data, new + off, end - off);
+		p += sizeof(*run) + end - off;
+		(*nr_runs)++;
+		off = end;
+	}
+
+	return p - out;
+}
+
+/*
+ * Queue the parts of 'p' that changed since the last TS sent for the same
+ * thread_number, and make 'p' the new base. Returns false if nothing was
+ * sent for this thread_number yet, the full TS must be sent then.
+ */
+static bool fio_server_send_ts_delta(struct cmd_ts_pdu *p)
+{
+	const size_t size = sizeof(*p);
+	struct cmd_ts_delta_pdu *pdu;
+	struct ts_delta_base *base;
+	uint32_t nr_runs;
+	size_t len, max;
+	bool created;
+
+	/*
+	 * Worst case every other word changed, each with its own run
+	 */
+	max = sizeof(*pdu) + size +
+		(size / sizeof(uint64_t) + 1) * sizeof(struct cmd_ts_delta_run);
+
+	pthread_mutex_lock(&ts_delta_lock);
+	base = ts_delta_find(p->ts.thread_number, &created);
+	if (!base) {
+		pthread_mutex_unlock(&ts_delta_lock);
+		return false;
+	}
+
+	pdu = created ? NULL : malloc(max);
+	if (!pdu) {
+		memcpy(&base->pdu, p, size);
+		pthread_mutex_unlock(&ts_delta_lock);
+		return false;
+	}
+
+	len = ts_delta_encode((uint8_t *) &base->pdu, (uint8_t *) p, size,
+				pdu->data, &nr_runs);
+	memcpy(&base->pdu, p, size);
+	pthread_mutex_unlock(&ts_delta_lock);
+
+	dprint(FD_NET, "server sending ts delta: %u runs, %lu bytes\n",
+		nr_runs, (unsigned long) len);
+
+	pdu->thread_number = p->ts.thread_number;
+	pdu->compressed = 0;
+	pdu->nr_runs = cpu_to_le32(nr_runs);
+	pdu->len = cpu_to_le32((uint32_t) len);
+
+#ifdef CONFIG_ZLIB
+	if (use_zlib && len) {
+		uLongf zlen = compressBound(len);
+		struct cmd_ts_delta_pdu *zpdu;
+
+		zpdu = malloc(sizeof(*zpdu) + zlen);
+		if (zpdu && compress2(zpdu->data, &zlen, pdu->data, len,
+				      Z_BEST_SPEED) == Z_OK && zlen < len) {
+			memcpy(zpdu, pdu, sizeof(*pdu));
+			zpdu->compressed = __cpu_to_le32(1);
+			free(pdu);
+			pdu = zpdu;
+			len = zlen;
+		} else
+			free(zpdu);
+	}
+#endif
+
+	fio_net_queue_cmd(FIO_NET_CMD_TS_DELTA, pdu, sizeof(*pdu) + len, NULL,
+				SK_F_COPY);
+	free(pdu);
+	return true;
+}
+
 /*
  * Send a CMD_TS, which packs struct thread_stat and group_run_stats
- * into a single payload.
+ * into a single payload. If the client already got one for this
+ * thread_number, only the changes are sent as a CMD_TS_DELTA.
  */
 void fio_server_send_ts(struct thread_stat *ts, struct group_run_stats *rs)
 {
 	struct cmd_ts_pdu p;
 	int i, j;
 	void *ss_buf;
-	uint64_t *ss_iops, *ss_bw;
+	uint64_t *ss_iops, *ss_bw, *ss_lat;
 
 	dprint(FD_NET, "server sending end stats\n");
 
@@ -1485,6 +1691,8 @@ void fio_server_send_ts(struct thread_stat *ts, struct group_run_stats *rs)
 		convert_io_stat(&p.ts.clat_stat[i], &ts->clat_stat[i]);
 		convert_io_stat(&p.ts.slat_stat[i], &ts->slat_stat[i]);
 		convert_io_stat(&p.ts.lat_stat[i], &ts->lat_stat[i]);
+		convert_io_stat(&p.ts.rsp_stat[i], &ts->rsp_stat[i]);
+		convert_io_stat(&p.ts.backlog_stat[i], &ts->backlog_stat[i]);
 		convert_io_stat(&p.ts.bw_stat[i], &ts->bw_stat[i]);
 		convert_io_stat(&p.ts.iops_stat[i], &ts->iops_stat[i]);
 	}
@@ -1518,9 +1726,12 @@ void fio_server_send_ts(struct thread_stat *ts, struct group_run_stats *rs)
 	for (i = 0; i < FIO_IO_U_LAT_M_NR; i++)
 		p.ts.io_u_lat_m[i]	= cpu_to_le64(ts->io_u_lat_m[i]);
 
-	for (i = 0; i < DDIR_RWDIR_CNT; i++)
-		for (j = 0; j < FIO_IO_U_PLAT_NR; j++)
+	for (i = 0; i < DDIR_RWDIR_CNT; i++) {
+		for (j = 0; j < FIO_IO_U_PLAT_NR; j++) {
 			p.ts.io_u_plat[i][j] = cpu_to_le64(ts->io_u_plat[i][j]);
+			p.ts.io_u_rsp_plat[i][j] = cpu_to_le64(ts->io_u_rsp_plat[i][j]);
+		}
+	}
 
 	for (i = 0; i < DDIR_RWDIR_CNT; i++) {
 		p.ts.total_io_u[i]	= cpu_to_le64(ts->total_io_u[i]);
@@ -1531,6 +1742,13 @@ void fio_server_send_ts(struct thread_stat *ts, struct group_run_stats *rs)
 	p.ts.total_submit	= cpu_to_le64(ts->total_submit);
 	p.ts.total_complete	= cpu_to_le64(ts->total_complete);
 	p.ts.nr_zone_resets	= cpu_to_le64(ts->nr_zone_resets);
+	p.ts.nr_zone_finishes	= cpu_to_le64(ts->nr_zone_finishes);
+
+	for (i = 0; i < FIO_ZONE_OP_NR; i++) {
+		convert_io_stat(&p.ts.zone_op_stat[i], &ts->zone_op_stat[i]);
+		for (j = 0; j < FIO_IO_U_PLAT_NR; j++)
+			p.ts.io_u_zone_op_plat[i][j] = cpu_to_le64(ts->io_u_zone_op_plat[i][j]);
+	}
 
 	for (i = 0; i < DDIR_RWDIR_CNT; i++) {
 		p.ts.io_bytes[i]	= cpu_to_le64(ts->io_bytes[i]);
@@ -1547,6 +1765,8 @@ void fio_server_send_ts(struct thread_stat *ts, struct group_run_stats *rs)
 	p.ts.latency_depth	= cpu_to_le32(ts->latency_depth);
 	p.ts.latency_target	= cpu_to_le64(ts->latency_target);
 	p.ts.latency_window	= cpu_to_le64(ts->latency_window);
+	p.ts.latency_sustained_iops = cpu_to_le64(ts->latency_sustained_iops);
+	p.ts.setup_time		= cpu_to_le64(ts->setup_time);
 	p.ts.latency_percentile.u.i = cpu_to_le64(fio_double_to_uint64(ts->latency_percentile.u.f));
 
 	p.ts.sig_figs		= cpu_to_le32(ts->sig_figs);
@@ -1559,6 +1779,12 @@ void fio_server_send_ts(struct thread_stat *ts, struct group_run_stats *rs)
 	p.ts.ss_state		= cpu_to_le32(ts->ss_state);
 	p.ts.ss_head		= cpu_to_le32(ts->ss_head);
 	p.ts.ss_limit.u.i	= cpu_to_le64(fio_double_to_uint64(ts->ss_limit.u.f));
+	p.ts.ss_percentile.u.i	= cpu_to_le64(fio_double_to_uint64(ts->ss_percentile.u.f));
+
+	p.ts.precond_fill_msec	= cpu_to_le64(ts->precond_fill_msec);
+	p.ts.precond_ss_msec	= cpu_to_le64(ts->precond_ss_msec);
+	p.ts.precond_measure_msec = cpu_to_le64(ts->precond_measure_msec);
+	p.ts.precond_fill_passes = cpu_to_le32(ts->precond_fill_passes);
 	p.ts.ss_slope.u.i	= cpu_to_le64(fio_double_to_uint64(ts->ss_slope.u.f));
 	p.ts.ss_deviation.u.i	= cpu_to_le64(fio_double_to_uint64(ts->ss_deviation.u.f));
 	p.ts.ss_criterion.u.i	= cpu_to_le64(fio_double_to_uint64(ts->ss_criterion.u.f));
@@ -1572,22 +1798,25 @@ void fio_server_send_ts(struct thread_stat *ts, struct group_run_stats *rs)
 	if (ts->ss_state & FIO_SS_DATA) {
 		dprint(FD_NET, "server sending steadystate ring buffers\n");
 
-		ss_buf = malloc(sizeof(p) + 2*ts->ss_dur*sizeof(uint64_t));
+		ss_buf = malloc(sizeof(p) + 3*ts->ss_dur*sizeof(uint64_t));
 
 		memcpy(ss_buf, &p, sizeof(p));
 
 		ss_iops = (uint64_t *) ((struct cmd_ts_pdu *)ss_buf + 1);
 		ss_bw = ss_iops + (int) ts->ss_dur;
+		ss_lat = ss_bw + (int) ts->ss_dur;
 		for (i = 0; i < ts->ss_dur; i++) {
 			ss_iops[i] = cpu_to_le64(ts->ss_iops_data[i]);
 			ss_bw[i] = cpu_to_le64(ts->ss_bw_data[i]);
+			ss_lat[i] = cpu_to_le64(ts->ss_lat_data[i]);
 		}
 
-		fio_net_queue_cmd(FIO_NET_CMD_TS, ss_buf, sizeof(p) + 2*ts->ss_dur*sizeof(uint64_t), NULL, SK_F_COPY);
+		fio_net_queue_cmd(FIO_NET_CMD_TS, ss_buf, sizeof(p) + 3*ts->ss_dur*sizeof(uint64_t), NULL, SK_F_COPY);
 
 		free(ss_buf);
+		fio_server_ts_delta_base(&p);
 	}
-	else
+	else if (!fio_server_send_ts_delta(&p))
 		fio_net_queue_cmd(FIO_NET_CMD_TS, &p, sizeof(p), NULL, SK_F_COPY);
 }
 
@@ -1955,18 +2184,213 @@ static int fio_append_text_log(struct sk_entry *first, struct io_log *log)
 	return ret;
 }
 
+/*
+ * Compress 'len' bytes of 'buf' with the negotiated log compressor. Returns
+ * NULL if the data should be sent as is.
+ */
+static void *iolog_chunk_compress(void *buf, size_t len, size_t *out_len,
+				  uint32_t *comp)
+{
+	size_t bound;
+	void *out;
+
+	switch (log_comp) {
+#ifdef CONFIG_ZLIB
+	case FIO_NET_COMP_ZLIB:
+		bound = compressBound(len);
+		break;
+#endif
+#ifdef CONFIG_LZ4
+	case FIO_NET_COMP_LZ4:
+		bound = LZ4_compressBound(len);
+		break;
+#endif
+#ifdef CONFIG_ZSTD
+	case FIO_NET_COMP_ZSTD:
+		bound = ZSTD_compressBound(len);
+		break;
+#endif
+	default:
+		return NULL;
+	}
+
+	out = malloc(bound);
+	if (!out)
+		return NULL;
+
+	*out_len = 0;
+	switch (log_comp) {
+#ifdef CONFIG_ZLIB
+	case FIO_NET_COMP_ZLIB: {
+		uLongf zlen = bound;
+
+		if (compress2(out, &zlen, buf, len, Z_BEST_SPEED) == Z_OK)
+			*out_len = zlen;
+		break;
+		}
+#endif
+#ifdef CONFIG_LZ4
+	case FIO_NET_COMP_LZ4: {
+		int ret;
+
+		ret = LZ4_compress_default(buf, out, len, bound);
+		if (ret > 0)
+			*out_len = ret;
+		break;
+		}
+#endif
+#ifdef CONFIG_ZSTD
+	case FIO_NET_COMP_ZSTD: {
+		size_t ret;
+
+		ret = ZSTD_compress(out, bound, buf, len, 1);
+		if (!ZSTD_isError(ret))
+			*out_len = ret;
+		break;
+		}
+#endif
+	}
+
+	if (!*out_len || *out_len >= len) {
+		free(out);
+		return NULL;
+	}
+
+	*comp = log_comp;
+	return out;
+}
+
+static int fio_send_iolog_chunk_pdu(struct io_log *log, void *samples,
+				    uint64_t nr_samples)
+{
+	struct cmd_iolog_chunk_pdu pdu = {
+		.nr_samples	= cpu_to_le64(nr_samples),
+		.thread_number	= cpu_to_le32(log->td->thread_number),
+		.log_type	= cpu_to_le32(log->log_type),
+		.log_offset	= cpu_to_le32(log->log_offset),
+	};
+	size_t len = nr_samples * log_entry_sz(log);
+	struct sk_entry *first, *entry;
+	uint32_t comp = FIO_NET_COMP_NONE;
+	size_t out_len;
+	void *out;
+
+	strncpy((char *) pdu.name, log->filename, FIO_NET_NAME_MAX);
+	pdu.name[FIO_NET_NAME_MAX - 1] = '\0';
+
+	out = iolog_chunk_compress(samples, len, &out_len, &comp);
+
+	pdu.comp = cpu_to_le32(comp);
+	pdu.len = cpu_to_le32((uint32_t) len);
+
+	first = fio_net_prep_cmd(FIO_NET_CMD_IOLOG_CHUNK, &pdu, sizeof(pdu),
+				 NULL, SK_F_VEC | SK_F_INLINE | SK_F_COPY);
+	if (!first) {
+		free(out);
+		return 1;
+	}
+
+	/*
+	 * The entries are sent inline, so the samples don't need copying.
+	 * Compressed output is freed once sent.
+	 */
+	if (out)
+		entry = fio_net_prep_cmd(FIO_NET_CMD_IOLOG_CHUNK, out, out_len,
+					 NULL, SK_F_VEC | SK_F_INLINE | SK_F_FREE);
+	else
+		entry = fio_net_prep_cmd(FIO_NET_CMD_IOLOG_CHUNK, samples, len,
+					 NULL, SK_F_VEC | SK_F_INLINE);
+	if (!entry) {
+		free(out);
+		finish_entry(first);
+		return 1;
+	}
+
+	flist_add_tail(&entry->list, &first->next);
+	fio_net_queue_entry(first);
+	return 0;
+}
+
+/*
+ * Send 'nr_samples' samples of 'log' to the client while the job runs.
+ * They are converted to little endian in place, and sent in chunks of at
+ * most FIO_SERVER_MAX_IOLOG_CHUNK bytes, so the client never has to
+ * buffer more than that.
+ */
+int fio_send_iolog_chunk(struct io_log *log, void *samples, uint64_t nr_samples)
+{
+	size_t sample_sz = log_entry_sz(log);
+	uint64_t i, per_chunk;
+	int ret = 0;
+
+	for (i = 0; i < nr_samples; i++) {
+		struct io_sample *s = __get_sample(samples, log->log_offset, i);
+
+		s->time		= cpu_to_le64(s->time);
+		s->data.val	= cpu_to_le64(s->data.val);
+		s->__ddir	= cpu_to_le32(s->__ddir);
+		s->bs		= cpu_to_le64(s->bs);
+
+		if (log->log_offset) {
+			struct io_sample_offset *so = (void *) s;
+
+			so->offset = cpu_to_le64(so->offset);
+		}
+	}
+
+	per_chunk = FIO_SERVER_MAX_IOLOG_CHUNK / sample_sz;
+	for (i = 0; i < nr_samples; i += per_chunk) {
+		uint64_t this_nr = min(per_chunk, nr_samples - i);
+
+		ret |= fio_send_iolog_chunk_pdu(log,
+				(char *) samples + i * sample_sz, this_nr);
+	}
+
+	return ret;
+}
+
 int fio_send_iolog(struct thread_data *td, struct io_log *log, const char *name)
 {
 	struct cmd_iolog_pdu pdu = {
 		.nr_samples		= cpu_to_le64(iolog_nr_samples(log)),
 		.thread_number		= cpu_to_le32(td->thread_number),
 		.log_type		= cpu_to_le32(log->log_type),
+		.log_offset		= cpu_to_le32(log->log_offset),
 		.log_hist_coarseness	= cpu_to_le32(log->hist_coarseness),
 	};
 	struct sk_entry *first;
 	struct flist_head *entry;
 	int ret = 0;
 
+	/*
+	 * What is left of a streamed log goes out as chunks too. The IOLOG
+	 * that follows has no samples, it tells the client the log is done.
+	 */
+	if (log->stream) {
+		while (!flist_empty(&log->io_logs)) {
+			struct io_logs *cur_log;
+
+			cur_log = flist_first_entry(&log->io_logs, struct io_logs, list);
+			flist_del_init(&cur_log->list);
+
+			if (cur_log->nr_samples)
+				ret |= fio_send_iolog_chunk(log, cur_log->log,
+							cur_log->nr_samples);
+
+			free(cur_log->log);
+			sfree(cur_log);
+		}
+
+		pdu.nr_samples = 0;
+		pdu.compressed = 0;
+		strncpy((char *) pdu.name, name, FIO_NET_NAME_MAX);
+		pdu.name[FIO_NET_NAME_MAX - 1] = '\0';
+
+		fio_net_queue_cmd(FIO_NET_CMD_IOLOG, &pdu, sizeof(pdu), NULL,
+					SK_F_COPY | SK_F_INLINE);
+		return ret;
+	}
+
 	if (!flist_empty(&log->chunk_list))
 		pdu.compressed = __cpu_to_le32(STORE_COMPRESSED);
 	else if (use_zlib)
@@ -48,7 +48,7 @@ struct fio_net_cmd_reply {
 };
 
 enum {
-	FIO_SERVER_VER			= 78,
+	FIO_SERVER_VER			= 90,
 
 	FIO_SERVER_MAX_FRAGMENT_PDU	= 1024,
 	FIO_SERVER_MAX_CMD_MB		= 2048,
@@ -75,7 +75,9 @@ enum {
 	FIO_NET_CMD_VTRIGGER		= 20,
 	FIO_NET_CMD_SENDFILE		= 21,
 	FIO_NET_CMD_JOB_OPT		= 22,
-	FIO_NET_CMD_NR			= 23,
+	FIO_NET_CMD_TS_DELTA		= 23,
+	FIO_NET_CMD_IOLOG_CHUNK		= 24,
+	FIO_NET_CMD_NR			= 25,
 
 	FIO_NET_CMD_F_MORE		= 1UL << 0,
 
@@ -88,6 +90,13 @@ enum {
 	FIO_NET_CLIENT_TIMEOUT		= 5000,
 
 	FIO_PROBE_FLAG_ZLIB		= 1UL << 0,
+	FIO_PROBE_FLAG_LZ4		= 1UL << 1,
+	FIO_PROBE_FLAG_ZSTD		= 1UL << 2,
+
+	/*
+	 * Max uncompressed size of the samples in an IOLOG_CHUNK
+	 */
+	FIO_SERVER_MAX_IOLOG_CHUNK	= 1024 * 1024,
 };
 
 struct cmd_sendfile {
@@ -120,6 +129,27 @@ struct cmd_ts_pdu {
 	struct group_run_stats rs;
 };
 
+/*
+ * Sent instead of a cmd_ts_pdu once the client has one for the same
+ * thread_number. 'nr_runs' cmd_ts_delta_run entries follow, each holding
+ * a byte range of the new cmd_ts_pdu that changed since the last one sent.
+ * The runs are zlib compressed if 'compressed' is set, 'len' is their
+ * uncompressed length.
+ */
+struct cmd_ts_delta_pdu {
+	uint32_t thread_number;
+	uint32_t compressed;
+	uint32_t nr_runs;
+	uint32_t len;
+	uint8_t data[0];
+};
+
+struct cmd_ts_delta_run {
+	uint32_t offset;
+	uint32_t len;
+	uint8_t data[0];
+};
+
 struct cmd_du_pdu {
 	struct disk_util_stat dus;
 	struct disk_util_agg agg;
@@ -187,6 +217,13 @@ enum {
 	STORE_COMPRESSED	= 2U,
 };
 
+enum {
+	FIO_NET_COMP_NONE	= 0U,
+	FIO_NET_COMP_ZLIB	= 1U,
+	FIO_NET_COMP_LZ4	= 2U,
+	FIO_NET_COMP_ZSTD	= 3U,
+};
+
 struct cmd_iolog_pdu {
 	uint64_t nr_samples;
 	uint32_t thread_number;
@@ -198,6 +235,24 @@ struct cmd_iolog_pdu {
 	struct io_sample samples[0];
 };
 
+/*
+ * Part of an IO log, sent while the job is running. The samples are
+ * compressed with 'comp', 'len' is their uncompressed size. The client
+ * appends them to the log file, and closes it when the cmd_iolog_pdu for
+ * the same log arrives at the end of the job.
+ */
+struct cmd_iolog_chunk_pdu {
+	uint64_t nr_samples;
+	uint32_t thread_number;
+	uint32_t log_type;
+	uint32_t log_offset;
+	uint32_t comp;
+	uint32_t len;
+	uint32_t pad;
+	uint8_t name[FIO_NET_NAME_MAX];
+	uint8_t samples[0];
+};
+
 struct cmd_job_option {
 	uint16_t global;
 	uint16_t truncated;
@@ -225,6 +280,7 @@ extern int fio_server_get_verify_state(const char *, int, void **);
 extern struct fio_net_cmd *fio_net_recv_cmd(int sk, bool wait);
 
 extern int fio_send_iolog(struct thread_data *, struct io_log *, const char *);
+extern int fio_send_iolog_chunk(struct io_log *, void *, uint64_t);
 extern void fio_server_send_add_job(struct thread_data *);
 extern void fio_server_send_start(struct thread_data *);
 extern int fio_net_send_quit(int sk);
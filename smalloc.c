@@ -1,10 +1,15 @@
 /*
  * simple memory allocator, backed by mmap() so that it hands out memory
  * that can be shared across processes and threads
+ *
+ * Small allocations are served from slabs of fixed size objects, one free
+ * list per size class, with a per-thread cache of free objects in front of
+ * each list. Larger allocations are carved out of the pool bitmaps.
  */
 #include <sys/mman.h>
 #include <assert.h>
 #include <string.h>
+#include <pthread.h>
 
 #include "fio.h"
 #include "fio_sem.h"
@@ -19,39 +24,108 @@
 #define SMALLOC_BPL	(SMALLOC_BPB * SMALLOC_BPI)
 
 #define INITIAL_SIZE	16*1024*1024	/* new pool size */
-#define INITIAL_POOLS	8		/* maximum number of pools to setup */
+#define INITIAL_POOLS	8		/* number of pools to setup at init */
 
-#define MAX_POOLS	16
+#define MAX_POOLS	128
+
+#define SMALLOC_SLAB_SIZE	(64 * 1024)	/* size class slab size */
+#define SMALLOC_CLASS_ALIGN	16
+#define SMALLOC_MAX_CLASS	2048		/* largest size class object */
+
+#define SMALLOC_TCACHE_MAX	32	/* max cached objects per class */
+#define SMALLOC_TCACHE_BATCH	16	/* objects moved to/from a list at once */
 
 #define SMALLOC_PRE_RED		0xdeadbeefU
 #define SMALLOC_POST_RED	0x5aa55aa5U
 
+/*
+ * Object sizes of the slab classes, including the block header
+ */
+static const unsigned int class_sizes[] = {
+	32, 48, 64, 96, 128, 192, 256, 384, 512, 768, 1024, 1536,
+	SMALLOC_MAX_CLASS,
+};
+
+#define SMALLOC_NR_CLASSES	ARRAY_SIZE(class_sizes)
+
 unsigned int smalloc_pool_size = INITIAL_SIZE;
 #ifdef SMALLOC_REDZONE
 static const int int_mask = sizeof(int) - 1;
 #endif
 
+/*
+ * Pool accounting lives in the pool mapping, so that all processes see
+ * the same counts
+ */
+struct pool_state {
+	size_t free_blocks;			/* free blocks */
+	size_t next_non_full;
+};
+
 struct pool {
 	struct fio_sem *lock;			/* protects this pool */
 	void *map;				/* map of blocks */
 	unsigned int *bitmap;			/* blocks free/busy map */
-	size_t free_blocks;		/* free blocks */
+	struct pool_state *state;
 	size_t nr_blocks;			/* total blocks */
-	size_t next_non_full;
 	size_t mmap_size;
 };
 
 struct block_hdr {
 	size_t size;
+	unsigned int class;			/* size class + 1, 0 if none */
 #ifdef SMALLOC_REDZONE
 	unsigned int prered;
 #endif
 };
 
+/*
+ * Free objects of one size, linked through their first word. Shared
+ * between processes.
+ */
+struct smalloc_class {
+	struct fio_sem lock;
+	void *free_list;
+	size_t nr_free;
+	size_t nr_slabs;
+};
+
+/*
+ * Per-thread stacks of free objects, allocations and frees that hit the
+ * cache take no locks
+ */
+struct smalloc_tcache {
+	unsigned int gen;
+	unsigned int nr[SMALLOC_NR_CLASSES];
+	void *objs[SMALLOC_NR_CLASSES][SMALLOC_TCACHE_MAX];
+};
+
 static struct pool mp[MAX_POOLS];
 static unsigned int nr_pools;
 static unsigned int last_pool;
 
+static struct smalloc_class *classes;
+static unsigned char size_to_class[SMALLOC_MAX_CLASS / SMALLOC_CLASS_ALIGN];
+
+/*
+ * Pools added after a fork would only be mapped in the process that added
+ * them, so they can only grow until the first fork.
+ */
+static bool pools_frozen;
+static pthread_mutex_t grow_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+ * Bumped in a forked child, objects in a thread cache inherited from the
+ * parent are still owned by the parent.
+ */
+static unsigned int tcache_gen;
+
+#ifdef CONFIG_TLS_THREAD
+static __thread struct smalloc_tcache *tcache;
+static pthread_key_t tcache_key;
+static bool tcache_key_valid;
+#endif
+
 static inline int ptr_valid(struct pool *pool, void *ptr)
 {
 	unsigned int pool_size = pool->nr_blocks * SMALLOC_BPL;
@@ -163,11 +237,11 @@ static bool add_pool(struct pool *pool, unsigned int alloc_size)
 	/* round up to nearest full number of blocks */
 	alloc_size = (alloc_size + SMALLOC_BPL - 1) & ~(SMALLOC_BPL - 1);
 	bitmap_blocks = alloc_size / SMALLOC_BPL;
+	alloc_size += sizeof(struct pool_state);
 	alloc_size += bitmap_blocks * sizeof(unsigned int);
 	pool->mmap_size = alloc_size;
 
 	pool->nr_blocks = bitmap_blocks;
-	pool->free_blocks = bitmap_blocks * SMALLOC_BPB;
 
 	mmap_flags = OS_MAP_ANON;
 #ifdef CONFIG_ESX
@@ -181,13 +255,21 @@ static bool add_pool(struct pool *pool, unsigned int alloc_size)
 		goto out_fail;
 
 	pool->map = ptr;
-	pool->bitmap = (unsigned int *)((char *) ptr + (pool->nr_blocks * SMALLOC_BPL));
+	pool->state = (struct pool_state *)((char *) ptr + (pool->nr_blocks * SMALLOC_BPL));
+	pool->state->free_blocks = bitmap_blocks * SMALLOC_BPB;
+	pool->state->next_non_full = 0;
+	pool->bitmap = (unsigned int *)(pool->state + 1);
 	memset(pool->bitmap, 0, bitmap_blocks * sizeof(unsigned int));
 
 	pool->lock = fio_sem_init(FIO_SEM_UNLOCKED);
 	if (!pool->lock)
 		goto out_fail;
 
+	/*
+	 * sfree() and smalloc() look at the pools without holding the
+	 * grow lock, make sure the pool is set up before it is visible
+	 */
+	write_barrier();
 	nr_pools++;
 	return true;
 out_fail:
@@ -197,11 +279,89 @@ out_fail:
 	return false;
 }
 
+static void smalloc_prefork(void)
+{
+	pthread_mutex_lock(&grow_lock);
+}
+
+static void smalloc_postfork_parent(void)
+{
+	pools_frozen = true;
+	pthread_mutex_unlock(&grow_lock);
+}
+
+static void smalloc_postfork_child(void)
+{
+	pools_frozen = true;
+	tcache_gen++;
+	pthread_mutex_unlock(&grow_lock);
+}
+
+#ifdef CONFIG_TLS_THREAD
+static void tcache_exit(void *data)
+{
+	struct smalloc_tcache *tc = data;
+
+	tcache = tc;
+	sflush();
+	tcache = NULL;
+	free(tc);
+}
+#endif
+
+static bool classes_init(void)
+{
+	unsigned int i, j;
+
+	classes = mmap(NULL, SMALLOC_NR_CLASSES * sizeof(*classes),
+			PROT_READ | PROT_WRITE, OS_MAP_ANON | MAP_SHARED, -1, 0);
+	if (classes == MAP_FAILED) {
+		classes = NULL;
+		return false;
+	}
+
+	for (i = 0; i < SMALLOC_NR_CLASSES; i++) {
+		if (__fio_sem_init(&classes[i].lock, FIO_SEM_UNLOCKED))
+			goto err;
+		classes[i].free_list = NULL;
+		classes[i].nr_free = classes[i].nr_slabs = 0;
+	}
+
+	for (i = 0, j = 0; i < ARRAY_SIZE(size_to_class); i++) {
+		if ((i + 1) * SMALLOC_CLASS_ALIGN > class_sizes[j])
+			j++;
+		size_to_class[i] = j;
+	}
+
+#ifdef CONFIG_TLS_THREAD
+	if (!pthread_key_create(&tcache_key, tcache_exit))
+		tcache_key_valid = true;
+	else
+		log_err("smalloc: can't create TLS key\n");
+#endif
+
+	pthread_atfork(smalloc_prefork, smalloc_postfork_parent,
+			smalloc_postfork_child);
+	return true;
+err:
+	while (i--)
+		__fio_sem_remove(&classes[i].lock);
+	munmap(classes, SMALLOC_NR_CLASSES * sizeof(*classes));
+	classes = NULL;
+	return false;
+}
+
 void sinit(void)
 {
 	bool ret;
 	int i;
 
+	/*
+	 * Without size classes, everything is allocated from the bitmaps
+	 */
+	if (!classes && !classes_init())
+		log_err("smalloc: failed setting up size classes\n");
+
 	for (i = 0; i < INITIAL_POOLS; i++) {
 		ret = add_pool(&mp[nr_pools], smalloc_pool_size);
 		if (!ret)
@@ -233,6 +393,13 @@ void scleanup(void)
 
 	for (i = 0; i < nr_pools; i++)
 		cleanup_pool(&mp[i]);
+
+	if (classes) {
+		for (i = 0; i < SMALLOC_NR_CLASSES; i++)
+			__fio_sem_remove(&classes[i].lock);
+		munmap(classes, SMALLOC_NR_CLASSES * sizeof(*classes));
+		classes = NULL;
+	}
 }
 
 #ifdef SMALLOC_REDZONE
@@ -281,6 +448,183 @@ static void sfree_check_redzone(struct block_hdr *hdr)
 }
 #endif
 
+/*
+ * Take up to 'nr' objects off the free list of class 'cls'
+ */
+static unsigned int class_get(unsigned int cls, void **objs, unsigned int nr)
+{
+	struct smalloc_class *c = &classes[cls];
+	unsigned int i = 0;
+
+	fio_sem_down(&c->lock);
+	while (i < nr && c->free_list) {
+		objs[i] = c->free_list;
+		c->free_list = *(void **) objs[i];
+		i++;
+	}
+	c->nr_free -= i;
+	fio_sem_up(&c->lock);
+
+	return i;
+}
+
+static void class_put(unsigned int cls, void **objs, unsigned int nr)
+{
+	struct smalloc_class *c = &classes[cls];
+	unsigned int i;
+
+	if (!nr)
+		return;
+
+	for (i = 0; i < nr - 1; i++)
+		*(void **) objs[i] = objs[i + 1];
+
+	fio_sem_down(&c->lock);
+	*(void **) objs[nr - 1] = c->free_list;
+	c->free_list = objs[0];
+	c->nr_free += nr;
+	fio_sem_up(&c->lock);
+}
+
+static void *smalloc_pools(size_t alloc_size);
+
+/*
+ * Carve a new slab into objects of class 'cls' and add them to its list
+ */
+static bool class_grow(unsigned int cls)
+{
+	struct smalloc_class *c = &classes[cls];
+	unsigned int i, size = class_sizes[cls];
+	unsigned int nr = SMALLOC_SLAB_SIZE / size;
+	char *slab;
+
+	slab = smalloc_pools(SMALLOC_SLAB_SIZE);
+	if (!slab)
+		return false;
+
+	for (i = 0; i < nr - 1; i++)
+		*(void **) (slab + i * size) = slab + (i + 1) * size;
+
+	fio_sem_down(&c->lock);
+	*(void **) (slab + (nr - 1) * size) = c->free_list;
+	c->free_list = slab;
+	c->nr_free += nr;
+	c->nr_slabs++;
+	fio_sem_up(&c->lock);
+	return true;
+}
+
+static unsigned int class_refill(unsigned int cls, void **objs,
+				 unsigned int nr)
+{
+	unsigned int ret;
+
+	ret = class_get(cls, objs, nr);
+	if (!ret && class_grow(cls))
+		ret = class_get(cls, objs, nr);
+
+	return ret;
+}
+
+#ifdef CONFIG_TLS_THREAD
+static struct smalloc_tcache *get_tcache(void)
+{
+	struct smalloc_tcache *tc = tcache;
+
+	if (tc) {
+		if (tc->gen != tcache_gen) {
+			memset(tc->nr, 0, sizeof(tc->nr));
+			tc->gen = tcache_gen;
+		}
+		return tc;
+	}
+
+	if (!tcache_key_valid)
+		return NULL;
+
+	tc = malloc(sizeof(*tc));
+	if (!tc)
+		return NULL;
+
+	memset(tc->nr, 0, sizeof(tc->nr));
+	tc->gen = tcache_gen;
+	if (pthread_setspecific(tcache_key, tc)) {
+		free(tc);
+		return NULL;
+	}
+
+	tcache = tc;
+	return tc;
+}
+
+static void *smalloc_class(unsigned int cls)
+{
+	struct smalloc_tcache *tc = get_tcache();
+	void *obj;
+
+	if (!tc)
+		return class_refill(cls, &obj, 1) ? obj : NULL;
+
+	if (!tc->nr[cls]) {
+		tc->nr[cls] = class_refill(cls, tc->objs[cls],
+						SMALLOC_TCACHE_BATCH);
+		if (!tc->nr[cls])
+			return NULL;
+	}
+
+	return tc->objs[cls][--tc->nr[cls]];
+}
+
+static void sfree_class(unsigned int cls, void *obj)
+{
+	struct smalloc_tcache *tc = get_tcache();
+	unsigned int keep;
+
+	if (!tc) {
+		class_put(cls, &obj, 1);
+		return;
+	}
+
+	if (tc->nr[cls] == SMALLOC_TCACHE_MAX) {
+		keep = SMALLOC_TCACHE_MAX - SMALLOC_TCACHE_BATCH;
+		class_put(cls, &tc->objs[cls][keep], SMALLOC_TCACHE_BATCH);
+		tc->nr[cls] = keep;
+	}
+
+	tc->objs[cls][tc->nr[cls]++] = obj;
+}
+
+void sflush(void)
+{
+	struct smalloc_tcache *tc = tcache;
+	unsigned int i;
+
+	if (!tc || tc->gen != tcache_gen)
+		return;
+
+	for (i = 0; i < SMALLOC_NR_CLASSES; i++) {
+		class_put(i, tc->objs[i], tc->nr[i]);
+		tc->nr[i] = 0;
+	}
+}
+#else
+static void *smalloc_class(unsigned int cls)
+{
+	void *obj;
+
+	return class_refill(cls, &obj, 1) ? obj : NULL;
+}
+
+static void sfree_class(unsigned int cls, void *obj)
+{
+	class_put(cls, &obj, 1);
+}
+
+void sflush(void)
+{
+}
+#endif
+
 static void sfree_pool(struct pool *pool, void *ptr)
 {
 	struct block_hdr *hdr;
@@ -297,15 +641,21 @@ static void sfree_pool(struct pool *pool, void *ptr)
 
 	sfree_check_redzone(hdr);
 
+	if (hdr->class) {
+		assert(hdr->class <= SMALLOC_NR_CLASSES);
+		sfree_class(hdr->class - 1, hdr);
+		return;
+	}
+
 	offset = ptr - pool->map;
 	i = offset / SMALLOC_BPL;
 	idx = (offset % SMALLOC_BPL) / SMALLOC_BPB;
 
 	fio_sem_down(pool->lock);
 	clear_blocks(pool, i, idx, size_to_blocks(hdr->size));
-	if (i < pool->next_non_full)
-		pool->next_non_full = i;
-	pool->free_blocks += size_to_blocks(hdr->size);
+	if (i < pool->state->next_non_full)
+		pool->state->next_non_full = i;
+	pool->state->free_blocks += size_to_blocks(hdr->size);
 	fio_sem_up(pool->lock);
 }
 
@@ -343,10 +693,10 @@ static void *__smalloc_pool(struct pool *pool, size_t size)
 	fio_sem_down(pool->lock);
 
 	nr_blocks = size_to_blocks(size);
-	if (nr_blocks > pool->free_blocks)
+	if (nr_blocks > pool->state->free_blocks)
 		goto fail;
 
-	i = pool->next_non_full;
+	i = pool->state->next_non_full;
 	last_idx = 0;
 	offset = -1U;
 	while (i < pool->nr_blocks) {
@@ -354,7 +704,7 @@ static void *__smalloc_pool(struct pool *pool, size_t size)
 
 		if (pool->bitmap[i] == -1U) {
 			i++;
-			pool->next_non_full = i;
+			pool->state->next_non_full = i;
 			last_idx = 0;
 			continue;
 		}
@@ -379,7 +729,7 @@ static void *__smalloc_pool(struct pool *pool, size_t size)
 	}
 
 	if (i < pool->nr_blocks) {
-		pool->free_blocks -= nr_blocks;
+		pool->state->free_blocks -= nr_blocks;
 		ret = pool->map + offset;
 	}
 fail:
@@ -387,65 +737,105 @@ fail:
 	return ret;
 }
 
-static void *smalloc_pool(struct pool *pool, size_t size)
+/*
+ * Add a pool if all pools are full and no other thread added one since
+ * we looked
+ */
+static bool smalloc_grow(unsigned int seen_pools, size_t alloc_size)
 {
-	size_t alloc_size = size + sizeof(struct block_hdr);
-	void *ptr;
+	bool ret = true;
 
-	/*
-	 * Round to int alignment, so that the postred pointer will
-	 * be naturally aligned as well.
-	 */
-#ifdef SMALLOC_REDZONE
-	alloc_size += sizeof(unsigned int);
-	alloc_size = (alloc_size + int_mask) & ~int_mask;
-#endif
+	if (pools_frozen)
+		return false;
 
-	ptr = __smalloc_pool(pool, alloc_size);
-	if (ptr) {
-		struct block_hdr *hdr = ptr;
+	pthread_mutex_lock(&grow_lock);
+	if (pools_frozen)
+		ret = false;
+	else if (nr_pools == seen_pools) {
+		if (alloc_size < smalloc_pool_size)
+			alloc_size = smalloc_pool_size;
+		ret = add_pool(&mp[nr_pools], alloc_size);
+	}
+	pthread_mutex_unlock(&grow_lock);
 
-		hdr->size = alloc_size;
-		fill_redzone(hdr);
+	return ret;
+}
 
-		ptr += sizeof(*hdr);
-		memset(ptr, 0, size);
-	}
+static void *smalloc_pools(size_t alloc_size)
+{
+	unsigned int i, end_pool, seen_pools;
 
-	return ptr;
+	do {
+		seen_pools = nr_pools;
+		read_barrier();
+
+		i = last_pool;
+		end_pool = seen_pools;
+
+		do {
+			for (; i < end_pool; i++) {
+				void *ptr = __smalloc_pool(&mp[i], alloc_size);
+
+				if (ptr) {
+					last_pool = i;
+					return ptr;
+				}
+			}
+			if (last_pool) {
+				end_pool = last_pool;
+				last_pool = i = 0;
+				continue;
+			}
+
+			break;
+		} while (1);
+	} while (smalloc_grow(seen_pools, alloc_size));
+
+	return NULL;
 }
 
 void *smalloc(size_t size)
 {
-	unsigned int i, end_pool;
+	size_t alloc_size = size + sizeof(struct block_hdr);
+	struct block_hdr *hdr;
+	unsigned int class = 0;
+	void *ptr;
 
 	if (size != (unsigned int) size)
 		return NULL;
 
-	i = last_pool;
-	end_pool = nr_pools;
+	/*
+	 * Round to int alignment, so that the postred pointer will
+	 * be naturally aligned as well.
+	 */
+#ifdef SMALLOC_REDZONE
+	alloc_size += sizeof(unsigned int);
+	alloc_size = (alloc_size + int_mask) & ~int_mask;
+#endif
 
-	do {
-		for (; i < end_pool; i++) {
-			void *ptr = smalloc_pool(&mp[i], size);
+	if (classes && alloc_size <= SMALLOC_MAX_CLASS) {
+		unsigned int cls;
 
-			if (ptr) {
-				last_pool = i;
-				return ptr;
-			}
-		}
-		if (last_pool) {
-			end_pool = last_pool;
-			last_pool = i = 0;
-			continue;
-		}
+		cls = size_to_class[(alloc_size - 1) / SMALLOC_CLASS_ALIGN];
+		hdr = smalloc_class(cls);
+		alloc_size = class_sizes[cls];
+		class = cls + 1;
+	} else
+		hdr = smalloc_pools(alloc_size);
 
-		break;
-	} while (1);
+	if (!hdr) {
+		log_err("smalloc: OOM. Consider using --alloc-size to increase the "
+			"shared memory available.\n");
+		return NULL;
+	}
 
-	log_err("smalloc: OOM. Consider using --alloc-size to increase the "
-		"shared memory available.\n");
-	return NULL;
+	hdr->size = alloc_size;
+	hdr->class = class;
+	fill_redzone(hdr);
+
+	ptr = (char *) hdr + sizeof(*hdr);
+	memset(ptr, 0, size);
+	return ptr;
 }
 
 void *scalloc(size_t nmemb, size_t size)
@@ -56,7 +56,7 @@ void update_rusage_stat(struct thread_data *td)
  * group by looking at the index bits.
  *
  */
-static unsigned int plat_val_to_idx(unsigned long long val)
+unsigned int plat_val_to_idx(unsigned long long val)
 {
 	unsigned int msb, error_bits, base, offset, idx;
 
@@ -414,6 +414,31 @@ static void display_lat(const char *name, unsigned long long min,
 	free(maxp);
 }
 
+static const char *zone_op_names[FIO_ZONE_OP_NR] = {
+	"reset", "finish",
+};
+
+static void show_zone_op_status(struct thread_stat *ts,
+				struct buf_output *out)
+{
+	unsigned long long min, max;
+	double mean, dev;
+	int i;
+
+	for (i = 0; i < FIO_ZONE_OP_NR; i++) {
+		if (!calc_lat(&ts->zone_op_stat[i], &min, &max, &mean, &dev))
+			continue;
+
+		log_buf(out, "  zone %s:\n", zone_op_names[i]);
+		display_lat(zone_op_names[i], min, max, mean, dev, out);
+		show_clat_percentiles(ts->io_u_zone_op_plat[i],
+					ts->zone_op_stat[i].samples,
+					ts->percentile_list,
+					ts->percentile_precision,
+					zone_op_names[i], out);
+	}
+}
+
 static void show_ddir_status(struct group_run_stats *rs, struct thread_stat *ts,
 			     int ddir, struct buf_output *out)
 {
@@ -497,6 +522,18 @@ static void show_ddir_status(struct group_run_stats *rs, struct thread_stat *ts,
 					ts->percentile_list,
 					ts->percentile_precision, name, out);
 	}
+	if (calc_lat(&ts->rsp_stat[ddir], &min, &max, &mean, &dev)) {
+		display_lat(" rsp", min, max, mean, dev, out);
+		if (ts->clat_percentiles || ts->lat_percentiles)
+			show_clat_percentiles(ts->io_u_rsp_plat[ddir],
+						ts->rsp_stat[ddir].samples,
+						ts->percentile_list,
+						ts->percentile_precision, " rsp",
+						out);
+	}
+	if (calc_lat(&ts->backlog_stat[ddir], &min, &max, &mean, &dev))
+		log_buf(out, "    backlog: max=%llu, avg=%5.02f, stdev=%5.02f\n",
+				max, mean, dev);
 	if (calc_lat(&ts->bw_stat[ddir], &min, &max, &mean, &dev)) {
 		double p_of_agg = 100.0, fkb_base = (double)rs->kb_base;
 		const char *bw_str;
@@ -756,11 +793,45 @@ static void show_block_infos(int nr_block_infos, uint32_t *block_infos,
 			 i == BLOCK_STATE_COUNT - 1 ? '\n' : ',');
 }
 
+static const char *ss_criterion_name(uint32_t state)
+{
+	if (state & FIO_SS_LAT)
+		return "lat";
+	if (state & FIO_SS_IOPS)
+		return "iops";
+
+	return "bw";
+}
+
+static bool precond_enabled(struct thread_stat *ts)
+{
+	return ts->precond_fill_passes || (ts->ss_state & FIO_SS_MEASURE);
+}
+
+/*
+ * Time spent in each phase of the preconditioning workflow
+ */
+static void show_precond_normal(struct thread_stat *ts, struct buf_output *out)
+{
+	if (!precond_enabled(ts))
+		return;
+
+	log_buf(out, "  precondition : fill=%u passes (%.1fs)",
+		ts->precond_fill_passes, ts->precond_fill_msec / 1000.0);
+	if (ts->ss_state & FIO_SS_MEASURE)
+		log_buf(out, ", steadystate=%.1fs (%s), measurement=%.1fs",
+			ts->precond_ss_msec / 1000.0,
+			ts->ss_state & FIO_SS_ATTAINED ? "attained" : "not attained",
+			ts->precond_measure_msec / 1000.0);
+	log_buf(out, "\n");
+}
+
 static void show_ss_normal(struct thread_stat *ts, struct buf_output *out)
 {
 	char *p1, *p1alt, *p2;
 	unsigned long long bw_mean, iops_mean;
 	const int i2p = is_power_of_2(ts->kb_base);
+	const char *unit = "";
 
 	if (!ts->ss_dur)
 		return;
@@ -772,13 +843,19 @@ static void show_ss_normal(struct thread_stat *ts, struct buf_output *out)
 	p1alt = num2str(bw_mean / ts->kb_base, ts->sig_figs, ts->kb_base, !i2p, ts->unit_base);
 	p2 = num2str(iops_mean, ts->sig_figs, 1, 0, N2S_NONE);
 
-	log_buf(out, "  steadystate  : attained=%s, bw=%s (%s), iops=%s, %s%s=%.3f%s\n",
+	log_buf(out, "  steadystate  : attained=%s, bw=%s (%s), iops=%s, ",
 		ts->ss_state & FIO_SS_ATTAINED ? "yes" : "no",
-		p1, p1alt, p2,
-		ts->ss_state & FIO_SS_IOPS ? "iops" : "bw",
+		p1, p1alt, p2);
+	if (ts->ss_state & FIO_SS_LAT) {
+		log_buf(out, "p%.2f=%.2fusec, ", ts->ss_percentile.u.f,
+			(double) steadystate_lat_mean(ts) / 1000.0);
+		unit = "nsec";
+	}
+	log_buf(out, "%s%s=%.3f%s\n",
+		ss_criterion_name(ts->ss_state),
 		ts->ss_state & FIO_SS_SLOPE ? " slope": " mean dev",
 		ts->ss_criterion.u.f,
-		ts->ss_state & FIO_SS_PCT ? "%" : "");
+		ts->ss_state & FIO_SS_PCT ? "%" : unit);
 
 	free(p1);
 	free(p1alt);
@@ -829,6 +906,8 @@ static void show_thread_status_normal(struct thread_stat *ts,
 	if (ts->sync_stat.samples)
 		show_ddir_status(rs, ts, DDIR_SYNC, out);
 
+	show_zone_op_status(ts, out);
+
 	runtime = ts->total_run_time;
 	if (runtime) {
 		double runt = (double) runtime;
@@ -845,6 +924,9 @@ static void show_thread_status_normal(struct thread_stat *ts,
 			(unsigned long long) ts->ctx,
 			(unsigned long long) ts->majf,
 			(unsigned long long) ts->minf);
+	if (ts->setup_time >= 1000)
+		log_buf(out, "  setup        : %llu msec\n",
+			(unsigned long long) ts->setup_time / 1000);
 
 	stat_calc_dist(ts->io_u_map, ddir_rw_sum(ts->total_io_u), io_u_dist);
 	log_buf(out, "  IO depths    : 1=%3.1f%%, 2=%3.1f%%, 4=%3.1f%%, 8=%3.1f%%,"
@@ -885,11 +967,15 @@ static void show_thread_status_normal(struct thread_stat *ts,
 					strerror(ts->first_error));
 	}
 	if (ts->latency_depth) {
-		log_buf(out, "     latency   : target=%llu, window=%llu, percentile=%.2f%%, depth=%u\n",
+		log_buf(out, "     latency   : target=%llu, window=%llu, percentile=%.2f%%, depth=%u",
 					(unsigned long long)ts->latency_target,
 					(unsigned long long)ts->latency_window,
 					ts->latency_percentile.u.f,
 					ts->latency_depth);
+		if (ts->latency_sustained_iops)
+			log_buf(out, ", sustained iops=%llu",
+				(unsigned long long)ts->latency_sustained_iops);
+		log_buf(out, "\n");
 	}
 
 	if (ts->nr_block_infos)
@@ -898,6 +984,8 @@ static void show_thread_status_normal(struct thread_stat *ts,
 
 	if (ts->ss_dur)
 		show_ss_normal(ts, out);
+
+	show_precond_normal(ts, out);
 }
 
 static void show_ddir_status_terse(struct thread_stat *ts,
@@ -986,6 +1074,138 @@ static void show_ddir_status_terse(struct thread_stat *ts,
 	}
 }
 
+/*
+ * Latency of zone resets or finishes, as "zone_reset" or "zone_finish"
+ */
+static void add_zone_op_json(struct thread_stat *ts, int op,
+			     struct json_object *parent)
+{
+	unsigned long long min, max, minv, maxv;
+	unsigned long long *ovals = NULL;
+	struct json_object *op_object, *tmp_object, *percentile_object;
+	struct json_object *bins_object;
+	unsigned int len = 0;
+	double mean, dev;
+	char buf[120];
+	int i;
+
+	if (!calc_lat(&ts->zone_op_stat[op], &min, &max, &mean, &dev))
+		return;
+
+	op_object = json_create_object();
+	snprintf(buf, sizeof(buf), "zone_%s", zone_op_names[op]);
+	json_object_add_value_object(parent, buf, op_object);
+	json_object_add_value_int(op_object, "total_ops",
+					ts->zone_op_stat[op].samples);
+
+	tmp_object = json_create_object();
+	json_object_add_value_object(op_object, "lat_ns", tmp_object);
+	json_object_add_value_int(tmp_object, "min", min);
+	json_object_add_value_int(tmp_object, "max", max);
+	json_object_add_value_float(tmp_object, "mean", mean);
+	json_object_add_value_float(tmp_object, "stddev", dev);
+
+	if (ts->clat_percentiles || ts->lat_percentiles) {
+		len = calc_clat_percentiles(ts->io_u_zone_op_plat[op],
+					ts->zone_op_stat[op].samples,
+					ts->percentile_list, &ovals, &maxv,
+					&minv);
+		if (len > FIO_IO_U_LIST_MAX_LEN)
+			len = FIO_IO_U_LIST_MAX_LEN;
+
+		percentile_object = json_create_object();
+		json_object_add_value_object(tmp_object, "percentile",
+						percentile_object);
+		for (i = 0; i < len; i++) {
+			snprintf(buf, sizeof(buf), "%f",
+					ts->percentile_list[i].u.f);
+			json_object_add_value_int(percentile_object,
+						(const char *)buf, ovals[i]);
+		}
+	}
+
+	if (output_format & FIO_OUTPUT_JSON_PLUS) {
+		bins_object = json_create_object();
+		json_object_add_value_object(tmp_object, "bins", bins_object);
+		for (i = 0; i < FIO_IO_U_PLAT_NR; i++) {
+			if (!ts->io_u_zone_op_plat[op][i])
+				continue;
+			snprintf(buf, sizeof(buf), "%llu", plat_idx_to_val(i));
+			json_object_add_value_int(bins_object, (const char *)buf,
+						ts->io_u_zone_op_plat[op][i]);
+		}
+	}
+
+	if (ovals)
+		free(ovals);
+}
+
+/*
+ * Response time, measured from when the rate process wanted an I/O
+ * issued, and the backlog of I/Os that were due but not issued yet
+ */
+static void add_rsp_json(struct thread_stat *ts, int ddir,
+			 unsigned long long min, unsigned long long max,
+			 double mean, double dev, struct json_object *parent)
+{
+	unsigned long long minv, maxv;
+	unsigned long long *ovals = NULL;
+	struct json_object *tmp_object, *percentile_object, *bins_object;
+	unsigned int len;
+	char buf[120];
+	int i;
+
+	tmp_object = json_create_object();
+	json_object_add_value_object(parent, "rsp_ns", tmp_object);
+	json_object_add_value_int(tmp_object, "min", min);
+	json_object_add_value_int(tmp_object, "max", max);
+	json_object_add_value_float(tmp_object, "mean", mean);
+	json_object_add_value_float(tmp_object, "stddev", dev);
+
+	if (ts->clat_percentiles || ts->lat_percentiles) {
+		len = calc_clat_percentiles(ts->io_u_rsp_plat[ddir],
+					ts->rsp_stat[ddir].samples,
+					ts->percentile_list, &ovals, &maxv,
+					&minv);
+		if (len > FIO_IO_U_LIST_MAX_LEN)
+			len = FIO_IO_U_LIST_MAX_LEN;
+
+		percentile_object = json_create_object();
+		json_object_add_value_object(tmp_object, "percentile",
+						percentile_object);
+		for (i = 0; i < len; i++) {
+			snprintf(buf, sizeof(buf), "%f",
+					ts->percentile_list[i].u.f);
+			json_object_add_value_int(percentile_object,
+						(const char *)buf, ovals[i]);
+		}
+	}
+
+	if (output_format & FIO_OUTPUT_JSON_PLUS) {
+		bins_object = json_create_object();
+		json_object_add_value_object(tmp_object, "bins", bins_object);
+		for (i = 0; i < FIO_IO_U_PLAT_NR; i++) {
+			if (!ts->io_u_rsp_plat[ddir][i])
+				continue;
+			snprintf(buf, sizeof(buf), "%llu", plat_idx_to_val(i));
+			json_object_add_value_int(bins_object, (const char *)buf,
+						ts->io_u_rsp_plat[ddir][i]);
+		}
+	}
+
+	if (ovals)
+		free(ovals);
+
+	if (!calc_lat(&ts->backlog_stat[ddir], &min, &max, &mean, &dev))
+		return;
+
+	tmp_object = json_create_object();
+	json_object_add_value_object(parent, "backlog", tmp_object);
+	json_object_add_value_int(tmp_object, "max", max);
+	json_object_add_value_float(tmp_object, "mean", mean);
+	json_object_add_value_float(tmp_object, "stddev", dev);
+}
+
 static void add_ddir_status_json(struct thread_stat *ts,
 		struct group_run_stats *rs, int ddir, struct json_object *parent)
 {
@@ -1136,6 +1356,9 @@ static void add_ddir_status_json(struct thread_stat *ts,
 	if (output_format & FIO_OUTPUT_JSON_PLUS && ts->lat_percentiles)
 		json_object_add_value_object(tmp_object, "bins", clat_bins_object);
 
+	if (calc_lat(&ts->rsp_stat[ddir], &min, &max, &mean, &dev))
+		add_rsp_json(ts, ddir, min, max, mean, dev, dir_object);
+
 	if (ovals)
 		free(ovals);
 
@@ -1311,6 +1534,9 @@ static struct json_object *show_thread_status_json(struct thread_stat *ts,
 	add_ddir_status_json(ts, rs, DDIR_TRIM, root);
 	add_ddir_status_json(ts, rs, DDIR_SYNC, root);
 
+	for (i = 0; i < FIO_ZONE_OP_NR; i++)
+		add_zone_op_json(ts, i, root);
+
 	/* CPU Usage */
 	if (ts->total_run_time) {
 		double runt = (double) ts->total_run_time;
@@ -1322,6 +1548,7 @@ static struct json_object *show_thread_status_json(struct thread_stat *ts,
 		sys_cpu = 0;
 	}
 	json_object_add_value_int(root, "job_runtime", ts->total_run_time);
+	json_object_add_value_int(root, "job_setup_time", ts->setup_time / 1000);
 	json_object_add_value_float(root, "usr_cpu", usr_cpu);
 	json_object_add_value_float(root, "sys_cpu", sys_cpu);
 	json_object_add_value_int(root, "ctx", ts->ctx);
@@ -1417,6 +1644,7 @@ static struct json_object *show_thread_status_json(struct thread_stat *ts,
 		json_object_add_value_int(root, "latency_target", ts->latency_target);
 		json_object_add_value_float(root, "latency_percentile", ts->latency_percentile.u.f);
 		json_object_add_value_int(root, "latency_window", ts->latency_window);
+		json_object_add_value_int(root, "latency_sustained_iops", ts->latency_sustained_iops);
 	}
 
 	/* Additional output if description is set */
@@ -1464,12 +1692,12 @@ static struct json_object *show_thread_status_json(struct thread_stat *ts,
 
 	if (ts->ss_dur) {
 		struct json_object *data;
-		struct json_array *iops, *bw;
+		struct json_array *iops, *bw, *lat = NULL;
 		int j, k, l;
 		char ss_buf[64];
 
 		snprintf(ss_buf, sizeof(ss_buf), "%s%s:%f%s",
-			ts->ss_state & FIO_SS_IOPS ? "iops" : "bw",
+			ss_criterion_name(ts->ss_state),
 			ts->ss_state & FIO_SS_SLOPE ? "_slope" : "",
 			(float) ts->ss_limit.u.f,
 			ts->ss_state & FIO_SS_PCT ? "%" : "");
@@ -1485,6 +1713,11 @@ static struct json_object *show_thread_status_json(struct thread_stat *ts,
 		json_object_add_value_string(tmp, "criterion", ss_buf);
 		json_object_add_value_float(tmp, "max_deviation", ts->ss_deviation.u.f);
 		json_object_add_value_float(tmp, "slope", ts->ss_slope.u.f);
+		if (ts->ss_state & FIO_SS_LAT) {
+			json_object_add_value_float(tmp, "percentile",
+							ts->ss_percentile.u.f);
+			lat = json_create_array();
+		}
 
 		data = json_create_object();
 		json_object_add_value_object(tmp, "data", data);
@@ -1505,11 +1738,34 @@ static struct json_object *show_thread_status_json(struct thread_stat *ts,
 			k = (j + l) % ts->ss_dur;
 			json_array_add_value_int(bw, ts->ss_bw_data[k]);
 			json_array_add_value_int(iops, ts->ss_iops_data[k]);
+			if (lat)
+				json_array_add_value_int(lat, ts->ss_lat_data[k]);
 		}
 		json_object_add_value_int(data, "bw_mean", steadystate_bw_mean(ts));
 		json_object_add_value_int(data, "iops_mean", steadystate_iops_mean(ts));
 		json_object_add_value_array(data, "iops", iops);
 		json_object_add_value_array(data, "bw", bw);
+		if (lat) {
+			json_object_add_value_int(data, "lat_ns_mean",
+						  steadystate_lat_mean(ts));
+			json_object_add_value_array(data, "lat_ns", lat);
+		}
+	}
+
+	if (precond_enabled(ts)) {
+		tmp = json_create_object();
+		json_object_add_value_object(root, "precondition", tmp);
+		json_object_add_value_int(tmp, "fill_passes",
+						ts->precond_fill_passes);
+		json_object_add_value_int(tmp, "fill_ms", ts->precond_fill_msec);
+		if (ts->ss_state & FIO_SS_MEASURE) {
+			json_object_add_value_int(tmp, "steadystate_ms",
+							ts->precond_ss_msec);
+			json_object_add_value_int(tmp, "attained",
+					(ts->ss_state & FIO_SS_ATTAINED) > 0);
+			json_object_add_value_int(tmp, "measurement_ms",
+							ts->precond_measure_msec);
+		}
 	}
 
 	return root;
@@ -1643,6 +1899,8 @@ void sum_thread_stats(struct thread_stat *dst, struct thread_stat *src,
 			sum_stat(&dst->clat_stat[l], &src->clat_stat[l], first, false);
 			sum_stat(&dst->slat_stat[l], &src->slat_stat[l], first, false);
 			sum_stat(&dst->lat_stat[l], &src->lat_stat[l], first, false);
+			sum_stat(&dst->rsp_stat[l], &src->rsp_stat[l], first, false);
+			sum_stat(&dst->backlog_stat[l], &src->backlog_stat[l], first, false);
 			sum_stat(&dst->bw_stat[l], &src->bw_stat[l], first, true);
 			sum_stat(&dst->iops_stat[l], &src->iops_stat[l], first, true);
 
@@ -1654,6 +1912,8 @@ void sum_thread_stats(struct thread_stat *dst, struct thread_stat *src,
 			sum_stat(&dst->clat_stat[0], &src->clat_stat[l], first, false);
 			sum_stat(&dst->slat_stat[0], &src->slat_stat[l], first, false);
 			sum_stat(&dst->lat_stat[0], &src->lat_stat[l], first, false);
+			sum_stat(&dst->rsp_stat[0], &src->rsp_stat[l], first, false);
+			sum_stat(&dst->backlog_stat[0], &src->backlog_stat[l], first, false);
 			sum_stat(&dst->bw_stat[0], &src->bw_stat[l], first, true);
 			sum_stat(&dst->iops_stat[0], &src->iops_stat[l], first, true);
 
@@ -1671,6 +1931,9 @@ void sum_thread_stats(struct thread_stat *dst, struct thread_stat *src,
 	}
 
 	sum_stat(&dst->sync_stat, &src->sync_stat, first, false);
+	for (k = 0; k < FIO_ZONE_OP_NR; k++)
+		sum_stat(&dst->zone_op_stat[k], &src->zone_op_stat[k], first,
+				false);
 	dst->usr_time += src->usr_time;
 	dst->sys_time += src->sys_time;
 	dst->ctx += src->ctx;
@@ -1689,6 +1952,13 @@ void sum_thread_stats(struct thread_stat *dst, struct thread_stat *src,
 	}
 	for (k = 0; k < FIO_IO_U_PLAT_NR; k++)
 		dst->io_u_sync_plat[k] += src->io_u_sync_plat[k];
+	for (k = 0; k < FIO_ZONE_OP_NR; k++) {
+		int m;
+
+		for (m = 0; m < FIO_IO_U_PLAT_NR; m++)
+			dst->io_u_zone_op_plat[k][m] +=
+				src->io_u_zone_op_plat[k][m];
+	}
 
 	for (k = 0; k < DDIR_RWDIR_CNT; k++) {
 		if (!dst->unified_rw_rep) {
@@ -1708,17 +1978,32 @@ void sum_thread_stats(struct thread_stat *dst, struct thread_stat *src,
 		int m;
 
 		for (m = 0; m < FIO_IO_U_PLAT_NR; m++) {
-			if (!dst->unified_rw_rep)
+			if (!dst->unified_rw_rep) {
 				dst->io_u_plat[k][m] += src->io_u_plat[k][m];
-			else
+				dst->io_u_rsp_plat[k][m] += src->io_u_rsp_plat[k][m];
+			} else {
 				dst->io_u_plat[0][m] += src->io_u_plat[k][m];
+				dst->io_u_rsp_plat[0][m] += src->io_u_rsp_plat[k][m];
+			}
 		}
 	}
 
 	dst->total_run_time += src->total_run_time;
+	if (dst->setup_time < src->setup_time)
+		dst->setup_time = src->setup_time;
 	dst->total_submit += src->total_submit;
 	dst->total_complete += src->total_complete;
 	dst->nr_zone_resets += src->nr_zone_resets;
+	dst->nr_zone_finishes += src->nr_zone_finishes;
+
+	/* the jobs of a group go through the phases side by side */
+	dst->precond_fill_passes = max(dst->precond_fill_passes,
+					src->precond_fill_passes);
+	dst->precond_fill_msec = max(dst->precond_fill_msec,
+					src->precond_fill_msec);
+	dst->precond_ss_msec = max(dst->precond_ss_msec, src->precond_ss_msec);
+	dst->precond_measure_msec = max(dst->precond_measure_msec,
+					src->precond_measure_msec);
 	dst->cachehit += src->cachehit;
 	dst->cachemiss += src->cachemiss;
 }
@@ -1742,10 +2027,14 @@ void init_thread_stat(struct thread_stat *ts)
 		ts->lat_stat[j].min_val = -1UL;
 		ts->clat_stat[j].min_val = -1UL;
 		ts->slat_stat[j].min_val = -1UL;
+		ts->rsp_stat[j].min_val = -1UL;
+		ts->backlog_stat[j].min_val = -1UL;
 		ts->bw_stat[j].min_val = -1UL;
 		ts->iops_stat[j].min_val = -1UL;
 	}
 	ts->sync_stat.min_val = -1UL;
+	for (j = 0; j < FIO_ZONE_OP_NR; j++)
+		ts->zone_op_stat[j].min_val = -1UL;
 	ts->groupid = -1;
 }
 
@@ -1877,6 +2166,7 @@ void __show_run_stats(void)
 		ts->latency_target = td->o.latency_target;
 		ts->latency_percentile = td->o.latency_percentile;
 		ts->latency_window = td->o.latency_window;
+		ts->latency_sustained_iops += td->latency_sustained_iops;
 
 		ts->nr_block_infos = td->ts.nr_block_infos;
 		for (k = 0; k < ts->nr_block_infos; k++)
@@ -1885,12 +2175,23 @@ void __show_run_stats(void)
 		sum_thread_stats(ts, &td->ts, idx == 1);
 
 		if (td->o.ss_dur) {
+			/*
+			 * Jobs judged on their own only count as attained
+			 * for the group if all of them got there
+			 */
+			bool attained = idx == 1 ||
+					(ts->ss_state & FIO_SS_ATTAINED);
+
 			ts->ss_state = td->ss.state;
+			if (!attained)
+				ts->ss_state &= ~FIO_SS_ATTAINED;
 			ts->ss_dur = td->ss.dur;
 			ts->ss_head = td->ss.head;
 			ts->ss_bw_data = td->ss.bw_data;
 			ts->ss_iops_data = td->ss.iops_data;
+			ts->ss_lat_data = td->ss.lat_data;
 			ts->ss_limit.u.f = td->ss.limit;
+			ts->ss_percentile.u.f = td->ss.percentile;
 			ts->ss_slope.u.f = td->ss.slope;
 			ts->ss_deviation.u.f = td->ss.deviation;
 			ts->ss_criterion.u.f = td->ss.criterion;
@@ -2241,6 +2542,11 @@ static struct io_logs *regrow_log(struct io_log *iolog)
 			log_err("fio: failed flushing iolog! Will stop logging.\n");
 			return NULL;
 		}
+	} else if (iolog->stream) {
+		if (iolog_cur_stream(iolog, cur_log)) {
+			log_err("fio: failed sending iolog! Will stop logging.\n");
+			return NULL;
+		}
 	}
 
 	/*
@@ -2281,6 +2587,7 @@ void regrow_logs(struct thread_data *td)
 	regrow_log(td->clat_log);
 	regrow_log(td->clat_hist_log);
 	regrow_log(td->lat_log);
+	regrow_log(td->rsp_log);
 	regrow_log(td->bw_log);
 	regrow_log(td->iops_log);
 	td->flags &= ~TD_F_REGROW_LOGS;
@@ -2369,6 +2676,8 @@ void reset_io_stats(struct thread_data *td)
 		reset_io_stat(&ts->clat_stat[i]);
 		reset_io_stat(&ts->slat_stat[i]);
 		reset_io_stat(&ts->lat_stat[i]);
+		reset_io_stat(&ts->rsp_stat[i]);
+		reset_io_stat(&ts->backlog_stat[i]);
 		reset_io_stat(&ts->bw_stat[i]);
 		reset_io_stat(&ts->iops_stat[i]);
 
@@ -2380,6 +2689,7 @@ void reset_io_stats(struct thread_data *td)
 
 		for (j = 0; j < FIO_IO_U_PLAT_NR; j++) {
 			ts->io_u_plat[i][j] = 0;
+			ts->io_u_rsp_plat[i][j] = 0;
 			if (!i)
 				ts->io_u_sync_plat[j] = 0;
 		}
@@ -2400,9 +2710,16 @@ void reset_io_stats(struct thread_data *td)
 	for (i = 0; i < FIO_IO_U_LAT_M_NR; i++)
 		ts->io_u_lat_m[i] = 0;
 
+	for (i = 0; i < FIO_ZONE_OP_NR; i++) {
+		reset_io_stat(&ts->zone_op_stat[i]);
+		for (j = 0; j < FIO_IO_U_PLAT_NR; j++)
+			ts->io_u_zone_op_plat[i][j] = 0;
+	}
+
 	ts->total_submit = 0;
 	ts->total_complete = 0;
 	ts->nr_zone_resets = 0;
+	ts->nr_zone_finishes = 0;
 	ts->cachehit = ts->cachemiss = 0;
 }
 
@@ -2496,6 +2813,8 @@ void finalize_logs(struct thread_data *td, bool unit_logs)
 		_add_stat_to_log(td->slat_log, elapsed, td->o.log_max != 0);
 	if (td->lat_log && unit_logs)
 		_add_stat_to_log(td->lat_log, elapsed, td->o.log_max != 0);
+	if (td->rsp_log && unit_logs)
+		_add_stat_to_log(td->rsp_log, elapsed, td->o.log_max != 0);
 	if (td->bw_log && (unit_logs == per_unit_log(td->bw_log)))
 		_add_stat_to_log(td->bw_log, elapsed, td->o.log_max != 0);
 	if (td->iops_log && (unit_logs == per_unit_log(td->iops_log)))
@@ -2522,6 +2841,17 @@ void add_sync_clat_sample(struct thread_stat *ts, unsigned long long nsec)
 	add_stat_sample(&ts->sync_stat, nsec);
 }
 
+void add_zone_op_lat_sample(struct thread_stat *ts, int op,
+			    unsigned long long nsec)
+{
+	unsigned int idx = plat_val_to_idx(nsec);
+	assert(idx < FIO_IO_U_PLAT_NR);
+	assert(op < FIO_ZONE_OP_NR);
+
+	ts->io_u_zone_op_plat[op][idx]++;
+	add_stat_sample(&ts->zone_op_stat[op], nsec);
+}
+
 static void add_clat_percentile_sample(struct thread_stat *ts,
 				unsigned long long nsec, enum fio_ddir ddir)
 {
@@ -2594,6 +2924,49 @@ void add_clat_sample(struct thread_data *td, enum fio_ddir ddir,
 		__td_io_u_unlock(td);
 }
 
+/*
+ * Batches can't be used if samples are logged as they come in, since the
+ * log entries would be out of order with those of other samples
+ */
+bool lat_batch_ok(struct thread_data *td)
+{
+	return !td->parent && !td->lat_log && !td->clat_log &&
+		!td->clat_hist_log;
+}
+
+void add_lat_batch(struct thread_data *td, struct lat_batch *b)
+{
+	const bool needs_lock = td_async_processing(td);
+	struct thread_stat *ts = &td->ts;
+	unsigned int i;
+
+	if (needs_lock)
+		__td_io_u_lock(td);
+
+	if (!td->o.disable_lat) {
+		for (i = 0; i < b->nr; i++)
+			add_stat_sample(&ts->lat_stat[b->ddir[i]], b->lat[i]);
+		if (ts->lat_percentiles) {
+			for (i = 0; i < b->nr; i++)
+				add_clat_percentile_sample(ts, b->lat[i],
+								b->ddir[i]);
+		}
+	}
+
+	if (!td->o.disable_clat) {
+		for (i = 0; i < b->nr; i++)
+			add_stat_sample(&ts->clat_stat[b->ddir[i]], b->clat[i]);
+		if (ts->clat_percentiles) {
+			for (i = 0; i < b->nr; i++)
+				add_clat_percentile_sample(ts, b->clat[i],
+								b->ddir[i]);
+		}
+	}
+
+	if (needs_lock)
+		__td_io_u_unlock(td);
+}
+
 void add_slat_sample(struct thread_data *td, enum fio_ddir ddir,
 		     unsigned long usec, unsigned long long bs, uint64_t offset)
 {
@@ -2615,6 +2988,44 @@ void add_slat_sample(struct thread_data *td, enum fio_ddir ddir,
 		__td_io_u_unlock(td);
 }
 
+void add_rsp_sample(struct thread_data *td, enum fio_ddir ddir,
+		    unsigned long long nsec, unsigned long long bs,
+		    uint64_t offset)
+{
+	const bool needs_lock = td_async_processing(td);
+	struct thread_stat *ts = &td->ts;
+	unsigned int idx = plat_val_to_idx(nsec);
+
+	assert(idx < FIO_IO_U_PLAT_NR);
+
+	if (needs_lock)
+		__td_io_u_lock(td);
+
+	add_stat_sample(&ts->rsp_stat[ddir], nsec);
+	ts->io_u_rsp_plat[ddir][idx]++;
+
+	if (td->rsp_log)
+		add_log_sample(td, td->rsp_log, sample_val(nsec), ddir, bs,
+			       offset);
+
+	if (needs_lock)
+		__td_io_u_unlock(td);
+}
+
+void add_backlog_sample(struct thread_data *td, enum fio_ddir ddir,
+			unsigned long long depth)
+{
+	const bool needs_lock = td_async_processing(td);
+
+	if (needs_lock)
+		__td_io_u_lock(td);
+
+	add_stat_sample(&td->ts.backlog_stat[ddir], depth);
+
+	if (needs_lock)
+		__td_io_u_unlock(td);
+}
+
 void add_lat_sample(struct thread_data *td, enum fio_ddir ddir,
 		    unsigned long long nsec, unsigned long long bs,
 		    uint64_t offset)
@@ -145,6 +145,15 @@ enum block_info_state {
 #define FIO_JOBDESC_SIZE	256
 #define FIO_VERROR_SIZE		128
 
+/*
+ * Zone management operations for which the latency is tracked
+ */
+enum {
+	FIO_ZONE_OP_RESET = 0,
+	FIO_ZONE_OP_FINISH,
+	FIO_ZONE_OP_NR,
+};
+
 struct thread_stat {
 	char name[FIO_JOBNAME_SIZE];
 	char verror[FIO_VERROR_SIZE];
@@ -165,6 +174,8 @@ struct thread_stat {
 	struct io_stat lat_stat[DDIR_RWDIR_CNT]; /* total latency */
 	struct io_stat bw_stat[DDIR_RWDIR_CNT]; /* bandwidth stats */
 	struct io_stat iops_stat[DDIR_RWDIR_CNT]; /* IOPS stats */
+	struct io_stat rsp_stat[DDIR_RWDIR_CNT]; /* response time, rate jobs */
+	struct io_stat backlog_stat[DDIR_RWDIR_CNT]; /* I/Os behind rate */
 
 	/*
 	 * fio system usage accounting
@@ -190,6 +201,7 @@ struct thread_stat {
 	uint64_t io_u_lat_m[FIO_IO_U_LAT_M_NR];
 	uint64_t io_u_plat[DDIR_RWDIR_CNT][FIO_IO_U_PLAT_NR];
 	uint64_t io_u_sync_plat[FIO_IO_U_PLAT_NR];
+	uint64_t io_u_rsp_plat[DDIR_RWDIR_CNT][FIO_IO_U_PLAT_NR];
 
 	uint64_t total_io_u[DDIR_RWDIR_SYNC_CNT];
 	uint64_t short_io_u[DDIR_RWDIR_CNT];
@@ -213,6 +225,9 @@ struct thread_stat {
 
 	/* ZBD stats */
 	uint64_t nr_zone_resets;
+	uint64_t nr_zone_finishes;
+	struct io_stat zone_op_stat[FIO_ZONE_OP_NR];
+	uint64_t io_u_zone_op_plat[FIO_ZONE_OP_NR][FIO_IO_U_PLAT_NR];
 
 	uint64_t nr_block_infos;
 	uint32_t block_infos[MAX_NR_BLOCK_INFOS];
@@ -225,6 +240,9 @@ struct thread_stat {
 	uint64_t latency_target;
 	fio_fp64_t latency_percentile;
 	uint64_t latency_window;
+	uint64_t latency_sustained_iops;
+
+	uint64_t setup_time;
 
 	uint32_t sig_figs;
 
@@ -236,6 +254,7 @@ struct thread_stat {
 	fio_fp64_t ss_slope;
 	fio_fp64_t ss_deviation;
 	fio_fp64_t ss_criterion;
+	fio_fp64_t ss_percentile;
 
 	union {
 		uint64_t *ss_iops_data;
@@ -247,6 +266,18 @@ struct thread_stat {
 		uint64_t pad5;
 	};
 
+	union {
+		uint64_t *ss_lat_data;
+		uint64_t pad6;
+	};
+
+	/* Preconditioning workflow, see precondition_fill and ss_measure */
+	uint64_t precond_fill_msec;
+	uint64_t precond_ss_msec;
+	uint64_t precond_measure_msec;
+	uint32_t precond_fill_passes;
+	uint32_t pad7;
+
 	uint64_t cachehit;
 	uint64_t cachemiss;
 } __attribute__((packed));
@@ -313,6 +344,27 @@ extern void reset_io_stats(struct thread_data *);
 extern void update_rusage_stat(struct thread_data *);
 extern void clear_rusage_stat(struct thread_data *);
 
+/*
+ * Latencies of completions reaped together. They are added to the stats
+ * in one pass per statistic by add_lat_batch(), which gives the same
+ * result as adding them one by one.
+ */
+#define FIO_LAT_BATCH	64
+
+struct lat_batch {
+	unsigned int nr;
+	unsigned long long lat[FIO_LAT_BATCH];
+	unsigned long long clat[FIO_LAT_BATCH];
+	enum fio_ddir ddir[FIO_LAT_BATCH];
+};
+
+extern unsigned int plat_val_to_idx(unsigned long long val);
+extern bool lat_batch_ok(struct thread_data *);
+extern void add_lat_batch(struct thread_data *, struct lat_batch *);
+extern void add_rsp_sample(struct thread_data *, enum fio_ddir, unsigned long long,
+				unsigned long long, uint64_t);
+extern void add_backlog_sample(struct thread_data *, enum fio_ddir,
+				unsigned long long);
 extern void add_lat_sample(struct thread_data *, enum fio_ddir, unsigned long long,
 				unsigned long long, uint64_t);
 extern void add_clat_sample(struct thread_data *, enum fio_ddir, unsigned long long,
@@ -326,6 +378,8 @@ extern void add_bw_sample(struct thread_data *, struct io_u *,
 				unsigned int, unsigned long long);
 extern void add_sync_clat_sample(struct thread_stat *ts,
 					unsigned long long nsec);
+extern void add_zone_op_lat_sample(struct thread_stat *ts, int op,
+					unsigned long long nsec);
 extern int calc_log_samples(void);
 
 extern struct io_log *agg_io_log[DDIR_RWDIR_CNT];
@@ -5,22 +5,93 @@
 
 bool steadystate_enabled = false;
 
+/*
+ * Completion latency histogram of the group (or job) being looked at
+ */
+static uint64_t ss_plat[FIO_IO_U_PLAT_NR];
+
 void steadystate_free(struct thread_data *td)
 {
 	free(td->ss.iops_data);
 	free(td->ss.bw_data);
+	free(td->ss.lat_data);
+	free(td->ss.lat_hist);
 	td->ss.iops_data = NULL;
 	td->ss.bw_data = NULL;
+	td->ss.lat_data = NULL;
+	td->ss.lat_hist = NULL;
 }
 
 static void steadystate_alloc(struct thread_data *td)
 {
 	td->ss.bw_data = calloc(td->ss.dur, sizeof(uint64_t));
 	td->ss.iops_data = calloc(td->ss.dur, sizeof(uint64_t));
+	td->ss.lat_data = calloc(td->ss.dur, sizeof(uint64_t));
+	if (td->ss.state & FIO_SS_LAT)
+		td->ss.lat_hist = calloc(td->ss.lat_window * FIO_IO_U_PLAT_NR,
+						sizeof(uint64_t));
 
 	td->ss.state |= FIO_SS_DATA;
 }
 
+/*
+ * Whether the steady state of the job is judged together with the rest of
+ * its reporting group
+ */
+static bool steadystate_grouped(struct thread_data *td)
+{
+	return td->o.group_reporting && !td->ss.per_job;
+}
+
+/*
+ * The measurements the criterion is evaluated on
+ */
+static uint64_t *steadystate_data(struct steadystate_data *ss)
+{
+	if (ss->state & FIO_SS_LAT)
+		return ss->lat_data;
+	if (ss->state & FIO_SS_IOPS)
+		return ss->iops_data;
+
+	return ss->bw_data;
+}
+
+/*
+ * Return the configured percentile of the latencies completed during the
+ * last lat_window seconds, given the current cumulative histogram in plat.
+ * plat is used as scratch space.
+ */
+static uint64_t steadystate_lat(struct steadystate_data *ss, uint64_t *plat)
+{
+	uint64_t *snap = &ss->lat_hist[ss->lat_slot * FIO_IO_U_PLAT_NR];
+	unsigned long long *ovals = NULL, minv, maxv, nr = 0;
+	fio_fp64_t plist[2];
+	uint64_t lat = 0;
+	int i;
+
+	for (i = 0; i < FIO_IO_U_PLAT_NR; i++) {
+		uint64_t cur = plat[i];
+
+		/* stats were reset since the snapshot, e.g. after ramp_time */
+		plat[i] = cur >= snap[i] ? cur - snap[i] : cur;
+		snap[i] = cur;
+		nr += plat[i];
+	}
+	ss->lat_slot = (ss->lat_slot + 1) % ss->lat_window;
+
+	if (!nr)
+		return 0;
+
+	plist[0].u.f = ss->percentile;
+	plist[1].u.f = 0.0;
+	if (calc_clat_percentiles(plat, nr, plist, &ovals, &maxv, &minv)) {
+		lat = ovals[0];
+		free(ovals);
+	}
+
+	return lat;
+}
+
 void steadystate_setup(void)
 {
 	struct thread_data *td, *prev_td;
@@ -40,7 +111,7 @@ void steadystate_setup(void)
 		if (!td->ss.dur)
 			continue;
 
-		if (!td->o.group_reporting) {
+		if (!steadystate_grouped(td)) {
 			steadystate_alloc(td);
 			continue;
 		}
@@ -53,39 +124,32 @@ void steadystate_setup(void)
 		prev_td = td;
 	}
 
-	if (prev_td && prev_td->o.group_reporting)
+	if (prev_td && steadystate_grouped(prev_td))
 		steadystate_alloc(prev_td);
 }
 
-static bool steadystate_slope(uint64_t iops, uint64_t bw,
+static bool steadystate_slope(uint64_t iops, uint64_t bw, uint64_t lat,
 			      struct thread_data *td)
 {
 	int i, j;
 	double result;
 	struct steadystate_data *ss = &td->ss;
+	uint64_t *data = steadystate_data(ss);
 	uint64_t new_val;
 
 	ss->bw_data[ss->tail] = bw;
 	ss->iops_data[ss->tail] = iops;
+	ss->lat_data[ss->tail] = lat;
 
-	if (ss->state & FIO_SS_IOPS)
-		new_val = iops;
-	else
-		new_val = bw;
+	new_val = data[ss->tail];
 
 	if (ss->state & FIO_SS_BUFFER_FULL || ss->tail - ss->head == ss->dur - 1) {
 		if (!(ss->state & FIO_SS_BUFFER_FULL)) {
 			/* first time through */
 			for(i = 0, ss->sum_y = 0; i < ss->dur; i++) {
-				if (ss->state & FIO_SS_IOPS)
-					ss->sum_y += ss->iops_data[i];
-				else
-					ss->sum_y += ss->bw_data[i];
+				ss->sum_y += data[i];
 				j = (ss->head + i) % ss->dur;
-				if (ss->state & FIO_SS_IOPS)
-					ss->sum_xy += i * ss->iops_data[j];
-				else
-					ss->sum_xy += i * ss->bw_data[j];
+				ss->sum_xy += i * data[j];
 			}
 			ss->state |= FIO_SS_BUFFER_FULL;
 		} else {		/* easy to update the sums */
@@ -94,10 +158,7 @@ static bool steadystate_slope(uint64_t iops, uint64_t bw,
 			ss->sum_xy = ss->sum_xy - ss->sum_y + ss->dur * new_val;
 		}
 
-		if (ss->state & FIO_SS_IOPS)
-			ss->oldest_y = ss->iops_data[ss->head];
-		else
-			ss->oldest_y = ss->bw_data[ss->head];
+		ss->oldest_y = data[ss->head];
 
 		/*
 		 * calculate slope as (sum_xy - sum_x * sum_y / n) / (sum_(x^2)
@@ -130,7 +191,7 @@ static bool steadystate_slope(uint64_t iops, uint64_t bw,
 	return false;
 }
 
-static bool steadystate_deviation(uint64_t iops, uint64_t bw,
+static bool steadystate_deviation(uint64_t iops, uint64_t bw, uint64_t lat,
 				  struct thread_data *td)
 {
 	int i;
@@ -138,40 +199,30 @@ static bool steadystate_deviation(uint64_t iops, uint64_t bw,
 	double mean;
 
 	struct steadystate_data *ss = &td->ss;
+	uint64_t *data = steadystate_data(ss);
 
 	ss->bw_data[ss->tail] = bw;
 	ss->iops_data[ss->tail] = iops;
+	ss->lat_data[ss->tail] = lat;
 
 	if (ss->state & FIO_SS_BUFFER_FULL || ss->tail - ss->head == ss->dur - 1) {
 		if (!(ss->state & FIO_SS_BUFFER_FULL)) {
 			/* first time through */
 			for(i = 0, ss->sum_y = 0; i < ss->dur; i++)
-				if (ss->state & FIO_SS_IOPS)
-					ss->sum_y += ss->iops_data[i];
-				else
-					ss->sum_y += ss->bw_data[i];
+				ss->sum_y += data[i];
 			ss->state |= FIO_SS_BUFFER_FULL;
 		} else {		/* easy to update the sum */
 			ss->sum_y -= ss->oldest_y;
-			if (ss->state & FIO_SS_IOPS)
-				ss->sum_y += ss->iops_data[ss->tail];
-			else
-				ss->sum_y += ss->bw_data[ss->tail];
+			ss->sum_y += data[ss->tail];
 		}
 
-		if (ss->state & FIO_SS_IOPS)
-			ss->oldest_y = ss->iops_data[ss->head];
-		else
-			ss->oldest_y = ss->bw_data[ss->head];
+		ss->oldest_y = data[ss->head];
 
 		mean = (double) ss->sum_y / ss->dur;
 		ss->deviation = 0.0;
 
 		for (i = 0; i < ss->dur; i++) {
-			if (ss->state & FIO_SS_IOPS)
-				diff = ss->iops_data[i] - mean;
-			else
-				diff = ss->bw_data[i] - mean;
+			diff = data[i] - mean;
 			ss->deviation = max(ss->deviation, diff * (diff < 0.0 ? -1.0 : 1.0));
 		}
 
@@ -202,7 +253,7 @@ void steadystate_check(void)
 	unsigned long rate_time;
 	struct thread_data *td, *td2;
 	struct timespec now;
-	uint64_t group_bw = 0, group_iops = 0;
+	uint64_t group_bw = 0, group_iops = 0, group_lat = 0;
 	uint64_t td_iops, td_bytes;
 	bool ret;
 
@@ -212,17 +263,20 @@ void steadystate_check(void)
 		struct steadystate_data *ss = &td->ss;
 
 		if (!ss->dur || td->runstate <= TD_SETTING_UP ||
+		    td->runstate == TD_PRE_READING ||
+		    td->runstate == TD_PRECONDITIONING ||
 		    td->runstate >= TD_EXITED || !ss->state ||
 		    ss->state & FIO_SS_ATTAINED)
 			continue;
 
 		td_iops = 0;
 		td_bytes = 0;
-		if (!td->o.group_reporting ||
-		    (td->o.group_reporting && td->groupid != prev_groupid)) {
+		if (!steadystate_grouped(td) || td->groupid != prev_groupid) {
 			group_bw = 0;
 			group_iops = 0;
 			group_ramp_time_over = 0;
+			if (ss->state & FIO_SS_LAT)
+				memset(ss_plat, 0, sizeof(ss_plat));
 		}
 		prev_groupid = td->groupid;
 
@@ -242,6 +296,10 @@ void steadystate_check(void)
 		for (ddir = 0; ddir < DDIR_RWDIR_CNT; ddir++) {
 			td_iops += td->io_blocks[ddir];
 			td_bytes += td->io_bytes[ddir];
+			if (!(ss->state & FIO_SS_LAT))
+				continue;
+			for (j = 0; j < FIO_IO_U_PLAT_NR; j++)
+				ss_plat[j] += td->ts.io_u_plat[ddir][j];
 		}
 
 		if (needs_lock)
@@ -265,9 +323,16 @@ void steadystate_check(void)
 		ss->prev_iops = td_iops;
 		ss->prev_bytes = td_bytes;
 
-		if (td->o.group_reporting && !(ss->state & FIO_SS_DATA))
+		if (steadystate_grouped(td) && !(ss->state & FIO_SS_DATA))
 			continue;
 
+		/*
+		 * The latency window slides from the start, so it holds
+		 * a full window of samples when ss->ramp_time is over
+		 */
+		if (ss->state & FIO_SS_LAT)
+			group_lat = steadystate_lat(ss, ss_plat);
+
 		/*
 		 * Don't begin checking criterion until ss->ramp_time is over
 		 * for at least one thread in group
@@ -277,28 +342,34 @@ void steadystate_check(void)
 
 		dprint(FD_STEADYSTATE, "steadystate_check() thread: %d, "
 					"groupid: %u, rate_msec: %ld, "
-					"iops: %llu, bw: %llu, head: %d, tail: %d\n",
+					"iops: %llu, bw: %llu, lat: %llu, "
+					"head: %d, tail: %d\n",
 					i, td->groupid, rate_time,
 					(unsigned long long) group_iops,
 					(unsigned long long) group_bw,
+					(unsigned long long) group_lat,
 					ss->head, ss->tail);
 
 		if (ss->state & FIO_SS_SLOPE)
-			ret = steadystate_slope(group_iops, group_bw, td);
+			ret = steadystate_slope(group_iops, group_bw, group_lat,
+						td);
 		else
-			ret = steadystate_deviation(group_iops, group_bw, td);
+			ret = steadystate_deviation(group_iops, group_bw,
+						    group_lat, td);
 
 		if (ret) {
-			if (td->o.group_reporting) {
+			if (steadystate_grouped(td)) {
 				for_each_td(td2, j) {
 					if (td2->groupid == td->groupid) {
 						td2->ss.state |= FIO_SS_ATTAINED;
-						fio_mark_td_terminate(td2);
+						if (!(td2->ss.state & FIO_SS_MEASURE))
+							fio_mark_td_terminate(td2);
 					}
 				}
 			} else {
 				ss->state |= FIO_SS_ATTAINED;
-				fio_mark_td_terminate(td);
+				if (!(ss->state & FIO_SS_MEASURE))
+					fio_mark_td_terminate(td);
 			}
 		}
 	}
@@ -321,10 +392,15 @@ int td_steadystate_init(struct thread_data *td)
 		ss->dur = o->ss_dur;
 		ss->limit = o->ss_limit.u.f;
 		ss->ramp_time = o->ss_ramp_time;
+		ss->percentile = o->ss_percentile.u.f;
+		ss->lat_window = max(o->ss_lat_window / 1000000ULL, 1ULL);
+		ss->per_job = o->ss_per_job;
 
 		ss->state = o->ss_state;
 		if (!td->ss.ramp_time)
 			ss->state |= FIO_SS_RAMP_OVER;
+		if (o->ss_measure)
+			ss->state |= FIO_SS_MEASURE;
 
 		ss->sum_x = o->ss_dur * (o->ss_dur - 1) / 2;
 		ss->sum_x_sq = (o->ss_dur - 1) * (o->ss_dur) * (2*o->ss_dur - 1) / 6;
@@ -338,6 +414,9 @@ int td_steadystate_init(struct thread_data *td)
 			if (ss2->dur != ss->dur ||
 			    ss2->limit != ss->limit ||
 			    ss2->ramp_time != ss->ramp_time ||
+			    ss2->percentile != ss->percentile ||
+			    ss2->lat_window != ss->lat_window ||
+			    ss2->per_job != ss->per_job ||
 			    ss2->state != ss->state ||
 			    ss2->sum_x != ss->sum_x ||
 			    ss2->sum_x_sq != ss->sum_x_sq) {
@@ -377,3 +456,53 @@ uint64_t steadystate_iops_mean(struct thread_stat *ts)
 
 	return sum / ts->ss_dur;
 }
+
+uint64_t steadystate_lat_mean(struct thread_stat *ts)
+{
+	int i;
+	uint64_t sum;
+
+	if (!ts->ss_dur || !ts->ss_lat_data)
+		return 0;
+
+	for (i = 0, sum = 0; i < ts->ss_dur; i++)
+		sum += ts->ss_lat_data[i];
+
+	return sum / ts->ss_dur;
+}
+
+/*
+ * Called by the job once steady state is attained with steadystate_measure
+ * set. Everything up to here was preconditioning, so drop the statistics
+ * and start the measurement phase.
+ */
+void steadystate_measure_start(struct thread_data *td)
+{
+	struct steadystate_data *ss = &td->ss;
+	struct timespec now;
+
+	fio_gettime(&now, NULL);
+	td->ts.precond_ss_msec = mtime_since(&ss->phase_start, &now);
+	memcpy(&ss->phase_start, &now, sizeof(now));
+	ss->measuring = true;
+
+	dprint(FD_STEADYSTATE, "job %s: steady state after %llu msec, "
+				"measuring\n", td->o.name,
+				(unsigned long long) td->ts.precond_ss_msec);
+
+	reset_all_stats(td);
+	reset_io_stats(td);
+}
+
+void steadystate_phase_end(struct thread_data *td)
+{
+	struct steadystate_data *ss = &td->ss;
+
+	if (!(ss->state & FIO_SS_MEASURE))
+		return;
+
+	if (ss->measuring)
+		td->ts.precond_measure_msec = mtime_since_now(&ss->phase_start);
+	else
+		td->ts.precond_ss_msec = mtime_since_now(&ss->phase_start);
+}
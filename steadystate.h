@@ -9,6 +9,9 @@ extern void steadystate_setup(void);
 extern int td_steadystate_init(struct thread_data *);
 extern uint64_t steadystate_bw_mean(struct thread_stat *);
 extern uint64_t steadystate_iops_mean(struct thread_stat *);
+extern uint64_t steadystate_lat_mean(struct thread_stat *);
+extern void steadystate_measure_start(struct thread_data *);
+extern void steadystate_phase_end(struct thread_data *);
 
 extern bool steadystate_enabled;
 
@@ -23,6 +26,25 @@ struct steadystate_data {
 	unsigned int tail;
 	uint64_t *iops_data;
 	uint64_t *bw_data;
+	uint64_t *lat_data;
+
+	/*
+	 * For the latency criteria, each sample is the given percentile of
+	 * the completion latencies over the last lat_window seconds. lat_hist
+	 * holds a snapshot of the histogram for each of those seconds.
+	 */
+	double percentile;
+	unsigned int lat_window;
+	unsigned int lat_slot;
+	uint64_t *lat_hist;
+	bool per_job;
+
+	/*
+	 * With steadystate_measure, the job keeps running once steady state
+	 * is attained. phase_start is when the current phase began.
+	 */
+	bool measuring;
+	struct timespec phase_start;
 
 	double slope;
 	double deviation;
@@ -48,6 +70,8 @@ enum {
 	__FIO_SS_DATA,
 	__FIO_SS_PCT,
 	__FIO_SS_BUFFER_FULL,
+	__FIO_SS_LAT,
+	__FIO_SS_MEASURE,
 };
 
 enum {
@@ -59,9 +83,12 @@ enum {
 	FIO_SS_DATA		= 1 << __FIO_SS_DATA,
 	FIO_SS_PCT		= 1 << __FIO_SS_PCT,
 	FIO_SS_BUFFER_FULL	= 1 << __FIO_SS_BUFFER_FULL,
+	FIO_SS_LAT		= 1 << __FIO_SS_LAT,
+	FIO_SS_MEASURE		= 1 << __FIO_SS_MEASURE,
 
 	FIO_SS_IOPS_SLOPE	= FIO_SS_IOPS | FIO_SS_SLOPE,
 	FIO_SS_BW_SLOPE		= FIO_SS_BW | FIO_SS_SLOPE,
+	FIO_SS_LAT_SLOPE	= FIO_SS_LAT | FIO_SS_SLOPE,
 };
 
 #define STEADYSTATE_MSEC	1000
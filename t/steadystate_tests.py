@@ -44,8 +44,11 @@ def parse_args():
     return args
 
 
-def check(data, iops, slope, pct, limit, dur, criterion):
-    measurement = 'iops' if iops else 'bw'
+def check(data, iops, slope, pct, limit, dur, criterion, lat=False):
+    if lat:
+        measurement = 'lat_ns'
+    else:
+        measurement = 'iops' if iops else 'bw'
     data = data[measurement]
     mean = sum(data) / len(data)
     if slope:
@@ -91,6 +94,10 @@ if __name__ == '__main__':
                   'output': "set steady state threshold to 0.100000%" },
                 { 'args': ["--parse-only", "--debug=parse", "--ss_dur=10s", "--ss=bw:12", "--ss_ramp=5"],
                   'output': "set steady state BW threshold to 12" },
+                { 'args': ["--parse-only", "--debug=parse", "--ss_dur=10s", "--ss=lat_slope:5%", "--ss_ramp=5"],
+                  'output': "set steady state threshold to 5.000000%" },
+                { 'args': ["--parse-only", "--debug=parse", "--ss_dur=10s", "--ss=lat:2ms", "--ss_ramp=5"],
+                  'output': "set steady state latency threshold to 2000us" },
               ]
     for test in parsing:
         output = subprocess.check_output([args.fio] + test['args'])
@@ -114,6 +121,7 @@ if __name__ == '__main__':
               {'s': False, 'timeout': 20, 'numjobs': 2},
               {'s': True, 'timeout': 100, 'numjobs': 3, 'ss_dur': 10, 'ss_ramp': 5, 'iops': False, 'slope': True, 'ss_limit': 0.1, 'pct': True},
               {'s': True, 'timeout': 10, 'numjobs': 3, 'ss_dur': 10, 'ss_ramp': 500, 'iops': False, 'slope': True, 'ss_limit': 0.1, 'pct': True},
+              {'s': True, 'timeout': 100, 'numjobs': 2, 'ss_dur': 5, 'ss_ramp': 3, 'iops': False, 'lat': True, 'slope': False, 'ss_limit': 50, 'pct': True},
             ]
 
     if args.read == None:
@@ -144,7 +152,9 @@ if __name__ == '__main__':
                             "--time_based",
                             "--runtime={0}".format(job['timeout']) ])
         if job['s']:
-           if job['iops']:
+           if job.get('lat'):
+               ss = 'lat'
+           elif job['iops']:
                ss = 'iops'
            else:
                ss = 'bw'
@@ -179,7 +189,8 @@ if __name__ == '__main__':
                             pct=job['pct'],
                             limit=job['ss_limit'],
                             dur=job['ss_dur'],
-                            criterion=jsonjob['steadystate']['criterion'])
+                            criterion=jsonjob['steadystate']['criterion'],
+                            lat=job.get('lat', False))
                         if not objsame:
                             line = 'FAILED ' + line + ' fio criterion {0} != calculated criterion {1} '.format(jsonjob['steadystate']['criterion'], target)
                         else:
@@ -201,7 +212,8 @@ if __name__ == '__main__':
                             pct=job['pct'],
                             limit=job['ss_limit'],
                             dur=job['ss_dur'],
-                            criterion=jsonjob['steadystate']['criterion'])
+                            criterion=jsonjob['steadystate']['criterion'],
+                            lat=job.get('lat', False))
                         if not objsame:
                             if actual > (job['ss_dur'] + job['ss_ramp'])*1000:
                                 line = 'FAILED ' + line + ' fio criterion {0} != calculated criterion {1} '.format(jsonjob['steadystate']['criterion'], target)
@@ -1,10 +1,15 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
 #include <assert.h>
 
 #include "../smalloc.h"
 #include "../flist.h"
 #include "../arch/arch.h"
+#include "../gettime.h"
+#include "../fio_time.h"
 #include "debug.h"
 
 #define MAGIC1	0xa9b1c8d2
@@ -12,14 +17,29 @@
 
 #define LOOPS	32
 
+#define BENCH_SLOTS	4096
+#define BENCH_OPS	4000000UL
+
 struct elem {
 	unsigned int magic1;
 	struct flist_head list;
 	unsigned int magic2;
 };
 
+struct bench_thread {
+	pthread_t thread;
+	unsigned int seed;
+	unsigned int max_size;
+	unsigned long ops;
+	unsigned long fails;
+};
+
 static FLIST_HEAD(list);
 
+static unsigned int num_threads = 4;
+static unsigned int max_size = 1024;
+static unsigned long bench_ops = BENCH_OPS;
+
 static int do_rand_allocs(void)
 {
 	unsigned int size, nr, rounds = 0;
@@ -59,14 +79,122 @@ static int do_rand_allocs(void)
 	return 0;
 }
 
+/*
+ * Randomly allocate or free one of a set of slots, with random sizes. With
+ * many threads this measures the contention on the allocator, and the mix
+ * of sizes and lifetimes fragments the pools.
+ */
+static void *bench_fn(void *data)
+{
+	struct bench_thread *bt = data;
+	unsigned int *slots[BENCH_SLOTS];
+	unsigned long i;
+
+	memset(slots, 0, sizeof(slots));
+
+	for (i = 0; i < bench_ops; i++) {
+		unsigned int slot = rand_r(&bt->seed) % BENCH_SLOTS;
+
+		if (slots[slot]) {
+			assert(*slots[slot] == slot);
+			sfree(slots[slot]);
+			slots[slot] = NULL;
+		} else {
+			unsigned int size;
+
+			size = sizeof(unsigned int) + rand_r(&bt->seed) % bt->max_size;
+			slots[slot] = smalloc(size);
+			if (!slots[slot]) {
+				bt->fails++;
+				continue;
+			}
+			*slots[slot] = slot;
+		}
+		bt->ops++;
+	}
+
+	for (i = 0; i < BENCH_SLOTS; i++)
+		sfree(slots[i]);
+
+	return NULL;
+}
+
+static int do_bench(void)
+{
+	unsigned long ops = 0, fails = 0;
+	struct bench_thread *bts;
+	struct timespec start;
+	uint64_t usec;
+	unsigned int i;
+
+	bts = calloc(num_threads, sizeof(*bts));
+
+	fio_gettime(&start, NULL);
+	for (i = 0; i < num_threads; i++) {
+		bts[i].seed = MAGIC2 + i;
+		bts[i].max_size = max_size;
+		if (pthread_create(&bts[i].thread, NULL, bench_fn, &bts[i])) {
+			perror("pthread_create");
+			num_threads = i;
+			break;
+		}
+	}
+
+	for (i = 0; i < num_threads; i++) {
+		pthread_join(bts[i].thread, NULL);
+		ops += bts[i].ops;
+		fails += bts[i].fails;
+	}
+	usec = utime_since_now(&start);
+
+	printf("Threads: %u, max size %u: %lu ops in %llu usec, %.0f ops/sec, %lu failed\n",
+		num_threads, max_size, ops, (unsigned long long) usec,
+		usec ? ops * 1000000.0 / usec : 0.0, fails);
+
+	free(bts);
+	return fails != 0;
+}
+
+static int usage(char *argv[])
+{
+	fprintf(stderr, "%s: [options]\n", argv[0]);
+	fprintf(stderr, "\t-t\tNumber of benchmark threads (default %u)\n", num_threads);
+	fprintf(stderr, "\t-s\tMax benchmark allocation size (default %u)\n", max_size);
+	fprintf(stderr, "\t-n\tBenchmark operations per thread (default %lu)\n", bench_ops);
+	return 1;
+}
+
 int main(int argc, char *argv[])
 {
+	int c, ret;
+
+	while ((c = getopt(argc, argv, "t:s:n:")) != -1) {
+		switch (c) {
+		case 't':
+			num_threads = atoi(optarg);
+			break;
+		case 's':
+			max_size = atoi(optarg);
+			break;
+		case 'n':
+			bench_ops = strtoul(optarg, NULL, 10);
+			break;
+		case '?':
+		default:
+			return usage(argv);
+		}
+	}
+
+	if (!num_threads || !max_size)
+		return usage(argv);
+
 	arch_init(argv);
 	sinit();
 	debug_init();
 
 	do_rand_allocs();
+	ret = do_bench();
 
 	scleanup();
-	return 0;
+	return ret;
 }
@@ -18,6 +18,21 @@ enum fio_zone_mode {
 	ZONE_MODE_ZBD		= 3,
 };
 
+/*
+ * How the load that meets latency_target is searched for
+ */
+enum {
+	LAT_CTL_BISECT = 0,
+	LAT_CTL_DEPTH,
+	LAT_CTL_IOPS,
+};
+
+/*
+ * Windows in a row that must meet latency_target for their IOPS to count
+ * as sustained
+ */
+#define LAT_CTL_SUSTAIN		3
+
 /*
  * What type of allocation to use for io buffers
  */
@@ -29,6 +44,7 @@ enum fio_memtype {
 	MEM_MMAPHUGE,	/* memory mapped huge file */
 	MEM_MMAPSHARED, /* use mmap with shared flag */
 	MEM_CUDA_MALLOC,/* use GPU memory */
+	MEM_ARENA,	/* per NUMA node arena of huge page backed memory */
 };
 
 #define ERROR_STR_MAX	128
@@ -76,6 +92,7 @@ struct thread_options {
 	unsigned int iodepth_batch;
 	unsigned int iodepth_batch_complete_min;
 	unsigned int iodepth_batch_complete_max;
+	unsigned int iodepth_batch_prep;
 	unsigned int serialize_overlap;
 
 	unsigned int unique_filename;
@@ -133,6 +150,7 @@ struct thread_options {
 	unsigned int verify_state;
 	unsigned int verify_state_save;
 	unsigned int use_thread;
+	unsigned int job_runners;
 	unsigned int unlink;
 	unsigned int unlink_each_loop;
 	unsigned int do_disk_util;
@@ -187,6 +205,11 @@ struct thread_options {
 	fio_fp64_t ss_limit;
 	unsigned long long ss_dur;
 	unsigned long long ss_ramp_time;
+	fio_fp64_t ss_percentile;
+	unsigned long long ss_lat_window;
+	unsigned int ss_per_job;
+	unsigned long long ss_measure;
+	unsigned int precondition_fill;
 	unsigned int overwrite;
 	unsigned int bw_avg_time;
 	unsigned int iops_avg_time;
@@ -285,6 +308,9 @@ struct thread_options {
 	unsigned int rate_iops_min[DDIR_RWDIR_CNT];
 	unsigned int rate_process;
 	unsigned int rate_ign_think;
+	unsigned long long rate_time[2];
+	fio_fp64_t rate_shape;
+	char *rate_curve;
 
 	char *ioscheduler;
 
@@ -312,6 +338,9 @@ struct thread_options {
 	int flow;
 	int flow_watermark;
 	unsigned int flow_sleep;
+	unsigned long long flow_rate;
+	unsigned int flow_rate_iops;
+	unsigned int flow_weight;
 
 	unsigned long long offset_increment;
 	unsigned long long number_ios;
@@ -321,6 +350,8 @@ struct thread_options {
 	unsigned long long latency_target;
 	unsigned long long latency_window;
 	fio_fp64_t latency_percentile;
+	unsigned int latency_controller;
+	char *latency_log_file;
 
 	unsigned int sig_figs;
 
@@ -338,6 +369,7 @@ struct thread_options {
 
 	/* Parameters that affect zonemode=zbd */
 	unsigned int read_beyond_wp;
+	unsigned int zone_append;
 	int max_open_zones;
 	fio_fp64_t zrt;
 	fio_fp64_t zrf;
@@ -367,6 +399,7 @@ struct thread_options_pack {
 	uint32_t iodepth_batch;
 	uint32_t iodepth_batch_complete_min;
 	uint32_t iodepth_batch_complete_max;
+	uint32_t iodepth_batch_prep;
 	uint32_t serialize_overlap;
 	uint32_t lat_percentiles;
 
@@ -422,6 +455,7 @@ struct thread_options_pack {
 	uint32_t verify_state;
 	uint32_t verify_state_save;
 	uint32_t use_thread;
+	uint32_t job_runners;
 	uint32_t unlink;
 	uint32_t unlink_each_loop;
 	uint32_t do_disk_util;
@@ -477,6 +511,11 @@ struct thread_options_pack {
 	uint64_t ss_ramp_time;
 	uint32_t ss_state;
 	fio_fp64_t ss_limit;
+	fio_fp64_t ss_percentile;
+	uint64_t ss_lat_window;
+	uint32_t ss_per_job;
+	uint32_t precondition_fill;
+	uint64_t ss_measure;
 	uint32_t overwrite;
 	uint32_t bw_avg_time;
 	uint32_t iops_avg_time;
@@ -571,6 +610,9 @@ struct thread_options_pack {
 	uint32_t rate_process;
 	uint32_t rate_ign_think;
 	uint32_t pad3;
+	uint64_t rate_time[2];
+	fio_fp64_t rate_shape;
+	uint8_t rate_curve[FIO_TOP_STR_MAX];
 
 	uint8_t ioscheduler[FIO_TOP_STR_MAX];
 
@@ -598,6 +640,9 @@ struct thread_options_pack {
 	int32_t flow;
 	int32_t flow_watermark;
 	uint32_t flow_sleep;
+	uint32_t flow_rate_iops;
+	uint32_t flow_weight;
+	uint64_t flow_rate;
 
 	uint64_t offset_increment;
 	uint64_t number_ios;
@@ -606,6 +651,9 @@ struct thread_options_pack {
 	uint64_t latency_window;
 	uint64_t max_latency;
 	fio_fp64_t latency_percentile;
+	uint32_t latency_controller;
+	uint32_t pad5;
+	uint8_t latency_log_file[FIO_TOP_STR_MAX];
 
 	uint32_t sig_figs;
 
@@ -2,6 +2,7 @@
 #include <sys/time.h>
 
 #include "fio.h"
+#include "runner.h"
 
 static struct timespec genesis;
 static unsigned long ns_granularity;
@@ -44,6 +45,15 @@ uint64_t usec_sleep(struct thread_data *td, unsigned long usec)
 	struct timespec tv;
 	uint64_t t = 0;
 
+	/*
+	 * Let the other jobs on the runner have the thread in the meantime
+	 */
+	if (in_runner()) {
+		fio_gettime(&tv, NULL);
+		runner_sleep(usec);
+		return utime_since_now(&tv);
+	}
+
 	do {
 		unsigned long ts = usec;
 
@@ -365,7 +365,8 @@ int workqueue_init(struct thread_data *td, struct workqueue *wq,
 
 err:
 	log_err("Can't create rate workqueue\n");
-	td_verror(td, ESRCH, "workqueue_init");
+	if (td)
+		td_verror(td, ESRCH, "workqueue_init");
 	workqueue_exit(wq);
 	return 1;
 }
@@ -17,6 +17,7 @@
 #include "fio.h"
 #include "lib/pow2.h"
 #include "log.h"
+#include "pshared.h"
 #include "smalloc.h"
 #include "verify.h"
 #include "zbd.h"
@@ -61,6 +62,103 @@ static bool is_valid_offset(const struct fio_file *f, uint64_t offset)
 	return (uint64_t)(offset - f->file_offset) < f->io_size;
 }
 
+#define ZONE_MAP_BITS	64
+
+/*
+ * Lock zone @z. If another job holds the zone lock, first complete the I/O
+ * this job has in flight. This job may be holding zone locks for that I/O,
+ * or the other job may be waiting for writes of this job to complete.
+ */
+static void zbd_lock_zone(struct thread_data *td, struct fio_zone_info *z)
+{
+	if (pthread_mutex_trylock(&z->mutex) != 0) {
+		if (!td_ioengine_flagged(td, FIO_SYNCIO))
+			io_u_quiesce(td);
+		pthread_mutex_lock(&z->mutex);
+	}
+}
+
+/*
+ * Wait until no writes to zone @z are in flight. With zone_append=1 the
+ * writes of other jobs may still be in flight after the zone lock has been
+ * obtained. The caller must hold z->mutex, so no new writes can start.
+ */
+static void zbd_wait_zone_idle(struct thread_data *td, const struct fio_file *f,
+			       struct fio_zone_info *z)
+{
+	struct zoned_block_device_info *zbd_info = f->zbd_info;
+
+	io_u_quiesce(td);
+
+	pthread_mutex_lock(&zbd_info->idle_mutex);
+	while (z->writes_in_flight)
+		pthread_cond_wait(&zbd_info->idle_cond, &zbd_info->idle_mutex);
+	pthread_mutex_unlock(&zbd_info->idle_mutex);
+}
+
+/* The caller must hold zbdi->mutex, or be the only user of zbdi. */
+static void zbd_set_open_bit(struct zoned_block_device_info *zbdi,
+			     uint32_t zone_idx, bool set)
+{
+	uint64_t mask = 1ULL << (zone_idx % ZONE_MAP_BITS);
+
+	if (set)
+		zbdi->open_map[zone_idx / ZONE_MAP_BITS] |= mask;
+	else
+		zbdi->open_map[zone_idx / ZONE_MAP_BITS] &= ~mask;
+}
+
+/*
+ * Return the index of the first zone in [@zone_idx, @end_idx) that is
+ * neither open nor offline, or @end_idx if there is no such zone. Since this
+ * function does not lock anything the caller must check the state of the
+ * zone again after having locked it.
+ */
+static uint32_t zbd_next_closed_zone(const struct zoned_block_device_info *zbdi,
+				     uint32_t zone_idx, uint32_t end_idx)
+{
+	while (zone_idx < end_idx) {
+		uint32_t w = zone_idx / ZONE_MAP_BITS;
+		uint64_t word;
+
+		word = zbdi->open_map[w] |
+			((1ULL << (zone_idx % ZONE_MAP_BITS)) - 1);
+		if (word != -1ULL) {
+			zone_idx = w * ZONE_MAP_BITS + ffz64(word);
+			break;
+		}
+		zone_idx = (w + 1) * ZONE_MAP_BITS;
+	}
+
+	return min(zone_idx, end_idx);
+}
+
+/*
+ * Allocate zone information for @nr_zones zones and the sentinel, with the
+ * open zone bitmap behind it.
+ */
+static struct zoned_block_device_info *zbd_alloc_info(uint32_t nr_zones)
+{
+	struct zoned_block_device_info *zbd_info;
+	size_t size;
+
+	size = sizeof(*zbd_info) +
+		(nr_zones + 1) * sizeof(zbd_info->zone_info[0]);
+	zbd_info = scalloc(1, size + (nr_zones + ZONE_MAP_BITS - 1) /
+			   ZONE_MAP_BITS * sizeof(uint64_t));
+	if (!zbd_info)
+		return NULL;
+
+	if (mutex_cond_init_pshared(&zbd_info->idle_mutex,
+				    &zbd_info->idle_cond)) {
+		sfree(zbd_info);
+		return NULL;
+	}
+
+	zbd_info->open_map = (void *)zbd_info + size;
+	return zbd_info;
+}
+
 /* Verify whether direct I/O is used for all host-managed zoned drives. */
 static bool zbd_using_direct_io(void)
 {
@@ -312,8 +410,7 @@ static int init_zone_info(struct thread_data *td, struct fio_file *f)
 	zone_size = td->o.zone_size;
 	assert(zone_size);
 	nr_zones = (f->real_file_size + zone_size - 1) / zone_size;
-	zbd_info = scalloc(1, sizeof(*zbd_info) +
-			   (nr_zones + 1) * sizeof(zbd_info->zone_info[0]));
+	zbd_info = zbd_alloc_info(nr_zones);
 	if (!zbd_info)
 		return -ENOMEM;
 
@@ -403,8 +500,7 @@ static int parse_zone_info(struct thread_data *td, struct fio_file *f)
 	dprint(FD_ZBD, "Device %s has %d zones of size %llu KB\n", f->file_name,
 	       nr_zones, (unsigned long long) zone_size / 1024);
 
-	zbd_info = scalloc(1, sizeof(*zbd_info) +
-			   (nr_zones + 1) * sizeof(zbd_info->zone_info[0]));
+	zbd_info = zbd_alloc_info(nr_zones);
 	ret = -ENOMEM;
 	if (!zbd_info)
 		goto close;
@@ -431,6 +527,8 @@ static int parse_zone_info(struct thread_data *td, struct fio_file *f)
 			}
 			p->type = z->type;
 			p->cond = z->cond;
+			if (p->cond == BLK_ZONE_COND_OFFLINE)
+				zbd_set_open_bit(zbd_info, j, true);
 			if (j > 0 && p->start != p[-1].start + zone_size) {
 				log_info("%s: invalid zone data\n",
 					 f->file_name);
@@ -536,11 +634,12 @@ static int zbd_init_zone_info(struct thread_data *td, struct fio_file *file)
 			    strcmp(f2->file_name, file->file_name) != 0)
 				continue;
 			file->zbd_info = f2->zbd_info;
-			file->zbd_info->refcount++;
+			file->zbd_slot = file->zbd_info->refcount++;
 			return 0;
 		}
 	}
 
+	file->zbd_slot = 0;
 	ret = zbd_create_zone_info(td, file);
 	if (ret < 0)
 		td_verror(td, -ret, "BLKREPORTZONE failed");
@@ -601,6 +700,7 @@ static int zbd_reset_range(struct thread_data *td, const struct fio_file *f,
 	};
 	uint32_t zone_idx_b, zone_idx_e;
 	struct fio_zone_info *zb, *ze, *z;
+	struct timespec start;
 	int ret = 0;
 
 	assert(f->fd != -1);
@@ -608,6 +708,7 @@ static int zbd_reset_range(struct thread_data *td, const struct fio_file *f,
 	switch (f->zbd_info->model) {
 	case ZBD_DM_HOST_AWARE:
 	case ZBD_DM_HOST_MANAGED:
+		fio_gettime(&start, NULL);
 		ret = ioctl(f->fd, BLKRESETZONE, &zr);
 		if (ret < 0) {
 			td_verror(td, errno, "resetting wp failed");
@@ -615,6 +716,8 @@ static int zbd_reset_range(struct thread_data *td, const struct fio_file *f,
 				f->file_name, zr.nr_sectors, zr.sector, errno);
 			return ret;
 		}
+		add_zone_op_lat_sample(&td->ts, FIO_ZONE_OP_RESET,
+					ntime_since_now(&start));
 		break;
 	case ZBD_DM_NONE:
 		break;
@@ -626,9 +729,8 @@ static int zbd_reset_range(struct thread_data *td, const struct fio_file *f,
 	ze = &f->zbd_info->zone_info[zone_idx_e];
 	for (z = zb; z < ze; z++) {
 		pthread_mutex_lock(&z->mutex);
-		pthread_mutex_lock(&f->zbd_info->mutex);
-		f->zbd_info->sectors_with_data -= z->wp - z->start;
-		pthread_mutex_unlock(&f->zbd_info->mutex);
+		__sync_fetch_and_sub(&f->zbd_info->sectors_with_data,
+				     z->wp - z->start);
 		z->wp = z->start;
 		z->verify_block = 0;
 		pthread_mutex_unlock(&z->mutex);
@@ -662,6 +764,51 @@ static int zbd_reset_zone(struct thread_data *td, const struct fio_file *f,
 	return zbd_reset_range(td, f, z->start, (z+1)->start - z->start);
 }
 
+/**
+ * zbd_finish_zone - transition a zone to the full condition
+ * @td: FIO thread data.
+ * @f: FIO file associated with the disk the zone belongs to.
+ * @z: Zone to finish. The caller must hold z->mutex.
+ *
+ * Called for zones that fio stops writing to before they are full, such
+ * that they do not count against the open zone limit of the drive. Failure
+ * is not an error since the drive will close the zone itself if needed.
+ */
+static void zbd_finish_zone(struct thread_data *td, const struct fio_file *f,
+			    struct fio_zone_info *z)
+{
+#ifdef BLKFINISHZONE
+	struct blk_zone_range zr = {
+		.sector         = z->start >> 9,
+		.nr_sectors     = ((z+1)->start - z->start) >> 9,
+	};
+	struct timespec start;
+
+	if (f->zbd_info->model == ZBD_DM_NONE ||
+	    z->type != BLK_ZONE_TYPE_SEQWRITE_REQ || z->wp >= (z+1)->start)
+		return;
+
+	zbd_wait_zone_idle(td, f, z);
+
+	dprint(FD_ZBD, "%s: finishing zone %u.\n", f->file_name,
+		zbd_zone_nr(f->zbd_info, z));
+
+	fio_gettime(&start, NULL);
+	if (ioctl(f->fd, BLKFINISHZONE, &zr) < 0) {
+		dprint(FD_ZBD, "%s: finishing zone %u failed (%d).\n",
+			f->file_name, zbd_zone_nr(f->zbd_info, z), errno);
+		return;
+	}
+	add_zone_op_lat_sample(&td->ts, FIO_ZONE_OP_FINISH,
+				ntime_since_now(&start));
+	td->ts.nr_zone_finishes++;
+
+	__sync_fetch_and_add(&f->zbd_info->sectors_with_data,
+			     (z+1)->start - z->wp);
+	z->wp = (z+1)->start;
+#endif
+}
+
 /*
  * Reset a range of zones. Returns 0 upon success and 1 upon failure.
  * @td: fio thread data.
@@ -843,28 +990,13 @@ void zbd_file_reset(struct thread_data *td, struct fio_file *f)
 	zbd_reset_write_cnt(td, f);
 }
 
-/* The caller must hold f->zbd_info->mutex. */
-static bool is_zone_open(const struct thread_data *td, const struct fio_file *f,
-			 unsigned int zone_idx)
-{
-	struct zoned_block_device_info *zbdi = f->zbd_info;
-	int i;
-
-	assert(td->o.max_open_zones <= ARRAY_SIZE(zbdi->open_zones));
-	assert(zbdi->num_open_zones <= td->o.max_open_zones);
-
-	for (i = 0; i < zbdi->num_open_zones; i++)
-		if (zbdi->open_zones[i] == zone_idx)
-			return true;
-
-	return false;
-}
-
 /*
  * Open a ZBD zone if it was not yet open. Returns true if either the zone was
  * already open or if opening a new zone is allowed. Returns false if the zone
  * was not yet open and opening a new zone would cause the zone limit to be
- * exceeded.
+ * exceeded. The caller must hold the mutex of the zone, which also protects
+ * z->open, so that checking whether the zone is already open does not need
+ * f->zbd_info->mutex.
  */
 static bool zbd_open_zone(struct thread_data *td, const struct io_u *io_u,
 			  uint32_t zone_idx)
@@ -888,14 +1020,17 @@ static bool zbd_open_zone(struct thread_data *td, const struct io_u *io_u,
 	if (!td->o.max_open_zones)
 		return true;
 
+	if (z->open)
+		return true;
+
 	pthread_mutex_lock(&f->zbd_info->mutex);
-	if (is_zone_open(td, f, zone_idx))
-		goto out;
+	assert(td->o.max_open_zones <= ARRAY_SIZE(f->zbd_info->open_zones));
 	res = false;
 	if (f->zbd_info->num_open_zones >= td->o.max_open_zones)
 		goto out;
 	dprint(FD_ZBD, "%s: opening zone %d\n", f->file_name, zone_idx);
 	f->zbd_info->open_zones[f->zbd_info->num_open_zones++] = zone_idx;
+	zbd_set_open_bit(f->zbd_info, zone_idx, true);
 	z->open = 1;
 	res = true;
 
@@ -904,10 +1039,11 @@ out:
 	return res;
 }
 
-/* The caller must hold f->zbd_info->mutex */
+/* The caller must hold f->zbd_info->mutex and the mutex of the zone. */
 static void zbd_close_zone(struct thread_data *td, const struct fio_file *f,
 			   unsigned int open_zone_idx)
 {
+	struct fio_zone_info *z;
 	uint32_t zone_idx;
 
 	assert(open_zone_idx < f->zbd_info->num_open_zones);
@@ -917,7 +1053,28 @@ static void zbd_close_zone(struct thread_data *td, const struct fio_file *f,
 		(FIO_MAX_OPEN_ZBD_ZONES - (open_zone_idx + 1)) *
 		sizeof(f->zbd_info->open_zones[0]));
 	f->zbd_info->num_open_zones--;
-	f->zbd_info->zone_info[zone_idx].open = 0;
+	z = &f->zbd_info->zone_info[zone_idx];
+	z->open = 0;
+	if (z->cond != BLK_ZONE_COND_OFFLINE)
+		zbd_set_open_bit(f->zbd_info, zone_idx, false);
+}
+
+/*
+ * Index in f->zbd_info->open_zones[] of the zone a write should go to by
+ * preference. Each job that shares the zone information gets its own part of
+ * the open zones and the write offsets are spread over that part, such that
+ * jobs mostly write to different zones and rarely wait for each other's zone
+ * locks. @num_open must be greater than zero.
+ */
+static uint32_t zbd_open_zone_hint(const struct fio_file *f,
+				   const struct io_u *io_u, uint32_t num_open)
+{
+	uint32_t nr_jobs = max(f->zbd_info->refcount, 1U);
+	uint32_t per_job = max(num_open / nr_jobs, 1U);
+	uint32_t first = (f->zbd_slot % nr_jobs) * num_open / nr_jobs;
+
+	return (first + (io_u->offset - f->file_offset) * per_job /
+		f->io_size) % num_open;
 }
 
 /*
@@ -934,19 +1091,46 @@ struct fio_zone_info *zbd_convert_to_open_zone(struct thread_data *td,
 	const struct fio_file *f = io_u->file;
 	struct fio_zone_info *z;
 	unsigned int open_zone_idx = -1;
-	uint32_t zone_idx, new_zone_idx;
+	uint32_t zone_idx, new_zone_idx, first_idx, end_idx;
 	int i;
 
 	assert(is_valid_offset(f, io_u->offset));
 
 	if (td->o.max_open_zones) {
+		uint32_t hint;
+
+		/*
+		 * Try the open zones, starting with the one this job prefers,
+		 * without waiting for the zone locks. Since trylock does not
+		 * block it is safe to call it with f->zbd_info->mutex held.
+		 */
+		pthread_mutex_lock(&f->zbd_info->mutex);
+		if (f->zbd_info->num_open_zones == 0) {
+			pthread_mutex_unlock(&f->zbd_info->mutex);
+			dprint(FD_ZBD, "%s(%s): no zones are open\n",
+			       __func__, f->file_name);
+			return NULL;
+		}
+		hint = zbd_open_zone_hint(f, io_u,
+					  f->zbd_info->num_open_zones);
+		for (i = 0; i < f->zbd_info->num_open_zones; i++) {
+			open_zone_idx = (hint + i) %
+				f->zbd_info->num_open_zones;
+			zone_idx = f->zbd_info->open_zones[open_zone_idx];
+			z = &f->zbd_info->zone_info[zone_idx];
+			if (pthread_mutex_trylock(&z->mutex) == 0) {
+				dprint(FD_ZBD, "%s(%s): trying open zone %d (offset %lld, buflen %lld)\n",
+				       __func__, f->file_name, zone_idx,
+				       io_u->offset, io_u->buflen);
+				goto examine_zone;
+			}
+		}
 		/*
-		 * This statement accesses f->zbd_info->open_zones[] on purpose
-		 * without locking.
+		 * All open zones are busy. Wait for the lock of the preferred
+		 * zone.
 		 */
-		zone_idx = f->zbd_info->open_zones[(io_u->offset -
-						    f->file_offset) *
-				f->zbd_info->num_open_zones / f->io_size];
+		zone_idx = f->zbd_info->open_zones[hint];
+		pthread_mutex_unlock(&f->zbd_info->mutex);
 	} else {
 		zone_idx = zbd_zone_idx(f, io_u->offset);
 	}
@@ -962,7 +1146,7 @@ struct fio_zone_info *zbd_convert_to_open_zone(struct thread_data *td,
 	for (;;) {
 		z = &f->zbd_info->zone_info[zone_idx];
 
-		pthread_mutex_lock(&z->mutex);
+		zbd_lock_zone(td, z);
 		pthread_mutex_lock(&f->zbd_info->mutex);
 		if (td->o.max_open_zones == 0)
 			goto examine_zone;
@@ -973,8 +1157,8 @@ struct fio_zone_info *zbd_convert_to_open_zone(struct thread_data *td,
 			       __func__, f->file_name);
 			return NULL;
 		}
-		open_zone_idx = (io_u->offset - f->file_offset) *
-			f->zbd_info->num_open_zones / f->io_size;
+		open_zone_idx = zbd_open_zone_hint(f, io_u,
+						   f->zbd_info->num_open_zones);
 		assert(open_zone_idx < f->zbd_info->num_open_zones);
 		new_zone_idx = f->zbd_info->open_zones[open_zone_idx];
 		if (new_zone_idx == zone_idx)
@@ -999,22 +1183,47 @@ examine_zone:
 
 	/* Only z->mutex is held. */
 
-	/* Zone 'z' is full, so try to open a new zone. */
-	for (i = f->io_size / f->zbd_info->zone_size; i > 0; i--) {
-		zone_idx++;
-		pthread_mutex_unlock(&z->mutex);
-		z++;
-		if (!is_valid_offset(f, z->start)) {
+	if (td->o.max_open_zones)
+		zbd_finish_zone(td, f, z);
+
+	/*
+	 * Zone 'z' is full, so try to open a new zone. Look for zones that are
+	 * neither open nor offline in the open zone bitmap, starting after
+	 * 'z' and wrapping around at the end of the file, such that only
+	 * candidate zones have to be locked.
+	 */
+	first_idx = zbd_zone_idx(f, f->file_offset);
+	end_idx = zbd_zone_idx(f, f->file_offset + f->io_size);
+	new_zone_idx = zone_idx + 1;
+	for (i = end_idx - first_idx; i > 0; i--) {
+		new_zone_idx = zbd_next_closed_zone(f->zbd_info, new_zone_idx,
+						    end_idx);
+		if (new_zone_idx >= end_idx) {
 			/* Wrap-around. */
-			zone_idx = zbd_zone_idx(f, f->file_offset);
-			z = &f->zbd_info->zone_info[zone_idx];
+			new_zone_idx = zbd_next_closed_zone(f->zbd_info,
+							    first_idx, end_idx);
+			if (new_zone_idx >= end_idx)
+				break;
 		}
+		if (new_zone_idx == zone_idx)
+			break;
+		zone_idx = new_zone_idx;
+		pthread_mutex_unlock(&z->mutex);
+		z = &f->zbd_info->zone_info[zone_idx];
 		assert(is_valid_offset(f, z->start));
-		pthread_mutex_lock(&z->mutex);
+		zbd_lock_zone(td, z);
+		new_zone_idx = zone_idx + 1;
 		if (z->open)
 			continue;
 		if (zbd_open_zone(td, io_u, zone_idx))
 			goto out;
+		/*
+		 * Stop looking if the open zone limit has been reached, since
+		 * none of the other zones can be opened either.
+		 */
+		if (td->o.max_open_zones &&
+		    f->zbd_info->num_open_zones >= td->o.max_open_zones)
+			break;
 	}
 
 	/* Only z->mutex is held. */
@@ -1028,7 +1237,7 @@ examine_zone:
 
 		z = &f->zbd_info->zone_info[zone_idx];
 
-		pthread_mutex_lock(&z->mutex);
+		zbd_lock_zone(td, z);
 		if (z->wp + min_bs <= (z+1)->start)
 			goto out;
 		pthread_mutex_lock(&f->zbd_info->mutex);
@@ -1091,7 +1300,7 @@ zbd_find_zone(struct thread_data *td, struct io_u *io_u,
 	 */
 	for (z1 = zb + 1, z2 = zb - 1; z1 < zl || z2 >= zf; z1++, z2--) {
 		if (z1 < zl && z1->cond != BLK_ZONE_COND_OFFLINE) {
-			pthread_mutex_lock(&z1->mutex);
+			zbd_lock_zone(td, z1);
 			if (z1->start + min_bs <= z1->wp)
 				return z1;
 			pthread_mutex_unlock(&z1->mutex);
@@ -1100,7 +1309,7 @@ zbd_find_zone(struct thread_data *td, struct io_u *io_u,
 		}
 		if (td_random(td) && z2 >= zf &&
 		    z2->cond != BLK_ZONE_COND_OFFLINE) {
-			pthread_mutex_lock(&z2->mutex);
+			zbd_lock_zone(td, z2);
 			if (z2->start + min_bs <= z2->wp)
 				return z2;
 			pthread_mutex_unlock(&z2->mutex);
@@ -1111,16 +1320,23 @@ zbd_find_zone(struct thread_data *td, struct io_u *io_u,
 	return NULL;
 }
 
+static void zbd_commit_append_io(const struct io_u *io_u);
+static void zbd_put_append_io(const struct io_u *io_u);
+
 /**
- * zbd_queue_io - update the write pointer of a sequential zone
+ * __zbd_queue_io - update the write pointer of a sequential zone
  * @io_u: I/O unit
  * @success: Whether or not the I/O unit has been queued successfully
  * @q: queueing status (busy, completed or queued).
+ * @append: whether writes are emulated zone appends (zone_append=1)
  *
  * For write and trim operations, update the write pointer of the I/O unit
- * target zone.
+ * target zone. With @append the zone is unlocked as soon as a write has been
+ * submitted, see zbd_io_committed(), instead of after it has completed. Other
+ * writes to the zone can then be queued behind it, at the write pointer that
+ * has already been advanced, without overtaking it.
  */
-static void zbd_queue_io(struct io_u *io_u, int q, bool success)
+static void __zbd_queue_io(struct io_u *io_u, int q, bool success, bool append)
 {
 	const struct fio_file *f = io_u->file;
 	struct zoned_block_device_info *zbd_info = f->zbd_info;
@@ -1149,14 +1365,13 @@ static void zbd_queue_io(struct io_u *io_u, int q, bool success)
 	case DDIR_WRITE:
 		zone_end = min((uint64_t)(io_u->offset + io_u->buflen),
 			       (z + 1)->start);
-		pthread_mutex_lock(&zbd_info->mutex);
 		/*
 		 * z->wp > zone_end means that one or more I/O errors
 		 * have occurred.
 		 */
 		if (z->wp <= zone_end)
-			zbd_info->sectors_with_data += zone_end - z->wp;
-		pthread_mutex_unlock(&zbd_info->mutex);
+			__sync_fetch_and_add(&zbd_info->sectors_with_data,
+					     zone_end - z->wp);
 		z->wp = zone_end;
 		break;
 	case DDIR_TRIM:
@@ -1171,9 +1386,23 @@ unlock:
 		/* BUSY or COMPLETED: unlock the zone */
 		pthread_mutex_unlock(&z->mutex);
 		io_u->zbd_put_io = NULL;
+	} else if (append && io_u->ddir == DDIR_WRITE) {
+		__sync_fetch_and_add(&z->writes_in_flight, 1);
+		io_u->zbd_commit_io = zbd_commit_append_io;
+		io_u->zbd_put_io = zbd_put_append_io;
 	}
 }
 
+static void zbd_queue_io(struct io_u *io_u, int q, bool success)
+{
+	__zbd_queue_io(io_u, q, success, false);
+}
+
+static void zbd_queue_append_io(struct io_u *io_u, int q, bool success)
+{
+	__zbd_queue_io(io_u, q, success, true);
+}
+
 /**
  * zbd_put_io - Unlock an I/O unit target zone lock
  * @io_u: I/O unit
@@ -1203,6 +1432,55 @@ static void zbd_put_io(const struct io_u *io_u)
 	zbd_check_swd(f);
 }
 
+/**
+ * zbd_commit_append_io - Unlock the target zone of a submitted zone_append=1
+ *	write
+ * @io_u: I/O unit
+ */
+static void zbd_commit_append_io(const struct io_u *io_u)
+{
+	const struct fio_file *f = io_u->file;
+	struct fio_zone_info *z;
+
+	z = &f->zbd_info->zone_info[zbd_zone_idx(f, io_u->offset)];
+	pthread_mutex_unlock(&z->mutex);
+}
+
+/**
+ * zbd_io_committed - Unlock the target zones of submitted zone_append=1 writes
+ * @td: FIO thread data
+ *
+ * Called after the queued I/O of @td has been submitted by td_io_commit().
+ */
+void zbd_io_committed(struct thread_data *td)
+{
+	struct io_u *io_u;
+	int i;
+
+	io_u_qiter(&td->io_u_all, io_u, i)
+		zbd_commit_io_u(io_u);
+}
+
+/**
+ * zbd_put_append_io - Account for the completion of a zone_append=1 write
+ * @io_u: I/O unit
+ */
+static void zbd_put_append_io(const struct io_u *io_u)
+{
+	const struct fio_file *f = io_u->file;
+	struct zoned_block_device_info *zbd_info = f->zbd_info;
+	struct fio_zone_info *z;
+
+	z = &zbd_info->zone_info[zbd_zone_idx(f, io_u->offset)];
+	assert(z->writes_in_flight);
+	if (__sync_sub_and_fetch(&z->writes_in_flight, 1))
+		return;
+
+	pthread_mutex_lock(&zbd_info->idle_mutex);
+	pthread_cond_broadcast(&zbd_info->idle_cond);
+	pthread_mutex_unlock(&zbd_info->idle_mutex);
+}
+
 bool zbd_unaligned_write(int error_code)
 {
 	switch (error_code) {
@@ -1264,11 +1542,7 @@ enum io_u_action zbd_adjust_block(struct thread_data *td, struct io_u *io_u)
 	 * process the currently queued I/Os so that I/O progress is made and
 	 * zones unlocked.
 	 */
-	if (pthread_mutex_trylock(&zb->mutex) != 0) {
-		if (!td_ioengine_flagged(td, FIO_SYNCIO))
-			io_u_quiesce(td);
-		pthread_mutex_lock(&zb->mutex);
-	}
+	zbd_lock_zone(td, zb);
 
 	switch (io_u->ddir) {
 	case DDIR_READ:
@@ -1358,7 +1632,7 @@ enum io_u_action zbd_adjust_block(struct thread_data *td, struct io_u *io_u)
 			 * write requests have completed before issuing a
 			 * zone reset.
 			 */
-			io_u_quiesce(td);
+			zbd_wait_zone_idle(td, f, zb);
 			zb->reset_zone = 0;
 			if (zbd_reset_zone(td, f, zb) < 0)
 				goto eof;
@@ -1409,7 +1683,8 @@ accept:
 	assert(zb->cond != BLK_ZONE_COND_OFFLINE);
 	assert(!io_u->zbd_queue_io);
 	assert(!io_u->zbd_put_io);
-	io_u->zbd_queue_io = zbd_queue_io;
+	io_u->zbd_queue_io = td->o.zone_append ? zbd_queue_append_io :
+		zbd_queue_io;
 	io_u->zbd_put_io = zbd_put_io;
 	return io_u_accept;
 
@@ -1424,7 +1699,12 @@ char *zbd_write_status(const struct thread_stat *ts)
 {
 	char *res;
 
-	if (asprintf(&res, "; %llu zone resets", (unsigned long long) ts->nr_zone_resets) < 0)
+	if (ts->nr_zone_finishes) {
+		if (asprintf(&res, "; %llu zone finishes, %llu zone resets",
+			     (unsigned long long) ts->nr_zone_finishes,
+			     (unsigned long long) ts->nr_zone_resets) < 0)
+			return NULL;
+	} else if (asprintf(&res, "; %llu zone resets", (unsigned long long) ts->nr_zone_resets) < 0)
 		return NULL;
 	return res;
 }
@@ -34,6 +34,8 @@ enum io_u_action {
  * @start: zone start location (bytes)
  * @wp: zone write pointer location (bytes)
  * @verify_block: number of blocks that have been verified for this zone
+ * @writes_in_flight: number of writes submitted with zone_append=1 that have
+ *		not yet completed. Modified with atomic instructions.
  * @mutex: protects the modifiable members in this structure
  * @type: zone type (BLK_ZONE_TYPE_*)
  * @cond: zone state (BLK_ZONE_COND_*)
@@ -47,6 +49,7 @@ struct fio_zone_info {
 	uint64_t		start;
 	uint64_t		wp;
 	uint32_t		verify_block;
+	uint32_t		writes_in_flight;
 	enum blk_zone_type	type:2;
 	enum blk_zone_cond	cond:4;
 	unsigned int		open:1;
@@ -57,10 +60,12 @@ struct fio_zone_info {
 /**
  * zoned_block_device_info - zoned block device characteristics
  * @model: Device model.
- * @mutex: Protects the modifiable members in this structure (refcount and
- *		num_open_zones).
+ * @mutex: Protects the modifiable members in this structure (refcount,
+ *		num_open_zones, open_zones, open_map and write_cnt).
  * @zone_size: size of a single zone in units of 512 bytes
- * @sectors_with_data: total size of data in all zones in units of 512 bytes
+ * @sectors_with_data: total size of data in all zones in units of 512 bytes.
+ *		Updated with atomic instructions so that writes need not take
+ *		@mutex.
  * @zone_size_log2: log2 of the zone size in bytes if it is a power of 2 or 0
  *		if the zone size is not a power of 2.
  * @nr_zones: number of zones
@@ -69,6 +74,12 @@ struct fio_zone_info {
  * @write_cnt: Number of writes since the latest zone reset triggered by
  *	       the zone_reset_frequency fio job parameter.
  * @open_zones: zone numbers of open zones
+ * @open_map: bitmap with a bit set for each zone that is open or offline.
+ *		Allows to find the next zone that can be opened without
+ *		locking the zones in between.
+ * @idle_mutex: protects waiting on @idle_cond
+ * @idle_cond: signalled when the last zone_append=1 write in flight to a zone
+ *		has completed
  * @zone_info: description of the individual zones
  *
  * Only devices for which all zones have the same size are supported.
@@ -86,6 +97,9 @@ struct zoned_block_device_info {
 	uint32_t		num_open_zones;
 	uint32_t		write_cnt;
 	uint32_t		open_zones[FIO_MAX_OPEN_ZBD_ZONES];
+	uint64_t		*open_map;
+	pthread_mutex_t		idle_mutex;
+	pthread_cond_t		idle_cond;
 	struct fio_zone_info	zone_info[0];
 };
 
@@ -96,6 +110,7 @@ void zbd_file_reset(struct thread_data *td, struct fio_file *f);
 bool zbd_unaligned_write(int error_code);
 enum io_u_action zbd_adjust_block(struct thread_data *td, struct io_u *io_u);
 char *zbd_write_status(const struct thread_stat *ts);
+void zbd_io_committed(struct thread_data *td);
 
 static inline void zbd_queue_io_u(struct io_u *io_u, enum fio_q_status status)
 {
@@ -105,8 +120,17 @@ static inline void zbd_queue_io_u(struct io_u *io_u, enum fio_q_status status)
 	}
 }
 
+static inline void zbd_commit_io_u(struct io_u *io_u)
+{
+	if (io_u->zbd_commit_io) {
+		io_u->zbd_commit_io(io_u);
+		io_u->zbd_commit_io = NULL;
+	}
+}
+
 static inline void zbd_put_io_u(struct io_u *io_u)
 {
+	zbd_commit_io_u(io_u);
 	if (io_u->zbd_put_io) {
 		io_u->zbd_put_io(io_u);
 		io_u->zbd_queue_io = NULL;
@@ -114,6 +138,19 @@ static inline void zbd_put_io_u(struct io_u *io_u)
 	}
 }
 
+/*
+ * Called once ->queue() has submitted @io_u, for engines without ->commit().
+ * A zone_append=1 write only holds its zone until then, its completion is
+ * still to come.
+ */
+static inline void zbd_submitted_io_u(struct io_u *io_u)
+{
+	if (io_u->zbd_commit_io)
+		zbd_commit_io_u(io_u);
+	else
+		zbd_put_io_u(io_u);
+}
+
 #else
 static inline void zbd_free_zone_info(struct fio_file *f)
 {
@@ -144,9 +181,15 @@ static inline char *zbd_write_status(const struct thread_stat *ts)
 	return NULL;
 }
 
+static inline void zbd_io_committed(struct thread_data *td)
+{
+}
+
 static inline void zbd_queue_io_u(struct io_u *io_u,
 				  enum fio_q_status status) {}
+static inline void zbd_commit_io_u(struct io_u *io_u) {}
 static inline void zbd_put_io_u(struct io_u *io_u) {}
+static inline void zbd_submitted_io_u(struct io_u *io_u) {}
 #endif
 
 #endif /* FIO_ZBD_H */